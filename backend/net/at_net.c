@@ -2,15 +2,26 @@
 #include "../../core/src/at_internal.h"
 #include "../../core/src/at_voxel.h"
 #include "acoustic/at.h"
+#include "acoustic/at_metrics.h"
+#include "acoustic/at_model.h"
+#include "acoustic/at_replay.h"
+#include "acoustic/at_result_file.h"
 #include "acoustic/at_result.h"
 
 #include <asm-generic/socket.h>
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #define BUFFER_SIZE 4096
 
@@ -21,31 +32,28 @@ AT_Result AT_simulation_to_json(cJSON **out_json, AT_Simulation *simulation)
 {
     if (!out_json || *out_json || !simulation) return AT_ERR_INVALID_ARGUMENT;
 
-    size_t FRAME_NUM_BUFFER_LENGTH = sizeof(uint8_t);
     cJSON *json = cJSON_CreateObject();
 
-    AT_Voxel* voxels = simulation->voxel_grid;
     uint32_t num_voxels = simulation->num_voxels;
     uint32_t num_bins = AT_voxel_get_num_bins(simulation);
 
     for (uint32_t f = 0; f < num_bins; f++) {
 
-        char frame_num[FRAME_NUM_BUFFER_LENGTH];
-        sprintf(frame_num, "frame_%d", f);
+        char frame_num[32];
+        snprintf(frame_num, sizeof(frame_num), "frame_%u", f);
 
         cJSON *frame_data = cJSON_CreateArray();
 
         for (uint32_t v = 0; v < num_voxels; v++) {
 
-            AT_Voxel voxel = voxels[v];
-
-            float energy = (f < voxel.count) ? voxel.items[f] : 0;
+            // v is the row-major index clients expect
+            float energy = AT_voxel_span_get(AT_voxel_span(simulation, v), f);
 
             // TODO: IF ENERGY OVER MIN THRESHOLD
             if (energy <= 0) continue;
 
-            char voxel_num[num_voxels];
-            sprintf(voxel_num, "%d", v);
+            char voxel_num[16];
+            snprintf(voxel_num, sizeof(voxel_num), "%u", v);
 
             cJSON *voxel_data = cJSON_CreateObject();
 
@@ -59,6 +67,348 @@ AT_Result AT_simulation_to_json(cJSON **out_json, AT_Simulation *simulation)
     return AT_OK;
 }
 
+#define AT_NET_JSON_BUFFER_SIZE 16384
+
+typedef struct {
+    AT_JsonWriteFn write_fn;
+    void *ctx;
+    size_t used;
+    bool is_failed;
+    char data[AT_NET_JSON_BUFFER_SIZE];
+} AT_JsonStream;
+
+static void AT_json_stream_flush(AT_JsonStream *stream)
+{
+    if (!stream->is_failed && stream->used > 0 && !stream->write_fn(stream->ctx, stream->data, stream->used)) {
+        stream->is_failed = true;
+    }
+    stream->used = 0;
+}
+
+static void AT_json_stream_put(AT_JsonStream *stream, const char *data, size_t size)
+{
+    if (stream->used + size > sizeof(stream->data)) AT_json_stream_flush(stream);
+    memcpy(stream->data + stream->used, data, size);
+    stream->used += size;
+}
+
+// Formats a number the way cJSON prints it, so both writers agree byte for byte
+static int AT_json_format_number(char *buffer, size_t size, double d)
+{
+    if (isnan(d) || isinf(d)) return snprintf(buffer, size, "null");
+
+    int as_int = (d >= INT_MAX) ? INT_MAX : (d <= (double)INT_MIN) ? INT_MIN : (int)d;
+    if (d == (double)as_int) return snprintf(buffer, size, "%d", as_int);
+
+    int length = snprintf(buffer, size, "%1.15g", d);
+    double test = 0.0;
+    if (sscanf(buffer, "%lg", &test) != 1 || fabs(test - d) > fmax(fabs(test), fabs(d)) * DBL_EPSILON) {
+        length = snprintf(buffer, size, "%1.17g", d);
+    }
+
+    char decimal_point = localeconv()->decimal_point[0];
+    for (int i = 0; i < length; i++) {
+        if (buffer[i] == decimal_point) buffer[i] = '.';
+    }
+    return length;
+}
+
+AT_Result AT_simulation_write_json(const AT_Simulation *simulation, AT_JsonWriteFn write_fn, void *ctx)
+{
+    if (!simulation || !write_fn) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_JsonStream *stream = malloc(sizeof(AT_JsonStream));
+    if (!stream) return AT_ERR_ALLOC_ERROR;
+    stream->write_fn = write_fn;
+    stream->ctx = ctx;
+    stream->used = 0;
+    stream->is_failed = false;
+
+    uint32_t num_voxels = simulation->num_voxels;
+    uint32_t num_bins = AT_voxel_get_num_bins(simulation);
+
+    AT_json_stream_put(stream, "{", 1);
+    for (uint32_t f = 0; f < num_bins && !stream->is_failed; f++) {
+        char text[64];
+        int length = snprintf(text, sizeof(text), "%s\"frame_%u\":[", (f > 0) ? "," : "", f);
+        AT_json_stream_put(stream, text, (size_t)length);
+
+        bool is_first = true;
+        for (uint32_t v = 0; v < num_voxels; v++) {
+            // v is the row-major index clients expect
+            float energy = AT_voxel_span_get(AT_voxel_span(simulation, v), f);
+            if (energy <= 0) continue;
+
+            length = snprintf(text, sizeof(text), "%s{\"%u\":", is_first ? "" : ",", v);
+            length += AT_json_format_number(text + length, sizeof(text) - (size_t)length, energy);
+            text[length++] = '}';
+            AT_json_stream_put(stream, text, (size_t)length);
+            is_first = false;
+        }
+        AT_json_stream_put(stream, "]", 1);
+    }
+    AT_json_stream_put(stream, "}", 1);
+    AT_json_stream_flush(stream);
+
+    AT_Result res = stream->is_failed ? AT_ERR_IO_FAILURE : AT_OK;
+    free(stream);
+    return res;
+}
+
+static bool AT_json_write_fd(void *ctx, const char *data, size_t size)
+{
+    int fd = *(const int*)ctx;
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+AT_Result AT_simulation_write_json_fd(const AT_Simulation *simulation, int fd)
+{
+    if (fd < 0) return AT_ERR_INVALID_ARGUMENT;
+    return AT_simulation_write_json(simulation, AT_json_write_fd, &fd);
+}
+
+
+#define AT_NET_STORAGE_DIR "../storage/sims"
+#define AT_NET_PATH_LENGTH 512
+
+#define AT_NET_CORS_HEADERS \
+    "Access-Control-Allow-Origin: http://localhost:5173\r\n" \
+    "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n" \
+    "Access-Control-Allow-Headers: content-type\r\n"
+
+// Claims the first free id from *next_id on by creating its directory,
+// so a restarted server never writes into the replay of an earlier run
+static AT_Result AT_net_claim_sim_id(uint32_t *next_id, uint32_t *out_id, char *dir_path, size_t dir_size)
+{
+    for (;;) {
+        uint32_t id = (*next_id)++;
+        snprintf(dir_path, dir_size, AT_NET_STORAGE_DIR "/%u", id);
+        if (mkdir(dir_path, 0755) == 0) {
+            *out_id = id;
+            return AT_OK;
+        }
+        if (errno != EEXIST) return AT_ERR_IO_FAILURE;
+    }
+}
+
+static void AT_net_write_all(int client_fd, const void *data, size_t size)
+{
+    const char *bytes = data;
+    while (size > 0) {
+        ssize_t written = write(client_fd, bytes, size);
+        if (written <= 0) return;
+        bytes += written;
+        size -= (size_t)written;
+    }
+}
+
+static void AT_net_send_status(int client_fd, const char *status)
+{
+    char header[256];
+    snprintf(header, sizeof(header),
+        "HTTP/1.1 %s\r\n"
+        AT_NET_CORS_HEADERS
+        "Content-Length: 0\r\n"
+        "\r\n",
+        status);
+    AT_net_write_all(client_fd, header, strlen(header));
+}
+
+static void AT_net_send_body(int client_fd, const char *content_type, const void *body, size_t size)
+{
+    char header[256];
+    snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        AT_NET_CORS_HEADERS
+        "Content-Length: %zu\r\n"
+        "\r\n",
+        content_type, size);
+    AT_net_write_all(client_fd, header, strlen(header));
+    AT_net_write_all(client_fd, body, size);
+}
+
+static void AT_net_send_file(int client_fd, const char *path, const char *content_type)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        AT_net_send_status(client_fd, "404 Not Found");
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    char *data = (size > 0) ? malloc((size_t)size) : NULL;
+    if (size <= 0 || !data || fread(data, 1, (size_t)size, file) != (size_t)size) {
+        AT_net_send_status(client_fd, "500 Internal Server Error");
+    } else {
+        AT_net_send_body(client_fd, content_type, data, (size_t)size);
+    }
+    free(data);
+    fclose(file);
+}
+
+// Serves one keyframe payload straight from the mapped result file
+static void AT_net_send_frame(int client_fd, const char *path, uint32_t frame)
+{
+    AT_ResultFile *file = NULL;
+    if (AT_result_open(&file, path) != AT_OK) {
+        AT_net_send_status(client_fd, "404 Not Found");
+        return;
+    }
+
+    AT_ResultFrame result_frame;
+    if (AT_result_get_frame(&result_frame, file, frame) != AT_OK) {
+        AT_net_send_status(client_fd, "404 Not Found");
+    } else {
+        AT_net_send_body(client_fd, "application/octet-stream", result_frame.data, result_frame.size);
+    }
+    AT_result_close(file);
+}
+
+// Serves the time series of the voxel holding a point as float32 values
+static void AT_net_send_series(int client_fd, const char *path, AT_Vec3 point)
+{
+    AT_ResultFile *file = NULL;
+    if (AT_result_open(&file, path) != AT_OK) {
+        AT_net_send_status(client_fd, "404 Not Found");
+        return;
+    }
+
+    AT_ResultSeries series;
+    if (AT_result_query_points(&series, file, &point, 1) != AT_OK) {
+        AT_net_send_status(client_fd, "404 Not Found");
+    } else {
+        AT_net_send_body(client_fd, "application/octet-stream", series.values, sizeof(float) * series.frame_count);
+        AT_result_series_destroy(&series);
+    }
+    AT_result_close(file);
+}
+
+// Parses the run config from a request body and runs the simulation.
+// On success the caller owns the model, scene and simulation.
+static AT_Result AT_net_run_simulation(const char *body, AT_Model **out_model, AT_Scene **out_scene, AT_Simulation **out_sim)
+{
+    char filename[256] = {0};
+    char filepath[512] = {0};
+    float voxel_size = 0.0f;
+    uint32_t num_rays = 0;
+    uint32_t fps = 0;
+    bool is_simplified = false;
+
+    cJSON *cjson = cJSON_Parse(body);
+    cJSON *j;
+
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "modelPath");
+    if (cJSON_IsString(j)) {
+        strncpy(filename, j->valuestring, sizeof(filename) - 1);
+        snprintf(filepath, sizeof(filepath), "../assets/glb/%s", filename);
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "voxelSize");
+    if (cJSON_IsNumber(j)) {
+        voxel_size = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "numRays");
+    if (cJSON_IsNumber(j)) {
+        num_rays = (uint32_t)j->valueint;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "fps");
+    if (cJSON_IsNumber(j)) {
+        fps = (uint32_t)j->valueint;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "simplify");
+    if (cJSON_IsBool(j)) {
+        is_simplified = cJSON_IsTrue(j);
+    }
+
+    cJSON_Delete(cjson);
+
+    // run raytracer
+
+    AT_Model *model = NULL;
+    AT_Result res = AT_model_create(&model, filepath);
+    AT_handle_result(res, "Error creating model\n");
+    if (res != AT_OK) return res;
+
+    //compiled scenes were cleaned up before they were written
+    if (!model->mapping) {
+        AT_ModelWeldStats weld_stats = {0};
+        res = AT_model_weld(model, AT_MODEL_WELD_TOLERANCE, &weld_stats);
+        AT_handle_result(res, "Error welding model\n");
+        if (res != AT_OK) {
+            AT_model_destroy(model);
+            return res;
+        }
+        printf("Welded %zu vertices, dropped %zu unused vertices, %zu degenerate and %zu duplicate triangles\n",
+               weld_stats.welded_vertices, weld_stats.unused_vertices,
+               weld_stats.degenerate_triangles, weld_stats.duplicate_triangles);
+    }
+
+    // TODO: Get source info from client
+    AT_Source s1 = {
+        .direction = {1, 0, 0},
+        .intensity = 50.0f,
+        .position = {0}
+    };
+
+    AT_Source sources[1];
+    sources[0] = s1;
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_PLASTIC,
+        .num_sources = 1,
+        .sources = sources
+    };
+
+    AT_Scene *scene = NULL;
+    res = AT_scene_create(&scene, &conf);
+    AT_handle_result(res, "Error creating scene\n");
+    if (res != AT_OK) {
+        AT_model_destroy(model);
+        return res;
+    }
+
+    AT_Settings settings = {
+        .fps = fps,
+        .num_rays = num_rays,
+        .voxel_size = voxel_size,
+        .is_simplified = is_simplified
+    };
+
+    AT_Simulation *sim = NULL;
+    res = AT_simulation_create(&sim, scene, &settings);
+    AT_handle_result(res, "Error creating simulation\n");
+    if (res == AT_OK) {
+        res = AT_simulation_run(sim);
+        AT_handle_result(res, "Error running simulation\n");
+    }
+    if (res == AT_OK) {
+        // every export below only reads the bins
+        res = AT_simulation_compact(sim);
+        AT_handle_result(res, "Error compacting simulation\n");
+    }
+    if (res != AT_OK) {
+        AT_simulation_destroy(sim);
+        AT_scene_destroy(scene);
+        AT_model_destroy(model);
+        return res;
+    }
+
+    *out_model = model;
+    *out_scene = scene;
+    *out_sim = sim;
+    return AT_OK;
+}
 
 void AT_raytracer()
 {
@@ -74,6 +424,11 @@ void AT_raytracer()
     listen(server_fd, 4);
     printf("Server running on 127.0.0.1:8080\n");
 
+    // replays are stored under AT_NET_STORAGE_DIR/<id>/
+    mkdir("../storage", 0755);
+    mkdir(AT_NET_STORAGE_DIR, 0755);
+    uint32_t next_sim_id = (uint32_t)time(NULL);
+
     while (1) {
         sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
@@ -91,29 +446,52 @@ void AT_raytracer()
         }
 
         // CORS preflight options
-        if (strncmp(buffer, "OPTIONS /run", 12) == 0) {
+        if (strncmp(buffer, "OPTIONS ", 8) == 0) {
             const char *resp =
                 "HTTP/1.1 204 No Content\r\n"
-                "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-                "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                "Access-Control-Allow-Headers: content-type\r\n"
+                AT_NET_CORS_HEADERS
                 "Access-Control-Max-Age: 86400\r\n"
                 "Content-Length: 0\r\n"
                 "\r\n";
-            write(client_fd, resp, strlen(resp));
+            AT_net_write_all(client_fd, resp, strlen(resp));
             close(client_fd);
             continue;
         }
 
-        // POST
-        if (strncmp(buffer, "POST /run", 9) != 0) {
-            const char *err =
-                "HTTP/1.1 404 Not Found\r\n"
-                "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-                "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                "Access-Control-Allow-Headers: content-type\r\n"
-                "Content-Length: 0\r\n\r\n";
-            write(client_fd, err, strlen(err));
+        // GET /api/simulations/:id/meta, /api/simulations/:id/chunks/:n,
+        // /api/simulations/:id/frames/:n, /api/simulations/:id/series?x=&y=&z=
+        // and /api/simulations/:id/metrics
+        if (strncmp(buffer, "GET /api/simulations/", 21) == 0) {
+            unsigned int sim_id = 0, chunk_idx = 0, frame_idx = 0;
+            AT_Vec3 point;
+            char path[AT_NET_PATH_LENGTH];
+            if (sscanf(buffer + 21, "%u/frames/%u ", &sim_id, &frame_idx) == 2) {
+                snprintf(path, sizeof(path), AT_NET_STORAGE_DIR "/%u/result.atr", sim_id);
+                AT_net_send_frame(client_fd, path, frame_idx);
+            } else if (sscanf(buffer + 21, "%u/series?x=%f&y=%f&z=%f ", &sim_id, &point.x, &point.y, &point.z) == 4) {
+                snprintf(path, sizeof(path), AT_NET_STORAGE_DIR "/%u/result.atr", sim_id);
+                AT_net_send_series(client_fd, path, point);
+            } else if (sscanf(buffer + 21, "%u/chunks/%u ", &sim_id, &chunk_idx) == 2) {
+                snprintf(path, sizeof(path), AT_NET_STORAGE_DIR "/%u/chunk_%03u.bin", sim_id, chunk_idx);
+                AT_net_send_file(client_fd, path, "application/octet-stream");
+            } else if (sscanf(buffer + 21, "%u/metrics ", &sim_id) == 1 && strstr(buffer, "/metrics ")) {
+                snprintf(path, sizeof(path), AT_NET_STORAGE_DIR "/%u/metrics.bin", sim_id);
+                AT_net_send_file(client_fd, path, "application/octet-stream");
+            } else if (sscanf(buffer + 21, "%u/meta ", &sim_id) == 1 && strstr(buffer, "/meta ")) {
+                snprintf(path, sizeof(path), AT_NET_STORAGE_DIR "/%u/meta.json", sim_id);
+                AT_net_send_file(client_fd, path, "application/json");
+            } else {
+                AT_net_send_status(client_fd, "404 Not Found");
+            }
+            close(client_fd);
+            continue;
+        }
+
+        // POST /run answers with the legacy JSON, POST /api/simulations
+        // stores a binary replay and answers with its id
+        bool is_legacy = strncmp(buffer, "POST /run", 9) == 0;
+        if (!is_legacy && strncmp(buffer, "POST /api/simulations", 21) != 0) {
+            AT_net_send_status(client_fd, "404 Not Found");
             close(client_fd);
             continue;
         }
@@ -121,13 +499,7 @@ void AT_raytracer()
         // find body start
         char *body_start = strstr(buffer, "\r\n\r\n");
         if (!body_start) {
-            const char *err =
-                "HTTP/1.1 400 Bad Request\r\n"
-                "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-                "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                "Access-Control-Allow-Headers: content-type\r\n"
-                "Content-Length: 0\r\n\r\n";
-            write(client_fd, err, strlen(err));
+            AT_net_send_status(client_fd, "400 Bad Request");
             close(client_fd);
             continue;
         }
@@ -151,99 +523,70 @@ void AT_raytracer()
         }
         buffer[header_len + body_received] = '\0';
 
-        // parse config from JSON
-
-        char filename[256] = {0};
-        char filepath[512] = {0};
-        float voxel_size = 0.0f;
-        uint32_t num_rays = 0;
-        uint32_t fps = 0;
-
-        cJSON *cjson = cJSON_Parse(body_start);
-        cJSON *j;
-
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "modelPath");
-        if (cJSON_IsString(j)) {
-            strncpy(filename, j->valuestring, sizeof(filename) - 1);
-            snprintf(filepath, sizeof(filepath), "../assets/glb/%s", filename);
-        }
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "voxelSize");
-        if (cJSON_IsNumber(j)) {
-            voxel_size = (float)j->valuedouble;
-        }
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "numRays");
-        if (cJSON_IsNumber(j)) {
-            num_rays = (uint32_t)j->valueint;
-        }
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "fps");
-        if (cJSON_IsNumber(j)) {
-            fps = (uint32_t)j->valueint;
-        }
-
-        cJSON_Delete(cjson);
-
-        // run raytracer
-
         AT_Model *model = NULL;
-        AT_Result res = AT_model_create(&model, filepath);
-        AT_handle_result(res, "Error creating model\n");
-
-        // TODO: Get source info from client
-        AT_Source s1 = {
-            .direction = {1, 0, 0},
-            .intensity = 50.0f,
-            .position = {0}
-        };
-
-        AT_Source sources[1];
-        sources[0] = s1;
-
-        AT_SceneConfig conf = {
-            .environment = model,
-            .material = AT_MATERIAL_PLASTIC,
-            .num_sources = 1,
-            .sources = sources
-        };
-
         AT_Scene *scene = NULL;
-        res = AT_scene_create(&scene, &conf);
-        AT_handle_result(res, "Error creating scene\n");
-
-        AT_Settings settings = {
-            .fps = fps,
-            .num_rays = num_rays,
-            .voxel_size = voxel_size
-        };
-
         AT_Simulation *sim = NULL;
-        res = AT_simulation_create(&sim, scene, &settings);
-        AT_handle_result(res, "Error creating simulation\n");
-
-        res = AT_simulation_run(sim);
-        AT_handle_result(res, "Error running simulation\n");
+        AT_Result res = AT_net_run_simulation(body_start, &model, &scene, &sim);
+        if (res != AT_OK) {
+            AT_net_send_status(client_fd, "500 Internal Server Error");
+            close(client_fd);
+            continue;
+        }
 
-        cJSON *sim_json = NULL;
-        res = AT_simulation_to_json(&sim_json, sim);
-        AT_handle_result(res, "Error converting simulation to JSON\n");
-        const char *json = cJSON_PrintUnformatted(sim_json);
-
-        char header[256];
-        snprintf(header, sizeof(header),
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: application/json\r\n"
-            "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-            "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-            "Access-Control-Allow-Headers: content-type\r\n"
-            "Content-Length: %zu\r\n"
-            "\r\n",
-            strlen(json));
-        write(client_fd, header, strlen(header));
-        write(client_fd, json, strlen(json));
+        if (is_legacy) {
+            // streamed as it is written, the end of the body is the close
+            const char *header =
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: application/json\r\n"
+                AT_NET_CORS_HEADERS
+                "Connection: close\r\n"
+                "\r\n";
+            AT_net_write_all(client_fd, header, strlen(header));
+            res = AT_simulation_write_json_fd(sim, client_fd);
+            AT_handle_result(res, "Error streaming simulation JSON\n");
+        } else {
+            uint32_t sim_id = 0;
+            char dir_path[AT_NET_PATH_LENGTH];
+            res = AT_net_claim_sim_id(&next_sim_id, &sim_id, dir_path, sizeof(dir_path));
+            AT_handle_result(res, "Error creating simulation directory\n");
+
+            AT_ReplaySettings replay_settings = {
+                .encoding = AT_REPLAY_ENCODING_QUANTISED
+            };
+            if (res == AT_OK) {
+                res = AT_replay_write(sim, &replay_settings, dir_path);
+                AT_handle_result(res, "Error writing replay\n");
+            }
+            if (res == AT_OK) {
+                char result_path[AT_NET_PATH_LENGTH];
+                snprintf(result_path, sizeof(result_path), AT_NET_STORAGE_DIR "/%u/result.atr", sim_id);
+                res = AT_result_write(sim, &replay_settings, result_path);
+                AT_handle_result(res, "Error writing result file\n");
+            }
+            if (res == AT_OK) {
+                AT_MetricGrid metrics;
+                res = AT_metrics_compute(&metrics, sim);
+                if (res == AT_OK) {
+                    char metrics_path[AT_NET_PATH_LENGTH];
+                    snprintf(metrics_path, sizeof(metrics_path), AT_NET_STORAGE_DIR "/%u/metrics.bin", sim_id);
+                    res = AT_metrics_write(&metrics, sim, metrics_path);
+                    AT_metrics_destroy(&metrics);
+                }
+                AT_handle_result(res, "Error writing metrics\n");
+            }
+            if (res == AT_OK) {
+                char json[64];
+                int len = snprintf(json, sizeof(json), "{\"id\": %u}", sim_id);
+                AT_net_send_body(client_fd, "application/json", json, (size_t)len);
+            } else {
+                AT_net_send_status(client_fd, "500 Internal Server Error");
+            }
+        }
         close(client_fd);
 
-        AT_scene_destroy(scene);
         AT_simulation_destroy(sim);
-        cJSON_Delete(sim_json);
+        AT_scene_destroy(scene);
+        AT_model_destroy(model);
     }
 
     close(server_fd);
@@ -4,6 +4,7 @@
 #include "../../core/include/acoustic/at.h"
 #include "cJSON.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -19,6 +20,22 @@ AT_Result AT_simulation_to_json(
         AT_Simulation *simulation
 );
 
+// Receives the streamed JSON piece by piece, returns false to stop
+typedef bool (*AT_JsonWriteFn)(void *ctx, const char *data, size_t size);
+
+// Writes the same JSON as AT_simulation_to_json + cJSON_PrintUnformatted
+// through a fixed buffer, without building it in memory
+AT_Result AT_simulation_write_json(
+        const AT_Simulation *simulation,
+        AT_JsonWriteFn write_fn,
+        void *ctx
+);
+
+AT_Result AT_simulation_write_json_fd(
+        const AT_Simulation *simulation,
+        int fd
+);
+
 AT_Result AT_send_json_to_url(
     cJSON *json,
     const AT_NetworkConfig *config
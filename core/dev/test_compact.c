@@ -0,0 +1,159 @@
+#include "acoustic/at.h"
+#include "acoustic/at_metrics.h"
+#include "acoustic/at_model.h"
+#include "acoustic/at_replay.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compacts the sample room for both voxel layouts and checks that every
+// bin, every replay chunk and the metric maps read the same afterwards,
+// reporting the bin memory before and after
+
+typedef struct {
+    uint8_t **chunks;
+    size_t *sizes;
+    uint32_t num_chunks;
+    AT_MetricGrid metrics;
+} Exports;
+
+static int export_all(Exports *out, const AT_Simulation *sim, const AT_ReplaySettings *replay_settings)
+{
+    out->num_chunks = AT_replay_chunk_count(sim, replay_settings);
+    out->chunks = calloc(out->num_chunks, sizeof(uint8_t*));
+    out->sizes = calloc(out->num_chunks, sizeof(size_t));
+    for (uint32_t c = 0; c < out->num_chunks; c++) {
+        if (AT_replay_encode_chunk(&out->chunks[c], &out->sizes[c], sim, replay_settings, c) != AT_OK) return 1;
+    }
+    return AT_metrics_compute(&out->metrics, sim) != AT_OK;
+}
+
+static void exports_destroy(Exports *exports)
+{
+    for (uint32_t c = 0; c < exports->num_chunks; c++) free(exports->chunks[c]);
+    free(exports->chunks);
+    free(exports->sizes);
+    AT_metrics_destroy(&exports->metrics);
+}
+
+static bool exports_equal(const Exports *a, const Exports *b)
+{
+    if (a->num_chunks != b->num_chunks) return false;
+    for (uint32_t c = 0; c < a->num_chunks; c++) {
+        if (a->sizes[c] != b->sizes[c] || memcmp(a->chunks[c], b->chunks[c], a->sizes[c]) != 0) return false;
+    }
+    for (int m = 0; m < AT_METRIC_COUNT; m++) {
+        if (memcmp(a->metrics.maps[m], b->metrics.maps[m], sizeof(float) * a->metrics.num_voxels) != 0) return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const char *filepath = "../assets/glb/L_room.gltf";
+    const char *layout_names[] = {"linear", "tiled"};
+
+    AT_Model *model = NULL;
+    if (AT_model_create(&model, filepath) != AT_OK) {
+        fprintf(stderr, "Error creating model\n");
+        return 1;
+    }
+
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{0, 1, 0}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Scene *scene = NULL;
+    if (AT_scene_create(&scene, &conf) != AT_OK) {
+        fprintf(stderr, "Error creating scene\n");
+        return 1;
+    }
+
+    AT_ReplaySettings replay_settings = {.encoding = AT_REPLAY_ENCODING_RAW};
+
+    int failures = 0;
+    for (int l = 0; l < 2; l++) {
+        AT_Settings settings = {
+            .fps = 60,
+            .num_rays = 500,
+            .voxel_size = 0.1f,
+            .num_threads = 4,
+            .voxel_layout = (AT_VoxelLayout)l,
+        };
+
+        AT_Simulation *sim = NULL;
+        if (AT_simulation_create(&sim, scene, &settings) != AT_OK || AT_simulation_run(sim) != AT_OK) {
+            fprintf(stderr, "Error running simulation\n");
+            return 1;
+        }
+
+        //dense copy of every bin, and what the grid holds on the heap
+        uint32_t num_bins = AT_voxel_get_num_bins(sim);
+        float *dense = calloc((size_t)sim->num_voxels * num_bins, sizeof(float));
+        size_t grid_bytes = sizeof(AT_Voxel) * sim->num_voxel_slots;
+        for (uint32_t i = 0; i < sim->num_voxel_slots; i++) grid_bytes += sizeof(float) * sim->voxel_grid[i].capacity;
+        for (uint32_t v = 0; v < sim->num_voxels; v++) {
+            const AT_Voxel *voxel = &sim->voxel_grid[AT_voxel_index_from_linear(sim, v)];
+            if (voxel->count > 0) memcpy(dense + (size_t)v * num_bins, voxel->items, sizeof(float) * voxel->count);
+        }
+
+        Exports before = {0};
+        Exports after = {0};
+        if (export_all(&before, sim, &replay_settings) != 0) {
+            fprintf(stderr, "Error exporting simulation\n");
+            return 1;
+        }
+
+        double start = now_seconds();
+        if (AT_simulation_compact(sim) != AT_OK) {
+            fprintf(stderr, "Error compacting simulation\n");
+            return 1;
+        }
+        double elapsed = now_seconds() - start;
+        uint32_t num_values = sim->bins.offsets[sim->num_voxels];
+        size_t bins_bytes = sizeof(uint32_t) * (2 * (size_t)sim->num_voxels + 1) + sizeof(float) * num_values;
+
+        bool is_ok = AT_voxel_get_num_bins(sim) == num_bins &&
+                     AT_simulation_run(sim) == AT_ERR_INVALID_ARGUMENT;
+        for (uint32_t v = 0; v < sim->num_voxels && is_ok; v++) {
+            AT_VoxelSpan span = AT_voxel_span(sim, v);
+            for (uint32_t b = 0; b < num_bins; b++) {
+                if (AT_voxel_span_get(span, b) != dense[(size_t)v * num_bins + b]) is_ok = false;
+            }
+        }
+        if (export_all(&after, sim, &replay_settings) != 0) {
+            fprintf(stderr, "Error exporting simulation\n");
+            return 1;
+        }
+        is_ok = is_ok && exports_equal(&before, &after);
+
+        printf("%-6s values=%u bins %.1f MB -> %.1f MB in %.3fs %s\n",
+               layout_names[l], num_values, grid_bytes / 1e6, bins_bytes / 1e6, elapsed,
+               is_ok ? "ok" : "MISMATCH");
+        failures += !is_ok;
+
+        exports_destroy(&before);
+        exports_destroy(&after);
+        free(dense);
+        AT_simulation_destroy(sim);
+    }
+
+    AT_scene_destroy(scene);
+    AT_model_destroy(model);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "acoustic/at_model.h"
+#include "../src/at_convex.h"
+#include "../src/at_internal.h"
+#include "../src/at_polygon.h"
+#include "../src/at_ray.h"
+#include "test_helpers.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks which rooms count as convex: a shoebox does, the same box without
+// a roof, an L-shaped prism or a floor of two materials do not. Random
+// rays leave the shoebox where the polygon search says they do, and a run
+// matches the one where a stray triangle outside forces the search.
+
+#define NUM_RAYS 20000
+
+static uint32_t convex_planes(const AT_Model *model, AT_ConvexRoom *out_room, AT_PolygonSet *out_polygons)
+{
+    AT_Triangle *triangles = NULL;
+    uint32_t count = (uint32_t)(model->index_count / 3);
+    if (AT_model_get_triangles(&triangles, model) != AT_OK ||
+        AT_polygon_set_create(out_polygons, triangles, model->triangle_materials, count) != AT_OK ||
+        AT_convex_room_create(out_room, out_polygons, triangles, count) != AT_OK) {
+        free(triangles);
+        return UINT32_MAX;
+    }
+    free(triangles);
+    return out_room->num_planes;
+}
+
+static double run_energy(const AT_Model *model, double *out_seconds)
+{
+    AT_Source source = {
+        .direction = {{1, 0.2f, 0.3f}},
+        .intensity = 50.0,
+        .position = {{2, 1, 3}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Settings settings = {
+        .fps = 60,
+        .num_rays = 300,
+        .voxel_size = 0.1f,
+        .num_threads = 4,
+        .deposit_strategy = AT_DEPOSIT_DETERMINISTIC,
+    };
+
+    AT_Scene *scene = NULL;
+    AT_Simulation *sim = NULL;
+    double total = -1.0;
+    srand(7);
+    double start = now_seconds();
+    if (AT_scene_create(&scene, &conf) == AT_OK &&
+        AT_simulation_create(&sim, scene, &settings) == AT_OK &&
+        AT_simulation_run(sim) == AT_OK) {
+        *out_seconds = now_seconds() - start;
+        total = 0.0;
+        for (uint32_t v = 0; v < sim->num_voxel_slots; v++) {
+            for (size_t b = 0; b < sim->voxel_grid[v].count; b++) total += sim->voxel_grid[v].items[b];
+        }
+    }
+    AT_simulation_destroy(sim);
+    AT_scene_destroy(scene);
+    return total;
+}
+
+int main()
+{
+    int failures = 0;
+    srand(1);
+
+    static const float box_outline[4][2] = {{0, 0}, {0, 8}, {6, 8}, {6, 0}};
+    static const float l_outline[6][2] = {{0, 0}, {0, 8}, {3, 8}, {3, 3}, {6, 3}, {6, 0}};
+
+    AT_Model *box = prism(box_outline, 4, 3.0f, 0);
+    AT_ConvexRoom room = {0};
+    AT_PolygonSet polygons = {0};
+    bool is_ok = convex_planes(box, &room, &polygons) == 6;
+    printf("box planes=%u %s\n", room.num_planes, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+
+    //every exit agrees with the nearest polygon hit
+    uint32_t mismatches = 0;
+    for (uint32_t r = 0; r < NUM_RAYS && is_ok; r++) {
+        AT_Vec3 origin = AT_vec3(6.0f * random_unit(), 3.0f * random_unit(), 8.0f * random_unit());
+        AT_Ray ray = AT_ray_init(origin, AT_vec3(random_unit() - 0.5f, random_unit() - 0.5f, random_unit() - 0.5f), 0.0f, 1.0f, r);
+        AT_Ray closest = AT_ray_init(AT_vec3(FLT_MAX, FLT_MAX, FLT_MAX), AT_vec3(0, 0, 0), 0.0f, 1.0f, r);
+        for (uint32_t p = 0; p < polygons.num_polygons; p++) AT_ray_polygon_intersect(&ray, &polygons, p, &closest);
+
+        float t = 0.0f;
+        uint32_t plane = AT_convex_room_exit(&room, ray.origin, ray.direction, AT_CONVEX_NO_PLANE, &t);
+        AT_Vec3 reflected = AT_ray_reflect(ray.direction, room.planes[plane].normal);
+        if (plane == AT_CONVEX_NO_PLANE || AT_vec3_distance(AT_ray_at(&ray, t), closest.origin) > 1e-3f ||
+            AT_vec3_distance(reflected, closest.direction) > 1e-3f) {
+            mismatches++;
+        }
+    }
+    is_ok = is_ok && mismatches == 0;
+    printf("box exits %u of %u differ %s\n", mismatches, NUM_RAYS, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_convex_room_destroy(&room);
+    AT_polygon_set_destroy(&polygons);
+
+    //no roof
+    box->index_count -= 3 * 2;
+    is_ok = convex_planes(box, &room, &polygons) == 0;
+    printf("open box planes=%u %s\n", room.num_planes, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_convex_room_destroy(&room);
+    AT_polygon_set_destroy(&polygons);
+    box->index_count += 3 * 2;
+
+    //one floor triangle of another material
+    box->triangle_materials[2 * 4] = AT_MATERIAL_CONCRETE;
+    is_ok = convex_planes(box, &room, &polygons) == 0;
+    printf("two material floor planes=%u %s\n", room.num_planes, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_convex_room_destroy(&room);
+    AT_polygon_set_destroy(&polygons);
+    box->triangle_materials[2 * 4] = AT_MATERIAL_PLASTIC;
+
+    //fanned from the corner opposite the notch
+    AT_Model *l_room = prism(l_outline, 6, 3.0f, 0);
+    is_ok = convex_planes(l_room, &room, &polygons) == 0;
+    printf("L room planes=%u %s\n", room.num_planes, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_convex_room_destroy(&room);
+    AT_polygon_set_destroy(&polygons);
+    AT_model_destroy(l_room);
+
+    //a stray triangle opens the surface, so the run searches polygons
+    AT_Model *searched = prism(box_outline, 4, 3.0f, 1);
+    double convex_seconds = 0.0, searched_seconds = 0.0;
+    double energy = run_energy(box, &convex_seconds);
+    double searched_energy = run_energy(searched, &searched_seconds);
+    is_ok = energy > 0.0 && fabs(energy - searched_energy) <= 1e-3 * energy;
+    printf("energy convex %.4f in %.3fs searched %.4f in %.3fs %s\n",
+           energy, convex_seconds, searched_energy, searched_seconds, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_model_destroy(searched);
+    AT_model_destroy(box);
+
+    return failures ? 1 : 0;
+}
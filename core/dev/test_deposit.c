@@ -0,0 +1,211 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "../src/at_deposit.h"
+#include "../src/at_internal.h"
+#include "../src/at_thread.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Times AT_simulation_run with each deposit strategy on the sample rooms.
+// Then feeds made-up rays straight through deterministic lanes, reporting
+// the most block memory held at once as the ray count grows, which has to
+// stay flat while the result stays the same for every thread count.
+
+#define BLOCK_TEST_VOXELS 20000
+#define BLOCK_TEST_BINS 64
+#define BLOCK_TEST_DEPOSITS_PER_RAY 200
+
+static double grid_energy_sum(const AT_Simulation *sim)
+{
+    double sum = 0.0;
+    for (uint32_t i = 0; i < sim->num_voxels; i++) {
+        for (size_t b = 0; b < sim->voxel_grid[i].count; b++) {
+            sum += sim->voxel_grid[i].items[b];
+        }
+    }
+    return sum;
+}
+
+typedef struct {
+    AT_Deposit *deposit;
+    uint32_t num_rays;
+    uint32_t next_ray;
+    AT_Result result;
+} BlockJob;
+
+static uint32_t hash_u32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// Every ray walks a short run of voxels from a random start, so blocks hit
+// a realistic mix of shared and unique cells
+static void block_worker(void *ctx, uint32_t thread_idx)
+{
+    BlockJob *job = ctx;
+    AT_DepositLane *lane = &job->deposit->lanes[thread_idx];
+
+    for (;;) {
+        uint32_t first = __atomic_fetch_add(&job->next_ray, AT_DEPOSIT_BLOCK_RAYS, __ATOMIC_RELAXED);
+        if (first >= job->num_rays) break;
+        uint32_t last = AT_min(first + AT_DEPOSIT_BLOCK_RAYS, job->num_rays);
+
+        AT_Result res = AT_OK;
+        for (uint32_t i = first; i < last && res == AT_OK; i++) {
+            uint32_t h = hash_u32(i);
+            for (uint32_t d = 0; d < BLOCK_TEST_DEPOSITS_PER_RAY && res == AT_OK; d++) {
+                uint32_t voxel = (h + d * 7) % BLOCK_TEST_VOXELS;
+                uint32_t bin = (h >> 8) % (BLOCK_TEST_BINS / 2) + d * BLOCK_TEST_BINS / (2 * BLOCK_TEST_DEPOSITS_PER_RAY);
+                res = AT_deposit_add(lane, voxel, bin, 1.0f / (1.0f + (float)(hash_u32(h + d) & 0xFF)));
+            }
+        }
+        if (res == AT_OK) res = AT_deposit_block_end(job->deposit, lane, first / AT_DEPOSIT_BLOCK_RAYS);
+        if (res != AT_OK) {
+            AT_deposit_abort(job->deposit, res);
+            __atomic_store_n(&job->result, res, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+}
+
+static bool run_blocks(uint32_t num_rays, uint32_t num_threads, uint64_t *out_hash, size_t *out_peak_bytes)
+{
+    AT_Deposit deposit = {0};
+    if (AT_deposit_create(&deposit, AT_DEPOSIT_DETERMINISTIC, BLOCK_TEST_VOXELS, 0, BLOCK_TEST_BINS,
+                          num_threads, num_rays, false) != AT_OK) {
+        return false;
+    }
+
+    AT_Voxel *voxels = calloc(BLOCK_TEST_VOXELS, sizeof(AT_Voxel));
+    BlockJob job = {.deposit = &deposit, .num_rays = num_rays, .result = AT_OK};
+    bool is_ok = voxels && AT_thread_run(num_threads, block_worker, &job) == AT_OK && job.result == AT_OK &&
+                 AT_deposit_finish(&deposit, voxels, 0) == AT_OK;
+    *out_peak_bytes = deposit.peak_pending_bytes;
+
+    //FNV-1a over the bits of every bin
+    uint64_t hash = 1469598103934665603ull;
+    for (uint32_t v = 0; is_ok && v < BLOCK_TEST_VOXELS; v++) {
+        for (size_t b = 0; b < voxels[v].count; b++) {
+            uint32_t bits;
+            memcpy(&bits, &voxels[v].items[b], sizeof(bits));
+            hash = (hash ^ bits) * 1099511628211ull;
+        }
+    }
+    *out_hash = hash;
+
+    for (uint32_t v = 0; voxels && v < BLOCK_TEST_VOXELS; v++) free(voxels[v].items);
+    free(voxels);
+    AT_deposit_destroy(&deposit);
+    return is_ok;
+}
+
+static int test_block_memory(void)
+{
+    int failures = 0;
+    const uint32_t ray_counts[] = {1000, 10000, 100000};
+
+    printf("deterministic block memory, %u deposits per ray\n", BLOCK_TEST_DEPOSITS_PER_RAY);
+    for (size_t r = 0; r < sizeof(ray_counts) / sizeof(ray_counts[0]); r++) {
+        uint64_t serial_hash = 0, hash = 0;
+        size_t serial_peak = 0, peak = 0;
+        bool is_ok = run_blocks(ray_counts[r], 1, &serial_hash, &serial_peak) &&
+                     run_blocks(ray_counts[r], 8, &hash, &peak) && hash == serial_hash;
+
+        //held blocks are capped per lane, not per ray
+        is_ok = is_ok && peak <= (size_t)AT_DEPOSIT_PENDING_BLOCKS_PER_LANE * 8 *
+                                  AT_DEPOSIT_BLOCK_RAYS * BLOCK_TEST_DEPOSITS_PER_RAY * sizeof(AT_DepositCell);
+        printf("  rays=%-7u all deposits=%8.1f KiB peak held 1 thread=%7.1f KiB 8 threads=%7.1f KiB %s\n",
+               ray_counts[r],
+               (double)ray_counts[r] * BLOCK_TEST_DEPOSITS_PER_RAY * sizeof(AT_DepositCell) / 1024.0,
+               serial_peak / 1024.0, peak / 1024.0, is_ok ? "ok" : "MISMATCH");
+        failures += !is_ok;
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = test_block_memory();
+
+    const char *rooms[] = {
+        "../assets/glb/box_room.gltf",
+        "../assets/glb/L_room.gltf",
+        "../assets/glb/polygon_room.gltf",
+    };
+    const char *strategy_names[] = {"auto", "private", "atomic", "determ"};
+    const uint32_t thread_counts[] = {1, 2, 4, 8};
+
+    for (size_t r = 0; r < sizeof(rooms) / sizeof(rooms[0]); r++) {
+        AT_Model *model = NULL;
+        if (AT_model_create(&model, rooms[r]) != AT_OK) {
+            fprintf(stderr, "Error creating model %s\n", rooms[r]);
+            continue;
+        }
+
+        AT_Source source = {
+            .direction = {{1, 0, 0}},
+            .intensity = 50.0,
+            .position = {{0, 1, 0}}
+        };
+
+        AT_SceneConfig conf = {
+            .environment = model,
+            .material = AT_MATERIAL_CONCRETE,
+            .num_sources = 1,
+            .sources = &source
+        };
+
+        AT_Scene *scene = NULL;
+        if (AT_scene_create(&scene, &conf) != AT_OK) {
+            fprintf(stderr, "Error creating scene\n");
+            AT_model_destroy(model);
+            continue;
+        }
+
+        printf("%s\n", rooms[r]);
+        for (int s = AT_DEPOSIT_PRIVATE; s <= AT_DEPOSIT_DETERMINISTIC; s++) {
+            for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+                AT_Settings settings = {
+                    .fps = 60,
+                    .num_rays = 500,
+                    .voxel_size = 0.1f,
+                    .num_threads = thread_counts[t],
+                    .deposit_strategy = (AT_DepositStrategy)s
+                };
+
+                AT_Simulation *sim = NULL;
+                if (AT_simulation_create(&sim, scene, &settings) != AT_OK) {
+                    fprintf(stderr, "Error creating simulation\n");
+                    continue;
+                }
+
+                srand(1);
+                double start = now_seconds();
+                AT_Result res = AT_simulation_run(sim);
+                double elapsed = now_seconds() - start;
+
+                if (res == AT_OK) {
+                    printf("  %-8s threads=%u voxels=%u bins=%u time=%.3fs energy=%.6f\n",
+                           strategy_names[s], thread_counts[t], sim->num_voxels,
+                           AT_voxel_get_num_bins(sim), elapsed, grid_energy_sum(sim));
+                }
+                AT_simulation_destroy(sim);
+            }
+        }
+
+        AT_scene_destroy(scene);
+        AT_model_destroy(model);
+    }
+
+    return failures ? 1 : 0;
+}
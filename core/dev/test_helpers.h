@@ -0,0 +1,142 @@
+#ifndef AT_TEST_HELPERS_H
+#define AT_TEST_HELPERS_H
+
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Timing, random numbers and small procedural models shared by the dev tests
+
+static inline double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline float random_unit(void)
+{
+    return (float)rand() / RAND_MAX;
+}
+
+static inline void area_per_material(double *out_area, const AT_Model *model)
+{
+    for (int m = 0; m < AT_MATERIAL_COUNT; m++) out_area[m] = 0.0;
+    for (size_t t = 0; t < model->index_count / 3; t++) {
+        AT_Vec3 a = model->vertices[model->indices[t * 3 + 0]];
+        AT_Vec3 b = model->vertices[model->indices[t * 3 + 1]];
+        AT_Vec3 c = model->vertices[model->indices[t * 3 + 2]];
+        out_area[model->triangle_materials[t]] += 0.5 * AT_vec3_length(AT_vec3_cross(AT_vec3_sub(b, a), AT_vec3_sub(c, a)));
+    }
+}
+
+// Point of face f at position (i, j) of a grid x grid tessellation, sharing
+// edge points with the neighbouring faces so the box is welded. Inner
+// points move bump into the box.
+static inline AT_Vec3 grid_point(AT_Vec3 size, int grid, int f, int i, int j, float bump)
+{
+    static const int axes[6][3] = {{2, 0, 1}, {2, 1, 0}, {0, 2, 1}, {0, 1, 2}, {1, 0, 2}, {1, 2, 0}};
+    int normal = axes[f][0], u = axes[f][1], v = axes[f][2];
+    AT_Vec3 p = {0};
+    p.arr[normal] = (f % 2) ? size.arr[normal] : 0.0f;
+    p.arr[u] = size.arr[u] * i / grid;
+    p.arr[v] = size.arr[v] * j / grid;
+    bool is_inner = i > 0 && i < grid && j > 0 && j < grid;
+    if (is_inner) p.arr[normal] += (f % 2) ? -bump : bump;
+    return p;
+}
+
+// Shoebox from the origin to size, every face split into grid x grid
+// quads. The first concrete_columns columns of the y = 0 floor are
+// concrete, everything else plastic. Bumps are drawn from rand(), up to
+// bump deep, and only when bump is not 0.
+static inline AT_Model *tessellated_box(AT_Vec3 size, int grid, float bump, int concrete_columns)
+{
+    const size_t max_vertices = 6 * (size_t)(grid + 1) * (grid + 1);
+    const size_t triangle_count = 6 * (size_t)grid * grid * 2;
+
+    AT_Model *model = calloc(1, sizeof(AT_Model));
+    model->vertices = malloc(sizeof(AT_Vec3) * max_vertices);
+    model->normals = calloc(max_vertices, sizeof(AT_Vec3));
+    model->indices = malloc(sizeof(uint32_t) * triangle_count * 3);
+    model->triangle_materials = malloc(sizeof(AT_MaterialId) * triangle_count);
+    uint32_t *ids = malloc(sizeof(uint32_t) * (grid + 1) * (grid + 1));
+
+    size_t t = 0;
+    for (int f = 0; f < 6; f++) {
+        for (int i = 0; i <= grid; i++) {
+            for (int j = 0; j <= grid; j++) {
+                float depth = (bump != 0.0f) ? bump * random_unit() : 0.0f;
+                model->vertices[model->vertex_count] = grid_point(size, grid, f, i, j, depth);
+                ids[i * (grid + 1) + j] = (uint32_t)model->vertex_count++;
+            }
+        }
+        bool is_flipped = f % 2;
+        for (int i = 0; i < grid; i++) {
+            for (int j = 0; j < grid; j++) {
+                uint32_t material = (f == 4 && i < concrete_columns) ? AT_MATERIAL_CONCRETE : AT_MATERIAL_PLASTIC;
+                uint32_t quad[4] = {
+                    ids[i * (grid + 1) + j], ids[(i + 1) * (grid + 1) + j],
+                    ids[(i + 1) * (grid + 1) + j + 1], ids[i * (grid + 1) + j + 1]
+                };
+                uint32_t *o = &model->indices[t * 3];
+                o[0] = quad[0]; o[1] = quad[is_flipped ? 2 : 1]; o[2] = quad[is_flipped ? 1 : 2];
+                o[3] = quad[0]; o[4] = quad[is_flipped ? 3 : 2]; o[5] = quad[is_flipped ? 2 : 3];
+                model->triangle_materials[t++] = material;
+                model->triangle_materials[t++] = material;
+            }
+        }
+    }
+    free(ids);
+    model->index_count = t * 3;
+    //faces repeat their shared edge points
+    AT_model_weld(model, 0.0f, NULL);
+    return model;
+}
+
+// Prism over a counter-clockwise outline in the xz plane, walls plus caps
+// fanned from the first corner, which must see every other corner. The
+// extra triangles sit just outside the first wall and are never hit.
+static inline AT_Model *prism(const float (*outline)[2], uint32_t n, float height, uint32_t extra_triangles)
+{
+    uint32_t triangle_count = 2 * n + 2 * (n - 2) + extra_triangles;
+    AT_Model *model = calloc(1, sizeof(AT_Model));
+    model->vertices = malloc(sizeof(AT_Vec3) * (2 * n + 3 * extra_triangles));
+    model->normals = calloc(2 * n + 3 * extra_triangles, sizeof(AT_Vec3));
+    model->indices = malloc(sizeof(uint32_t) * triangle_count * 3);
+    model->triangle_materials = malloc(sizeof(AT_MaterialId) * triangle_count);
+
+    for (uint32_t i = 0; i < n; i++) {
+        model->vertices[i] = AT_vec3(outline[i][0], 0.0f, outline[i][1]);
+        model->vertices[n + i] = AT_vec3(outline[i][0], height, outline[i][1]);
+    }
+    uint32_t *o = model->indices;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = (i + 1) % n;
+        *o++ = i; *o++ = n + i; *o++ = n + j;
+        *o++ = i; *o++ = n + j; *o++ = j;
+    }
+    for (uint32_t i = 1; i + 1 < n; i++) {
+        *o++ = 0; *o++ = i; *o++ = i + 1;
+        *o++ = n; *o++ = n + i + 1; *o++ = n + i;
+    }
+    for (uint32_t e = 0; e < extra_triangles; e++) {
+        uint32_t base = 2 * n + 3 * e;
+        model->vertices[base + 0] = AT_vec3(-0.5f, 1.0f, 1.0f + e);
+        model->vertices[base + 1] = AT_vec3(-0.5f, 2.0f, 1.0f + e);
+        model->vertices[base + 2] = AT_vec3(-0.5f, 1.0f, 2.0f + e);
+        *o++ = base; *o++ = base + 1; *o++ = base + 2;
+    }
+    for (uint32_t t = 0; t < triangle_count; t++) model->triangle_materials[t] = AT_MATERIAL_PLASTIC;
+    model->vertex_count = 2 * n + 3 * extra_triangles;
+    model->index_count = triangle_count * 3;
+    return model;
+}
+
+#endif // AT_TEST_HELPERS_H
@@ -0,0 +1,194 @@
+#include "acoustic/at.h"
+#include "acoustic/at_metrics.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Computes the metric maps of the sample room, checks them against a plain
+// double precision version of the same fits, then replaces one voxel with an
+// exponential decay of a known reverberation time
+
+static double reference_decay_time(const double *levels, uint32_t n, double start_db, double end_db, double bin_width)
+{
+    uint32_t first = 0;
+    while (first < n && levels[first] > start_db) first++;
+    uint32_t last = first;
+    while (last < n && levels[last] >= end_db) last++;
+    if (last == n || last - first < 2) return NAN;
+
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    for (uint32_t i = first; i < last; i++) {
+        sum_x += i;
+        sum_y += levels[i];
+        sum_xx += (double)i * i;
+        sum_xy += i * levels[i];
+    }
+    double count = last - first;
+    double slope = (count * sum_xy - sum_x * sum_y) / (count * sum_xx - sum_x * sum_x);
+    if (!(-slope * (count - 1) >= 0.5 * (start_db - end_db))) return NAN;
+    return -60.0 * bin_width / slope;
+}
+
+static void reference_metrics(double out[AT_METRIC_COUNT], const AT_Voxel *voxel, uint8_t fps)
+{
+    double bin_width = 1.0 / fps;
+    for (int m = 0; m < AT_METRIC_COUNT; m++) out[m] = NAN;
+
+    uint32_t onset = 0;
+    while (onset < voxel->count && !(voxel->items[onset] > 0.0f)) onset++;
+    if (onset == voxel->count) return;
+
+    uint32_t n = voxel->count - onset;
+    double *schroeder = malloc(sizeof(double) * n);
+    double *levels = malloc(sizeof(double) * n);
+    double acc = 0.0;
+    for (uint32_t i = n; i-- > 0;) {
+        acc += voxel->items[onset + i];
+        schroeder[i] = acc;
+    }
+    for (uint32_t i = 0; i < n; i++) levels[i] = (schroeder[i] > 0.0) ? 10.0 * log10(schroeder[i] / acc) : -INFINITY;
+
+    out[AT_METRIC_EDT] = reference_decay_time(levels, n, 0.0, -10.0, bin_width);
+    out[AT_METRIC_T20] = reference_decay_time(levels, n, -5.0, -25.0, bin_width);
+    out[AT_METRIC_T30] = reference_decay_time(levels, n, -5.0, -35.0, bin_width);
+
+    double early_bins = 0.05 * fps;
+    uint32_t k = (uint32_t)fmin(early_bins, n);
+    double split = (k < n) ? (early_bins - k) * voxel->items[onset + k] : 0.0;
+    double early = split;
+    for (uint32_t i = 0; i < k; i++) early += voxel->items[onset + i];
+    double late = (k < n) ? fmax(schroeder[k] - split, 0.0) : 0.0;
+    out[AT_METRIC_D50] = early / (early + late);
+    out[AT_METRIC_C50] = (late > 0.0) ? 10.0 * log10(early / late) : INFINITY;
+
+    free(schroeder);
+    free(levels);
+}
+
+// Largest difference between the maps and the reference, a NaN on one side
+// only counts as infinite
+static double compare(const AT_MetricGrid *grid, const AT_Simulation *sim, uint32_t *out_defined)
+{
+    double max_error = 0.0;
+    *out_defined = 0;
+    for (uint32_t v = 0; v < grid->num_voxels; v++) {
+        double expected[AT_METRIC_COUNT];
+        reference_metrics(expected, &sim->voxel_grid[AT_voxel_index_from_linear(sim, v)], sim->fps);
+        for (int m = 0; m < AT_METRIC_COUNT; m++) {
+            double got = grid->maps[m][v];
+            if (isnan(got) || isnan(expected[m])) {
+                if (isnan(got) != isnan(expected[m])) max_error = INFINITY;
+                continue;
+            }
+            if (m == AT_METRIC_EDT) (*out_defined)++;
+            if (isinf(got) || isinf(expected[m])) {
+                if (got != expected[m]) max_error = INFINITY;
+                continue;
+            }
+            //decay times relative, levels and ratios absolute
+            double error = fabs(got - expected[m]);
+            if (m <= AT_METRIC_T30) error /= fabs(expected[m]);
+            max_error = fmax(max_error, error);
+        }
+    }
+    return max_error;
+}
+
+int main()
+{
+    const char *filepath = "../assets/glb/L_room.gltf";
+
+    AT_Model *model = NULL;
+    if (AT_model_create(&model, filepath) != AT_OK) {
+        fprintf(stderr, "Error creating model\n");
+        return 1;
+    }
+
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{0, 1, 0}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Settings settings = {
+        .fps = 60,
+        .num_rays = 500,
+        .voxel_size = 0.1f,
+        .num_threads = 4,
+    };
+
+    AT_Scene *scene = NULL;
+    AT_Simulation *sim = NULL;
+    if (AT_scene_create(&scene, &conf) != AT_OK ||
+        AT_simulation_create(&sim, scene, &settings) != AT_OK ||
+        AT_simulation_run(sim) != AT_OK) {
+        fprintf(stderr, "Error running simulation\n");
+        return 1;
+    }
+
+    int failures = 0;
+
+    AT_MetricGrid grid;
+    double start = now_seconds();
+    if (AT_metrics_compute(&grid, sim) != AT_OK) {
+        fprintf(stderr, "Error computing metrics\n");
+        return 1;
+    }
+    double elapsed = now_seconds() - start;
+
+    uint32_t defined = 0;
+    double max_error = compare(&grid, sim, &defined);
+    //the fast log is good to 2e-5 dB, far below what moves a fit by 1e-3
+    bool is_ok = max_error < 1e-3;
+    printf("room     voxels=%u with EDT=%u in %.3fs max error %.2e %s\n",
+           grid.num_voxels, defined, elapsed, max_error, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+
+    if (AT_metrics_write(&grid, sim, "metrics_out.bin") != AT_OK) {
+        fprintf(stderr, "Error writing metrics\n");
+        failures++;
+    }
+    AT_metrics_destroy(&grid);
+
+    //1 dB per bin at 60 fps is a 1 s decay, 3 bins of it fall in 50 ms
+    AT_Voxel *voxel = &sim->voxel_grid[AT_voxel_index_from_linear(sim, 0)];
+    AT_da_clear(voxel);
+    for (int i = 0; i < 5; i++) AT_voxel_bin_append(voxel, 0.0f);
+    for (int i = 0; i < 120; i++) AT_voxel_bin_append(voxel, powf(10.0f, -0.1f * i));
+
+    if (AT_metrics_compute(&grid, sim) != AT_OK) {
+        fprintf(stderr, "Error computing metrics\n");
+        return 1;
+    }
+    double d50 = 1.0 - pow(10.0, -0.3);
+    double expected[AT_METRIC_COUNT] = {1.0, 1.0, 1.0, 10.0 * log10(d50 / (1.0 - d50)), d50};
+    const char *names[AT_METRIC_COUNT] = {"EDT", "T20", "T30", "C50", "D50"};
+    for (int m = 0; m < AT_METRIC_COUNT; m++) {
+        double error = fabs(grid.maps[m][0] - expected[m]);
+        bool is_metric_ok = error < 1e-3;
+        printf("decay    %s=%.4f expected %.4f %s\n", names[m], grid.maps[m][0], expected[m],
+               is_metric_ok ? "ok" : "MISMATCH");
+        failures += !is_metric_ok;
+    }
+    AT_metrics_destroy(&grid);
+
+    AT_simulation_destroy(sim);
+    AT_scene_destroy(scene);
+    AT_model_destroy(model);
+    return failures ? 1 : 0;
+}
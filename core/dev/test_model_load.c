@@ -0,0 +1,72 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Loads every sample model, reports its size, load and triangle gathering
+// time and checks that indices stay in range, normals are unit length (or
+// zero when the file has none) and gathered triangles match their indices
+
+int main()
+{
+    const char *filepaths[] = {
+        "../assets/glb/L_room.gltf",
+        "../assets/glb/L_room.glb",
+        "../assets/glb/L_room_roof.gltf",
+        "../assets/glb/box_room.gltf",
+        "../assets/glb/Sponza.gltf",
+    };
+
+    int failures = 0;
+    for (size_t f = 0; f < sizeof(filepaths) / sizeof(filepaths[0]); f++) {
+        AT_Model *model = NULL;
+        double start = now_seconds();
+        if (AT_model_create(&model, filepaths[f]) != AT_OK) {
+            printf("%-32s failed to load\n", filepaths[f]);
+            failures++;
+            continue;
+        }
+        double elapsed = now_seconds() - start;
+
+        bool is_ok = model->index_count % 3 == 0;
+        for (size_t i = 0; i < model->index_count; i++) {
+            if (model->indices[i] >= model->vertex_count) is_ok = false;
+        }
+        for (size_t i = 0; i < model->vertex_count; i++) {
+            AT_Vec3 n = model->normals[i];
+            float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+            if (length != 0.0f && fabsf(length - 1.0f) > 1e-3f) is_ok = false;
+        }
+
+        AT_Triangle *triangles = NULL;
+        start = now_seconds();
+        if (AT_model_get_triangles(&triangles, model) != AT_OK) {
+            is_ok = false;
+        } else {
+            for (size_t t = 0; t < model->index_count / 3; t++) {
+                AT_Vec3 v3 = model->vertices[model->indices[t * 3 + 2]];
+                if (memcmp(&triangles[t].v3, &v3, sizeof(v3)) != 0) is_ok = false;
+            }
+        }
+        double gather_elapsed = now_seconds() - start;
+        free(triangles);
+
+        AT_AABB aabb;
+        AT_model_to_AABB(&aabb, model);
+        printf("%-32s vertices=%zu triangles=%zu in %.3fs gathered in %.3fs bounds (%.2f %.2f %.2f)-(%.2f %.2f %.2f) %s\n",
+               filepaths[f], model->vertex_count, model->index_count / 3, elapsed, gather_elapsed,
+               aabb.min.x, aabb.min.y, aabb.min.z, aabb.max.x, aabb.max.y, aabb.max.z,
+               is_ok ? "ok" : "INVALID");
+        failures += !is_ok;
+
+        AT_model_destroy(model);
+    }
+
+    return failures ? 1 : 0;
+}
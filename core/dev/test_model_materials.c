@@ -0,0 +1,114 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "acoustic/at_scene_file.h"
+#include "../src/at_internal.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Loads a glTF whose triangles use a material named after wood, one tagged
+// concrete in its extras, two with the same custom absorption and none at
+// all, checks the IDs and the table they index, the reflectance the scene
+// caches and that a compiled scene keeps both.
+
+#define GLTF_PATH "materials_test.gltf"
+#define SCENE_PATH "materials_test" AT_SCENE_FILE_EXTENSION
+
+// One triangle, drawn by every primitive
+static const char GLTF[] =
+    "{\"asset\": {\"version\": \"2.0\"},"
+    " \"buffers\": [{\"byteLength\": 36, \"uri\": \"data:application/octet-stream;base64,"
+    "AAAAAAAAAAAAAAAAAACAPwAAAAAAAAAAAAAAAAAAgD8AAAAA\"}],"
+    " \"bufferViews\": [{\"buffer\": 0, \"byteLength\": 36}],"
+    " \"accessors\": [{\"bufferView\": 0, \"componentType\": 5126, \"count\": 3, \"type\": \"VEC3\","
+    "                \"min\": [0, 0, 0], \"max\": [1, 1, 0]}],"
+    " \"materials\": [{\"name\": \"Oak_Wood_Floor\"},"
+    "                {\"name\": \"Wall\", \"extras\": {\"" AT_MODEL_EXTRAS_MATERIAL "\": \"Concrete\"}},"
+    "                {\"name\": \"Curtain\", \"extras\": {\"" AT_MODEL_EXTRAS_ABSORPTION "\": 0.45}},"
+    "                {\"name\": \"Curtain.001\", \"extras\": {\"" AT_MODEL_EXTRAS_ABSORPTION "\": 0.45}}],"
+    " \"meshes\": [{\"primitives\": ["
+    "     {\"attributes\": {\"POSITION\": 0}, \"material\": 0},"
+    "     {\"attributes\": {\"POSITION\": 0}, \"material\": 1},"
+    "     {\"attributes\": {\"POSITION\": 0}, \"material\": 2},"
+    "     {\"attributes\": {\"POSITION\": 0}, \"material\": 3},"
+    "     {\"attributes\": {\"POSITION\": 0}}]}],"
+    " \"nodes\": [{\"mesh\": 0}],"
+    " \"scenes\": [{\"nodes\": [0]}],"
+    " \"scene\": 0}";
+
+static bool check_materials(const AT_Model *model, const char *label)
+{
+    static const AT_MaterialId expected[] = {
+        AT_MATERIAL_WOOD, AT_MATERIAL_CONCRETE, AT_MATERIAL_COUNT, AT_MATERIAL_COUNT, AT_MATERIAL_PLASTIC,
+    };
+    size_t triangle_count = model->triangles ? model->triangle_count : model->index_count / 3;
+
+    bool is_ok = triangle_count == 5 && model->material_count == AT_MATERIAL_COUNT + 1 &&
+                 model->materials[AT_MATERIAL_COUNT].absorption == 0.45f;
+    for (size_t t = 0; is_ok && t < triangle_count; t++) is_ok = model->triangle_materials[t] == expected[t];
+    for (int m = 0; is_ok && m < AT_MATERIAL_COUNT; m++) {
+        is_ok = model->materials[m].absorption == AT_MATERIAL_TABLE[m].absorption;
+    }
+    printf("%-8s materials=%u ids=", label, model->material_count);
+    for (size_t t = 0; t < triangle_count; t++) printf("%u ", model->triangle_materials[t]);
+    printf("%s\n", is_ok ? "ok" : "MISMATCH");
+    return is_ok;
+}
+
+int main()
+{
+    int failures = 0;
+
+    FILE *file = fopen(GLTF_PATH, "wb");
+    if (!file || fwrite(GLTF, 1, sizeof(GLTF) - 1, file) != sizeof(GLTF) - 1) {
+        fprintf(stderr, "Error writing %s\n", GLTF_PATH);
+        if (file) fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    AT_Model *model = NULL;
+    if (AT_model_create(&model, GLTF_PATH) != AT_OK) {
+        fprintf(stderr, "Error loading %s\n", GLTF_PATH);
+        unlink(GLTF_PATH);
+        return 1;
+    }
+    unlink(GLTF_PATH);
+    failures += !check_materials(model, "glTF");
+
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{0.2f, 0.2f, 0}}
+    };
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+    AT_Scene *scene = NULL;
+    bool is_ok = AT_scene_create(&scene, &conf) == AT_OK &&
+                 scene->num_materials == model->material_count &&
+                 scene->reflectance[AT_MATERIAL_WOOD] == 1.0f - AT_MATERIAL_TABLE[AT_MATERIAL_WOOD].absorption &&
+                 scene->reflectance[AT_MATERIAL_COUNT] == 1.0f - 0.45f;
+    printf("scene    reflectance %s\n", is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_scene_destroy(scene);
+
+    AT_Model *compiled = NULL;
+    if (AT_scene_file_write(model, SCENE_PATH) != AT_OK || AT_model_create(&compiled, SCENE_PATH) != AT_OK) {
+        printf("compiled failed to round trip\n");
+        failures++;
+    } else {
+        failures += !check_materials(compiled, "compiled");
+    }
+    unlink(SCENE_PATH);
+
+    AT_model_destroy(compiled);
+    AT_model_destroy(model);
+    return failures ? 1 : 0;
+}
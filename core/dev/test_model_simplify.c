@@ -0,0 +1,126 @@
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Simplifies a finely tessellated shoebox with a concrete floor and
+// millimetre bumps, checks that the floor keeps its outline and area and
+// that a simplified run deposits about the same energy. Then reports the
+// reduction on the sample models at a 0.1 m voxel.
+
+#define GRID 24
+
+static double run_energy(const AT_Model *model, bool is_simplified, uint32_t *out_voxels)
+{
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{2, 1, 3}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Settings settings = {
+        .fps = 60,
+        .num_rays = 300,
+        .voxel_size = 0.1f,
+        .num_threads = 4,
+        .deposit_strategy = AT_DEPOSIT_DETERMINISTIC,
+        .is_simplified = is_simplified,
+    };
+
+    AT_Scene *scene = NULL;
+    AT_Simulation *sim = NULL;
+    double total = -1.0;
+    srand(7);
+    if (AT_scene_create(&scene, &conf) == AT_OK &&
+        AT_simulation_create(&sim, scene, &settings) == AT_OK &&
+        AT_simulation_run(sim) == AT_OK) {
+        total = 0.0;
+        for (uint32_t v = 0; v < sim->num_voxel_slots; v++) {
+            for (size_t b = 0; b < sim->voxel_grid[v].count; b++) total += sim->voxel_grid[v].items[b];
+        }
+        *out_voxels = sim->num_voxels;
+    }
+    AT_simulation_destroy(sim);
+    AT_scene_destroy(scene);
+    return total;
+}
+
+int main()
+{
+    int failures = 0;
+
+    AT_Vec3 size = AT_vec3(6.0f, 3.0f, 8.0f);
+    srand(1);
+    AT_Model *box = tessellated_box(size, GRID, 1e-3f, GRID);
+    double before[AT_MATERIAL_COUNT], after[AT_MATERIAL_COUNT];
+    area_per_material(before, box);
+
+    AT_Model *simplified = NULL;
+    AT_ModelSimplifyStats stats = {0};
+    float max_error = 0.1f * AT_SIMULATION_SIMPLIFY_VOXEL_FRACTION;
+    double start = now_seconds();
+    bool is_ok = AT_model_simplify(&simplified, box, max_error, &stats) == AT_OK;
+    double elapsed = now_seconds() - start;
+    if (is_ok) area_per_material(after, simplified);
+
+    AT_AABB aabb, simplified_aabb;
+    AT_model_to_AABB(&aabb, box);
+    if (is_ok) AT_model_to_AABB(&simplified_aabb, simplified);
+    is_ok = is_ok && stats.triangle_count * 20 < box->index_count / 3 &&
+            stats.max_error <= max_error && AT_vec3_distance(aabb.min, simplified_aabb.min) < 1e-3f &&
+            AT_vec3_distance(aabb.max, simplified_aabb.max) < 1e-3f;
+    for (int m = 0; m < AT_MATERIAL_COUNT && is_ok; m++) is_ok = fabs(before[m] - after[m]) <= 1e-3 * before[m] + 1e-3;
+    printf("box triangles %zu -> %zu vertices %zu -> %zu max error %.4f in %.3fs %s\n",
+           box->index_count / 3, stats.triangle_count, box->vertex_count, stats.vertex_count,
+           stats.max_error, elapsed, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_model_destroy(simplified);
+
+    //the surfaces move by at most a millimetre, so the field barely changes
+    uint32_t num_voxels = 0, simplified_voxels = 0;
+    double energy = run_energy(box, false, &num_voxels);
+    double simplified_energy = run_energy(box, true, &simplified_voxels);
+    is_ok = energy > 0.0 && num_voxels == simplified_voxels && fabs(energy - simplified_energy) <= 0.05 * energy;
+    printf("energy %.4f simplified %.4f %s\n", energy, simplified_energy, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_model_destroy(box);
+
+    const char *filepaths[] = {
+        "../assets/glb/L_room.gltf",
+        "../assets/glb/Sponza.gltf",
+    };
+    for (size_t f = 0; f < sizeof(filepaths) / sizeof(filepaths[0]); f++) {
+        AT_Model *model = NULL;
+        if (AT_model_create(&model, filepaths[f]) != AT_OK || AT_model_weld(model, 0.0f, NULL) != AT_OK) {
+            printf("%-28s failed to load\n", filepaths[f]);
+            AT_model_destroy(model);
+            failures++;
+            continue;
+        }
+        simplified = NULL;
+        start = now_seconds();
+        is_ok = AT_model_simplify(&simplified, model, max_error, &stats) == AT_OK;
+        elapsed = now_seconds() - start;
+        printf("%-28s triangles %zu -> %zu in %.3fs %s\n",
+               filepaths[f], model->index_count / 3, stats.triangle_count, elapsed, is_ok ? "ok" : "FAILED");
+        failures += !is_ok;
+        AT_model_destroy(simplified);
+        AT_model_destroy(model);
+    }
+
+    return failures ? 1 : 0;
+}
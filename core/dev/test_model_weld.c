@@ -0,0 +1,136 @@
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Welds a box whose faces carry their own jittered corners, plus a sliver
+// and a repeated triangle, and checks what was removed and that the area of
+// every material survives. Then welds the sample rooms and reports the stats.
+
+// 6 faces with 4 corners each, 12 triangles, then a sliver along the first
+// edge and a copy of the first triangle with another winding
+static AT_Model *box_with_seams(void)
+{
+    static const uint32_t faces[6][4] = {{0,1,3,2},{4,6,7,5},{0,4,5,1},{2,3,7,6},{0,2,6,4},{1,5,7,3}};
+    const size_t vertex_count = 24 + 3;
+    const size_t triangle_count = 12 + 2;
+
+    AT_Model *model = calloc(1, sizeof(AT_Model));
+    model->vertices = malloc(sizeof(AT_Vec3) * vertex_count);
+    model->normals = calloc(vertex_count, sizeof(AT_Vec3));
+    model->indices = malloc(sizeof(uint32_t) * triangle_count * 3);
+    model->triangle_materials = malloc(sizeof(AT_MaterialId) * triangle_count);
+    model->vertex_count = vertex_count;
+    model->index_count = triangle_count * 3;
+
+    srand(1);
+    for (uint32_t f = 0; f < 6; f++) {
+        for (uint32_t c = 0; c < 4; c++) {
+            uint32_t corner = faces[f][c];
+            float jitter = 2e-5f * ((float)rand() / RAND_MAX - 0.5f);
+            model->vertices[f * 4 + c] = AT_vec3((corner & 1) ? 10.0f : jitter,
+                                                 (corner & 2) ? 4.0f : jitter,
+                                                 (corner & 4) ? 8.0f : jitter);
+        }
+        uint32_t *quad = &model->indices[f * 6];
+        uint32_t base = f * 4;
+        quad[0] = base; quad[1] = base + 1; quad[2] = base + 2;
+        quad[3] = base; quad[4] = base + 2; quad[5] = base + 3;
+        model->triangle_materials[f * 2 + 0] = (f == 0) ? AT_MATERIAL_CONCRETE : AT_MATERIAL_PLASTIC;
+        model->triangle_materials[f * 2 + 1] = (f == 0) ? AT_MATERIAL_CONCRETE : AT_MATERIAL_PLASTIC;
+    }
+
+    model->vertices[24] = AT_vec3(0.0f, 0.0f, 0.0f);
+    model->vertices[25] = AT_vec3(10.0f, 0.0f, 0.0f);
+    model->vertices[26] = AT_vec3(5.0f, 5e-5f, 0.0f);
+    uint32_t *extra = &model->indices[12 * 3];
+    extra[0] = 24; extra[1] = 25; extra[2] = 26;
+    extra[3] = model->indices[1]; extra[4] = model->indices[2]; extra[5] = model->indices[0];
+    model->triangle_materials[12] = AT_MATERIAL_PLASTIC;
+    model->triangle_materials[13] = AT_MATERIAL_PLASTIC;
+    return model;
+}
+
+int main()
+{
+    int failures = 0;
+
+    AT_Model *box = box_with_seams();
+    double before[AT_MATERIAL_COUNT], after[AT_MATERIAL_COUNT];
+    area_per_material(before, box);
+
+    AT_ModelWeldStats stats = {0};
+    bool is_ok = AT_model_weld(box, 0.0f, &stats) == AT_OK;
+    area_per_material(after, box);
+    is_ok = is_ok && stats.welded_vertices == 18 && stats.unused_vertices == 1 &&
+            stats.degenerate_triangles == 1 && stats.duplicate_triangles == 1 &&
+            stats.vertex_count == 8 && stats.triangle_count == 12 &&
+            box->vertex_count == 8 && box->index_count == 36;
+    for (size_t i = 0; i < box->index_count && is_ok; i++) is_ok = box->indices[i] < box->vertex_count;
+    //the sliver adds no area, the duplicate doubles one triangle
+    before[AT_MATERIAL_PLASTIC] -= 0.5 * 10.0 * 4.0;
+    for (int m = 0; m < AT_MATERIAL_COUNT && is_ok; m++) is_ok = fabs(before[m] - after[m]) < 1e-2;
+    printf("box welded=%zu unused=%zu degenerate=%zu duplicate=%zu vertices=%zu triangles=%zu %s\n",
+           stats.welded_vertices, stats.unused_vertices, stats.degenerate_triangles, stats.duplicate_triangles,
+           stats.vertex_count, stats.triangle_count, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_model_destroy(box);
+
+    //the same box below the origin, its bounds also scale the weld's grid
+    box = box_with_seams();
+    for (size_t i = 0; i < box->vertex_count; i++) {
+        box->vertices[i] = AT_vec3_sub(box->vertices[i], AT_vec3(20.0f, 20.0f, 20.0f));
+    }
+    AT_AABB aabb = {0};
+    AT_model_to_AABB(&aabb, box);
+    is_ok = fabsf(aabb.max.x + 10.0f) < 1e-3f && fabsf(aabb.max.y + 16.0f) < 1e-3f && fabsf(aabb.max.z + 12.0f) < 1e-3f &&
+            fabsf(aabb.min.x + 20.0f) < 1e-3f && fabsf(aabb.min.y + 20.0f) < 1e-3f && fabsf(aabb.min.z + 20.0f) < 1e-3f;
+    stats = (AT_ModelWeldStats){0};
+    is_ok = is_ok && AT_model_weld(box, 0.0f, &stats) == AT_OK &&
+            stats.welded_vertices == 18 && stats.vertex_count == 8 && stats.triangle_count == 12;
+    printf("negative box max=(%.2f, %.2f, %.2f) vertices=%zu triangles=%zu %s\n",
+           aabb.max.x, aabb.max.y, aabb.max.z, stats.vertex_count, stats.triangle_count, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_model_destroy(box);
+
+    const char *filepaths[] = {
+        "../assets/glb/L_room.gltf",
+        "../assets/glb/Sponza.gltf",
+    };
+    for (size_t f = 0; f < sizeof(filepaths) / sizeof(filepaths[0]); f++) {
+        AT_Model *model = NULL;
+        if (AT_model_create(&model, filepaths[f]) != AT_OK) {
+            printf("%-28s failed to load\n", filepaths[f]);
+            failures++;
+            continue;
+        }
+        size_t triangle_count = model->index_count / 3;
+        area_per_material(before, model);
+
+        double start = now_seconds();
+        is_ok = AT_model_weld(model, AT_MODEL_WELD_TOLERANCE, &stats) == AT_OK;
+        double elapsed = now_seconds() - start;
+        area_per_material(after, model);
+
+        is_ok = is_ok && stats.triangle_count + stats.degenerate_triangles + stats.duplicate_triangles == triangle_count &&
+                stats.vertex_count == model->vertex_count && stats.triangle_count * 3 == model->index_count;
+        for (size_t i = 0; i < model->index_count && is_ok; i++) is_ok = model->indices[i] < model->vertex_count;
+        //without repeats only slivers go, which barely move the area
+        for (int m = 0; m < AT_MATERIAL_COUNT && is_ok && stats.duplicate_triangles == 0; m++) {
+            is_ok = fabs(before[m] - after[m]) <= 1e-3 * fmax(before[m], 1.0);
+        }
+        printf("%-28s welded=%zu unused=%zu degenerate=%zu duplicate=%zu vertices=%zu triangles=%zu in %.3fs %s\n",
+               filepaths[f], stats.welded_vertices, stats.unused_vertices, stats.degenerate_triangles,
+               stats.duplicate_triangles, stats.vertex_count, stats.triangle_count, elapsed, is_ok ? "ok" : "MISMATCH");
+        failures += !is_ok;
+        AT_model_destroy(model);
+    }
+
+    return failures ? 1 : 0;
+}
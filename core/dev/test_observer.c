@@ -0,0 +1,176 @@
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "../src/at_ray.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Voxelises only an observer area of a 10x4x8 shoebox and checks the
+// voxels it allocates, that every voxel of it holds the same energy as in
+// a run over the whole grid, and that no bin of either run goes negative.
+// A segment starting in the clip slack past a wall must not step
+// backwards, and a box that misses the model must be refused.
+
+#define VOXEL_SIZE 0.25f
+#define NUM_RAYS 500
+
+static AT_Simulation *run(const AT_Model *model, const AT_AABB *observer_area, AT_Scene **out_scene, AT_Result *out_res)
+{
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{3, 1.5f, 4}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_PLASTIC,
+        .num_sources = 1,
+        .sources = &source,
+        .observer_area = observer_area
+    };
+
+    AT_Settings settings = {
+        .fps = 60,
+        .num_rays = NUM_RAYS,
+        .voxel_size = VOXEL_SIZE,
+        .deposit_strategy = AT_DEPOSIT_DETERMINISTIC
+    };
+
+    *out_scene = NULL;
+    AT_Simulation *sim = NULL;
+    *out_res = AT_scene_create(out_scene, &conf);
+    if (*out_res != AT_OK) return NULL;
+
+    //same rays for every run
+    srand(1);
+    *out_res = AT_simulation_create(&sim, *out_scene, &settings);
+    if (*out_res == AT_OK) *out_res = AT_simulation_run(sim);
+    if (*out_res != AT_OK) {
+        AT_simulation_destroy(sim);
+        AT_scene_destroy(*out_scene);
+        *out_scene = NULL;
+        return NULL;
+    }
+    return sim;
+}
+
+static float min_bin(const AT_Simulation *sim)
+{
+    float lowest = 0.0f;
+    for (uint32_t v = 0; v < sim->num_voxel_slots; v++) {
+        for (size_t b = 0; b < sim->voxel_grid[v].count; b++) lowest = fminf(lowest, sim->voxel_grid[v].items[b]);
+    }
+    return lowest;
+}
+
+// Largest difference between a voxel of the area and the same voxel of the
+// full grid, relative to the largest bin of the full grid
+static double max_error(const AT_Simulation *area, const AT_Simulation *full)
+{
+    int offset[3];
+    for (int axis = 0; axis < 3; axis++) {
+        offset[axis] = (int)lroundf((area->origin.arr[axis] - full->origin.arr[axis]) / VOXEL_SIZE);
+    }
+
+    double largest = 0.0;
+    for (uint32_t v = 0; v < full->num_voxel_slots; v++) {
+        for (size_t b = 0; b < full->voxel_grid[v].count; b++) largest = fmax(largest, full->voxel_grid[v].items[b]);
+    }
+
+    double error = 0.0;
+    for (int z = 0; z < (int)area->grid_dimensions.z; z++) {
+        for (int y = 0; y < (int)area->grid_dimensions.y; y++) {
+            for (int x = 0; x < (int)area->grid_dimensions.x; x++) {
+                const AT_Voxel *a = &area->voxel_grid[AT_voxel_index(area, x, y, z)];
+                const AT_Voxel *f = &full->voxel_grid[AT_voxel_index(full, x + offset[0], y + offset[1], z + offset[2])];
+                size_t count = (a->count > f->count) ? a->count : f->count;
+                for (size_t b = 0; b < count; b++) {
+                    double va = (b < a->count) ? a->items[b] : 0.0;
+                    double vf = (b < f->count) ? f->items[b] : 0.0;
+                    error = fmax(error, fabs(va - vf));
+                }
+            }
+        }
+    }
+    return largest > 0.0 ? error / largest : error;
+}
+
+int main()
+{
+    int failures = 0;
+
+    AT_Model *box = tessellated_box(AT_vec3(10.0f, 4.0f, 8.0f), 1, 0.0f, 0);
+
+    AT_Scene *full_scene = NULL;
+    AT_Result res = AT_OK;
+    AT_Simulation *full = run(box, NULL, &full_scene, &res);
+    if (!full) {
+        fprintf(stderr, "Error running the full grid\n");
+        AT_model_destroy(box);
+        return 1;
+    }
+    bool is_ok = full->num_voxels == 40 * 16 * 32 && min_bin(full) >= 0.0f;
+    printf("full voxels=%u lowest bin %g %s\n", full->num_voxels, min_bin(full), is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+
+    //a hit point rounded just past the far wall, heading on out of the grid
+    float past_wall = 10.0f + 0.5f * AT_VOXEL_CLIP_EPSILON * VOXEL_SIZE;
+    AT_Ray ray = AT_ray_init(AT_vec3(past_wall, 2.0f, 4.0f), AT_vec3(1.0f, 0.0f, 1.0f), 0.0f, 1.0f, 0);
+    AT_VoxelSegment segment = {0};
+    is_ok = true;
+    if (AT_voxel_segment_init(full, &ray, AT_ray_at(&ray, 5.0f), &segment)) {
+        for (int axis = 0; axis < 3; axis++) is_ok = is_ok && segment.t_max[axis] >= 0.0f;
+    }
+    printf("slack start t_max=(%g, %g, %g) %s\n",
+           segment.t_max[0], segment.t_max[1], segment.t_max[2], is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+
+    //touches the floor, the rest is inside the room
+    AT_AABB inner = {.min = {{2.0f, 0.0f, 1.0f}}, .max = {{7.0f, 1.5f, 6.0f}}};
+    AT_Scene *area_scene = NULL;
+    AT_Simulation *area = run(box, &inner, &area_scene, &res);
+    is_ok = area && area->num_voxels == 20 * 6 * 20 && min_bin(area) >= 0.0f;
+    double error = is_ok ? max_error(area, full) : 1.0;
+    is_ok = is_ok && error < 1e-5;
+    printf("area voxels=%u of %u max error %.2e %s\n",
+           area ? area->num_voxels : 0, full->num_voxels, error, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_simulation_destroy(area);
+    AT_scene_destroy(area_scene);
+
+    //reaches past the walls, clipped to the model
+    AT_AABB outside = {.min = {{-5.0f, -1.0f, 4.0f}}, .max = {{3.0f, 9.0f, 20.0f}}};
+    area = run(box, &outside, &area_scene, &res);
+    is_ok = area && area->num_voxels == 12 * 16 * 16 && min_bin(area) >= 0.0f;
+    error = is_ok ? max_error(area, full) : 1.0;
+    is_ok = is_ok && error < 1e-5;
+    printf("clipped voxels=%u of %u max error %.2e %s\n",
+           area ? area->num_voxels : 0, full->num_voxels, error, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_simulation_destroy(area);
+    AT_scene_destroy(area_scene);
+
+    AT_AABB missing = {.min = {{11.0f, 0.0f, 0.0f}}, .max = {{12.0f, 1.0f, 1.0f}}};
+    area = run(box, &missing, &area_scene, &res);
+    is_ok = !area && res == AT_ERR_INVALID_ARGUMENT;
+    printf("missing box %s\n", is_ok ? "refused ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_simulation_destroy(area);
+
+    AT_simulation_destroy(full);
+    AT_scene_destroy(full_scene);
+    AT_model_destroy(box);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
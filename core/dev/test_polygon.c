@@ -0,0 +1,120 @@
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "../src/at_polygon.h"
+#include "../src/at_ray.h"
+#include "test_helpers.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Merges a tessellated shoebox whose floor is half concrete into polygons,
+// expecting one per wall plus two for the floor, and checks that random
+// rays from inside hit the same point and material as with the triangles.
+// Then reports the merge on the sample models.
+
+#define GRID 8
+#define NUM_RAYS 20000
+
+// Nearest hit against the triangles and the polygons of the same model
+static bool compare_rays(const AT_Triangle *triangles, const AT_MaterialId *materials, uint32_t count,
+                         const AT_PolygonSet *set, AT_Vec3 size)
+{
+    uint32_t mismatches = 0;
+    for (uint32_t r = 0; r < NUM_RAYS; r++) {
+        AT_Vec3 origin = AT_vec3(size.x * (0.05f + 0.9f * random_unit()),
+                                 size.y * (0.05f + 0.9f * random_unit()),
+                                 size.z * (0.05f + 0.9f * random_unit()));
+        AT_Vec3 direction = AT_vec3(random_unit() - 0.5f, random_unit() - 0.5f, random_unit() - 0.5f);
+        AT_Ray ray = AT_ray_init(origin, direction, 0.0f, 1.0f, r);
+
+        AT_Ray by_triangle = AT_ray_init(AT_vec3(FLT_MAX, FLT_MAX, FLT_MAX), AT_vec3(0, 0, 0), 0.0f, 1.0f, r);
+        AT_Ray by_polygon = by_triangle;
+        uint32_t triangle_material = UINT32_MAX, polygon_material = UINT32_MAX;
+        for (uint32_t t = 0; t < count; t++) {
+            AT_Vec3 nearest = by_triangle.origin;
+            if (AT_ray_triangle_intersect(&ray, &triangles[t], &by_triangle) &&
+                memcmp(&nearest, &by_triangle.origin, sizeof(nearest)) != 0) {
+                triangle_material = materials[t];
+            }
+        }
+        for (uint32_t p = 0; p < set->num_polygons; p++) {
+            AT_Vec3 nearest = by_polygon.origin;
+            if (AT_ray_polygon_intersect(&ray, set, p, &by_polygon) &&
+                memcmp(&nearest, &by_polygon.origin, sizeof(nearest)) != 0) {
+                polygon_material = set->polygons[p].material;
+            }
+        }
+
+        bool is_same = AT_vec3_distance(by_triangle.origin, by_polygon.origin) < 1e-3f &&
+                       AT_vec3_distance(by_triangle.direction, by_polygon.direction) < 1e-3f;
+        //a hit on the seam between two materials may land on either
+        bool is_seam = fabsf(by_triangle.origin.y) < 1e-3f && fabsf(by_triangle.origin.x - size.x / 2) < 1e-3f;
+        if (!is_same || (triangle_material != polygon_material && !is_seam)) mismatches++;
+    }
+    if (mismatches) printf("%u of %u rays differ\n", mismatches, NUM_RAYS);
+    return mismatches == 0;
+}
+
+int main()
+{
+    int failures = 0;
+    srand(1);
+
+    AT_Vec3 size = AT_vec3(6.0f, 3.0f, 8.0f);
+    AT_Model *box = tessellated_box(size, GRID, 0.0f, GRID / 2);
+    uint32_t count = (uint32_t)(box->index_count / 3);
+    AT_Triangle *triangles = NULL;
+    if (AT_model_get_triangles(&triangles, box) != AT_OK) {
+        fprintf(stderr, "Error building triangles\n");
+        return 1;
+    }
+
+    AT_PolygonSet set = {0};
+    double start = now_seconds();
+    bool is_ok = AT_polygon_set_create(&set, triangles, box->triangle_materials, count) == AT_OK;
+    double elapsed = now_seconds() - start;
+    is_ok = is_ok && set.num_polygons == 7 && set.num_edges == 7 * 4;
+    printf("box triangles=%u polygons=%u edges=%u in %.4fs %s\n",
+           count, set.num_polygons, set.num_edges, elapsed, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+
+    is_ok = compare_rays(triangles, box->triangle_materials, count, &set, size);
+    printf("box rays %s\n", is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_polygon_set_destroy(&set);
+    free(triangles);
+    AT_model_destroy(box);
+
+    const char *filepaths[] = {
+        "../assets/glb/box_room.gltf",
+        "../assets/glb/L_room.gltf",
+        "../assets/glb/Sponza.gltf",
+    };
+    for (size_t f = 0; f < sizeof(filepaths) / sizeof(filepaths[0]); f++) {
+        AT_Model *model = NULL;
+        triangles = NULL;
+        if (AT_model_create(&model, filepaths[f]) != AT_OK || AT_model_get_triangles(&triangles, model) != AT_OK) {
+            printf("%-28s failed to load\n", filepaths[f]);
+            AT_model_destroy(model);
+            failures++;
+            continue;
+        }
+        count = (uint32_t)(model->index_count / 3);
+        start = now_seconds();
+        is_ok = AT_polygon_set_create(&set, triangles, model->triangle_materials, count) == AT_OK;
+        elapsed = now_seconds() - start;
+        printf("%-28s triangles=%u polygons=%u edges=%u in %.4fs %s\n",
+               filepaths[f], count, set.num_polygons, set.num_edges, elapsed, is_ok ? "ok" : "FAILED");
+        failures += !is_ok;
+        AT_polygon_set_destroy(&set);
+        free(triangles);
+        AT_model_destroy(model);
+    }
+
+    return failures ? 1 : 0;
+}
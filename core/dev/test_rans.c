@@ -0,0 +1,212 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "acoustic/at_replay.h"
+#include "../src/at_rans.h"
+#include "test_helpers.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Round trips the rANS coder on synthetic blocks, then compresses the
+// replay chunks of the sample rooms, reporting ratio and throughput next
+// to the plain chunks and checking that a truncated chunk is rejected
+
+#define NUM_REPEATS 20
+#define BLOCK_SIZE (1u << 20)
+
+// Returns false if the block does not survive the round trip, or comes
+// out in another mode than expected
+static bool check_block(const uint8_t *src, size_t size, uint8_t mode, const char *name)
+{
+    size_t coded_size = AT_rans_bound(size);
+    uint8_t *coded = malloc(coded_size);
+    uint8_t *decoded = malloc(size ? size : 1);
+    bool is_ok = coded && decoded &&
+                 AT_rans_compress(coded, &coded_size, src, size) == AT_OK && coded[0] == mode &&
+                 AT_rans_decompress(decoded, size, coded, coded_size) == AT_OK &&
+                 memcmp(decoded, src, size) == 0;
+    //a block cut short never decodes
+    if (is_ok && coded_size > 1) is_ok = AT_rans_decompress(decoded, size, coded, coded_size - 1) != AT_OK;
+
+    printf("  %-9s %8zu -> %8zu bytes %s\n", name, size, coded_size, is_ok ? "ok" : "FAILED");
+    free(coded);
+    free(decoded);
+    return is_ok;
+}
+
+static bool check_blocks(void)
+{
+    uint8_t *block = malloc(BLOCK_SIZE);
+    if (!block) return false;
+
+    srand(1);
+    bool is_ok = check_block(block, 0, AT_RANS_STORED, "empty");
+
+    memset(block, 7, BLOCK_SIZE);
+    is_ok = check_block(block, BLOCK_SIZE, AT_RANS_CODED, "constant") && is_ok;
+
+    for (size_t i = 0; i < BLOCK_SIZE; i++) block[i] = (uint8_t)rand();
+    is_ok = check_block(block, BLOCK_SIZE, AT_RANS_STORED, "uniform") && is_ok;
+
+    //mostly small values with a uniform tail, like the high bytes of a frame
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        int r = rand() % 100;
+        block[i] = (uint8_t)((r < 60) ? 0 : (r < 85) ? 1 : (r < 95) ? 2 + rand() % 4 : rand());
+    }
+    is_ok = check_block(block, BLOCK_SIZE, AT_RANS_CODED, "skewed") && is_ok;
+    is_ok = check_block(block, BLOCK_SIZE - 1, AT_RANS_CODED, "odd") && is_ok;
+    is_ok = check_block(block, 5, AT_RANS_STORED, "short") && is_ok;
+
+    free(block);
+    return is_ok;
+}
+
+// Returns false if a chunk does not survive the round trip
+static bool bench_chunks(const AT_Simulation *sim, const AT_ReplaySettings *replay_settings, const char *name)
+{
+    AT_ReplaySettings compressed_settings = *replay_settings;
+    compressed_settings.is_compressed = true;
+
+    size_t plain_bytes = 0;
+    size_t compressed_bytes = 0;
+    double plain_time = 0.0;
+    double compress_time = 0.0;
+    double decompress_time = 0.0;
+
+    uint32_t num_chunks = AT_replay_chunk_count(sim, replay_settings);
+    for (uint32_t c = 0; c < num_chunks; c++) {
+        uint8_t *data = NULL;
+        size_t size = 0;
+        uint8_t *compressed = NULL;
+        size_t compressed_size = 0;
+        uint8_t *decompressed = NULL;
+        size_t decompressed_size = 0;
+        AT_Result res = AT_OK;
+
+        double start = now_seconds();
+        for (int r = 0; r < NUM_REPEATS && res == AT_OK; r++) {
+            free(data);
+            data = NULL;
+            res = AT_replay_encode_chunk(&data, &size, sim, replay_settings, c);
+        }
+        plain_time += now_seconds() - start;
+
+        start = now_seconds();
+        for (int r = 0; r < NUM_REPEATS && res == AT_OK; r++) {
+            free(compressed);
+            compressed = NULL;
+            res = AT_replay_encode_chunk(&compressed, &compressed_size, sim, &compressed_settings, c);
+        }
+        compress_time += now_seconds() - start;
+
+        start = now_seconds();
+        for (int r = 0; r < NUM_REPEATS && res == AT_OK; r++) {
+            free(decompressed);
+            decompressed = NULL;
+            res = AT_replay_decompress_chunk(&decompressed, &decompressed_size, compressed, compressed_size);
+        }
+        decompress_time += now_seconds() - start;
+
+        bool is_same = res == AT_OK && decompressed_size == size && memcmp(decompressed, data, size) == 0;
+
+        //a compressed chunk cut short is rejected, not decoded into garbage
+        AT_ReplayChunkInfo info;
+        if (is_same && AT_replay_read_chunk_info(&info, compressed, compressed_size) == AT_OK &&
+            (info.flags & AT_REPLAY_FLAG_COMPRESSED)) {
+            uint8_t *copy = NULL;
+            size_t copy_size = 0;
+            is_same = AT_replay_decompress_chunk(&copy, &copy_size, compressed, compressed_size - 1) != AT_OK;
+            free(copy);
+        }
+
+        plain_bytes += size;
+        compressed_bytes += compressed_size;
+        free(data);
+        free(compressed);
+        free(decompressed);
+        if (!is_same) return false;
+    }
+
+    //encoding time spent on the shuffle and coder, on top of the plain encode
+    double megabytes = (double)plain_bytes * NUM_REPEATS / 1e6;
+    double code_time = compress_time - plain_time;
+    printf("  %-9s %9zu -> %9zu bytes ratio=%.2fx compress=%.0fMB/s decompress=%.0fMB/s\n",
+           name, plain_bytes, compressed_bytes, (double)plain_bytes / compressed_bytes,
+           (code_time > 0.0) ? megabytes / code_time : 0.0, megabytes / decompress_time);
+    return true;
+}
+
+int main()
+{
+    printf("blocks\n");
+    if (!check_blocks()) {
+        fprintf(stderr, "Block round trip failed\n");
+        return 1;
+    }
+
+    const char *rooms[] = {
+        "../assets/glb/box_room.gltf",
+        "../assets/glb/L_room.gltf",
+        "../assets/glb/polygon_room.gltf",
+    };
+
+    const char *names[] = {"raw", "quantised", "delta"};
+    AT_ReplaySettings replay_settings[] = {
+        {0},
+        {.encoding = AT_REPLAY_ENCODING_QUANTISED},
+        {.encoding = AT_REPLAY_ENCODING_QUANTISED, .keyframe_interval = 8, .delta_tolerance = 1e-4f},
+    };
+
+    for (size_t r = 0; r < sizeof(rooms) / sizeof(rooms[0]); r++) {
+        AT_Model *model = NULL;
+        if (AT_model_create(&model, rooms[r]) != AT_OK) {
+            fprintf(stderr, "Error creating model %s\n", rooms[r]);
+            continue;
+        }
+
+        AT_Source source = {
+            .direction = {{1, 0, 0}},
+            .intensity = 50.0,
+            .position = {{0, 1, 0}}
+        };
+
+        AT_SceneConfig conf = {
+            .environment = model,
+            .material = AT_MATERIAL_CONCRETE,
+            .num_sources = 1,
+            .sources = &source
+        };
+
+        AT_Scene *scene = NULL;
+        if (AT_scene_create(&scene, &conf) != AT_OK) {
+            fprintf(stderr, "Error creating scene\n");
+            AT_model_destroy(model);
+            continue;
+        }
+
+        AT_Settings settings = {
+            .fps = 60,
+            .num_rays = 1000,
+            .voxel_size = 0.1f
+        };
+
+        AT_Simulation *sim = NULL;
+        if (AT_simulation_create(&sim, scene, &settings) == AT_OK && AT_simulation_run(sim) == AT_OK) {
+            printf("%s\n", rooms[r]);
+            for (size_t i = 0; i < sizeof(replay_settings) / sizeof(replay_settings[0]); i++) {
+                if (!bench_chunks(sim, &replay_settings[i], names[i])) {
+                    fprintf(stderr, "Round trip failed\n");
+                    return 1;
+                }
+            }
+        }
+
+        AT_simulation_destroy(sim);
+        AT_scene_destroy(scene);
+        AT_model_destroy(model);
+    }
+
+    return 0;
+}
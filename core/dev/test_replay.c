@@ -0,0 +1,326 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "acoustic/at_replay.h"
+#include "acoustic/at_result_file.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "../../backend/net/at_net.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Writes a replay of the sample room, reads every chunk back against the
+// voxel grid and compares size and time of the raw, quantised and delta
+// coded chunks with the cJSON exporter and the streamed JSON, then reads
+// the frames of a result file back in reverse order and queries its
+// voxel time series
+
+static uint32_t read_u32(const uint8_t *src)
+{
+    return (uint32_t)src[0] | (uint32_t)src[1] << 8 | (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+static float read_f32(const uint8_t *src)
+{
+    uint32_t bits = read_u32(src);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Decodes every frame back to a dense field and checks it against the voxel
+// grid. Returns the number of non-zero voxels seen, or -1 on a mismatch.
+static long check_chunk(const AT_Simulation *sim, const AT_ReplaySettings *replay_settings,
+                        const uint8_t *data, size_t size)
+{
+    AT_ReplayChunkInfo info;
+    if (AT_replay_read_chunk_info(&info, data, size) != AT_OK) return -1;
+
+    float chunk_max = 0.0f;
+    for (uint32_t f = 0; f < info.frame_count; f++) {
+        chunk_max = fmaxf(chunk_max, read_f32(data + AT_REPLAY_HEADER_SIZE + f * AT_REPLAY_DIRECTORY_ENTRY_SIZE + 8));
+    }
+
+    //quantisation, the threshold and the delta tolerance bound the error
+    float tolerance = replay_settings->threshold + replay_settings->delta_tolerance;
+    if (info.encoding == AT_REPLAY_ENCODING_QUANTISED) tolerance += chunk_max / 65535.0f;
+    tolerance += chunk_max * 1e-6f;
+
+    float *values = malloc(sizeof(float) * info.num_voxels);
+    if (!values) return -1;
+
+    long num_pairs = 0;
+    for (uint32_t f = 0; f < info.frame_count; f++) {
+        if (AT_replay_decode_frame(values, data, size, f) != AT_OK) {
+            free(values);
+            return -1;
+        }
+
+        for (uint32_t v = 0; v < info.num_voxels; v++) {
+            const AT_Voxel *voxel = &sim->voxel_grid[AT_voxel_index_from_linear(sim, v)];
+            float expected = (info.start_frame + f < voxel->count) ? voxel->items[info.start_frame + f] : 0.0f;
+            if (fabsf(values[v] - expected) > tolerance) {
+                free(values);
+                return -1;
+            }
+            num_pairs += values[v] != 0.0f;
+        }
+    }
+
+    free(values);
+    return num_pairs;
+}
+
+// Writes a result file, maps it and checks every frame against the voxel
+// grid, last frame first. Returns the number of pairs seen, or -1.
+static long check_result_file(const AT_Simulation *sim, const AT_ReplaySettings *replay_settings, const char *path)
+{
+    if (AT_result_write(sim, replay_settings, path) != AT_OK) return -1;
+
+    AT_ResultFile *file = NULL;
+    if (AT_result_open(&file, path) != AT_OK) return -1;
+
+    const AT_ResultInfo *info = AT_result_info(file);
+    float *values = malloc(sizeof(float) * info->num_voxels);
+    long num_pairs = (info->frame_count == AT_replay_frame_count(sim) && values) ? 0 : -1;
+
+    for (uint32_t i = 0; i < info->frame_count && num_pairs >= 0; i++) {
+        uint32_t f = info->frame_count - 1 - i;
+        AT_ResultFrame frame;
+        if (AT_result_get_frame(&frame, file, f) != AT_OK || AT_result_decode_frame(values, file, f) != AT_OK) {
+            num_pairs = -1;
+            break;
+        }
+
+        float tolerance = replay_settings->threshold + frame.max * 1e-6f;
+        if (info->encoding == AT_REPLAY_ENCODING_QUANTISED) tolerance += frame.max / 65535.0f;
+
+        uint32_t active_count = 0;
+        for (uint32_t v = 0; v < info->num_voxels; v++) {
+            const AT_Voxel *voxel = &sim->voxel_grid[AT_voxel_index_from_linear(sim, v)];
+            float expected = (f < voxel->count) ? voxel->items[f] : 0.0f;
+            if (fabsf(values[v] - expected) > tolerance) {
+                num_pairs = -1;
+                break;
+            }
+            active_count += values[v] != 0.0f;
+        }
+        if (active_count > frame.active_count) num_pairs = -1;
+        if (num_pairs >= 0) num_pairs += active_count;
+    }
+
+    free(values);
+    AT_result_close(file);
+    return num_pairs;
+}
+
+// Checks point and box queries against fully decoded frames, the points
+// spread along the grid diagonal and the box one metre around its centre
+static bool check_result_query(const char *path)
+{
+    AT_ResultFile *file = NULL;
+    if (AT_result_open(&file, path) != AT_OK) return false;
+    const AT_ResultInfo *info = AT_result_info(file);
+
+    AT_Vec3 size = AT_vec3(info->grid[0] * info->voxel_size, info->grid[1] * info->voxel_size, info->grid[2] * info->voxel_size);
+    AT_Vec3 points[8];
+    for (uint32_t i = 0; i < 8; i++) {
+        points[i] = AT_vec3_add(info->origin, AT_vec3_scale(size, (i + 0.5f) / 8.0f));
+    }
+    AT_Vec3 centre = AT_vec3_add(info->origin, AT_vec3_scale(size, 0.5f));
+    AT_AABB box = {
+        .min = AT_vec3_sub(centre, AT_vec3(0.5f, 0.5f, 0.5f)),
+        .max = AT_vec3_add(centre, AT_vec3(0.5f, 0.5f, 0.5f)),
+    };
+
+    double start = now_seconds();
+    AT_ResultSeries point_series = {0};
+    AT_ResultSeries box_series = {0};
+    bool is_ok = AT_result_query_points(&point_series, file, points, 8) == AT_OK &&
+                 AT_result_query_aabb(&box_series, file, box) == AT_OK;
+    double query_time = now_seconds() - start;
+
+    float *values = malloc(sizeof(float) * info->num_voxels);
+    if (!values) is_ok = false;
+    for (uint32_t f = 0; f < info->frame_count && is_ok; f++) {
+        if (AT_result_decode_frame(values, file, f) != AT_OK) is_ok = false;
+        for (uint32_t i = 0; i < point_series.num_series && is_ok; i++) {
+            is_ok = point_series.values[(size_t)i * info->frame_count + f] == values[point_series.voxels[i]];
+        }
+        for (uint32_t i = 0; i < box_series.num_series && is_ok; i++) {
+            is_ok = box_series.values[(size_t)i * info->frame_count + f] == values[box_series.voxels[i]];
+        }
+    }
+    if (is_ok) printf("query      8 points + %u box voxels %.3fms\n", box_series.num_series, query_time * 1e3);
+
+    free(values);
+    AT_result_series_destroy(&point_series);
+    AT_result_series_destroy(&box_series);
+    AT_result_close(file);
+    return is_ok;
+}
+
+typedef struct {
+    const char *expected;
+    size_t expected_size;
+    size_t offset;
+} JsonCompare;
+
+static bool compare_json(void *ctx, const char *data, size_t size)
+{
+    JsonCompare *compare = ctx;
+    if (size > compare->expected_size - compare->offset) return false;
+    if (memcmp(compare->expected + compare->offset, data, size) != 0) return false;
+    compare->offset += size;
+    return true;
+}
+
+// Encodes and checks every chunk, returns the total size or 0 on failure
+static size_t encode_replay(const AT_Simulation *sim, const AT_ReplaySettings *replay_settings,
+                            long *out_pairs, double *out_time)
+{
+    uint32_t num_chunks = AT_replay_chunk_count(sim, replay_settings);
+
+    double start = now_seconds();
+    size_t replay_bytes = 0;
+    *out_pairs = 0;
+    for (uint32_t c = 0; c < num_chunks; c++) {
+        uint8_t *data = NULL;
+        size_t size = 0;
+        if (AT_replay_encode_chunk(&data, &size, sim, replay_settings, c) != AT_OK) {
+            fprintf(stderr, "Error encoding chunk %u\n", c);
+            return 0;
+        }
+        replay_bytes += size;
+
+        uint8_t *chunk = NULL;
+        size_t chunk_size = 0;
+        long checked = -1;
+        if (AT_replay_decompress_chunk(&chunk, &chunk_size, data, size) == AT_OK) {
+            checked = check_chunk(sim, replay_settings, chunk, chunk_size);
+            free(chunk);
+        }
+        free(data);
+        if (checked < 0) {
+            fprintf(stderr, "Chunk %u does not match the voxel grid\n", c);
+            return 0;
+        }
+        *out_pairs += checked;
+    }
+    *out_time = now_seconds() - start;
+    return replay_bytes;
+}
+
+int main()
+{
+    const char *filepath = "../assets/glb/L_room.gltf";
+
+    AT_Model *model = NULL;
+    if (AT_model_create(&model, filepath) != AT_OK) {
+        fprintf(stderr, "Error creating model\n");
+        return 1;
+    }
+
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{0, 1, 0}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Scene *scene = NULL;
+    if (AT_scene_create(&scene, &conf) != AT_OK) {
+        fprintf(stderr, "Error creating scene\n");
+        return 1;
+    }
+
+    AT_Settings settings = {
+        .fps = 60,
+        .num_rays = 1000,
+        .voxel_size = 0.1f
+    };
+
+    AT_Simulation *sim = NULL;
+    if (AT_simulation_create(&sim, scene, &settings) != AT_OK) {
+        fprintf(stderr, "Error creating simulation\n");
+        return 1;
+    }
+
+    if (AT_simulation_run(sim) != AT_OK) {
+        fprintf(stderr, "Error running simulation\n");
+        return 1;
+    }
+
+    const char *names[] = {"raw", "quantised", "delta", "delta+rans"};
+    AT_ReplaySettings replay_settings[] = {
+        {0},
+        {.encoding = AT_REPLAY_ENCODING_QUANTISED},
+        {.encoding = AT_REPLAY_ENCODING_QUANTISED, .keyframe_interval = 8, .delta_tolerance = 1e-4f},
+        {.encoding = AT_REPLAY_ENCODING_QUANTISED, .keyframe_interval = 8, .delta_tolerance = 1e-4f, .is_compressed = true},
+    };
+
+    printf("voxels=%u frames=%u chunks=%u\n",
+           sim->num_voxels, AT_replay_frame_count(sim), AT_replay_chunk_count(sim, NULL));
+
+    size_t raw_bytes = 0;
+    for (size_t i = 0; i < sizeof(replay_settings) / sizeof(replay_settings[0]); i++) {
+        long num_pairs;
+        double replay_time;
+        size_t replay_bytes = encode_replay(sim, &replay_settings[i], &num_pairs, &replay_time);
+        if (replay_bytes == 0) return 1;
+        if (i == 0) raw_bytes = replay_bytes;
+
+        printf("%-9s  %zu bytes %.3fs (encode + check) pairs=%ld %.2fx smaller\n",
+               names[i], replay_bytes, replay_time, num_pairs, (double)raw_bytes / replay_bytes);
+    }
+
+    double start = now_seconds();
+    long result_pairs = check_result_file(sim, &replay_settings[1], "result_out.atr");
+    if (result_pairs < 0) {
+        fprintf(stderr, "Result file does not match the voxel grid\n");
+        return 1;
+    }
+    printf("result     pairs=%ld %.3fs (write + reverse read)\n", result_pairs, now_seconds() - start);
+    if (!check_result_query("result_out.atr")) {
+        fprintf(stderr, "Result query does not match the decoded frames\n");
+        return 1;
+    }
+
+    start = now_seconds();
+    cJSON *json = NULL;
+    AT_simulation_to_json(&json, sim);
+    char *json_string = cJSON_PrintUnformatted(json);
+    double json_time = now_seconds() - start;
+    printf("json       %zu bytes %.3fs\n", strlen(json_string), json_time);
+
+    //the streamed JSON has to match the cJSON output byte for byte
+    JsonCompare compare = {.expected = json_string, .expected_size = strlen(json_string)};
+    start = now_seconds();
+    if (AT_simulation_write_json(sim, compare_json, &compare) != AT_OK || compare.offset != compare.expected_size) {
+        fprintf(stderr, "Streamed JSON differs from cJSON at byte %zu\n", compare.offset);
+        return 1;
+    }
+    printf("streamed   %zu bytes %.3fs\n", compare.offset, now_seconds() - start);
+
+    if (AT_replay_write(sim, &replay_settings[3], "replay_out") != AT_OK) {
+        fprintf(stderr, "Error writing replay\n");
+        return 1;
+    }
+
+    free(json_string);
+    cJSON_Delete(json);
+    AT_simulation_destroy(sim);
+    AT_scene_destroy(scene);
+    AT_model_destroy(model);
+    return 0;
+}
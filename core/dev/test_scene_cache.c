@@ -0,0 +1,141 @@
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "../src/at_scene_cache.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Runs several simulations of one L-shaped room, one after another and all
+// at once. Every run must trace the scene's own polygons or the one
+// simplified set built for its voxel size, and concurrent runs must agree
+// with the sequential ones on how many rays reach the walls.
+
+#define NUM_RUNS 4
+
+typedef struct {
+    const AT_Scene *scene;
+    bool is_simplified;
+    AT_Result result;
+    uint32_t num_rays_hit; //rays with at least one bounce
+} RunJob;
+
+static void *run_simulation(void *arg)
+{
+    RunJob *job = arg;
+    AT_Settings settings = {
+        .fps = 60,
+        .num_rays = 300,
+        .voxel_size = 0.1f,
+        .num_threads = 2,
+        .deposit_strategy = AT_DEPOSIT_DETERMINISTIC,
+        .is_simplified = job->is_simplified,
+    };
+
+    AT_Simulation *sim = NULL;
+    job->result = AT_simulation_create(&sim, job->scene, &settings);
+    if (job->result == AT_OK) job->result = AT_simulation_run(sim);
+    job->num_rays_hit = 0;
+    for (uint32_t r = 0; job->result == AT_OK && r < sim->num_rays; r++) {
+        job->num_rays_hit += sim->rays[r].child != NULL;
+    }
+    AT_simulation_destroy(sim);
+    return NULL;
+}
+
+typedef struct {
+    AT_Scene *scene;
+    const AT_PolygonSet *polygons;
+} CacheJob;
+
+static void *get_cached(void *arg)
+{
+    CacheJob *job = arg;
+    float max_error = 0.1f * AT_SIMULATION_SIMPLIFY_VOXEL_FRACTION;
+    if (AT_scene_cache_get(&job->polygons, job->scene->cache, job->scene->environment, max_error) != AT_OK) {
+        job->polygons = NULL;
+    }
+    return NULL;
+}
+
+int main()
+{
+    int failures = 0;
+
+    static const float l_outline[6][2] = {{0, 0}, {0, 8}, {3, 8}, {3, 3}, {6, 3}, {6, 0}};
+    AT_Model *model = prism(l_outline, 6, 3.0f, 0);
+
+    AT_Source source = {
+        .direction = {{1, 0.2f, 0.3f}},
+        .intensity = 50.0,
+        .position = {{1, 1, 1}}
+    };
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Scene *scene = NULL;
+    double start = now_seconds();
+    if (AT_scene_create(&scene, &conf) != AT_OK) {
+        fprintf(stderr, "Error creating scene\n");
+        return 1;
+    }
+    printf("scene polygons=%u convex planes=%u in %.4fs\n",
+           scene->polygons.num_polygons, scene->convex_room.num_planes, now_seconds() - start);
+
+    //every thread gets the one set built for the error
+    pthread_t threads[NUM_RUNS];
+    CacheJob cache_jobs[NUM_RUNS];
+    for (int i = 0; i < NUM_RUNS; i++) {
+        cache_jobs[i] = (CacheJob){.scene = scene};
+        pthread_create(&threads[i], NULL, get_cached, &cache_jobs[i]);
+    }
+    for (int i = 0; i < NUM_RUNS; i++) pthread_join(threads[i], NULL);
+    bool is_ok = cache_jobs[0].polygons != NULL && cache_jobs[0].polygons != &scene->polygons;
+    for (int i = 1; i < NUM_RUNS; i++) is_ok = is_ok && cache_jobs[i].polygons == cache_jobs[0].polygons;
+
+    const AT_PolygonSet *other = NULL;
+    is_ok = is_ok && AT_scene_cache_get(&other, scene->cache, model, 0.5f) == AT_OK && other != cache_jobs[0].polygons;
+    printf("cache one set per error %s\n", is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+
+    for (int simplified = 0; simplified < 2; simplified++) {
+        RunJob sequential[NUM_RUNS], concurrent[NUM_RUNS];
+        start = now_seconds();
+        for (int i = 0; i < NUM_RUNS; i++) {
+            sequential[i] = (RunJob){.scene = scene, .is_simplified = simplified};
+            run_simulation(&sequential[i]);
+        }
+        double sequential_seconds = now_seconds() - start;
+
+        start = now_seconds();
+        for (int i = 0; i < NUM_RUNS; i++) {
+            concurrent[i] = (RunJob){.scene = scene, .is_simplified = simplified};
+            pthread_create(&threads[i], NULL, run_simulation, &concurrent[i]);
+        }
+        for (int i = 0; i < NUM_RUNS; i++) pthread_join(threads[i], NULL);
+        double concurrent_seconds = now_seconds() - start;
+
+        //the room is closed, so every ray from inside reaches a wall
+        is_ok = true;
+        for (int i = 0; i < NUM_RUNS; i++) {
+            is_ok = is_ok && sequential[i].result == AT_OK && concurrent[i].result == AT_OK &&
+                    sequential[i].num_rays_hit == 300 && concurrent[i].num_rays_hit == 300;
+        }
+        printf("%s runs sequential %.3fs concurrent %.3fs %s\n", simplified ? "simplified" : "full",
+               sequential_seconds, concurrent_seconds, is_ok ? "ok" : "MISMATCH");
+        failures += !is_ok;
+    }
+
+    AT_scene_destroy(scene);
+    AT_model_destroy(model);
+    return failures ? 1 : 0;
+}
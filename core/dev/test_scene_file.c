@@ -0,0 +1,140 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "acoustic/at_scene_file.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Compiles the sample room to an .atscene, maps it back and checks that the
+// triangles, materials and bounds match and that a simulation of either
+// model fills the same voxels. A truncated copy must be rejected.
+
+static AT_Simulation *run(const AT_Model *model, AT_Scene **out_scene)
+{
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{0, 1, 0}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Settings settings = {
+        .fps = 60,
+        .num_rays = 500,
+        .voxel_size = 0.1f,
+        .num_threads = 4,
+        .deposit_strategy = AT_DEPOSIT_DETERMINISTIC,
+    };
+
+    AT_Simulation *sim = NULL;
+    srand(1);
+    if (AT_scene_create(out_scene, &conf) != AT_OK ||
+        AT_simulation_create(&sim, *out_scene, &settings) != AT_OK ||
+        AT_simulation_run(sim) != AT_OK) {
+        return NULL;
+    }
+    return sim;
+}
+
+int main()
+{
+    const char *filepath = "../assets/glb/L_room.gltf";
+    const char *compiled_path = "scene_out" AT_SCENE_FILE_EXTENSION;
+    const char *truncated_path = "scene_truncated" AT_SCENE_FILE_EXTENSION;
+
+    double start = now_seconds();
+    AT_Model *model = NULL;
+    if (AT_model_create(&model, filepath) != AT_OK) {
+        fprintf(stderr, "Error creating model\n");
+        return 1;
+    }
+    double gltf_time = now_seconds() - start;
+
+    if (AT_scene_file_write(model, compiled_path) != AT_OK) {
+        fprintf(stderr, "Error writing compiled scene\n");
+        return 1;
+    }
+
+    start = now_seconds();
+    AT_Model *compiled = NULL;
+    if (AT_model_create(&compiled, compiled_path) != AT_OK) {
+        fprintf(stderr, "Error opening compiled scene\n");
+        return 1;
+    }
+    double compiled_time = now_seconds() - start;
+
+    AT_Triangle *triangles = NULL;
+    if (AT_model_get_triangles(&triangles, model) != AT_OK) {
+        fprintf(stderr, "Error building triangles\n");
+        return 1;
+    }
+    AT_AABB aabb, compiled_aabb;
+    AT_model_to_AABB(&aabb, model);
+    AT_model_to_AABB(&compiled_aabb, compiled);
+
+    size_t triangle_count = model->index_count / 3;
+    bool is_ok = compiled->triangle_count == triangle_count &&
+                 memcmp(compiled->triangles, triangles, sizeof(AT_Triangle) * triangle_count) == 0 &&
+                 memcmp(compiled->triangle_materials, model->triangle_materials, sizeof(AT_MaterialId) * triangle_count) == 0 &&
+                 memcmp(&aabb, &compiled_aabb, sizeof(aabb)) == 0;
+    free(triangles);
+    printf("compiled triangles=%zu gltf %.4fs mmap %.4fs %s\n",
+           triangle_count, gltf_time, compiled_time, is_ok ? "ok" : "MISMATCH");
+    int failures = !is_ok;
+
+    //the deterministic deposit makes both runs bit-identical
+    AT_Scene *scene = NULL;
+    AT_Scene *compiled_scene = NULL;
+    AT_Simulation *sim = run(model, &scene);
+    AT_Simulation *compiled_sim = run(compiled, &compiled_scene);
+    if (!sim || !compiled_sim) {
+        fprintf(stderr, "Error running simulation\n");
+        return 1;
+    }
+    is_ok = sim->num_voxels == compiled_sim->num_voxels;
+    for (uint32_t v = 0; v < sim->num_voxels && is_ok; v++) {
+        const AT_Voxel *a = &sim->voxel_grid[v];
+        const AT_Voxel *b = &compiled_sim->voxel_grid[v];
+        is_ok = a->count == b->count && (a->count == 0 || memcmp(a->items, b->items, sizeof(float) * a->count) == 0);
+    }
+    printf("simulation voxels=%u %s\n", sim->num_voxels, is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+
+    //a file cut short of its materials
+    FILE *src = fopen(compiled_path, "rb");
+    FILE *dst = fopen(truncated_path, "wb");
+    if (src && dst) {
+        fseek(src, 0, SEEK_END);
+        long size = ftell(src) - 4;
+        fseek(src, 0, SEEK_SET);
+        for (long i = 0; i < size; i++) fputc(fgetc(src), dst);
+    }
+    if (src) fclose(src);
+    if (dst) fclose(dst);
+    AT_Model *truncated = NULL;
+    is_ok = AT_model_create(&truncated, truncated_path) == AT_ERR_INVALID_ARGUMENT;
+    printf("truncated file rejected %s\n", is_ok ? "ok" : "MISMATCH");
+    failures += !is_ok;
+    AT_model_destroy(truncated);
+    unlink(truncated_path);
+
+    AT_simulation_destroy(compiled_sim);
+    AT_simulation_destroy(sim);
+    AT_scene_destroy(compiled_scene);
+    AT_scene_destroy(scene);
+    AT_model_destroy(compiled);
+    AT_model_destroy(model);
+    return failures ? 1 : 0;
+}
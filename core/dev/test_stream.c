@@ -0,0 +1,143 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "acoustic/at_replay.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs the sample room with AT_simulation_run_streamed for each deposit
+// strategy, keeping and releasing the emitted bins, checks every emitted
+// frame against a plain AT_simulation_run and reports when the first frame
+// arrived and the most bins the voxels held at once
+
+typedef struct {
+    const AT_Simulation *reference;
+    const AT_Simulation *streamed;
+    size_t max_held_bins;
+    uint32_t num_frames;
+    double start;
+    double first_frame_time;
+    double max_error; //relative to the frame's largest reference value
+    bool is_out_of_order;
+} StreamCheck;
+
+static AT_Result check_frame(void *ctx, uint32_t frame, const float *values, uint32_t num_voxels)
+{
+    StreamCheck *check = ctx;
+    const AT_Simulation *reference = check->reference;
+    if (frame != check->num_frames || num_voxels != reference->num_voxels) check->is_out_of_order = true;
+    if (check->num_frames++ == 0) check->first_frame_time = now_seconds() - check->start;
+
+    float frame_max = 0.0f;
+    float error = 0.0f;
+    for (uint32_t v = 0; v < num_voxels; v++) {
+        const AT_Voxel *voxel = &reference->voxel_grid[AT_voxel_index_from_linear(reference, v)];
+        float expected = (frame < voxel->count) ? voxel->items[frame] : 0.0f;
+        frame_max = fmaxf(frame_max, expected);
+        error = fmaxf(error, fabsf(values[v] - expected));
+    }
+    if (frame_max > 0.0f) check->max_error = fmax(check->max_error, error / frame_max);
+    else if (error > 0.0f) check->max_error = INFINITY;
+
+    size_t held_bins = 0;
+    for (uint32_t i = 0; i < check->streamed->num_voxel_slots; i++) held_bins += check->streamed->voxel_grid[i].count;
+    if (held_bins > check->max_held_bins) check->max_held_bins = held_bins;
+    return AT_OK;
+}
+
+static size_t count_bins(const AT_Simulation *simulation)
+{
+    size_t bins = 0;
+    for (uint32_t i = 0; i < simulation->num_voxel_slots; i++) bins += simulation->voxel_grid[i].count;
+    return bins;
+}
+
+int main()
+{
+    const char *filepath = "../assets/glb/L_room.gltf";
+    const char *strategy_names[] = {"auto", "private", "atomic", "determ"};
+
+    AT_Model *model = NULL;
+    if (AT_model_create(&model, filepath) != AT_OK) {
+        fprintf(stderr, "Error creating model\n");
+        return 1;
+    }
+
+    AT_Source source = {
+        .direction = {{1, 0, 0}},
+        .intensity = 50.0,
+        .position = {{0, 1, 0}}
+    };
+
+    AT_SceneConfig conf = {
+        .environment = model,
+        .material = AT_MATERIAL_CONCRETE,
+        .num_sources = 1,
+        .sources = &source
+    };
+
+    AT_Scene *scene = NULL;
+    if (AT_scene_create(&scene, &conf) != AT_OK) {
+        fprintf(stderr, "Error creating scene\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (int run = 0; run < 8; run++) {
+        int s = run / 2;
+        bool is_releasing = run % 2;
+        AT_Settings settings = {
+            .fps = 60,
+            .num_rays = 500,
+            .voxel_size = 0.1f,
+            .num_threads = 4,
+            .deposit_strategy = (AT_DepositStrategy)s,
+        };
+
+        //both runs trace the same rays
+        AT_Simulation *reference = NULL;
+        AT_Simulation *streamed = NULL;
+        srand(1);
+        if (AT_simulation_create(&reference, scene, &settings) != AT_OK || AT_simulation_run(reference) != AT_OK) {
+            fprintf(stderr, "Error running simulation\n");
+            return 1;
+        }
+
+        srand(1);
+        if (AT_simulation_create(&streamed, scene, &settings) != AT_OK) {
+            fprintf(stderr, "Error creating streamed simulation\n");
+            return 1;
+        }
+        StreamCheck check = {.reference = reference, .streamed = streamed, .start = now_seconds()};
+        AT_FrameStream stream = {.sink = check_frame, .ctx = &check, .is_releasing = is_releasing};
+        if (AT_simulation_run_streamed(streamed, &stream) != AT_OK) {
+            fprintf(stderr, "Error running streamed simulation\n");
+            return 1;
+        }
+        double total_time = now_seconds() - check.start;
+
+        //a released run ends with nothing left in the voxels
+        size_t final_bins = count_bins(streamed);
+        bool is_ok = !check.is_out_of_order &&
+                     check.num_frames == AT_replay_frame_count(reference) &&
+                     check.max_error < 1e-4 &&
+                     (!is_releasing || final_bins == 0);
+        printf("%-8s %-8s frames=%u first frame %.3fs of %.3fs max error %.2e held bins %zu of %zu %s\n",
+               strategy_names[s], is_releasing ? "released" : "kept", check.num_frames, check.first_frame_time,
+               total_time, check.max_error, check.max_held_bins, count_bins(reference), is_ok ? "ok" : "MISMATCH");
+        failures += !is_ok;
+
+        AT_simulation_destroy(streamed);
+        AT_simulation_destroy(reference);
+    }
+
+    AT_scene_destroy(scene);
+    AT_model_destroy(model);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "test_helpers.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Walks the traced rays of a simulation with the scalar DDA and with the
+// batched SIMD DDA, comparing time and deposited energy
+
+#define NUM_REPEATS 20
+
+static double walk_rays(const AT_Simulation *sim, bool is_batched, double *out_energy)
+{
+    float max_segment_length = AT_vec3_distance(sim->scene->world_AABB.min, sim->scene->world_AABB.max);
+
+    AT_Deposit deposit = {0};
+    if (AT_deposit_create(&deposit, AT_DEPOSIT_PRIVATE, sim->num_voxel_slots, 0, sim->num_bins,
+                          1, sim->num_rays, false) != AT_OK) {
+        *out_energy = 0.0;
+        return 0.0;
+    }
+    AT_DepositLane *lane = &deposit.lanes[0];
+
+    AT_VoxelBatch batch;
+    AT_voxel_batch_init(&batch, sim);
+
+    double start = now_seconds();
+    for (int r = 0; r < NUM_REPEATS; r++) {
+        for (uint32_t i = 0; i < sim->num_rays; i++) {
+            for (const AT_Ray *ray = &sim->rays[i]; ray; ray = ray->child) {
+                AT_Vec3 ray_end = ray->child ?
+                    ray->child->origin :
+                    AT_vec3_add(ray->origin, AT_vec3_scale(ray->direction, max_segment_length));
+
+                if (is_batched) {
+                    AT_voxel_batch_add(&batch, lane, ray, ray_end);
+                } else {
+                    AT_voxel_ray_step(sim, lane, ray, ray_end);
+                }
+            }
+        }
+    }
+    if (is_batched) AT_voxel_batch_flush(&batch, lane);
+    double elapsed = now_seconds() - start;
+
+    double energy = 0.0;
+    const AT_DepositGrid *grid = &deposit.privates[0];
+    for (uint32_t t = 0; t < grid->num_tiles; t++) {
+        if (!grid->tiles[t]) continue;
+        for (size_t f = 0; f < grid->tile_floats; f++) energy += grid->tiles[t][f];
+    }
+    *out_energy = energy;
+
+    AT_deposit_destroy(&deposit);
+    return elapsed;
+}
+
+int main()
+{
+    const char *rooms[] = {
+        "../assets/glb/box_room.gltf",
+        "../assets/glb/L_room.gltf",
+        "../assets/glb/polygon_room.gltf",
+    };
+    const float voxel_sizes[] = {0.5f, 0.1f};
+
+    printf("SIMD width %d\n", AT_SIMD_WIDTH);
+
+    for (size_t r = 0; r < sizeof(rooms) / sizeof(rooms[0]); r++) {
+        AT_Model *model = NULL;
+        if (AT_model_create(&model, rooms[r]) != AT_OK) {
+            fprintf(stderr, "Error creating model %s\n", rooms[r]);
+            continue;
+        }
+
+        AT_Source source = {
+            .direction = {{1, 0, 0}},
+            .intensity = 50.0,
+            .position = {{0, 1, 0}}
+        };
+
+        AT_SceneConfig conf = {
+            .environment = model,
+            .material = AT_MATERIAL_CONCRETE,
+            .num_sources = 1,
+            .sources = &source
+        };
+
+        AT_Scene *scene = NULL;
+        if (AT_scene_create(&scene, &conf) != AT_OK) {
+            fprintf(stderr, "Error creating scene\n");
+            AT_model_destroy(model);
+            continue;
+        }
+
+        printf("%s\n", rooms[r]);
+        for (size_t v = 0; v < sizeof(voxel_sizes) / sizeof(voxel_sizes[0]); v++) {
+            AT_Settings settings = {
+                .fps = 60,
+                .num_rays = 500,
+                .voxel_size = voxel_sizes[v],
+                .num_threads = 1
+            };
+
+            AT_Simulation *sim = NULL;
+            if (AT_simulation_create(&sim, scene, &settings) != AT_OK) {
+                fprintf(stderr, "Error creating simulation\n");
+                continue;
+            }
+
+            srand(1);
+            if (AT_simulation_run(sim) == AT_OK) {
+                double scalar_energy, batch_energy;
+                double scalar_time = walk_rays(sim, false, &scalar_energy);
+                double batch_time = walk_rays(sim, true, &batch_energy);
+
+                printf("  voxel=%.2f scalar=%.3fs batch=%.3fs speedup=%.2fx energy=%.6f/%.6f\n",
+                       voxel_sizes[v], scalar_time, batch_time, scalar_time / batch_time,
+                       scalar_energy, batch_energy);
+            }
+            AT_simulation_destroy(sim);
+        }
+
+        AT_scene_destroy(scene);
+        AT_model_destroy(model);
+    }
+
+    return 0;
+}
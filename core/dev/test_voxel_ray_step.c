@@ -175,10 +175,7 @@ int main()
                     for (uint32_t z = 0; z < sim->grid_dimensions.z; z++) {
                         for (uint32_t y = 0; y < sim->grid_dimensions.y; y++) {
                             for (uint32_t x = 0; x < sim->grid_dimensions.x; x++) {
-                                uint32_t i =
-                                    z * sim->grid_dimensions.y * sim->grid_dimensions.x +
-                                    y * sim->grid_dimensions.x +
-                                    x;
+                                uint32_t i = AT_voxel_index(sim, x, y, z);
 
                                 AT_Voxel *v = &sim->voxel_grid[i];
 
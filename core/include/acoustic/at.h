@@ -5,6 +5,7 @@
 #define AT_H
 
 #include "acoustic/at_math.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -19,7 +20,8 @@ typedef enum {
   AT_ERR_INVALID_ARGUMENT, /**< Incorrect arguments were given to the function.
                             */
   AT_ERR_ALLOC_ERROR,      /**< Memory allocation failed. */
-  AT_ERR_NETWORK_FAILURE   /**< Network failure.  */
+  AT_ERR_NETWORK_FAILURE,  /**< Network failure.  */
+  AT_ERR_IO_FAILURE        /**< A file could not be opened, read or written. */
 } AT_Result;
 
 /** \brief Defines possible material types.
@@ -36,6 +38,31 @@ typedef struct {
     // TODO: diffuse, scatter, etc
 } AT_Material;
 
+/** \brief Index into the material table of a model. The AT_MaterialType
+    values come first in every table, so they are valid IDs everywhere.
+ */
+typedef uint16_t AT_MaterialId;
+
+/** \brief Most entries a model's material table can hold. */
+#define AT_MATERIAL_MAX_COUNT (UINT16_MAX + 1)
+
+/** \brief Defines how parallel workers deposit energy into the voxel grid.
+ */
+typedef enum {
+    AT_DEPOSIT_AUTO = 0, /**< Pick a strategy from the grid size and thread count. */
+    AT_DEPOSIT_PRIVATE,  /**< Per-thread tiled grids merged by a tree reduction. */
+    AT_DEPOSIT_ATOMIC,   /**< Atomic float adds into one shared dense grid. */
+    AT_DEPOSIT_DETERMINISTIC, /**< Fixed ray blocks combined in a fixed order,
+                                   bit-identical for any thread count. */
+} AT_DepositStrategy;
+
+/** \brief Defines how the voxel grid is ordered in memory.
+ */
+typedef enum {
+    AT_VOXEL_LAYOUT_LINEAR = 0, /**< Row-major, x fastest. */
+    AT_VOXEL_LAYOUT_TILED,      /**< 4x4x4 bricks, Z-order inside each brick. */
+} AT_VoxelLayout;
+
 /** \brief Groups the information required for the sound source.
  */
 typedef struct {
@@ -53,6 +80,10 @@ typedef struct {
 
   // Borrowed: must remain valid for the entire lifetime of the scene
   const AT_Model *environment; /**< Pointer to the room object. */
+
+  /** Optional region of interest, clipped to the model bounds. Only this
+      box is voxelised; NULL covers the whole model. Copied on create. */
+  const AT_AABB *observer_area;
 } AT_SceneConfig;
 
 /** \brief The simulation's settings. */
@@ -60,8 +91,42 @@ typedef struct {
   float voxel_size; /**< The renderer's resolution. */
   uint32_t num_rays;
   uint8_t fps; // Bin width is always one frame
+  uint32_t num_threads; /**< Worker threads, 0 uses every online CPU. */
+  AT_DepositStrategy deposit_strategy; /**< Defaults to AT_DEPOSIT_AUTO. */
+  bool is_compensated; /**< Kahan summation for AT_DEPOSIT_DETERMINISTIC. */
+  AT_VoxelLayout voxel_layout; /**< Defaults to AT_VOXEL_LAYOUT_LINEAR. */
+  bool is_simplified; /**< Trace the model decimated to AT_SIMULATION_SIMPLIFY_VOXEL_FRACTION of a voxel. */
 } AT_Settings;
 
+/** \brief Surface error a simplified run allows, as a fraction of the voxel size. */
+#define AT_SIMULATION_SIMPLIFY_VOXEL_FRACTION 0.25f
+
+/** \brief Frames a streamed run advances the ray front by between emissions. */
+#define AT_SIMULATION_DEFAULT_EPOCH_FRAMES 8
+
+/** \brief Receives one finished frame of a streamed run.
+
+    \param ctx User data from AT_FrameStream.
+    \param frame Frame (time bin) index, frames arrive in ascending order.
+    \param values Energy of every voxel in the frame, row-major, only valid during the call.
+    \param num_voxels Number of values.
+
+    \retval AT_Result Anything but AT_OK stops the run, which then returns it.
+*/
+typedef AT_Result (*AT_FrameSinkFn)(void *ctx, uint32_t frame, const float *values, uint32_t num_voxels);
+
+/** \brief Where a streamed run hands its frames to.
+
+    Tracing the rays and depositing their energy into the voxels are both
+    streamed, a ray is only bounced once the epoch reaching it runs.
+*/
+typedef struct {
+  AT_FrameSinkFn sink;
+  void *ctx;
+  uint32_t frames_per_epoch; /**< 0 uses AT_SIMULATION_DEFAULT_EPOCH_FRAMES. */
+  bool is_releasing; /**< Free each frame's bins once the sink has it, the voxel grid ends up empty. */
+} AT_FrameStream;
+
 // Model
 AT_Result AT_model_create(
     AT_Model **out_model,
@@ -100,6 +165,20 @@ AT_Result AT_simulation_run(
     AT_Simulation *simulation
 );
 
+// Runs the simulation epoch by epoch in time order, handing each frame
+// to the sink as soon as no ray can still deposit into it
+AT_Result AT_simulation_run_streamed(
+    AT_Simulation *simulation,
+    const AT_FrameStream *stream
+);
+
+// Packs the bins of a finished run into compressed sparse rows and frees
+// the per-voxel buffers. The simulation can still be exported and
+// analysed but no longer run.
+AT_Result AT_simulation_compact(
+    AT_Simulation *simulation
+);
+
 void AT_simulation_destroy(
     AT_Simulation *simulation
 );
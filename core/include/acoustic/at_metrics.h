@@ -0,0 +1,77 @@
+/** \file
+    \brief Per-voxel room acoustics metrics computed from the energy bins
+*/
+
+#ifndef AT_METRICS_H
+#define AT_METRICS_H
+
+#include "at.h"
+
+#include <stdint.h>
+
+/*  Metrics file layout, every field little endian:
+
+    header      AT_METRICS_HEADER_SIZE bytes
+        char     magic[4]      "ATMT"
+        uint16_t version       AT_METRICS_VERSION
+        uint16_t metric_count  AT_METRIC_COUNT
+        uint32_t grid[3]
+        uint32_t num_voxels    row-major voxel count of the grid
+        float    origin[3]
+        float    voxel_size
+        uint32_t fps
+        uint32_t reserved
+
+    maps        metric_count maps of num_voxels floats, in AT_Metric order
+*/
+
+#define AT_METRICS_MAGIC "ATMT"
+#define AT_METRICS_VERSION 1
+#define AT_METRICS_HEADER_SIZE 48
+
+/** \brief Metrics computed for every voxel.
+
+    Decay times come from a least squares line through the Schroeder
+    backward integrated curve, in the level range given. Times start at
+    the first bin holding energy, so the resolution is one frame.
+ */
+typedef enum {
+    AT_METRIC_EDT = 0, /**< Early decay time in seconds, 0 to -10 dB. */
+    AT_METRIC_T20,     /**< Reverberation time in seconds, -5 to -25 dB. */
+    AT_METRIC_T30,     /**< Reverberation time in seconds, -5 to -35 dB. */
+    AT_METRIC_C50,     /**< Clarity in dB, the first 50 ms against the rest. */
+    AT_METRIC_D50,     /**< Definition, the share of the energy in the first 50 ms. */
+    AT_METRIC_COUNT,
+} AT_Metric;
+
+/** \brief One row-major map per metric.
+ */
+typedef struct {
+    uint32_t num_voxels;
+    float *maps[AT_METRIC_COUNT]; /**< NaN where a voxel holds no energy or its decay never reaches the range. */
+} AT_MetricGrid;
+
+/** \brief Computes every metric for every voxel, in parallel over voxels.
+
+    \param out_grid Receives the maps, free them with AT_metrics_destroy().
+    \param simulation Pointer to a simulation that has been run.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the maps could not be allocated.
+*/
+AT_Result AT_metrics_compute(AT_MetricGrid *out_grid, const AT_Simulation *simulation);
+
+/** \brief Writes the maps with the grid of their simulation.
+
+    \param grid Maps from AT_metrics_compute().
+    \param simulation The simulation they were computed from.
+    \param path File to create or overwrite.
+
+    \retval AT_Result AT_ERR_IO_FAILURE if the file could not be written.
+*/
+AT_Result AT_metrics_write(const AT_MetricGrid *grid, const AT_Simulation *simulation, const char *path);
+
+/** \brief Frees the maps of a grid.
+ */
+void AT_metrics_destroy(AT_MetricGrid *grid);
+
+#endif // AT_METRICS_H
@@ -7,13 +7,28 @@
 
 #include "at.h"
 
+#include <stddef.h>
+
 /** \brief Groups the necessary information representing the 3D model.
  */
 typedef struct AT_Model AT_Model;
 
+/** \brief Keys of a glTF material's extras that set its acoustic material.
+
+    AT_MODEL_EXTRAS_MATERIAL names a built-in material ("concrete",
+    "plastic" or "wood"), AT_MODEL_EXTRAS_ABSORPTION gives an absorption in
+    [0, 1] of its own. Either takes precedence over the material name.
+ */
+#define AT_MODEL_EXTRAS_MATERIAL "acoustic_material"
+#define AT_MODEL_EXTRAS_ABSORPTION "absorption"
+
 /** \brief AT_Model constructor for a given `glb` filepath.
     \relates AT_Model
 
+    Every glTF material becomes an entry of the model's material table,
+    from its extras, else from a built-in material its name contains, else
+    plastic. Triangles without a material are plastic.
+
     \param out_model Pointer to an empty initialised AT_Model.
     \param filepath String showing the location of the file.
 
@@ -22,6 +37,68 @@ typedef struct AT_Model AT_Model;
 AT_Result AT_model_create(AT_Model **out_model, const char *filepath);
 
 
+/** \brief Default distance AT_model_weld() merges vertices within, in metres. */
+#define AT_MODEL_WELD_TOLERANCE 1e-4f
+
+/** \brief What AT_model_weld() changed.
+ */
+typedef struct {
+    size_t welded_vertices;      /**< Vertices merged into an earlier one within the tolerance. */
+    size_t unused_vertices;      /**< Vertices no remaining triangle references. */
+    size_t degenerate_triangles; /**< Triangles thinner than the tolerance, after welding. */
+    size_t duplicate_triangles;  /**< Triangles over the same three vertices as an earlier one. */
+    size_t vertex_count;         /**< Vertices left. */
+    size_t triangle_count;       /**< Triangles left. */
+} AT_ModelWeldStats;
+
+/** \brief Cleans up a loaded model in place.
+
+    Welds vertices closer than \a tolerance using a spatial hash, drops
+    triangles that became degenerate or thinner than the tolerance and
+    triangles repeating the vertices of an earlier one, then orders the
+    triangles along a Morton curve and renumbers the vertices in first use
+    order, so nearby triangles sit close in memory.
+
+    \param model Pointer to a model from glTF, compiled scenes are already final.
+    \param tolerance Weld distance, 0 uses AT_MODEL_WELD_TOLERANCE.
+    \param out_stats Optional, receives what was removed.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if no triangle is left or the
+   model is a compiled scene.
+*/
+AT_Result AT_model_weld(AT_Model *model, float tolerance, AT_ModelWeldStats *out_stats);
+
+
+/** \brief What AT_model_simplify() produced.
+ */
+typedef struct {
+    size_t collapsed_vertices; /**< Vertices moved onto a neighbour. */
+    size_t vertex_count;       /**< Vertices in the simplified model. */
+    size_t triangle_count;     /**< Triangles in the simplified model. */
+    float max_error;           /**< Largest collapse error used, in metres. */
+} AT_ModelSimplifyStats;
+
+/** \brief Builds a decimated copy of a model.
+    \relates AT_Model
+
+    Collapses edges by quadric error, cheapest first, while the collapse
+    stays within \a max_error of the planes it removes. Vertices only move
+    onto existing neighbours, open edges and edges between two materials
+    only slide along themselves and corners where they meet stay, so every
+    material keeps its outline. Weld the model first, split seams count as
+    open edges.
+
+    \param out_model Pointer to an empty AT_Model pointer.
+    \param model Pointer to a model from glTF, compiled scenes have no connectivity.
+    \param max_error Largest distance, in metres, a surface may move.
+    \param out_stats Optional, receives the resulting sizes.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT for a compiled scene or a model
+   without triangles.
+*/
+AT_Result AT_model_simplify(AT_Model **out_model, const AT_Model *model, float max_error, AT_ModelSimplifyStats *out_stats);
+
+
 /** \brief Calculates the min and max of a model for AABB collision.
     \relates AT_AABB
 
@@ -0,0 +1,266 @@
+/** \file
+    \brief Binary replay export: meta.json plus sparse chunk_NNN.bin files
+*/
+
+#ifndef AT_REPLAY_H
+#define AT_REPLAY_H
+
+#include "at.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*  Chunk layout, every field little endian:
+
+    header      AT_REPLAY_HEADER_SIZE bytes
+        char     magic[4]      "ATRC"
+        uint16_t version       AT_REPLAY_VERSION
+        uint16_t flags         AT_REPLAY_FLAG_*
+        uint32_t chunk_index
+        uint32_t frame_count
+        uint32_t start_frame
+        uint32_t encoding      AT_ReplayEncoding
+        uint32_t num_voxels    row-major voxel count of the grid
+        uint32_t keyframe_interval
+
+    directory   frame_count entries of AT_REPLAY_DIRECTORY_ENTRY_SIZE bytes
+        uint32_t offset        frame payload, from the start of the chunk
+        uint32_t size          frame payload in bytes
+        float    max           largest value kept in the frame
+        float    sum           sum of the values kept in the frame
+
+    frames      one payload per frame, 4 byte aligned
+
+        AT_REPLAY_ENCODING_RAW
+        uint32_t active_count
+        uint32_t voxel_index[active_count]   ascending, row-major
+        float    value[active_count]
+
+        AT_REPLAY_ENCODING_QUANTISED
+        uint32_t active_count
+        float    scale                       value = quantised * scale
+        uint32_t index_bytes
+        uint8_t  index_deltas[index_bytes]   LEB128 varints, the first from 0
+        padding to 2 bytes
+        uint16_t quantised[active_count]
+        padding to 4 bytes
+
+    With AT_REPLAY_FLAG_DELTA every frame payload starts with a kind:
+
+        uint32_t kind                        AT_REPLAY_FRAME_KEY or _DELTA
+
+    Keyframes follow with the layout above. Delta frames hold the changes
+    since the previous frame:
+
+        pairs in the chunk's encoding         voxels that entered or changed
+        uint32_t removed_count
+        uint32_t index_bytes
+        uint8_t  index_deltas[index_bytes]   voxels that left, LEB128 as above
+        padding to 4 bytes
+
+    The first frame of a chunk is always a keyframe, and there is one at
+    least every keyframe_interval frames; the writer also emits one
+    wherever it comes out no larger than the delta.
+
+    The directory max and sum always describe the whole frame.
+
+    With AT_REPLAY_FLAG_COMPRESSED the header is followed by
+
+        uint32_t body_size                   size of the directory and frames
+        uint32_t stream_size[AT_REPLAY_NUM_STREAMS]
+        uint32_t block_size[AT_REPLAY_NUM_STREAMS]
+        uint8_t  blocks[]                    one block per stream, back to back, laid
+                                             out as in core/src/at_rans.h
+
+    The body is split into streams walking it in layout order. Stream 0
+    holds the directory, every other field and the padding, 1 the
+    index_deltas, 2 and 3 the low and high bytes of quantised. Raw chunks
+    put byte 0 to 3 of each voxel_index minus the previous one (0 for the
+    first) in 4 to 7, and byte 0 to 3 of each value in 8 to 11.
+
+    AT_replay_decompress_chunk() turns it back into the layout above.
+*/
+
+#define AT_REPLAY_MAGIC "ATRC"
+#define AT_REPLAY_VERSION 4
+#define AT_REPLAY_HEADER_SIZE 32
+#define AT_REPLAY_DIRECTORY_ENTRY_SIZE 16
+#define AT_REPLAY_DEFAULT_FRAMES_PER_CHUNK 60
+
+#define AT_REPLAY_FLAG_DELTA 0x1
+#define AT_REPLAY_FLAG_COMPRESSED 0x2
+
+#define AT_REPLAY_NUM_STREAMS 12
+#define AT_REPLAY_COMPRESSED_PREFIX_SIZE (AT_REPLAY_HEADER_SIZE + 4 + 8 * AT_REPLAY_NUM_STREAMS)
+
+#define AT_REPLAY_FRAME_KEY 0
+#define AT_REPLAY_FRAME_DELTA 1
+
+/** \brief Defines how the frame payloads of a chunk are encoded.
+ */
+typedef enum {
+    AT_REPLAY_ENCODING_RAW = 0,  /**< Row-major uint32 indices and float values. */
+    AT_REPLAY_ENCODING_QUANTISED, /**< Varint index deltas, uint16 values with a per-frame scale. */
+} AT_ReplayEncoding;
+
+/** \brief Replay export settings, zero initialised fields use the defaults.
+ */
+typedef struct {
+    uint32_t frames_per_chunk; /**< 0 uses AT_REPLAY_DEFAULT_FRAMES_PER_CHUNK. */
+    float threshold; /**< Voxels at or below this energy are left out. */
+    uint32_t top_k; /**< Keep at most this many voxels per frame, 0 keeps all. */
+    AT_ReplayEncoding encoding;
+    uint32_t keyframe_interval; /**< Delta code frames with a keyframe at least this often, 0 or 1 keyframes every frame. */
+    float delta_tolerance; /**< Voxels that moved by at most this much keep their previous value in delta frames. */
+    bool is_compressed; /**< Entropy code each chunk, kept only where it is smaller. */
+    uint32_t num_threads; /**< Encoding threads, 0 uses the simulation's. */
+} AT_ReplaySettings;
+
+/** \brief Number of frames (time bins) a replay of the simulation holds.
+
+    \param simulation Pointer to a simulation that has been run.
+
+    \retval uint32_t The frame count.
+*/
+uint32_t AT_replay_frame_count(const AT_Simulation *simulation);
+
+/** \brief Number of chunk files a replay of the simulation is split into.
+
+    \param simulation Pointer to a simulation that has been run.
+    \param settings Pointer to the export settings, NULL uses the defaults.
+
+    \retval uint32_t The chunk count.
+*/
+uint32_t AT_replay_chunk_count(const AT_Simulation *simulation, const AT_ReplaySettings *settings);
+
+/** \brief Encodes one chunk straight from the voxel grid.
+
+    Voxels above the threshold are gathered in parallel, each thread
+    scanning its own range of voxels, then the frames are encoded in
+    parallel. The bytes do not depend on the thread count.
+
+    \param out_data Receives a malloc'd buffer holding the chunk, owned by the caller.
+    \param out_size Receives the chunk size in bytes.
+    \param simulation Pointer to a simulation that has been run.
+    \param settings Pointer to the export settings, NULL uses the defaults.
+    \param chunk_index Index of the chunk, below AT_replay_chunk_count().
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the chunk could not be allocated.
+*/
+AT_Result AT_replay_encode_chunk(uint8_t **out_data,
+                                 size_t *out_size,
+                                 const AT_Simulation *simulation,
+                                 const AT_ReplaySettings *settings,
+                                 uint32_t chunk_index);
+
+/** \brief Chunk header fields, see the layout above.
+ */
+typedef struct {
+    uint16_t flags;
+    uint32_t chunk_index;
+    uint32_t frame_count;
+    uint32_t start_frame;
+    AT_ReplayEncoding encoding;
+    uint32_t num_voxels;
+    uint32_t keyframe_interval; /**< Most frames between keyframes, 1 without AT_REPLAY_FLAG_DELTA. */
+} AT_ReplayChunkInfo;
+
+/** \brief Reads and validates the header of an encoded chunk.
+
+    \param out_info Receives the header fields.
+    \param data Pointer to the chunk.
+    \param size Chunk size in bytes.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the data is not a chunk of this version.
+*/
+AT_Result AT_replay_read_chunk_info(AT_ReplayChunkInfo *out_info, const uint8_t *data, size_t size);
+
+/** \brief Returns a chunk with its body decompressed.
+
+    \param out_data Receives a malloc'd copy of the chunk without AT_REPLAY_FLAG_COMPRESSED, owned by the caller.
+    \param out_size Receives its size in bytes.
+    \param data Pointer to the chunk, compressed or not.
+    \param size Chunk size in bytes.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the chunk is malformed.
+*/
+AT_Result AT_replay_decompress_chunk(uint8_t **out_data, size_t *out_size, const uint8_t *data, size_t size);
+
+/** \brief Decodes one frame of a chunk into a dense row-major field.
+
+    Delta frames are rebuilt from their keyframe, voxels not in the frame
+    are set to 0.
+
+    \param values Receives num_voxels values.
+    \param data Pointer to an uncompressed chunk.
+    \param size Chunk size in bytes.
+    \param frame Frame index within the chunk.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the chunk is malformed or compressed.
+*/
+AT_Result AT_replay_decode_frame(float *values, const uint8_t *data, size_t size, uint32_t frame);
+
+/** \brief Writes the voxels of one keyframe payload into a dense field.
+
+    Voxels the payload does not list are left untouched.
+
+    \param values Dense row-major field of \a num_voxels values.
+    \param num_voxels Voxel count of the grid.
+    \param encoding Encoding of the payload.
+    \param data Pointer to the payload.
+    \param size Payload size in bytes.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the payload is malformed.
+*/
+AT_Result AT_replay_apply_keyframe(float *values,
+                                   uint32_t num_voxels,
+                                   AT_ReplayEncoding encoding,
+                                   const uint8_t *data,
+                                   size_t size);
+
+/** \brief Reads a few voxels out of one keyframe payload.
+
+    Only walks the payload as far as the last voxel asked for.
+
+    \param out_values Receives the value of each voxel, left untouched where the payload has none.
+    \param voxels Row-major voxel indices in ascending order, repeats allowed.
+    \param count Number of voxels.
+    \param encoding Encoding of the payload.
+    \param data Pointer to the payload.
+    \param size Payload size in bytes.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the payload is malformed.
+*/
+AT_Result AT_replay_lookup_keyframe(float *out_values,
+                                    const uint32_t *voxels,
+                                    uint32_t count,
+                                    AT_ReplayEncoding encoding,
+                                    const uint8_t *data,
+                                    size_t size);
+
+/** \brief Writes meta.json describing the grid and the chunks.
+
+    \param simulation Pointer to a simulation that has been run.
+    \param settings Pointer to the export settings, NULL uses the defaults.
+    \param path File to create or overwrite.
+
+    \retval AT_Result AT_ERR_IO_FAILURE if the file could not be written.
+*/
+AT_Result AT_replay_write_meta(const AT_Simulation *simulation,
+                               const AT_ReplaySettings *settings,
+                               const char *path);
+
+/** \brief Writes meta.json and every chunk_NNN.bin into a directory.
+
+    \param simulation Pointer to a simulation that has been run.
+    \param settings Pointer to the export settings, NULL uses the defaults.
+    \param dir_path Directory to write into, created if it does not exist.
+
+    \retval AT_Result AT_ERR_IO_FAILURE if a file could not be written.
+*/
+AT_Result AT_replay_write(const AT_Simulation *simulation,
+                          const AT_ReplaySettings *settings,
+                          const char *dir_path);
+
+#endif // AT_REPLAY_H
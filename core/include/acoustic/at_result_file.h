@@ -0,0 +1,168 @@
+/** \file
+    \brief Result container: every frame of a run in one file, read through mmap
+*/
+
+#ifndef AT_RESULT_FILE_H
+#define AT_RESULT_FILE_H
+
+#include "at.h"
+#include "at_replay.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*  File layout, every field little endian:
+
+    header      AT_RESULT_FILE_HEADER_SIZE bytes
+        char     magic[4]      "ATRS"
+        uint16_t version       AT_RESULT_FILE_VERSION
+        uint16_t flags
+        uint32_t frame_count
+        uint32_t encoding      AT_ReplayEncoding
+        uint32_t grid[3]
+        uint32_t num_voxels    row-major voxel count of the grid
+        float    origin[3]
+        float    voxel_size
+        uint32_t fps
+        uint32_t reserved
+        uint64_t table_offset
+
+    table       frame_count entries of AT_RESULT_FILE_ENTRY_SIZE bytes
+        uint64_t offset        frame payload, from the start of the file
+        uint32_t size          frame payload in bytes
+        uint32_t active_count
+        float    max
+        float    sum
+
+    With AT_RESULT_FILE_FLAG_VOXEL_SPANS the table is followed by
+
+    spans       num_voxels entries of AT_RESULT_FILE_SPAN_SIZE bytes, row-major
+        uint32_t first_frame   no frame before it holds the voxel
+        uint32_t end_frame     no frame from it on holds the voxel, first_frame if none does
+
+    frames      one keyframe payload per frame, laid out as in at_replay.h
+*/
+
+#define AT_RESULT_FILE_MAGIC "ATRS"
+#define AT_RESULT_FILE_VERSION 1
+#define AT_RESULT_FILE_HEADER_SIZE 64
+#define AT_RESULT_FILE_ENTRY_SIZE 24
+#define AT_RESULT_FILE_SPAN_SIZE 8
+
+#define AT_RESULT_FILE_FLAG_VOXEL_SPANS 0x1
+
+typedef struct AT_ResultFile AT_ResultFile;
+
+/** \brief Grid and frame information of an open result file.
+ */
+typedef struct {
+    uint32_t frame_count;
+    AT_ReplayEncoding encoding;
+    uint32_t grid[3];
+    uint32_t num_voxels;
+    AT_Vec3 origin;
+    float voxel_size;
+    uint32_t fps;
+} AT_ResultInfo;
+
+/** \brief One frame of a result file, pointing into the mapping.
+ */
+typedef struct {
+    const uint8_t *data; /**< Keyframe payload in the file's encoding, valid until AT_result_close(). */
+    size_t size;
+    uint32_t active_count;
+    float max;
+    float sum;
+} AT_ResultFrame;
+
+/** \brief Time series of a set of voxels, read from a result file.
+ */
+typedef struct {
+    uint32_t num_series;
+    uint32_t frame_count;
+    uint32_t *voxels; /**< Row-major voxel index of each series. */
+    float *values; /**< values[series * frame_count + frame], 0 where the frame leaves the voxel out. */
+} AT_ResultSeries;
+
+/** \brief Writes every frame of a simulation into a result file.
+
+    Frames are encoded as keyframes with the threshold, top_k and encoding
+    of \a settings, delta coding and compression are not used.
+
+    \param simulation Pointer to a simulation that has been run.
+    \param settings Pointer to the export settings, NULL uses the defaults.
+    \param path File to create or overwrite.
+
+    \retval AT_Result AT_ERR_IO_FAILURE if the file could not be written.
+*/
+AT_Result AT_result_write(const AT_Simulation *simulation, const AT_ReplaySettings *settings, const char *path);
+
+/** \brief Maps a result file and checks its header and frame table.
+
+    \param out_file Receives the open file, close it with AT_result_close().
+    \param path File to open.
+
+    \retval AT_Result AT_ERR_IO_FAILURE if the file cannot be mapped, AT_ERR_INVALID_ARGUMENT if it is not a result file.
+*/
+AT_Result AT_result_open(AT_ResultFile **out_file, const char *path);
+
+/** \brief Grid and frame information of an open result file.
+ */
+const AT_ResultInfo *AT_result_info(const AT_ResultFile *file);
+
+/** \brief Looks up one frame, O(1) and without copying.
+
+    \param out_frame Receives the frame.
+    \param file Open result file.
+    \param frame Frame index, below frame_count.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the frame is out of range or points outside the file.
+*/
+AT_Result AT_result_get_frame(AT_ResultFrame *out_frame, const AT_ResultFile *file, uint32_t frame);
+
+/** \brief Decodes one frame into a dense row-major field.
+
+    \param values Receives num_voxels values, 0 where the frame has none.
+    \param file Open result file.
+    \param frame Frame index, below frame_count.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the frame is out of range or malformed.
+*/
+AT_Result AT_result_decode_frame(float *values, const AT_ResultFile *file, uint32_t frame);
+
+/** \brief Reads the time series of the voxels holding the given points.
+
+    Frames are only read where the voxel span index says a queried voxel
+    can be present, and only the queried voxels are looked up in them.
+
+    \param out_series Receives one series per point, in point order. Free with AT_result_series_destroy().
+    \param file Open result file.
+    \param points World space positions.
+    \param num_points Number of points.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if a point lies outside the grid or a frame is malformed.
+*/
+AT_Result AT_result_query_points(AT_ResultSeries *out_series,
+                                 const AT_ResultFile *file,
+                                 const AT_Vec3 *points,
+                                 uint32_t num_points);
+
+/** \brief Reads the time series of every voxel overlapping a box.
+
+    \param out_series Receives one series per voxel, in row-major order. Free with AT_result_series_destroy().
+    \param file Open result file.
+    \param box World space box, clipped to the grid.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if a frame is malformed.
+*/
+AT_Result AT_result_query_aabb(AT_ResultSeries *out_series, const AT_ResultFile *file, AT_AABB box);
+
+/** \brief Frees the arrays of a series read with AT_result_query_points() or AT_result_query_aabb().
+ */
+void AT_result_series_destroy(AT_ResultSeries *series);
+
+/** \brief Unmaps the file, frames returned from it are no longer valid.
+ */
+void AT_result_close(AT_ResultFile *file);
+
+#endif // AT_RESULT_FILE_H
@@ -14,6 +14,11 @@ typedef struct AT_Scene AT_Scene;
 /** \brief AT_Scene constructor for a given AT_SceneConfig.
     \relates AT_Scene
 
+    Merges the environment into the polygons rays are traced against once,
+    here. Every simulation of the scene shares them read-only, so several
+    may run at the same time. Simplified runs build their polygons on first
+    use and share them too.
+
     \param out_scene Pointer to an emtpy initialised AT_Scene.
     \param config Pointer to the scene's config.
 
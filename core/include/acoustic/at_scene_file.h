@@ -0,0 +1,73 @@
+/** \file
+    \brief Compiled scene files, models ready to trace straight from mmap
+*/
+
+#ifndef AT_SCENE_FILE_H
+#define AT_SCENE_FILE_H
+
+#include "at.h"
+
+#include <stdint.h>
+
+/*  Compiled scene layout. Sections hold the in-memory types of the machine
+    that wrote the file and start on AT_SCENE_FILE_ALIGNMENT boundaries, so
+    a mapped file is used in place. Files from a machine with another byte
+    order or struct layout are rejected rather than converted.
+
+    header      AT_SCENE_FILE_HEADER_SIZE bytes
+        char     magic[4]           "ATSC"
+        uint16_t version            AT_SCENE_FILE_VERSION
+        uint16_t flags              none defined yet
+        uint32_t byte_order         AT_SCENE_FILE_BYTE_ORDER as written
+        uint32_t triangle_size      sizeof(AT_Triangle)
+        uint64_t triangle_count
+        uint64_t triangles_offset   AT_Triangle[triangle_count], world space
+        uint64_t materials_offset   AT_MaterialId[triangle_count]
+        uint64_t file_size
+        float    aabb_min[3]
+        float    aabb_max[3]
+        uint32_t material_size      sizeof(AT_Material)
+        uint32_t material_count
+        uint64_t table_offset       AT_Material[material_count], the IDs index it
+        uint8_t  reserved[]         zero, up to the header size
+*/
+
+#define AT_SCENE_FILE_MAGIC "ATSC"
+#define AT_SCENE_FILE_VERSION 2
+#define AT_SCENE_FILE_HEADER_SIZE 128
+#define AT_SCENE_FILE_ALIGNMENT 4096
+#define AT_SCENE_FILE_BYTE_ORDER 0x01020304u
+
+/** \brief File extension AT_model_create() loads as a compiled scene. */
+#define AT_SCENE_FILE_EXTENSION ".atscene"
+
+/** \brief Writes a model as a compiled scene.
+
+    Stores the model's world-space triangles with their bounding boxes, the
+    material ID of every triangle, the material table and the bounds of the
+    whole model.
+
+    \param model Pointer to a loaded model, from glTF or a compiled scene.
+    \param path File to create or overwrite.
+
+    \retval AT_Result AT_ERR_IO_FAILURE if the file could not be written.
+*/
+AT_Result AT_scene_file_write(const AT_Model *model, const char *path);
+
+/** \brief Maps a compiled scene as a model.
+
+    The triangles, material IDs and material table stay in the read-only
+    mapping, loading only checks the header, the section bounds and that
+    every ID is in the table. The model has
+    no vertices, indices or normals. AT_model_destroy() unmaps it.
+
+    \param out_model Pointer to an empty AT_Model pointer.
+    \param path Compiled scene to open.
+
+    \retval AT_Result AT_ERR_IO_FAILURE if the file could not be opened or
+   mapped, AT_ERR_INVALID_ARGUMENT if it is not a valid compiled scene for
+   this machine.
+*/
+AT_Result AT_scene_file_open(AT_Model **out_model, const char *path);
+
+#endif // AT_SCENE_FILE_H
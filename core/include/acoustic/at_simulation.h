@@ -36,3 +36,38 @@ void AT_simulation_destroy(AT_Simulation *simulation);
     \retval AT_Result A result enum value which must be checked for errors.
 */
 AT_Result AT_simulation_run(AT_Simulation *simulation);
+
+/** \brief Starts the simulation, handing out frames while it runs.
+
+    The rays advance in epochs of AT_FrameStream::frames_per_epoch
+    frames, each epoch tracing them only as far as it deposits. After
+    each epoch every frame before the earliest ray still in flight is
+    final and goes to the sink, in order. Each epoch deposits
+    into a grid covering only the bins its segments can reach. The voxel
+    grid ends up the same as after AT_simulation_run(), up to float
+    rounding, and the sink sees exactly AT_replay_frame_count() frames.
+    With AT_FrameStream::is_releasing the voxels only hold the frames not
+    yet emitted and end up empty, so the run cannot be exported afterwards.
+
+    \param simulation Pointer to the simulation.
+    \param stream Pointer to the sink and epoch length.
+
+    \retval AT_Result A result enum value which must be checked for errors.
+*/
+AT_Result AT_simulation_run_streamed(AT_Simulation *simulation, const AT_FrameStream *stream);
+
+/** \brief Packs the voxel bins of a finished run into compressed sparse rows.
+
+    Each voxel keeps the run between its first and last non-zero bin, all
+    runs packed into one array in row-major voxel order with an offset and
+    a first bin per voxel. The per-voxel buffers, mostly spare capacity,
+    are freed. Exports, replays, result files and metrics read the same
+    values as before. Running the simulation again is an invalid argument.
+    Calling it on a compacted simulation does nothing.
+
+    \param simulation Pointer to a simulation that has been run.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the packed bins could not be
+   allocated, the grid is left as it was.
+*/
+AT_Result AT_simulation_compact(AT_Simulation *simulation);
@@ -0,0 +1,93 @@
+#ifndef AT_BYTES_H
+#define AT_BYTES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Little endian fields and LEB128 varints, shared by the replay, result,
+// metrics and rANS encoders
+
+static inline void AT_bytes_put_u16(uint8_t *dst, uint16_t value)
+{
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static inline void AT_bytes_put_u32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+    dst[2] = (uint8_t)(value >> 16);
+    dst[3] = (uint8_t)(value >> 24);
+}
+
+static inline void AT_bytes_put_u64(uint8_t *dst, uint64_t value)
+{
+    AT_bytes_put_u32(dst, (uint32_t)value);
+    AT_bytes_put_u32(dst + 4, (uint32_t)(value >> 32));
+}
+
+static inline void AT_bytes_put_f32(uint8_t *dst, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    AT_bytes_put_u32(dst, bits);
+}
+
+static inline uint16_t AT_bytes_get_u16(const uint8_t *src)
+{
+    return (uint16_t)(src[0] | src[1] << 8);
+}
+
+static inline uint32_t AT_bytes_get_u32(const uint8_t *src)
+{
+    return (uint32_t)src[0] | (uint32_t)src[1] << 8 | (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+static inline uint64_t AT_bytes_get_u64(const uint8_t *src)
+{
+    return (uint64_t)AT_bytes_get_u32(src) | (uint64_t)AT_bytes_get_u32(src + 4) << 32;
+}
+
+static inline float AT_bytes_get_f32(const uint8_t *src)
+{
+    uint32_t bits = AT_bytes_get_u32(src);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// LEB128, 7 bits per byte with the high bit set on all but the last
+static inline uint8_t *AT_bytes_put_varint(uint8_t *dst, uint32_t value)
+{
+    while (value >= 0x80) {
+        *dst++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *dst++ = (uint8_t)value;
+    return dst;
+}
+
+static inline size_t AT_bytes_varint_size(uint32_t value)
+{
+    return 1 + (value >= 1u << 7) + (value >= 1u << 14) + (value >= 1u << 21) + (value >= 1u << 28);
+}
+
+// Returns NULL if the varint runs past end or does not fit 32 bits
+static inline const uint8_t *AT_bytes_get_varint(const uint8_t *src, const uint8_t *end, uint32_t *out_value)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (src == end) return NULL;
+        uint8_t byte = *src++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *out_value = value;
+            return src;
+        }
+    }
+    return NULL;
+}
+
+#endif // AT_BYTES_H
@@ -0,0 +1,101 @@
+#include "../src/at_convex.h"
+#include "../src/at_polygon.h"
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline float AT_convex_plane_distance(const AT_ConvexPlane *plane, AT_Vec3 p)
+{
+    return AT_vec3_dot(plane->normal, p) + plane->d;
+}
+
+AT_Result AT_convex_room_create(AT_ConvexRoom *out_room, const AT_PolygonSet *set, const AT_Triangle *triangles, uint32_t count)
+{
+    if (!out_room || !set || (!triangles && count > 0)) return AT_ERR_INVALID_ARGUMENT;
+    *out_room = (AT_ConvexRoom){0};
+    if (!set->is_closed || set->num_polygons < 4 || set->num_polygons > AT_CONVEX_MAX_PLANES) return AT_OK;
+
+    //the corner average of a closed convex surface is inside it
+    AT_Vec3 centre = AT_vec3_zero();
+    for (uint32_t t = 0; t < count; t++) {
+        centre = AT_vec3_add(centre, AT_vec3_add(triangles[t].v1, AT_vec3_add(triangles[t].v2, triangles[t].v3)));
+    }
+    centre = AT_vec3_scale(centre, 1.0f / (3.0f * count));
+
+    AT_ConvexPlane planes[AT_CONVEX_MAX_PLANES];
+    uint32_t num_planes = 0;
+    for (uint32_t p = 0; p < set->num_polygons; p++) {
+        const AT_Polygon *polygon = &set->polygons[p];
+        AT_ConvexPlane plane = {.normal = polygon->normal, .d = polygon->d, .material = polygon->material};
+        float side = AT_convex_plane_distance(&plane, centre);
+        if (fabsf(side) <= AT_CONVEX_TOLERANCE) return AT_OK;
+        if (side < 0.0f) {
+            plane.normal = AT_vec3_scale(plane.normal, -1.0f);
+            plane.d = -plane.d;
+        }
+
+        bool is_shared = false;
+        for (uint32_t q = 0; q < num_planes && !is_shared; q++) {
+            is_shared = AT_vec3_dot(planes[q].normal, plane.normal) >= AT_POLYGON_COPLANAR_COS &&
+                        fabsf(planes[q].d - plane.d) <= AT_CONVEX_TOLERANCE;
+            if (is_shared && planes[q].material != plane.material) return AT_OK;
+        }
+        if (!is_shared) planes[num_planes++] = plane;
+    }
+
+    for (uint32_t t = 0; t < count; t++) {
+        for (uint32_t q = 0; q < num_planes; q++) {
+            if (AT_convex_plane_distance(&planes[q], triangles[t].v1) < -AT_CONVEX_TOLERANCE ||
+                AT_convex_plane_distance(&planes[q], triangles[t].v2) < -AT_CONVEX_TOLERANCE ||
+                AT_convex_plane_distance(&planes[q], triangles[t].v3) < -AT_CONVEX_TOLERANCE) {
+                return AT_OK;
+            }
+        }
+    }
+
+    out_room->planes = malloc(sizeof(AT_ConvexPlane) * num_planes);
+    if (!out_room->planes) return AT_ERR_ALLOC_ERROR;
+    memcpy(out_room->planes, planes, sizeof(AT_ConvexPlane) * num_planes);
+    out_room->num_planes = num_planes;
+    return AT_OK;
+}
+
+bool AT_convex_room_contains(const AT_ConvexRoom *room, AT_Vec3 point)
+{
+    for (uint32_t q = 0; q < room->num_planes; q++) {
+        if (AT_convex_plane_distance(&room->planes[q], point) < -AT_CONVEX_TOLERANCE) return false;
+    }
+    return room->num_planes > 0;
+}
+
+uint32_t AT_convex_room_exit(const AT_ConvexRoom *room, AT_Vec3 origin, AT_Vec3 direction, uint32_t skip, float *out_t)
+{
+    uint32_t hit = AT_CONVEX_NO_PLANE;
+    float nearest = FLT_MAX;
+    for (uint32_t q = 0; q < room->num_planes; q++) {
+        //only planes the ray heads out through
+        float approach = -AT_vec3_dot(room->planes[q].normal, direction);
+        if (q == skip || approach <= 0.0f) continue;
+        //an origin rounded just outside a plane hits it straight away
+        float t = fmaxf(AT_convex_plane_distance(&room->planes[q], origin), 0.0f) / approach;
+        if (t < nearest) {
+            nearest = t;
+            hit = q;
+        }
+    }
+    *out_t = nearest;
+    return hit;
+}
+
+void AT_convex_room_destroy(AT_ConvexRoom *room)
+{
+    if (!room) return;
+    free(room->planes);
+    *room = (AT_ConvexRoom){0};
+}
@@ -0,0 +1,70 @@
+#ifndef AT_CONVEX_H
+#define AT_CONVEX_H
+
+#include "acoustic/at.h"
+#include "../src/at_polygon.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** \brief Most planes a room may have to be traced with the half-space kernel. */
+#define AT_CONVEX_MAX_PLANES 64
+
+/** \brief How far outside a plane a corner or a source may sit, in metres. */
+#define AT_CONVEX_TOLERANCE 1e-4f
+
+#define AT_CONVEX_NO_PLANE UINT32_MAX
+
+/** \brief Wall of a convex room, the normal points into the room. */
+typedef struct {
+    AT_Vec3 normal;
+    float d;
+    AT_MaterialId material;
+} AT_ConvexPlane;
+
+/** \brief A closed convex room as the intersection of its wall half-spaces.
+
+    Every point of the room has dot(normal, p) + d >= 0 for every plane, so
+    a ray from inside leaves through the nearest plane it heads towards.
+    num_planes is 0 when the model is not such a room.
+ */
+typedef struct {
+    AT_ConvexPlane *planes;
+    uint32_t num_planes;
+} AT_ConvexRoom;
+
+/** \brief Recognises a closed convex room.
+
+    The polygons must close the surface and every corner must lie inside
+    every polygon plane. Coplanar polygons share one plane, which needs a
+    single material. Anything else leaves the room empty and the tracer
+    searches polygons instead.
+
+    \param out_room Pointer to an empty AT_ConvexRoom.
+    \param set Polygons merged from the triangles.
+    \param triangles Triangles of the model.
+    \param count Number of triangles.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the planes could not be stored.
+ */
+AT_Result AT_convex_room_create(AT_ConvexRoom *out_room, const AT_PolygonSet *set, const AT_Triangle *triangles, uint32_t count);
+
+/** \brief Whether a point is inside the room, within AT_CONVEX_TOLERANCE. */
+bool AT_convex_room_contains(const AT_ConvexRoom *room, AT_Vec3 point);
+
+/** \brief Finds where a ray from inside the room leaves it.
+
+    \param room Pointer to a convex room.
+    \param origin Ray origin, inside the room.
+    \param direction Ray direction.
+    \param skip Plane the ray starts on, AT_CONVEX_NO_PLANE for none.
+    \param out_t Receives the distance along the direction to the hit.
+
+    \retval uint32_t Index of the plane hit, AT_CONVEX_NO_PLANE if none.
+ */
+uint32_t AT_convex_room_exit(const AT_ConvexRoom *room, AT_Vec3 origin, AT_Vec3 direction, uint32_t skip, float *out_t);
+
+/** \brief Frees the planes of a convex room. */
+void AT_convex_room_destroy(AT_ConvexRoom *room);
+
+#endif // AT_CONVEX_H
@@ -0,0 +1,555 @@
+#include "../src/at_deposit.h"
+#include "../src/at_thread.h"
+#include "../src/at_utils.h"
+#include "at_internal.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static AT_Result AT_deposit_grid_init(AT_DepositGrid *grid, uint32_t num_voxels, uint32_t first_bin, uint32_t num_bins)
+{
+    grid->num_tiles = (num_voxels + AT_DEPOSIT_TILE_MASK) >> AT_DEPOSIT_TILE_SHIFT;
+    grid->first_bin = first_bin;
+    grid->num_bins = num_bins;
+    grid->tile_floats = (size_t)AT_DEPOSIT_TILE_VOXELS * num_bins;
+    grid->tiles = calloc(grid->num_tiles, sizeof(float*));
+    if (!grid->tiles) return AT_ERR_ALLOC_ERROR;
+    return AT_OK;
+}
+
+static void AT_deposit_grid_free(AT_DepositGrid *grid, bool owns_tiles)
+{
+    if (!grid->tiles) return;
+    if (owns_tiles) {
+        for (uint32_t i = 0; i < grid->num_tiles; i++) {
+            free(grid->tiles[i]);
+        }
+    }
+    free(grid->tiles);
+    grid->tiles = NULL;
+}
+
+float *AT_deposit_grid_tile(AT_DepositGrid *grid, uint32_t tile_idx)
+{
+    if (tile_idx >= grid->num_tiles) return NULL;
+    if (!grid->tiles[tile_idx]) {
+        grid->tiles[tile_idx] = calloc(grid->tile_floats, sizeof(float));
+    }
+    return grid->tiles[tile_idx];
+}
+
+static AT_Result AT_deposit_block_map_init(AT_DepositBlockMap *map, uint32_t capacity)
+{
+    map->slots = malloc(sizeof(AT_DepositSlot) * capacity);
+    if (!map->slots) return AT_ERR_ALLOC_ERROR;
+
+    for (uint32_t i = 0; i < capacity; i++) {
+        map->slots[i].key = AT_DEPOSIT_EMPTY_KEY;
+    }
+    map->capacity = capacity;
+    map->count = 0;
+    return AT_OK;
+}
+
+static void AT_deposit_block_map_free(AT_DepositBlockMap *map)
+{
+    free(map->slots);
+    *map = (AT_DepositBlockMap){0};
+}
+
+AT_Result AT_deposit_block_map_grow(AT_DepositBlockMap *map)
+{
+    AT_DepositBlockMap old = *map;
+    if (AT_deposit_block_map_init(map, old.capacity * 2) != AT_OK) {
+        *map = old;
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    uint32_t mask = map->capacity - 1;
+    for (uint32_t i = 0; i < old.capacity; i++) {
+        if (old.slots[i].key == AT_DEPOSIT_EMPTY_KEY) continue;
+        uint32_t j = (uint32_t)((old.slots[i].key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+        while (map->slots[j].key != AT_DEPOSIT_EMPTY_KEY) {
+            j = (j + 1) & mask;
+        }
+        map->slots[j] = old.slots[i];
+    }
+    map->count = old.count;
+
+    AT_deposit_block_map_free(&old);
+    return AT_OK;
+}
+
+// LSD radix sort on the cell keys, 8 bits per pass, only as many passes as
+// the largest key needs. Stable, so equal keys would keep their order.
+static void AT_deposit_sort_cells(AT_DepositCell *cells, AT_DepositCell *tmp, uint32_t n, uint64_t max_key)
+{
+    AT_DepositCell *src = cells;
+    AT_DepositCell *dst = tmp;
+
+    for (uint32_t shift = 0; shift < 64 && (max_key >> shift) != 0; shift += 8) {
+        uint32_t counts[256] = {0};
+        for (uint32_t i = 0; i < n; i++) {
+            counts[(src[i].key >> shift) & 0xFF]++;
+        }
+        uint32_t offset = 0;
+        for (uint32_t d = 0; d < 256; d++) {
+            uint32_t c = counts[d];
+            counts[d] = offset;
+            offset += c;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            dst[counts[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
+        AT_DepositCell *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != cells) memcpy(cells, src, sizeof(AT_DepositCell) * n);
+}
+
+AT_DepositStrategy AT_deposit_choose_strategy(uint32_t num_voxels, uint32_t num_bins, uint32_t num_threads)
+{
+    if (num_threads <= 1) return AT_DEPOSIT_PRIVATE;
+
+    size_t grid_bytes = (size_t)num_voxels * num_bins * sizeof(float);
+    if (grid_bytes <= AT_DEPOSIT_PRIVATE_BUDGET_BYTES / num_threads) {
+        return AT_DEPOSIT_PRIVATE;
+    }
+    return AT_DEPOSIT_ATOMIC;
+}
+
+AT_Result AT_deposit_create(AT_Deposit *out_deposit,
+                            AT_DepositStrategy strategy,
+                            uint32_t num_voxels,
+                            uint32_t first_bin,
+                            uint32_t num_bins,
+                            uint32_t num_threads,
+                            uint32_t num_rays,
+                            bool is_compensated)
+{
+    if (!out_deposit || num_voxels == 0 || num_bins == 0) return AT_ERR_INVALID_ARGUMENT;
+    if (num_threads == 0) num_threads = 1;
+
+    if (strategy == AT_DEPOSIT_AUTO) {
+        strategy = AT_deposit_choose_strategy(num_voxels, num_bins, num_threads);
+    }
+
+    // lanes point back into the deposit, so build it in place
+    AT_Deposit *deposit = out_deposit;
+    *deposit = (AT_Deposit){
+        .strategy = strategy,
+        .num_voxels = num_voxels,
+        .first_bin = first_bin,
+        .num_bins = num_bins,
+        .num_threads = num_threads,
+        .is_compensated = is_compensated,
+    };
+
+    deposit->lanes = calloc(num_threads, sizeof(AT_DepositLane));
+    if (!deposit->lanes) return AT_ERR_ALLOC_ERROR;
+
+    if (strategy == AT_DEPOSIT_ATOMIC) {
+        if (AT_deposit_grid_init(&deposit->shared, num_voxels, first_bin, num_bins) != AT_OK) {
+            AT_deposit_destroy(deposit);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        deposit->dense = calloc((size_t)deposit->shared.num_tiles * deposit->shared.tile_floats, sizeof(float));
+        if (!deposit->dense) {
+            AT_deposit_destroy(deposit);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        for (uint32_t i = 0; i < deposit->shared.num_tiles; i++) {
+            deposit->shared.tiles[i] = deposit->dense + (size_t)i * deposit->shared.tile_floats;
+        }
+        for (uint32_t t = 0; t < num_threads; t++) {
+            deposit->lanes[t] = (AT_DepositLane){ .grid = &deposit->shared, .is_atomic = true };
+        }
+    } else if (strategy == AT_DEPOSIT_DETERMINISTIC) {
+        if (pthread_mutex_init(&deposit->fold_lock, NULL) != 0) {
+            AT_deposit_destroy(deposit);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        if (pthread_cond_init(&deposit->fold_done, NULL) != 0) {
+            pthread_mutex_destroy(&deposit->fold_lock);
+            AT_deposit_destroy(deposit);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        deposit->has_fold_lock = true;
+
+        deposit->num_blocks = (num_rays + AT_DEPOSIT_BLOCK_RAYS - 1) / AT_DEPOSIT_BLOCK_RAYS;
+        deposit->num_block_slots = AT_max(AT_min(deposit->num_blocks, AT_DEPOSIT_PENDING_BLOCKS_PER_LANE * num_threads), 1u);
+        deposit->blocks = calloc(deposit->num_block_slots, sizeof(AT_DepositBlock));
+        deposit->block_maps = calloc(num_threads, sizeof(AT_DepositBlockMap));
+        if (!deposit->blocks || !deposit->block_maps ||
+            AT_deposit_grid_init(&deposit->shared, num_voxels, first_bin, num_bins) != AT_OK ||
+            (is_compensated &&
+             AT_deposit_grid_init(&deposit->compensation, num_voxels, first_bin, num_bins) != AT_OK)) {
+            AT_deposit_destroy(deposit);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        for (uint32_t t = 0; t < num_threads; t++) {
+            if (AT_deposit_block_map_init(&deposit->block_maps[t], AT_DEPOSIT_BLOCK_MAP_CAPACITY) != AT_OK) {
+                AT_deposit_destroy(deposit);
+                return AT_ERR_ALLOC_ERROR;
+            }
+            deposit->lanes[t] = (AT_DepositLane){
+                .grid = &deposit->shared,
+                .block_map = &deposit->block_maps[t],
+                .is_compensated = is_compensated
+            };
+        }
+    } else {
+        deposit->privates = calloc(num_threads, sizeof(AT_DepositGrid));
+        if (!deposit->privates) {
+            AT_deposit_destroy(deposit);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        for (uint32_t t = 0; t < num_threads; t++) {
+            if (AT_deposit_grid_init(&deposit->privates[t], num_voxels, first_bin, num_bins) != AT_OK) {
+                AT_deposit_destroy(deposit);
+                return AT_ERR_ALLOC_ERROR;
+            }
+            deposit->lanes[t] = (AT_DepositLane){ .grid = &deposit->privates[t], .is_atomic = false };
+        }
+    }
+
+    return AT_OK;
+}
+
+typedef struct {
+    AT_Deposit *deposit;
+    AT_Voxel *voxel_grid;
+    uint32_t voxel_first_bin;
+    uint32_t end_bin;
+    AT_Result result;
+} AT_DepositFinishCtx;
+
+// Sums the per-thread copies of one tile into privates[0] pairwise, so the
+// additions form a balanced tree over the threads.
+static void AT_deposit_reduce_tile(AT_Deposit *deposit, uint32_t tile_idx)
+{
+    const uint32_t n = deposit->num_threads;
+    const size_t tile_floats = deposit->privates[0].tile_floats;
+
+    for (uint32_t stride = 1; stride < n; stride *= 2) {
+        for (uint32_t i = 0; i + stride < n; i += 2 * stride) {
+            float **dst = &deposit->privates[i].tiles[tile_idx];
+            float **src = &deposit->privates[i + stride].tiles[tile_idx];
+            if (!*src) continue;
+            if (!*dst) {
+                *dst = *src;
+                *src = NULL;
+                continue;
+            }
+            for (size_t f = 0; f < tile_floats; f++) {
+                (*dst)[f] += (*src)[f];
+            }
+            free(*src);
+            *src = NULL;
+        }
+    }
+}
+
+// Grows a voxel to hold \a end bins, zeroing the new ones. Same growth as
+// AT_da_reserve, but a failed realloc is returned instead of asserted.
+static AT_Result AT_deposit_voxel_grow(AT_Voxel *voxel, size_t end)
+{
+    if (end > voxel->capacity) {
+        size_t capacity = voxel->capacity ? voxel->capacity : AT_DA_INITIAL_CAPACITY;
+        while (capacity < end) capacity *= 2;
+        float *items = AT_REALLOC(voxel->items, capacity * sizeof(float));
+        if (!items) return AT_ERR_ALLOC_ERROR;
+        voxel->items = items;
+        voxel->capacity = capacity;
+    }
+    memset(voxel->items + voxel->count, 0, (end - voxel->count) * sizeof(float));
+    voxel->count = end;
+    return AT_OK;
+}
+
+// Adds a tile's series to its voxels, whose first item holds bin
+// voxel_first_bin, and raises *end_bin to one past the last bin written
+static AT_Result AT_deposit_commit_tile(const AT_DepositGrid *grid, uint32_t tile_idx, uint32_t num_voxels,
+                                        AT_Voxel *voxel_grid, uint32_t voxel_first_bin, uint32_t *end_bin)
+{
+    const float *tile = grid->tiles[tile_idx];
+    if (!tile) return AT_OK;
+
+    uint32_t first = tile_idx << AT_DEPOSIT_TILE_SHIFT;
+    uint32_t last = AT_min(first + AT_DEPOSIT_TILE_VOXELS, num_voxels);
+
+    for (uint32_t v = first; v < last; v++) {
+        const float *series = tile + (size_t)(v - first) * grid->num_bins;
+
+        size_t count = grid->num_bins;
+        while (count > 0 && series[count - 1] == 0.0f) count--;
+        if (count == 0) continue;
+
+        //the series starts at the grid's first bin
+        size_t start = grid->first_bin - voxel_first_bin;
+        size_t end = start + count;
+        AT_Voxel *voxel = &voxel_grid[v];
+        if (voxel->count < end && AT_deposit_voxel_grow(voxel, end) != AT_OK) {
+            return AT_ERR_ALLOC_ERROR;
+        }
+        *end_bin = AT_max(*end_bin, grid->first_bin + (uint32_t)count);
+        float *items = voxel->items + start;
+        for (size_t b = 0; b < count; b++) {
+            items[b] += series[b];
+        }
+    }
+    return AT_OK;
+}
+
+// Adds key sorted cells into a grid, looking the tile up only when the key
+// crosses into a new one. Tiles are allocated on first touch, which is only
+// safe for grids this caller owns (or whose tiles are all preallocated).
+static AT_Result AT_deposit_apply_cells(AT_DepositGrid *grid, AT_DepositGrid *compensation,
+                                        const AT_DepositCell *cells, uint32_t count)
+{
+    const uint64_t tile_keys = (uint64_t)AT_DEPOSIT_TILE_VOXELS * grid->num_bins;
+    uint64_t tile_first_key = 0;
+    uint64_t tile_end_key = 0;
+    float *tile = NULL;
+    float *tile_compensation = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t key = cells[i].key;
+        if (key >= tile_end_key || key < tile_first_key) {
+            uint32_t tile_idx = (uint32_t)(key / tile_keys);
+            tile_first_key = tile_idx * tile_keys;
+            tile_end_key = tile_first_key + tile_keys;
+            tile = AT_deposit_grid_tile(grid, tile_idx);
+            if (!tile) return AT_ERR_ALLOC_ERROR;
+            if (compensation) {
+                tile_compensation = AT_deposit_grid_tile(compensation, tile_idx);
+                if (!tile_compensation) return AT_ERR_ALLOC_ERROR;
+            }
+        }
+
+        size_t offset = (size_t)(key - tile_first_key);
+        if (compensation) {
+            AT_deposit_kahan_add(&tile[offset], &tile_compensation[offset], cells[i].value);
+        } else {
+            tile[offset] += cells[i].value;
+        }
+    }
+    return AT_OK;
+}
+
+// Called with the fold lock held, which is dropped while cells are added.
+// Only one lane folds at a time, the others keep tracing meanwhile.
+static AT_Result AT_deposit_fold_blocks(AT_Deposit *deposit)
+{
+    if (deposit->is_folding) return AT_OK;
+    deposit->is_folding = true;
+
+    AT_Result res = AT_OK;
+    while (deposit->fold_result == AT_OK && deposit->next_fold < deposit->num_blocks) {
+        AT_DepositBlock *slot = &deposit->blocks[deposit->next_fold % deposit->num_block_slots];
+        if (!slot->cells) break;
+        AT_DepositBlock block = *slot;
+
+        pthread_mutex_unlock(&deposit->fold_lock);
+        res = AT_deposit_apply_cells(&deposit->shared,
+                                     deposit->is_compensated ? &deposit->compensation : NULL,
+                                     block.cells, block.count);
+        free(block.cells);
+        pthread_mutex_lock(&deposit->fold_lock);
+
+        *slot = (AT_DepositBlock){0};
+        deposit->pending_bytes -= sizeof(AT_DepositCell) * block.count;
+        deposit->next_fold++;
+        pthread_cond_broadcast(&deposit->fold_done);
+        if (res != AT_OK) {
+            deposit->fold_result = res;
+            break;
+        }
+    }
+
+    deposit->is_folding = false;
+    return res;
+}
+
+AT_Result AT_deposit_block_end(AT_Deposit *deposit, AT_DepositLane *lane, uint32_t block_idx)
+{
+    if (!deposit || !lane) return AT_ERR_INVALID_ARGUMENT;
+    if (!lane->block_map) return AT_OK;
+    if (block_idx >= deposit->num_blocks) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_DepositBlockMap *map = lane->block_map;
+
+    //the oldest unfolded block is never waited on, so some lane can always
+    //close it and let this one through
+    pthread_mutex_lock(&deposit->fold_lock);
+    while (deposit->fold_result == AT_OK && block_idx >= deposit->next_fold + deposit->num_block_slots) {
+        pthread_cond_wait(&deposit->fold_done, &deposit->fold_lock);
+    }
+    AT_Result res = deposit->fold_result;
+    pthread_mutex_unlock(&deposit->fold_lock);
+
+    AT_DepositCell *cells = NULL;
+    AT_DepositCell *tmp = NULL;
+    if (res == AT_OK) {
+        cells = malloc(sizeof(AT_DepositCell) * (map->count ? map->count : 1));
+        tmp = malloc(sizeof(AT_DepositCell) * (map->count ? map->count : 1));
+        if (!cells || !tmp) res = AT_ERR_ALLOC_ERROR;
+    }
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < map->capacity && map->count > 0; i++) {
+        AT_DepositSlot *slot = &map->slots[i];
+        if (slot->key == AT_DEPOSIT_EMPTY_KEY) continue;
+        if (res == AT_OK) {
+            cells[n++] = (AT_DepositCell){
+                .key = slot->key,
+                .value = lane->is_compensated ? slot->sum - slot->compensation : slot->sum
+            };
+        }
+        slot->key = AT_DEPOSIT_EMPTY_KEY;
+    }
+    map->count = 0;
+
+    if (res != AT_OK) {
+        free(cells);
+        free(tmp);
+        AT_deposit_abort(deposit, res);
+        return res;
+    }
+
+    // keys are unique, so the sorted order (and therefore the fold) is fully determined
+    uint64_t max_key = (uint64_t)deposit->num_voxels * deposit->num_bins;
+    AT_deposit_sort_cells(cells, tmp, n, max_key);
+    free(tmp);
+
+    pthread_mutex_lock(&deposit->fold_lock);
+    deposit->blocks[block_idx % deposit->num_block_slots] = (AT_DepositBlock){ .cells = cells, .count = n };
+    deposit->pending_bytes += sizeof(AT_DepositCell) * n;
+    deposit->peak_pending_bytes = AT_max(deposit->peak_pending_bytes, deposit->pending_bytes);
+    res = AT_deposit_fold_blocks(deposit);
+    if (res == AT_OK) res = deposit->fold_result;
+    pthread_mutex_unlock(&deposit->fold_lock);
+    return res;
+}
+
+void AT_deposit_abort(AT_Deposit *deposit, AT_Result result)
+{
+    if (!deposit || !deposit->has_fold_lock) return;
+
+    pthread_mutex_lock(&deposit->fold_lock);
+    if (deposit->fold_result == AT_OK) deposit->fold_result = result;
+    pthread_cond_broadcast(&deposit->fold_done);
+    pthread_mutex_unlock(&deposit->fold_lock);
+}
+
+// Kahan terms of tiles [first_tile, last_tile) are applied once every block
+// is in. The tiles are owned by the calling worker only.
+static void AT_deposit_compensate_tiles(AT_Deposit *deposit, uint32_t first_tile, uint32_t last_tile)
+{
+    for (uint32_t t = first_tile; t < last_tile; t++) {
+        float *tile = deposit->shared.tiles[t];
+        const float *compensation = deposit->compensation.tiles[t];
+        if (!tile || !compensation) continue;
+        for (size_t f = 0; f < deposit->shared.tile_floats; f++) {
+            tile[f] -= compensation[f];
+        }
+    }
+}
+
+static void AT_deposit_finish_worker(void *ctx, uint32_t thread_idx)
+{
+    AT_DepositFinishCtx *finish = ctx;
+    AT_Deposit *deposit = finish->deposit;
+
+    const bool is_shared = deposit->strategy == AT_DEPOSIT_ATOMIC ||
+                           deposit->strategy == AT_DEPOSIT_DETERMINISTIC;
+    const AT_DepositGrid *result = is_shared ? &deposit->shared : &deposit->privates[0];
+
+    // each worker owns a contiguous slice of tiles, so no two touch the same voxel
+    uint32_t num_tiles = result->num_tiles;
+    uint32_t first = (uint32_t)((uint64_t)num_tiles * thread_idx / deposit->num_threads);
+    uint32_t last = (uint32_t)((uint64_t)num_tiles * (thread_idx + 1) / deposit->num_threads);
+
+    if (deposit->is_compensated) {
+        AT_deposit_compensate_tiles(deposit, first, last);
+    }
+
+    uint32_t end_bin = 0;
+    AT_Result res = AT_OK;
+    for (uint32_t t = first; t < last && res == AT_OK; t++) {
+        if (!is_shared) {
+            AT_deposit_reduce_tile(deposit, t);
+        }
+        res = AT_deposit_commit_tile(result, t, deposit->num_voxels, finish->voxel_grid,
+                                     finish->voxel_first_bin, &end_bin);
+    }
+    if (res != AT_OK) {
+        __atomic_store_n(&finish->result, res, __ATOMIC_RELAXED);
+    }
+
+    uint32_t seen = __atomic_load_n(&finish->end_bin, __ATOMIC_RELAXED);
+    while (end_bin > seen &&
+           !__atomic_compare_exchange_n(&finish->end_bin, &seen, end_bin, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+AT_Result AT_deposit_finish(AT_Deposit *deposit, AT_Voxel *voxel_grid, uint32_t voxel_first_bin)
+{
+    if (!deposit || !voxel_grid || voxel_first_bin > deposit->first_bin) return AT_ERR_INVALID_ARGUMENT;
+
+    //every block has to be folded, or a lane gave up on one
+    if (deposit->strategy == AT_DEPOSIT_DETERMINISTIC) {
+        if (deposit->fold_result != AT_OK) return deposit->fold_result;
+        if (deposit->next_fold != deposit->num_blocks) return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    AT_DepositFinishCtx ctx = {
+        .deposit = deposit,
+        .voxel_grid = voxel_grid,
+        .voxel_first_bin = voxel_first_bin,
+        .result = AT_OK,
+    };
+
+    AT_Result res = AT_thread_run(deposit->num_threads, AT_deposit_finish_worker, &ctx);
+    deposit->end_bin = ctx.end_bin;
+    return (res != AT_OK) ? res : ctx.result;
+}
+
+void AT_deposit_destroy(AT_Deposit *deposit)
+{
+    if (!deposit) return;
+
+    if (deposit->privates) {
+        for (uint32_t t = 0; t < deposit->num_threads; t++) {
+            AT_deposit_grid_free(&deposit->privates[t], true);
+        }
+    }
+    if (deposit->block_maps) {
+        for (uint32_t t = 0; t < deposit->num_threads; t++) {
+            AT_deposit_block_map_free(&deposit->block_maps[t]);
+        }
+    }
+    if (deposit->blocks) {
+        for (uint32_t b = 0; b < deposit->num_block_slots; b++) {
+            free(deposit->blocks[b].cells);
+        }
+    }
+    if (deposit->has_fold_lock) {
+        pthread_mutex_destroy(&deposit->fold_lock);
+        pthread_cond_destroy(&deposit->fold_done);
+    }
+    // atomic shared tiles point into the dense block
+    AT_deposit_grid_free(&deposit->shared, deposit->dense == NULL);
+    AT_deposit_grid_free(&deposit->compensation, true);
+
+    free(deposit->dense);
+    free(deposit->block_maps);
+    free(deposit->blocks);
+    free(deposit->privates);
+    free(deposit->lanes);
+    *deposit = (AT_Deposit){0};
+}
@@ -0,0 +1,270 @@
+#ifndef AT_DEPOSIT_H
+#define AT_DEPOSIT_H
+
+#include "acoustic/at.h"
+#include "at_internal.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Voxels are grouped into tiles of 64, each tile holding 64 * num_bins floats
+// (voxel major, so one voxel's time series is contiguous).
+#define AT_DEPOSIT_TILE_SHIFT 6
+#define AT_DEPOSIT_TILE_VOXELS (1u << AT_DEPOSIT_TILE_SHIFT)
+#define AT_DEPOSIT_TILE_MASK (AT_DEPOSIT_TILE_VOXELS - 1)
+
+// AT_DEPOSIT_DETERMINISTIC partitions rays into blocks of this many ray indices
+#define AT_DEPOSIT_BLOCK_RAYS 64
+// Finished blocks wait to be folded in block order, a lane that gets this
+// many blocks per lane ahead of the oldest unfolded one waits for it
+#define AT_DEPOSIT_PENDING_BLOCKS_PER_LANE 4
+#define AT_DEPOSIT_BLOCK_MAP_CAPACITY (1u << 16)
+#define AT_DEPOSIT_EMPTY_KEY UINT64_MAX
+
+// AT_DEPOSIT_AUTO only privatises the grid when a full copy per thread fits here
+#define AT_DEPOSIT_PRIVATE_BUDGET_BYTES ((size_t)512 * 1024 * 1024)
+
+// Tiled accumulation grid. Tiles are allocated on first touch, so a private
+// grid only costs memory for the part of the room its rays actually cross.
+typedef struct {
+    float **tiles;
+    uint32_t num_tiles;
+    uint32_t first_bin; //the grid holds bins [first_bin, first_bin + num_bins)
+    uint32_t num_bins;
+    size_t tile_floats;
+} AT_DepositGrid;
+
+// One 16 byte slot, so a probe touches a single cache line
+typedef struct {
+    uint64_t key;
+    float sum;
+    float compensation;
+} AT_DepositSlot;
+
+// Sparse per-block accumulator (open addressing, linear probing).
+// Cells are keyed by voxel * num_bins + bin.
+typedef struct {
+    AT_DepositSlot *slots;
+    uint32_t capacity;
+    uint32_t count;
+} AT_DepositBlockMap;
+
+typedef struct {
+    uint64_t key;
+    float value;
+} AT_DepositCell;
+
+// Finished block partial: unique cells in ascending key order, NULL cells
+// until the block is finished.
+typedef struct {
+    AT_DepositCell *cells;
+    uint32_t count;
+} AT_DepositBlock;
+
+// Per-thread handle used by the DDA to deposit energy.
+typedef struct {
+    AT_DepositGrid *grid;
+    AT_DepositBlockMap *block_map; // only set for AT_DEPOSIT_DETERMINISTIC
+    bool is_atomic;
+    bool is_compensated;
+} AT_DepositLane;
+
+typedef struct {
+    AT_DepositStrategy strategy;
+    uint32_t num_voxels;
+    uint32_t first_bin;
+    uint32_t num_bins;
+    uint32_t num_threads;
+    float *dense; // backing block for the shared grid (atomic strategy)
+    AT_DepositGrid shared;
+    AT_DepositGrid compensation; // Kahan terms, deterministic + compensated only
+    AT_DepositGrid *privates;
+    AT_DepositBlockMap *block_maps;
+    AT_DepositBlock *blocks; // ring of finished blocks, block_idx % num_block_slots
+    uint32_t num_blocks;
+    uint32_t num_block_slots;
+    uint32_t next_fold; // blocks before this one are in the shared grid
+    bool is_folding; // a lane is folding, the others keep tracing
+    AT_Result fold_result; // first failure, returned to every lane after it
+    size_t pending_bytes; // cells of finished blocks not folded yet
+    size_t peak_pending_bytes;
+    pthread_mutex_t fold_lock;
+    pthread_cond_t fold_done;
+    bool has_fold_lock;
+    bool is_compensated;
+    AT_DepositLane *lanes;
+    uint32_t end_bin; // one past the last bin AT_deposit_finish wrote, 0 if none
+} AT_Deposit;
+
+/** \brief Picks the strategy AT_DEPOSIT_AUTO resolves to.
+
+    A single thread always uses a private grid (plain adds, no reduction).
+    Otherwise per-thread grids are used while a full copy per thread stays
+    under AT_DEPOSIT_PRIVATE_BUDGET_BYTES, and atomics beyond that.
+*/
+AT_DepositStrategy AT_deposit_choose_strategy(uint32_t num_voxels,
+                                              uint32_t num_bins,
+                                              uint32_t num_threads);
+
+/** \brief AT_Deposit constructor.
+
+    \param out_deposit Pointer to an empty AT_Deposit.
+    \param strategy Requested strategy, AT_DEPOSIT_AUTO is resolved here.
+    \param num_voxels Number of voxels in the grid.
+    \param first_bin First time bin the deposit accepts, 0 for a whole run.
+    \param num_bins Number of time bins per voxel, from \a first_bin on.
+    \param num_threads Number of lanes to create.
+    \param num_rays Number of root rays, used to size the deterministic blocks.
+    \param is_compensated Use Kahan summation in deterministic mode.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the grids could not be allocated.
+*/
+AT_Result AT_deposit_create(AT_Deposit *out_deposit,
+                            AT_DepositStrategy strategy,
+                            uint32_t num_voxels,
+                            uint32_t first_bin,
+                            uint32_t num_bins,
+                            uint32_t num_threads,
+                            uint32_t num_rays,
+                            bool is_compensated);
+
+/** \brief Allocates a missing tile of a grid. */
+float *AT_deposit_grid_tile(AT_DepositGrid *grid, uint32_t tile_idx);
+
+/** \brief Doubles a block map, rehashing its cells. */
+AT_Result AT_deposit_block_map_grow(AT_DepositBlockMap *map);
+
+/** \brief Closes the block a lane has been depositing into.
+
+    In deterministic mode the lane's accumulator is sorted and stored as
+    block \a block_idx, then cleared for the next block. Finished blocks
+    are folded into the shared grid in block order as soon as every
+    earlier block is in, by whichever lane finds them ready, so only the
+    blocks finished out of order are held. A lane more than
+    AT_DEPOSIT_PENDING_BLOCKS_PER_LANE blocks per lane ahead of the oldest
+    unfolded block waits for it first. Every ray of a block must be
+    deposited by the same lane between two calls, and blocks must be
+    claimed in ascending order. Other strategies ignore this call.
+
+    \param deposit Pointer to the deposit owning the lane.
+    \param lane Lane that deposited the block.
+    \param block_idx First ray index of the block / AT_DEPOSIT_BLOCK_RAYS.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the block could not be stored
+   or folded, or the error another lane passed to AT_deposit_abort().
+*/
+AT_Result AT_deposit_block_end(AT_Deposit *deposit, AT_DepositLane *lane, uint32_t block_idx);
+
+/** \brief Stops the deterministic blocks after a lane failed.
+
+    Lanes waiting in AT_deposit_block_end(), and every later call, return
+    \a result instead of waiting for a block that will never be closed.
+    Other strategies ignore this call.
+*/
+void AT_deposit_abort(AT_Deposit *deposit, AT_Result result);
+
+/** \brief Merges the lanes and copies the result into the voxel grid.
+
+    Private grids are reduced tile by tile, each worker owning a slice of
+    the tiles and summing the per-thread copies pairwise (tree order). The
+    merged series are then written into each voxel's bins, trimmed after
+    the last non-zero bin, and added to what the voxels already hold, so
+    deposits covering successive bin windows can be finished one after
+    another. Deterministic blocks are already folded in block order, so
+    the result does not depend on the thread count. One past the last bin
+    written is left in AT_Deposit::end_bin, so callers need not scan the
+    voxels for it.
+
+    \param deposit Pointer to a deposit every lane has finished with.
+    \param voxel_grid Array of num_voxels initialised voxels.
+    \param voxel_first_bin Bin each voxel's first item holds, 0 unless a
+   stream has released the bins before it. At most the deposit's first bin.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if a voxel could not be grown.
+*/
+AT_Result AT_deposit_finish(AT_Deposit *deposit, AT_Voxel *voxel_grid, uint32_t voxel_first_bin);
+
+/** \brief Frees every grid owned by the deposit. */
+void AT_deposit_destroy(AT_Deposit *deposit);
+
+static inline void AT_deposit_atomic_add_float(float *dst, float value)
+{
+    uint32_t *bits = (uint32_t*)dst;
+    uint32_t old_bits = __atomic_load_n(bits, __ATOMIC_RELAXED);
+    uint32_t new_bits;
+    do {
+        float f;
+        memcpy(&f, &old_bits, sizeof(f));
+        f += value;
+        memcpy(&new_bits, &f, sizeof(f));
+    } while (!__atomic_compare_exchange_n(bits, &old_bits, new_bits, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline void AT_deposit_kahan_add(float *sum, float *compensation, float value)
+{
+    float y = value - *compensation;
+    float t = *sum + y;
+    *compensation = (t - *sum) - y;
+    *sum = t;
+}
+
+static inline AT_Result AT_deposit_block_add(AT_DepositBlockMap *map, bool is_compensated, uint64_t key, float energy)
+{
+    if ((map->count + 1) * 2 > map->capacity) {
+        if (AT_deposit_block_map_grow(map) != AT_OK) return AT_ERR_ALLOC_ERROR;
+    }
+
+    uint32_t mask = map->capacity - 1;
+    uint32_t i = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (map->slots[i].key != key && map->slots[i].key != AT_DEPOSIT_EMPTY_KEY) {
+        i = (i + 1) & mask;
+    }
+
+    AT_DepositSlot *slot = &map->slots[i];
+    if (slot->key == AT_DEPOSIT_EMPTY_KEY) {
+        *slot = (AT_DepositSlot){ .key = key };
+        map->count++;
+    }
+
+    if (is_compensated) {
+        AT_deposit_kahan_add(&slot->sum, &slot->compensation, energy);
+    } else {
+        slot->sum += energy;
+    }
+    return AT_OK;
+}
+
+static inline AT_Result AT_deposit_add(AT_DepositLane *lane, uint32_t voxel_idx, uint32_t bin_index, float energy)
+{
+    AT_DepositGrid *grid = lane->grid;
+    bin_index -= grid->first_bin; //bins before the window wrap around and are rejected
+    if (bin_index >= grid->num_bins) return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t tile_idx = voxel_idx >> AT_DEPOSIT_TILE_SHIFT;
+    if (tile_idx >= grid->num_tiles) return AT_ERR_INVALID_ARGUMENT;
+
+    if (lane->block_map) {
+        uint64_t key = (uint64_t)voxel_idx * grid->num_bins + bin_index;
+        return AT_deposit_block_add(lane->block_map, lane->is_compensated, key, energy);
+    }
+
+    float *tile = grid->tiles[tile_idx];
+    if (!tile) {
+        tile = AT_deposit_grid_tile(grid, tile_idx);
+        if (!tile) return AT_ERR_ALLOC_ERROR;
+    }
+
+    float *cell = tile + (size_t)(voxel_idx & AT_DEPOSIT_TILE_MASK) * grid->num_bins + bin_index;
+    if (lane->is_atomic) {
+        AT_deposit_atomic_add_float(cell, energy);
+    } else {
+        *cell += energy;
+    }
+    return AT_OK;
+}
+
+#endif // AT_DEPOSIT_H
@@ -8,6 +8,9 @@
 
 #include "acoustic/at.h"
 #include "acoustic/at_math.h"
+#include "at_convex.h"
+#include "at_polygon.h"
+#include "at_scene_cache.h"
 #include <stdint.h>
 
 // Private Types (typedef + define)
@@ -37,33 +40,73 @@ typedef struct {
 struct AT_Scene {
     AT_Source *sources;
     AT_AABB world_AABB;
+    AT_AABB observer_AABB; //region the voxel grid covers, world_AABB by default
     uint32_t num_sources;
     AT_MaterialType material;
     const AT_Model *environment;
+    // Derived from the environment once and only read afterwards, so every
+    // simulation of the scene shares them, concurrent ones included
+    AT_PolygonSet polygons; //merged from the environment as loaded
+    AT_ConvexRoom convex_room; //planes of a closed convex environment, traced without a polygon search
+    AT_SceneCache *cache; //polygons of simplified environments, built on first use
+    float *reflectance; //1 - absorption of every material of the environment
+    uint32_t num_materials;
 };
 
 struct AT_Model {
     AT_Vec3 *vertices;
     AT_Vec3 *normals;
     uint32_t *indices;
-    uint32_t *triangle_materials;
+    AT_MaterialId *triangle_materials;
+    AT_Material *materials; //table triangle_materials index, NULL holds only AT_MATERIAL_TABLE
+    uint32_t material_count;
     size_t vertex_count;
     size_t index_count;
+
+    // Compiled scenes: world-space triangles, materials and bounds live in
+    // the read-only mapping and the arrays above are empty
+    const AT_Triangle *triangles;
+    size_t triangle_count;
+    AT_AABB aabb;
+    void *mapping;
+    size_t mapping_size;
 };
 
+// Voxel bins as compressed sparse rows, built by AT_simulation_compact.
+// Row-major voxel v holds bins first_bin[v] up to first_bin[v] plus
+// offsets[v + 1] - offsets[v], stored from values + offsets[v]. Bins
+// outside that run are zero.
+typedef struct {
+    uint32_t *offsets; // num_voxels + 1
+    uint32_t *first_bin; // num_voxels
+    float *values;
+    uint32_t num_bins; // longest voxel before compaction, trailing zeros included
+} AT_VoxelBins;
+
 struct AT_Simulation {
     //using the scene struct within the simulation struct we can access its members like this:
     // simulation->scene->sources etc..
     const AT_Scene *scene; //borrowed: must remain valid for the lifetime of AT_Simulation
-    AT_Voxel *voxel_grid;
+    AT_Voxel *voxel_grid; // NULL once compacted into bins
+    AT_VoxelBins bins;
     AT_Ray *rays;
     AT_Vec3 origin;
     AT_Vec3 dimensions;
     AT_Vec3 grid_dimensions;
+    AT_Vec3 clip_min, clip_max; //box DDA segments are clipped to, in voxels
     float voxel_size;
     float bin_width;
     uint32_t num_rays;
-    uint32_t num_voxels;
+    uint32_t num_voxels; // grid_x * grid_y * grid_z
+    uint32_t num_voxel_slots; // length of voxel_grid, includes brick padding
+    uint32_t bricks_x;
+    uint32_t bricks_y;
+    AT_VoxelLayout voxel_layout;
+    uint32_t num_bins; // known once AT_simulation_run has traced the rays
+    uint32_t num_threads;
+    AT_DepositStrategy deposit_strategy;
+    bool is_compensated;
+    bool is_simplified;
     uint8_t fps;
 };
 
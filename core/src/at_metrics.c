@@ -0,0 +1,227 @@
+#include "acoustic/at_metrics.h"
+#include "acoustic/at.h"
+#include "../src/at_bytes.h"
+#include "../src/at_internal.h"
+#include "../src/at_simd.h"
+#include "../src/at_thread.h"
+#include "../src/at_utils.h"
+#include "../src/at_voxel.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AT_METRICS_EARLY_SECONDS 0.05f
+#define AT_METRICS_WRITE_FLOATS 4096
+
+typedef struct {
+    const AT_Simulation *simulation;
+    AT_MetricGrid *grid;
+    uint32_t num_bins;
+    uint32_t num_workers;
+    AT_Result result;
+} AT_MetricsJob;
+
+// Level range a decay time is fitted over, in dB below the total
+typedef struct {
+    float start_db;
+    float end_db;
+} AT_MetricsRange;
+
+static const AT_MetricsRange AT_METRICS_RANGES[] = {
+    [AT_METRIC_EDT] = {0.0f, -10.0f},
+    [AT_METRIC_T20] = {-5.0f, -25.0f},
+    [AT_METRIC_T30] = {-5.0f, -35.0f},
+};
+
+// Least squares slope of levels[first, last) against the bin index, in dB per bin
+static float AT_metrics_slope(const float *levels, uint32_t first, uint32_t last)
+{
+    AT_SimdFloat sum = {0};
+    AT_SimdFloat weighted = {0};
+    AT_SimdFloat index = {0};
+    for (int l = 0; l < AT_SIMD_WIDTH; l++) index[l] = (float)l;
+
+    //indices are taken from first, which keeps the sums small
+    uint32_t n = last - first;
+    uint32_t i = 0;
+    for (; i + AT_SIMD_WIDTH <= n; i += AT_SIMD_WIDTH) {
+        AT_SimdFloat v;
+        memcpy(&v, levels + first + i, sizeof(v));
+        sum += v;
+        weighted += v * index;
+        index += (float)AT_SIMD_WIDTH;
+    }
+
+    double sum_l = 0.0;
+    double sum_il = 0.0;
+    for (int l = 0; l < AT_SIMD_WIDTH; l++) {
+        sum_l += sum[l];
+        sum_il += weighted[l];
+    }
+    for (; i < n; i++) {
+        sum_l += levels[first + i];
+        sum_il += (double)i * levels[first + i];
+    }
+
+    double sum_i = (double)n * (n - 1) / 2.0;
+    double sum_ii = (double)n * (n - 1) * (2.0 * n - 1) / 6.0;
+    double denominator = n * sum_ii - sum_i * sum_i;
+    return (float)((n * sum_il - sum_i * sum_l) / denominator);
+}
+
+// Decay time over a range of the Schroeder curve. NaN if the curve does not
+// get past the end of the range, or the fitted line covers less than half
+// of it, which is what a window on one step of a sparse curve looks like
+static float AT_metrics_decay_time(const float *levels, uint32_t num_levels, AT_MetricsRange range, float bin_width)
+{
+    uint32_t first = 0;
+    while (first < num_levels && levels[first] > range.start_db) first++;
+    uint32_t last = first;
+    while (last < num_levels && levels[last] >= range.end_db) last++;
+    if (last == num_levels || last - first < 2) return NAN;
+
+    float slope = AT_metrics_slope(levels, first, last);
+    if (!(-slope * (float)(last - first - 1) >= 0.5f * (range.start_db - range.end_db))) return NAN;
+    return -60.0f * bin_width / slope;
+}
+
+static void AT_metrics_voxel(const AT_MetricsJob *job, AT_VoxelSpan span, uint32_t v,
+                             float *schroeder, float *levels)
+{
+    AT_MetricGrid *grid = job->grid;
+    for (int m = 0; m < AT_METRIC_COUNT; m++) grid->maps[m][v] = NAN;
+
+    uint32_t onset = 0;
+    while (onset < span.count && !(span.values[onset] > 0.0f)) onset++;
+    if (onset == span.count) return;
+
+    //backward integration from the onset on
+    const float *energy = span.values + onset;
+    uint32_t n = span.count - onset;
+    double acc = 0.0;
+    for (uint32_t i = n; i-- > 0;) {
+        acc += energy[i];
+        schroeder[i] = (float)acc;
+    }
+    float total = schroeder[0];
+
+    //windows are found on the levels themselves, so the fast log decides
+    //both where a range starts and whether the curve gets past it
+    AT_simd_decibels(levels, schroeder, n, 1.0f / total);
+
+    const float bin_width = job->simulation->bin_width;
+    for (int m = AT_METRIC_EDT; m <= AT_METRIC_T30; m++) {
+        grid->maps[m][v] = AT_metrics_decay_time(levels, n, AT_METRICS_RANGES[m], bin_width);
+    }
+
+    //the bin the early window ends in counts in part. Both sides are summed
+    //directly, a difference of two totals loses the small one
+    float early_bins = AT_METRICS_EARLY_SECONDS * (float)job->simulation->fps;
+    uint32_t k = AT_min((uint32_t)early_bins, n);
+    float split = (k < n) ? (early_bins - (float)k) * energy[k] : 0.0f;
+    double early = split;
+    for (uint32_t i = 0; i < k; i++) early += energy[i];
+    float late = (k < n) ? fmaxf(schroeder[k] - split, 0.0f) : 0.0f;
+
+    grid->maps[AT_METRIC_D50][v] = (float)(early / (early + late));
+    grid->maps[AT_METRIC_C50][v] = (late > 0.0f) ? 10.0f * log10f((float)early / late) : INFINITY;
+}
+
+static void AT_metrics_worker(void *ctx, uint32_t worker)
+{
+    AT_MetricsJob *job = ctx;
+    const AT_Simulation *simulation = job->simulation;
+    uint64_t num_voxels = simulation->num_voxels;
+    uint32_t first = (uint32_t)(num_voxels * worker / job->num_workers);
+    uint32_t last = (uint32_t)(num_voxels * (worker + 1) / job->num_workers);
+
+    float *schroeder = malloc(sizeof(float) * AT_max(job->num_bins, 1u));
+    float *levels = malloc(sizeof(float) * AT_max(job->num_bins, 1u));
+    if (!schroeder || !levels) {
+        free(schroeder);
+        free(levels);
+        __atomic_store_n(&job->result, AT_ERR_ALLOC_ERROR, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (uint32_t v = first; v < last; v++) {
+        AT_metrics_voxel(job, AT_voxel_span(simulation, v), v, schroeder, levels);
+    }
+
+    free(schroeder);
+    free(levels);
+}
+
+AT_Result AT_metrics_compute(AT_MetricGrid *out_grid, const AT_Simulation *simulation)
+{
+    if (!out_grid || !simulation) return AT_ERR_INVALID_ARGUMENT;
+
+    *out_grid = (AT_MetricGrid){.num_voxels = simulation->num_voxels};
+    for (int m = 0; m < AT_METRIC_COUNT; m++) {
+        out_grid->maps[m] = malloc(sizeof(float) * AT_max(simulation->num_voxels, 1u));
+        if (!out_grid->maps[m]) {
+            AT_metrics_destroy(out_grid);
+            return AT_ERR_ALLOC_ERROR;
+        }
+    }
+
+    AT_MetricsJob job = {
+        .simulation = simulation,
+        .grid = out_grid,
+        .num_bins = AT_voxel_get_num_bins(simulation),
+        .num_workers = AT_max(simulation->num_threads, 1u),
+        .result = AT_OK,
+    };
+    AT_Result res = AT_thread_run(job.num_workers, AT_metrics_worker, &job);
+    if (res == AT_OK) res = job.result;
+    if (res != AT_OK) AT_metrics_destroy(out_grid);
+    return res;
+}
+
+AT_Result AT_metrics_write(const AT_MetricGrid *grid, const AT_Simulation *simulation, const char *path)
+{
+    if (!grid || !simulation || !path) return AT_ERR_INVALID_ARGUMENT;
+    if (grid->num_voxels != simulation->num_voxels) return AT_ERR_INVALID_ARGUMENT;
+
+    uint8_t header[AT_METRICS_HEADER_SIZE] = {0};
+    memcpy(header, AT_METRICS_MAGIC, 4);
+    header[4] = AT_METRICS_VERSION;
+    header[6] = AT_METRIC_COUNT;
+    AT_bytes_put_u32(header + 8, (uint32_t)simulation->grid_dimensions.x);
+    AT_bytes_put_u32(header + 12, (uint32_t)simulation->grid_dimensions.y);
+    AT_bytes_put_u32(header + 16, (uint32_t)simulation->grid_dimensions.z);
+    AT_bytes_put_u32(header + 20, simulation->num_voxels);
+    AT_bytes_put_f32(header + 24, simulation->origin.x);
+    AT_bytes_put_f32(header + 28, simulation->origin.y);
+    AT_bytes_put_f32(header + 32, simulation->origin.z);
+    AT_bytes_put_f32(header + 36, simulation->voxel_size);
+    AT_bytes_put_u32(header + 40, (uint32_t)simulation->fps);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return AT_ERR_IO_FAILURE;
+
+    bool is_failed = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+
+    uint8_t buffer[AT_METRICS_WRITE_FLOATS * 4];
+    for (int m = 0; m < AT_METRIC_COUNT && !is_failed; m++) {
+        for (uint32_t v = 0; v < grid->num_voxels && !is_failed; v += AT_METRICS_WRITE_FLOATS) {
+            uint32_t n = AT_min(grid->num_voxels - v, (uint32_t)AT_METRICS_WRITE_FLOATS);
+            for (uint32_t i = 0; i < n; i++) AT_bytes_put_f32(buffer + i * 4, grid->maps[m][v + i]);
+            is_failed = fwrite(buffer, 1, (size_t)n * 4, file) != (size_t)n * 4;
+        }
+    }
+
+    if (fclose(file) != 0) is_failed = true;
+    return is_failed ? AT_ERR_IO_FAILURE : AT_OK;
+}
+
+void AT_metrics_destroy(AT_MetricGrid *grid)
+{
+    if (!grid) return;
+    for (int m = 0; m < AT_METRIC_COUNT; m++) free(grid->maps[m]);
+    *grid = (AT_MetricGrid){0};
+}
@@ -2,201 +2,798 @@
 #include "../src/at_internal.h"
 #include "../src/at_utils.h"
 #include "../src/at_aabb.h"
+#include "../src/at_thread.h"
 #include "acoustic/at.h"
 #include "acoustic/at_math.h"
+#include "acoustic/at_scene_file.h"
+#include "cJSON.h"
 #include "cgltf.h"
 
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <float.h>
+#include <sys/mman.h>
+
+// A mesh placed in the world by a node, every node referencing a mesh
+// adds one
+typedef struct {
+    const cgltf_mesh *mesh;
+    float transform[16]; //column-major world matrix
+} AT_ModelInstance;
+
+typedef struct {
+    AT_ModelInstance *items;
+    size_t count;
+    size_t capacity;
+} AT_ModelInstances;
+
+// Elements one worker takes at a time when loading a model or gathering
+// its triangles, small models stay on the calling thread
+#define AT_MODEL_CHUNK_SIZE 65536
+
+typedef struct {
+    AT_Material *items;
+    size_t count;
+    size_t capacity;
+} AT_ModelMaterials;
+
+static const char *const AT_MODEL_MATERIAL_NAMES[AT_MATERIAL_COUNT] = {
+    [AT_MATERIAL_CONCRETE] = "concrete",
+    [AT_MATERIAL_PLASTIC] = "plastic",
+    [AT_MATERIAL_WOOD] = "wood",
+};
+
+static const float AT_MODEL_IDENTITY[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+static void AT_model_collect_node(AT_ModelInstances *instances, const cgltf_node *node)
+{
+    if (node->mesh) {
+        AT_ModelInstance instance = {.mesh = node->mesh};
+        cgltf_node_transform_world(node, instance.transform);
+        AT_da_append(instances, instance);
+    }
+    for (size_t i = 0; i < node->children_count; i++) {
+        AT_model_collect_node(instances, node->children[i]);
+    }
+}
 
-AT_Result AT_model_create(AT_Model **out_model, const char *filepath)
+// Flattens the default scene, or the root nodes if the file has no scenes.
+// Files without any nodes place each mesh once, untransformed.
+static void AT_model_collect_instances(AT_ModelInstances *instances, const cgltf_data *data)
 {
-    if (!out_model || *out_model || !filepath) return AT_ERR_INVALID_ARGUMENT;
+    const cgltf_scene *scene = data->scene ? data->scene : (data->scenes_count > 0 ? &data->scenes[0] : NULL);
+    if (scene) {
+        for (size_t i = 0; i < scene->nodes_count; i++) AT_model_collect_node(instances, scene->nodes[i]);
+    } else {
+        for (size_t i = 0; i < data->nodes_count; i++) {
+            if (!data->nodes[i].parent) AT_model_collect_node(instances, &data->nodes[i]);
+        }
+    }
 
-    cgltf_options options = {0};
-    cgltf_data *data = NULL;
-    cgltf_result res = cgltf_parse_file(&options, filepath, &data);
+    if (data->nodes_count == 0) {
+        for (size_t i = 0; i < data->meshes_count; i++) {
+            AT_ModelInstance instance = {.mesh = &data->meshes[i]};
+            memcpy(instance.transform, AT_MODEL_IDENTITY, sizeof(instance.transform));
+            AT_da_append(instances, instance);
+        }
+    }
+}
 
-    if (res != cgltf_result_success) return AT_ERR_INVALID_ARGUMENT;
+static const cgltf_accessor *AT_model_find_attribute(const cgltf_primitive *primitive, cgltf_attribute_type type)
+{
+    for (size_t i = 0; i < primitive->attributes_count; i++) {
+        if (primitive->attributes[i].type == type) return primitive->attributes[i].data;
+    }
+    return NULL;
+}
 
-    res = cgltf_load_buffers(&options, data, filepath);
+// The accessor's elements in the loaded buffer when they are tightly packed
+// elements of element_size bytes, NULL if they need per-element reads
+// (sparse, strided, or not loaded)
+static const uint8_t *AT_model_packed_data(const cgltf_accessor *accessor, size_t element_size)
+{
+    const cgltf_buffer_view *view = accessor->buffer_view;
+    if (accessor->is_sparse || !view || accessor->stride != element_size) return NULL;
+    if (accessor->offset + element_size * accessor->count > view->size) return NULL;
+
+    //extensions such as meshopt decode into view->data
+    const uint8_t *base = view->data ? (const uint8_t*)view->data :
+                          view->buffer->data ? (const uint8_t*)view->buffer->data + view->offset :
+                          NULL;
+    return base ? base + accessor->offset : NULL;
+}
 
-    if (res != cgltf_result_success) {
-        cgltf_free(data);
-        return AT_ERR_INVALID_ARGUMENT;
+static inline bool AT_model_is_float3(const cgltf_accessor *accessor)
+{
+    return accessor->component_type == cgltf_component_type_r_32f && accessor->type == cgltf_type_vec3;
+}
+
+static inline AT_Vec3 AT_model_transform_point(const float *m, const float *p)
+{
+    return AT_vec3(m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+                   m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+                   m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]);
+}
+
+// Reads elements first up to first + count of the accessor into out
+static void AT_model_read_positions(AT_Vec3 *out, const cgltf_accessor *accessor, const float *transform,
+                                    size_t first, size_t count)
+{
+    const uint8_t *src = AT_model_is_float3(accessor) ? AT_model_packed_data(accessor, 3 * sizeof(float)) : NULL;
+
+    if (src && sizeof(AT_Vec3) == 3 * sizeof(float) && memcmp(transform, AT_MODEL_IDENTITY, sizeof(AT_MODEL_IDENTITY)) == 0) {
+        memcpy(out, src + first * sizeof(AT_Vec3), count * sizeof(AT_Vec3));
+        return;
     }
 
-    if (data->meshes_count == 0) {
-        cgltf_free(data);
-        return AT_ERR_INVALID_ARGUMENT;
+    for (size_t i = 0; i < count; i++) {
+        float p[3];
+        if (src) memcpy(p, src + (first + i) * sizeof(p), sizeof(p));
+        else cgltf_accessor_read_float(accessor, first + i, p, 3);
+        out[i] = AT_model_transform_point(transform, p);
     }
+}
 
-    uint32_t total_vertices = 0;
-    uint32_t total_indices = 0;
-    uint32_t total_normals = 0;
+// Normals go through the cofactor matrix, the inverse transpose up to a
+// scale the normalisation removes
+static void AT_model_read_normals(AT_Vec3 *out, const cgltf_accessor *accessor, const float *m, float det,
+                                  size_t first, size_t count)
+{
+    float sign = (det < 0.0f) ? -1.0f : 1.0f;
+    float c[9] = {
+        sign * (m[5] * m[10] - m[6] * m[9]), sign * (m[6] * m[8] - m[4] * m[10]), sign * (m[4] * m[9] - m[5] * m[8]),
+        sign * (m[9] * m[2] - m[10] * m[1]), sign * (m[10] * m[0] - m[8] * m[2]), sign * (m[8] * m[1] - m[9] * m[0]),
+        sign * (m[1] * m[6] - m[2] * m[5]), sign * (m[2] * m[4] - m[0] * m[6]), sign * (m[0] * m[5] - m[1] * m[4]),
+    };
+
+    const uint8_t *src = AT_model_is_float3(accessor) ? AT_model_packed_data(accessor, 3 * sizeof(float)) : NULL;
+    for (size_t i = 0; i < count; i++) {
+        float n[3];
+        if (src) memcpy(n, src + (first + i) * sizeof(n), sizeof(n));
+        else cgltf_accessor_read_float(accessor, first + i, n, 3);
+
+        //row r of the normal matrix is column r of the cofactors
+        AT_Vec3 t = AT_vec3(c[0] * n[0] + c[3] * n[1] + c[6] * n[2],
+                            c[1] * n[0] + c[4] * n[1] + c[7] * n[2],
+                            c[2] * n[0] + c[5] * n[1] + c[8] * n[2]);
+        float length = sqrtf(t.x * t.x + t.y * t.y + t.z * t.z);
+        out[i] = (length > 0.0f) ? AT_vec3(t.x / length, t.y / length, t.z / length) : t;
+    }
+}
 
-    uint32_t vertex_index = 0;
-    uint32_t index_index = 0;
-    uint32_t normal_index = 0;
+// Writes indices first up to first + count offset by base_vertex.
+// Non-indexed primitives number their vertices in order.
+static void AT_model_read_indices(uint32_t *out, const cgltf_accessor *accessor, size_t first, size_t count,
+                                  uint32_t base_vertex)
+{
+    if (!accessor) {
+        for (size_t i = 0; i < count; i++) out[i] = base_vertex + (uint32_t)(first + i);
+        return;
+    }
 
-    cgltf_mesh *mesh = &data->meshes[0];
+    size_t component_size = (accessor->component_type == cgltf_component_type_r_8u) ? 1 :
+                            (accessor->component_type == cgltf_component_type_r_16u) ? 2 :
+                            (accessor->component_type == cgltf_component_type_r_32u) ? 4 : 0;
+    const uint8_t *src = (component_size && accessor->type == cgltf_type_scalar) ?
+                         AT_model_packed_data(accessor, component_size) :
+                         NULL;
+    if (src) src += first * component_size;
+
+    if (src && component_size == 1) {
+        for (size_t i = 0; i < count; i++) out[i] = base_vertex + src[i];
+    } else if (src && component_size == 2) {
+        for (size_t i = 0; i < count; i++) {
+            uint16_t idx;
+            memcpy(&idx, src + i * 2, 2);
+            out[i] = base_vertex + idx;
+        }
+    } else if (src) {
+        memcpy(out, src, count * 4);
+        for (size_t i = 0; i < count; i++) out[i] += base_vertex;
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            cgltf_uint idx = 0;
+            cgltf_accessor_read_uint(accessor, first + i, &idx, 1);
+            out[i] = base_vertex + (uint32_t)idx;
+        }
+    }
+}
 
-    if (mesh->primitives_count == 0) {
-        cgltf_free(data);
-        return AT_ERR_INVALID_ARGUMENT;
+// Built-in material whose name text contains, ignoring case,
+// AT_MATERIAL_COUNT if none
+static AT_MaterialType AT_model_material_in_text(const char *text, size_t length)
+{
+    for (int m = 0; m < AT_MATERIAL_COUNT; m++) {
+        size_t name_length = strlen(AT_MODEL_MATERIAL_NAMES[m]);
+        for (size_t i = 0; i + name_length <= length; i++) {
+            size_t c = 0;
+            while (c < name_length && tolower((unsigned char)text[i + c]) == AT_MODEL_MATERIAL_NAMES[m][c]) c++;
+            if (c == name_length) return (AT_MaterialType)m;
+        }
     }
-    for (unsigned long i = 0; i < mesh->primitives_count; i++) {
+    return AT_MATERIAL_COUNT;
+}
 
-        cgltf_primitive *primitive = &mesh->primitives[i];
+// The material one glTF material resolves to, custom absorptions are
+// added to the table unless an equal entry is already there
+static AT_Result AT_model_resolve_material(AT_MaterialId *out_id, AT_ModelMaterials *table,
+                                           const cgltf_data *data, const cgltf_material *material)
+{
+    *out_id = AT_MATERIAL_PLASTIC;
+    if (!material) return AT_OK;
+
+    cgltf_size size = 0;
+    char *extras = NULL;
+    if (cgltf_copy_extras_json(data, &material->extras, NULL, &size) == cgltf_result_success && size > 1) {
+        extras = malloc(size);
+        if (!extras) return AT_ERR_ALLOC_ERROR;
+        if (cgltf_copy_extras_json(data, &material->extras, extras, &size) != cgltf_result_success) extras[0] = '\0';
+    }
 
-        cgltf_accessor *pos_accessor = NULL;
-        for (size_t i = 0; i < primitive->attributes_count; i++) {
-            if (primitive->attributes[i].type == cgltf_attribute_type_position) {
-                pos_accessor = primitive->attributes[i].data;
-                break;
+    //malformed extras are ignored like missing ones
+    cJSON *json = extras ? cJSON_Parse(extras) : NULL;
+    const cJSON *named = cJSON_GetObjectItemCaseSensitive(json, AT_MODEL_EXTRAS_MATERIAL);
+    const cJSON *absorption = cJSON_GetObjectItemCaseSensitive(json, AT_MODEL_EXTRAS_ABSORPTION);
+    AT_MaterialType type = AT_MATERIAL_COUNT;
+    if (cJSON_IsString(named)) type = AT_model_material_in_text(named->valuestring, strlen(named->valuestring));
+
+    AT_Result res = AT_OK;
+    float value = cJSON_IsNumber(absorption) ? (float)absorption->valuedouble : -1.0f;
+    if (type != AT_MATERIAL_COUNT) {
+        *out_id = (AT_MaterialId)type;
+    } else if (value >= 0.0f && value <= 1.0f) {
+        size_t id = 0;
+        while (id < table->count && table->items[id].absorption != value) id++;
+        if (id == table->count) {
+            if (table->count == AT_MATERIAL_MAX_COUNT) {
+                res = AT_ERR_INVALID_ARGUMENT;
+            } else {
+                AT_da_append(table, ((AT_Material){.absorption = value}));
             }
         }
+        *out_id = (AT_MaterialId)id;
+    } else if (material->name) {
+        type = AT_model_material_in_text(material->name, strlen(material->name));
+        if (type != AT_MATERIAL_COUNT) *out_id = (AT_MaterialId)type;
+    }
 
-        if (!pos_accessor) {
-            cgltf_free(data);
-            return AT_ERR_INVALID_ARGUMENT;
-        }
+    cJSON_Delete(json);
+    free(extras);
+    return res;
+}
 
-        size_t vertex_count = pos_accessor->count;
+static inline size_t AT_model_primitive_index_count(const cgltf_primitive *primitive, const cgltf_accessor *positions)
+{
+    size_t count = primitive->indices ? primitive->indices->count : positions->count;
+    return count - count % 3;
+}
 
-        cgltf_accessor *idx_accessor = primitive->indices;
+typedef void (*AT_ModelRangeFn)(void *ctx, uint32_t worker, size_t first, size_t last);
 
-        if (!idx_accessor) {
-            cgltf_free(data);
-            return AT_ERR_INVALID_ARGUMENT;
-        }
+typedef struct {
+    AT_ModelRangeFn fn;
+    void *ctx;
+    size_t count;
+    size_t grain;
+    size_t next; //first element not yet handed out
+} AT_ModelRangeJob;
+
+static void AT_model_range_worker(void *ctx, uint32_t worker)
+{
+    AT_ModelRangeJob *job = ctx;
+    for (;;) {
+        size_t first = __atomic_fetch_add(&job->next, job->grain, __ATOMIC_RELAXED);
+        if (first >= job->count) break;
+        job->fn(job->ctx, worker, first, AT_min(first + job->grain, job->count));
+    }
+}
 
-        size_t index_count = idx_accessor->count;
+// Workers worth starting for count elements taken grain at a time
+static uint32_t AT_model_worker_count(size_t count, size_t grain)
+{
+    size_t num_pieces = (count + grain - 1) / grain;
+    return (uint32_t)AT_max(AT_min(num_pieces, (size_t)AT_thread_default_count()), (size_t)1);
+}
 
-        // Normals
-        cgltf_accessor *norm_accessor = NULL;
-        for (size_t i = 0; i < primitive->attributes_count; i++) {
-            if (primitive->attributes[i].type == cgltf_attribute_type_normal) {
-                norm_accessor = primitive->attributes[i].data;
-                break;
-            }
+// Runs fn over [0, count) in pieces of grain elements, each worker takes
+// the next piece as soon as it is done with its last
+static void AT_model_parallel_for(uint32_t num_workers, size_t count, size_t grain, AT_ModelRangeFn fn, void *ctx)
+{
+    AT_ModelRangeJob job = {.fn = fn, .ctx = ctx, .count = count, .grain = grain, .next = 0};
+    AT_thread_run(num_workers, AT_model_range_worker, &job);
+}
+
+// A triangle primitive of one instance and where it lands in the model.
+// Large primitives are read in several pieces, each a slice of the
+// vertices together with a slice of the triangles.
+typedef struct {
+    const cgltf_primitive *primitive;
+    const cgltf_accessor *positions;
+    const cgltf_accessor *normals; //NULL when missing or not one per position
+    const float *transform;
+    float det;
+    AT_MaterialId material;
+    size_t first_vertex;
+    size_t first_index;
+    size_t index_count;
+    size_t first_piece;
+    size_t num_pieces;
+} AT_ModelPrimitive;
+
+typedef struct {
+    AT_ModelPrimitive *items;
+    size_t count;
+    size_t capacity;
+} AT_ModelPrimitives;
+
+typedef struct {
+    const AT_ModelPrimitives *primitives;
+    AT_Model *model;
+    bool is_valid; //cleared by any piece indexing past its primitive
+} AT_ModelLoadJob;
+
+static void AT_model_load_piece(AT_ModelLoadJob *job, const AT_ModelPrimitive *primitive, size_t piece)
+{
+    AT_Model *model = job->model;
+    size_t vertex_count = primitive->positions->count;
+    size_t triangle_count = primitive->index_count / 3;
+    size_t n = primitive->num_pieces;
+    size_t first_vertex = vertex_count * piece / n;
+    size_t last_vertex = vertex_count * (piece + 1) / n;
+    size_t first_triangle = triangle_count * piece / n;
+    size_t last_triangle = triangle_count * (piece + 1) / n;
+
+    AT_Vec3 *vertices = model->vertices + primitive->first_vertex + first_vertex;
+    AT_model_read_positions(vertices, primitive->positions, primitive->transform, first_vertex, last_vertex - first_vertex);
+    // Normals are optional, primitives without them keep zero vectors
+    if (primitive->normals) {
+        AT_model_read_normals(model->normals + primitive->first_vertex + first_vertex, primitive->normals,
+                              primitive->transform, primitive->det, first_vertex, last_vertex - first_vertex);
+    }
+
+    uint32_t base_vertex = (uint32_t)primitive->first_vertex;
+    size_t index_count = (last_triangle - first_triangle) * 3;
+    uint32_t *indices = model->indices + primitive->first_index + first_triangle * 3;
+    AT_model_read_indices(indices, primitive->primitive->indices, first_triangle * 3, index_count, base_vertex);
+
+    bool is_valid = true;
+    for (size_t i = 0; i < index_count; i++) {
+        is_valid &= indices[i] - base_vertex < vertex_count;
+    }
+    if (!is_valid) __atomic_store_n(&job->is_valid, false, __ATOMIC_RELAXED);
+
+    //a mirroring transform turns the triangles inside out
+    if (primitive->det < 0.0f) {
+        for (size_t i = 0; i < index_count; i += 3) {
+            uint32_t tmp = indices[i + 1];
+            indices[i + 1] = indices[i + 2];
+            indices[i + 2] = tmp;
         }
-        if (!norm_accessor) {
-            cgltf_free(data);
-            return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    AT_MaterialId *materials = model->triangle_materials + primitive->first_index / 3 + first_triangle;
+    for (size_t t = 0; t < last_triangle - first_triangle; t++) {
+        materials[t] = primitive->material;
+    }
+}
+
+static void AT_model_load_worker(void *ctx, uint32_t worker, size_t first, size_t last)
+{
+    (void)worker;
+    AT_ModelLoadJob *job = ctx;
+    const AT_ModelPrimitives *primitives = job->primitives;
+
+    for (size_t piece = first; piece < last; piece++) {
+        //last primitive starting at or before the piece
+        size_t lo = 0, hi = primitives->count - 1;
+        while (lo < hi) {
+            size_t mid = (lo + hi + 1) / 2;
+            if (primitives->items[mid].first_piece <= piece) lo = mid;
+            else hi = mid - 1;
         }
+        const AT_ModelPrimitive *primitive = &primitives->items[lo];
+        AT_model_load_piece(job, primitive, piece - primitive->first_piece);
+    }
+}
 
-        size_t normal_count = norm_accessor->count;
+AT_Result AT_model_create(AT_Model **out_model, const char *filepath)
+{
+    if (!out_model || *out_model || !filepath) return AT_ERR_INVALID_ARGUMENT;
 
-        total_vertices += vertex_count;
-        total_indices += index_count;
-        total_normals += normal_count;
+    size_t path_length = strlen(filepath);
+    size_t extension_length = strlen(AT_SCENE_FILE_EXTENSION);
+    if (path_length >= extension_length &&
+        strcmp(filepath + path_length - extension_length, AT_SCENE_FILE_EXTENSION) == 0) {
+        return AT_scene_file_open(out_model, filepath);
+    }
+
+    cgltf_options options = {0};
+    cgltf_data *data = NULL;
+    cgltf_result res = cgltf_parse_file(&options, filepath, &data);
+
+    if (res != cgltf_result_success) return AT_ERR_INVALID_ARGUMENT;
+
+    res = cgltf_load_buffers(&options, data, filepath);
 
+    if (res != cgltf_result_success) {
+        cgltf_free(data);
+        return AT_ERR_INVALID_ARGUMENT;
     }
 
-    AT_Vec3 *vertices = malloc(sizeof(AT_Vec3) * total_vertices);
+    AT_ModelInstances instances;
+    AT_da_init(&instances);
+    AT_model_collect_instances(&instances, data);
+
+    //sizes and offsets of every triangle primitive of every instance
+    AT_ModelPrimitives primitives;
+    AT_da_init(&primitives);
+    size_t total_vertices = 0;
+    size_t total_indices = 0;
+    size_t total_pieces = 0;
+    for (size_t n = 0; n < instances.count; n++) {
+        const AT_ModelInstance *instance = &instances.items[n];
+        const float *m = instance->transform;
+        float det = m[0] * (m[5] * m[10] - m[6] * m[9]) -
+                    m[4] * (m[1] * m[10] - m[2] * m[9]) +
+                    m[8] * (m[1] * m[6] - m[2] * m[5]);
+
+        for (size_t p = 0; p < instance->mesh->primitives_count; p++) {
+            const cgltf_primitive *primitive = &instance->mesh->primitives[p];
+            if (primitive->type != cgltf_primitive_type_triangles) continue;
+
+            const cgltf_accessor *positions = AT_model_find_attribute(primitive, cgltf_attribute_type_position);
+            if (!positions) {
+                AT_da_free(&primitives);
+                AT_da_free(&instances);
+                cgltf_free(data);
+                return AT_ERR_INVALID_ARGUMENT;
+            }
+            const cgltf_accessor *normals = AT_model_find_attribute(primitive, cgltf_attribute_type_normal);
+            size_t index_count = AT_model_primitive_index_count(primitive, positions);
+            size_t largest = AT_max(positions->count, index_count);
+
+            AT_ModelPrimitive entry = {
+                .primitive = primitive,
+                .positions = positions,
+                .normals = (normals && normals->count == positions->count) ? normals : NULL,
+                .transform = m,
+                .det = det,
+                .first_vertex = total_vertices,
+                .first_index = total_indices,
+                .index_count = index_count,
+                .first_piece = total_pieces,
+                .num_pieces = AT_max((largest + AT_MODEL_CHUNK_SIZE - 1) / AT_MODEL_CHUNK_SIZE, (size_t)1),
+            };
+            AT_da_append(&primitives, entry);
+            total_vertices += positions->count;
+            total_indices += index_count;
+            total_pieces += entry.num_pieces;
+        }
+    }
 
-    if (!vertices) {
+    if (total_indices == 0 || total_vertices > UINT32_MAX) {
+        AT_da_free(&primitives);
+        AT_da_free(&instances);
         cgltf_free(data);
-        return AT_ERR_ALLOC_ERROR;
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    //built-in materials keep their IDs, every glTF material resolves to one
+    //of them or adds its own absorption
+    AT_ModelMaterials table;
+    AT_da_init(&table);
+    for (int m = 0; m < AT_MATERIAL_COUNT; m++) AT_da_append(&table, AT_MATERIAL_TABLE[m]);
+    AT_MaterialId *material_ids = malloc(sizeof(AT_MaterialId) * AT_max(data->materials_count, (size_t)1));
+    AT_Result material_res = material_ids ? AT_OK : AT_ERR_ALLOC_ERROR;
+    for (size_t i = 0; i < data->materials_count && material_res == AT_OK; i++) {
+        material_res = AT_model_resolve_material(&material_ids[i], &table, data, &data->materials[i]);
+    }
+    for (size_t i = 0; i < primitives.count && material_res == AT_OK; i++) {
+        const cgltf_material *material = primitives.items[i].primitive->material;
+        primitives.items[i].material = material ? material_ids[material - data->materials] : AT_MATERIAL_PLASTIC;
     }
+    free(material_ids);
 
+    AT_Vec3 *vertices = malloc(sizeof(AT_Vec3) * total_vertices);
+    AT_Vec3 *normals = calloc(total_vertices, sizeof(AT_Vec3));
     uint32_t *indices = malloc(sizeof(uint32_t) * total_indices);
+    AT_MaterialId *triangle_materials = malloc(sizeof(AT_MaterialId) * (total_indices / 3));
+    AT_Model *model = calloc(1, sizeof(AT_Model));
 
-    if (!indices) {
-        cgltf_free(data);
+    if (material_res != AT_OK || !vertices || !normals || !indices || !triangle_materials || !model) {
         free(vertices);
-        return AT_ERR_ALLOC_ERROR;
+        free(normals);
+        free(indices);
+        free(triangle_materials);
+        free(model);
+        AT_da_free(&table);
+        AT_da_free(&primitives);
+        AT_da_free(&instances);
+        cgltf_free(data);
+        return (material_res != AT_OK) ? material_res : AT_ERR_ALLOC_ERROR;
     }
 
-    AT_Vec3 *normals = malloc(sizeof(AT_Vec3) * total_normals);
+    model->index_count = total_indices;
+    model->vertex_count = total_vertices;
+    model->indices = indices;
+    model->vertices = vertices;
+    model->normals = normals;
+    model->triangle_materials = triangle_materials;
+    model->materials = table.items;
+    model->material_count = (uint32_t)table.count;
+
+    //every piece writes its own slices, so they need no ordering
+    AT_ModelLoadJob job = {.primitives = &primitives, .model = model, .is_valid = true};
+    AT_model_parallel_for(AT_model_worker_count(total_pieces, 1), total_pieces, 1, AT_model_load_worker, &job);
+    AT_da_free(&primitives);
 
-    if (!normals) {
+    if (!job.is_valid) {
+        AT_model_destroy(model);
+        AT_da_free(&instances);
         cgltf_free(data);
-        free(vertices);
-        free(indices);
-        return AT_ERR_ALLOC_ERROR;
+        return AT_ERR_INVALID_ARGUMENT;
     }
 
-    uint32_t tri = 0;
-    uint32_t *triangle_materials = malloc(sizeof(uint32_t) * (total_indices / 3));
+    *out_model = model;
 
-    for (unsigned long i = 0; i < mesh->primitives_count; i++) {
+    AT_da_free(&instances);
+    cgltf_free(data);
+    return AT_OK;
+}
 
-        size_t base_vertex = vertex_index;
+#define AT_MODEL_EMPTY_SLOT UINT32_MAX
 
-        cgltf_primitive *primitive = &mesh->primitives[i];
+static inline uint32_t AT_model_hash3(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t h = a * 0x8da6b343u ^ b * 0xd8163841u ^ c * 0xcb1ab31fu;
+    return h ^ (h >> 15);
+}
 
-        cgltf_accessor *pos_accessor = NULL;
-        for (size_t i = 0; i < primitive->attributes_count; i++) {
-            if (primitive->attributes[i].type == cgltf_attribute_type_position) {
-                pos_accessor = primitive->attributes[i].data;
-                break;
+// Power of two with at least twice as many slots as entries
+static inline uint32_t AT_model_table_size(size_t entries)
+{
+    uint32_t size = 16;
+    while (size < entries * 2) size <<= 1;
+    return size;
+}
+
+static inline int32_t AT_model_cell(float value, float inv_cell)
+{
+    float cell = floorf(value * inv_cell);
+    return (int32_t)fmaxf(fminf(cell, (float)(INT32_MAX / 2)), (float)(INT32_MIN / 2));
+}
+
+// Maps every vertex to the first earlier vertex within tolerance, or to
+// itself. Cells are one tolerance wide, so a match is in one of the 27
+// cells around the vertex.
+static AT_Result AT_model_weld_vertices(uint32_t *remap, const AT_Model *model, float tolerance, size_t *out_welded)
+{
+    size_t vertex_count = model->vertex_count;
+    uint32_t table_size = AT_model_table_size(vertex_count);
+    uint32_t *heads = malloc(sizeof(uint32_t) * table_size); //first representative per slot
+    int32_t *cells = malloc(sizeof(int32_t) * 3 * table_size);
+    uint32_t *next = malloc(sizeof(uint32_t) * AT_max(vertex_count, (size_t)1)); //chain of representatives in a cell
+    if (!heads || !cells || !next) {
+        free(heads);
+        free(cells);
+        free(next);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    memset(heads, 0xff, sizeof(uint32_t) * table_size);
+
+    float inv_cell = 1.0f / tolerance;
+    float tolerance_sq = tolerance * tolerance;
+    size_t welded = 0;
+
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        AT_Vec3 p = model->vertices[i];
+        int32_t c[3] = {AT_model_cell(p.x, inv_cell), AT_model_cell(p.y, inv_cell), AT_model_cell(p.z, inv_cell)};
+
+        uint32_t match = AT_MODEL_EMPTY_SLOT;
+        for (int d = 0; d < 27 && match == AT_MODEL_EMPTY_SLOT; d++) {
+            int32_t n[3] = {c[0] + d % 3 - 1, c[1] + (d / 3) % 3 - 1, c[2] + d / 9 - 1};
+            uint32_t slot = AT_model_hash3((uint32_t)n[0], (uint32_t)n[1], (uint32_t)n[2]) & (table_size - 1);
+            while (heads[slot] != AT_MODEL_EMPTY_SLOT && memcmp(&cells[slot * 3], n, sizeof(n)) != 0) {
+                slot = (slot + 1) & (table_size - 1);
+            }
+            for (uint32_t r = heads[slot]; r != AT_MODEL_EMPTY_SLOT; r = next[r]) {
+                if (AT_vec3_distance_sq(model->vertices[r], p) <= tolerance_sq) {
+                    match = r;
+                    break;
+                }
             }
         }
 
-        // Vertices
-        size_t vertex_count = pos_accessor->count;
-        for (size_t i = 0; i < vertex_count; i++) {
-            float v[3];
-            cgltf_accessor_read_float(pos_accessor, i, v, 3);
-            vertices[vertex_index + i] = (AT_Vec3){{v[0], v[1], v[2]}};
+        if (match != AT_MODEL_EMPTY_SLOT) {
+            remap[i] = match;
+            welded++;
+            continue;
         }
-        vertex_index += vertex_count;
 
-        // Indices
-        cgltf_accessor *idx_accessor = primitive->indices;
-        size_t index_count = idx_accessor->count;
-        for (size_t i = 0; i < index_count; i++) {
-            uint32_t idx = 0;
-            cgltf_accessor_read_uint(idx_accessor, i, &idx, 1);
-            indices[index_index + i] = idx + base_vertex;
+        //a new representative, chained into its own cell
+        uint32_t slot = AT_model_hash3((uint32_t)c[0], (uint32_t)c[1], (uint32_t)c[2]) & (table_size - 1);
+        while (heads[slot] != AT_MODEL_EMPTY_SLOT && memcmp(&cells[slot * 3], c, sizeof(c)) != 0) {
+            slot = (slot + 1) & (table_size - 1);
         }
-        index_index += index_count;
+        if (heads[slot] == AT_MODEL_EMPTY_SLOT) memcpy(&cells[slot * 3], c, sizeof(c));
+        next[i] = heads[slot];
+        heads[slot] = i;
+        remap[i] = i;
+    }
+
+    free(heads);
+    free(cells);
+    free(next);
+    *out_welded = welded;
+    return AT_OK;
+}
+
+// Spreads the low 10 bits of v three apart
+static inline uint32_t AT_model_morton_spread(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
 
-        // Materials - set to be plastic for now
-        for (uint32_t i = 0; i < index_count; i+=3) {
-            triangle_materials[tri++] = AT_MATERIAL_PLASTIC;
+static int AT_model_compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+AT_Result AT_model_weld(AT_Model *model, float tolerance, AT_ModelWeldStats *out_stats)
+{
+    if (!model || model->mapping || tolerance < 0.0f) return AT_ERR_INVALID_ARGUMENT;
+    if (tolerance == 0.0f) tolerance = AT_MODEL_WELD_TOLERANCE;
+
+    size_t vertex_count = model->vertex_count;
+    size_t triangle_count = model->index_count / 3;
+    AT_ModelWeldStats stats = {0};
+
+    uint32_t *remap = malloc(sizeof(uint32_t) * AT_max(vertex_count, (size_t)1));
+    uint64_t *keys = malloc(sizeof(uint64_t) * AT_max(triangle_count, (size_t)1)); //Morton code << 32 | triangle
+    uint32_t tri_table_size = AT_model_table_size(triangle_count);
+    uint32_t *tri_table = malloc(sizeof(uint32_t) * tri_table_size);
+    if (!remap || !keys || !tri_table) {
+        free(remap);
+        free(keys);
+        free(tri_table);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    AT_Result res = AT_model_weld_vertices(remap, model, tolerance, &stats.welded_vertices);
+    if (res != AT_OK) {
+        free(remap);
+        free(keys);
+        free(tri_table);
+        return res;
+    }
+
+    AT_AABB aabb;
+    AT_model_to_AABB(&aabb, model);
+    AT_Vec3 extent = AT_vec3_sub(aabb.max, aabb.min);
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++) scale[axis] = (extent.arr[axis] > 0.0f) ? 1023.0f / extent.arr[axis] : 0.0f;
+
+    //a triangle is kept unless it collapsed, is thinner than the tolerance
+    //or repeats the vertex set of an earlier one
+    memset(tri_table, 0xff, sizeof(uint32_t) * tri_table_size);
+    uint32_t *indices = model->indices;
+    size_t kept = 0;
+    for (size_t t = 0; t < triangle_count; t++) {
+        uint32_t a = remap[indices[t * 3 + 0]];
+        uint32_t b = remap[indices[t * 3 + 1]];
+        uint32_t c = remap[indices[t * 3 + 2]];
+        indices[t * 3 + 0] = a;
+        indices[t * 3 + 1] = b;
+        indices[t * 3 + 2] = c;
+
+        AT_Vec3 pa = model->vertices[a], pb = model->vertices[b], pc = model->vertices[c];
+        float twice_area = AT_vec3_length(AT_vec3_cross(AT_vec3_sub(pb, pa), AT_vec3_sub(pc, pa)));
+        float longest = fmaxf(AT_vec3_distance(pa, pb), fmaxf(AT_vec3_distance(pb, pc), AT_vec3_distance(pc, pa)));
+        if (a == b || b == c || c == a || !(twice_area > tolerance * longest)) {
+            stats.degenerate_triangles++;
+            continue;
         }
 
-        // Normals
-        cgltf_accessor *norm_accessor = NULL;
-        for (size_t i = 0; i < primitive->attributes_count; i++) {
-            if (primitive->attributes[i].type == cgltf_attribute_type_normal) {
-                norm_accessor = primitive->attributes[i].data;
+        uint32_t lo = AT_min(a, AT_min(b, c));
+        uint32_t hi = AT_max(a, AT_max(b, c));
+        uint32_t mid = a ^ b ^ c ^ lo ^ hi;
+        uint32_t slot = AT_model_hash3(lo, mid, hi) & (tri_table_size - 1);
+        bool is_duplicate = false;
+        for (; tri_table[slot] != AT_MODEL_EMPTY_SLOT; slot = (slot + 1) & (tri_table_size - 1)) {
+            const uint32_t *o = &indices[tri_table[slot] * 3];
+            uint32_t o_lo = AT_min(o[0], AT_min(o[1], o[2]));
+            uint32_t o_hi = AT_max(o[0], AT_max(o[1], o[2]));
+            if (o_lo == lo && o_hi == hi && (o[0] ^ o[1] ^ o[2] ^ o_lo ^ o_hi) == mid) {
+                is_duplicate = true;
                 break;
             }
         }
-        for (size_t i = 0; i < norm_accessor->count; i++) {
-            float n[3];
-            cgltf_accessor_read_float(norm_accessor, i, n, 3);
-            normals[normal_index + i] = (AT_Vec3){{n[0], n[1], n[2]}};
+        if (is_duplicate) {
+            stats.duplicate_triangles++;
+            continue;
+        }
+        tri_table[slot] = (uint32_t)t;
+
+        AT_Vec3 centroid = AT_vec3_scale(AT_vec3_add(pa, AT_vec3_add(pb, pc)), 1.0f / 3.0f);
+        uint32_t code = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            uint32_t q = (uint32_t)((centroid.arr[axis] - aabb.min.arr[axis]) * scale[axis]);
+            code |= AT_model_morton_spread(AT_min(q, 1023u)) << axis;
         }
-        normal_index += norm_accessor->count;
+        keys[kept++] = (uint64_t)code << 32 | (uint64_t)t;
     }
+    free(tri_table);
 
-    AT_Model *model = calloc(1, sizeof(AT_Model));
-    if (!model) {
-        cgltf_free(data);
-        free(vertices);
-        free(indices);
-        free(normals);
-        free(triangle_materials);
+    if (kept == 0) {
+        free(remap);
+        free(keys);
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+    qsort(keys, kept, sizeof(uint64_t), AT_model_compare_u64);
+
+    //rebuild in Morton order, numbering vertices as they are first used
+    uint32_t *new_indices = malloc(sizeof(uint32_t) * kept * 3);
+    AT_MaterialId *new_materials = malloc(sizeof(AT_MaterialId) * kept);
+    AT_Vec3 *new_vertices = malloc(sizeof(AT_Vec3) * AT_min(vertex_count, kept * 3));
+    AT_Vec3 *new_normals = malloc(sizeof(AT_Vec3) * AT_min(vertex_count, kept * 3));
+    if (!new_indices || !new_materials || !new_vertices || !new_normals) {
+        free(new_indices);
+        free(new_materials);
+        free(new_vertices);
+        free(new_normals);
+        free(remap);
+        free(keys);
         return AT_ERR_ALLOC_ERROR;
     }
 
-    model->index_count = total_indices;
-    model->vertex_count = total_vertices;
-    model->indices = indices;
-    model->vertices = vertices;
-    model->normals = normals;
-    model->triangle_materials = triangle_materials;
+    //remap now holds the new number of each representative
+    memset(remap, 0xff, sizeof(uint32_t) * vertex_count);
+    uint32_t new_vertex_count = 0;
+    for (size_t k = 0; k < kept; k++) {
+        uint32_t t = (uint32_t)keys[k];
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t old = indices[t * 3 + corner];
+            if (remap[old] == AT_MODEL_EMPTY_SLOT) {
+                remap[old] = new_vertex_count;
+                new_vertices[new_vertex_count] = model->vertices[old];
+                new_normals[new_vertex_count] = model->normals[old];
+                new_vertex_count++;
+            }
+            new_indices[k * 3 + corner] = remap[old];
+        }
+        new_materials[k] = model->triangle_materials[t];
+    }
 
-    *out_model = model;
+    stats.unused_vertices = vertex_count - stats.welded_vertices - new_vertex_count;
+    stats.vertex_count = new_vertex_count;
+    stats.triangle_count = kept;
 
-    cgltf_free(data);
+    free(model->vertices);
+    free(model->normals);
+    free(model->indices);
+    free(model->triangle_materials);
+    model->vertices = new_vertices;
+    model->normals = new_normals;
+    model->indices = new_indices;
+    model->triangle_materials = new_materials;
+    model->vertex_count = new_vertex_count;
+    model->index_count = kept * 3;
+
+    free(remap);
+    free(keys);
+    if (out_stats) *out_stats = stats;
     return AT_OK;
 }
 
@@ -204,19 +801,32 @@ void AT_model_destroy(AT_Model *model)
 {
     if (!model) return;
 
+    if (model->mapping) {
+        munmap(model->mapping, model->mapping_size);
+        free(model);
+        return;
+    }
+
     free(model->vertices);
     free(model->indices);
     free(model->normals);
     free(model->triangle_materials);
+    free(model->materials);
     free(model);
 }
 
-void AT_model_to_AABB(AT_AABB *out_aabb, const AT_Model *model)
+typedef struct {
+    const AT_Model *model;
+    AT_AABB *bounds; //one per worker
+} AT_ModelBoundsJob;
+
+static void AT_model_bounds_worker(void *ctx, uint32_t worker, size_t first, size_t last)
 {
-    AT_Vec3 min_vec = AT_vec3(FLT_MAX, FLT_MAX, FLT_MAX);
-    AT_Vec3 max_vec = AT_vec3(FLT_MIN, FLT_MIN, FLT_MIN);
-    for (unsigned long i = 0; i < model->vertex_count; i++) {
-        AT_Vec3 vec = model->vertices[i];
+    AT_ModelBoundsJob *job = ctx;
+    AT_Vec3 min_vec = job->bounds[worker].min;
+    AT_Vec3 max_vec = job->bounds[worker].max;
+    for (size_t i = first; i < last; i++) {
+        AT_Vec3 vec = job->model->vertices[i];
         min_vec.x = AT_min(min_vec.x, vec.x);
         min_vec.y = AT_min(min_vec.y, vec.y);
         min_vec.z = AT_min(min_vec.z, vec.z);
@@ -224,19 +834,58 @@ void AT_model_to_AABB(AT_AABB *out_aabb, const AT_Model *model)
         max_vec.y = AT_max(max_vec.y, vec.y);
         max_vec.z = AT_max(max_vec.z, vec.z);
     }
+    job->bounds[worker].min = min_vec;
+    job->bounds[worker].max = max_vec;
+}
 
-    out_aabb->min = min_vec;
-    out_aabb->max = max_vec;
+void AT_model_to_AABB(AT_AABB *out_aabb, const AT_Model *model)
+{
+    if (model->triangles) {
+        *out_aabb = model->aabb;
+        out_aabb->midpoint = AT_AABB_calc_midpoint(out_aabb);
+        return;
+    }
+
+    //every worker bounds the pieces it took, then the boxes are merged
+    uint32_t num_workers = AT_model_worker_count(model->vertex_count, AT_MODEL_CHUNK_SIZE);
+    AT_AABB stack_bounds[1];
+    AT_AABB *bounds = (num_workers > 1) ? malloc(sizeof(AT_AABB) * num_workers) : NULL;
+    if (!bounds) {
+        bounds = stack_bounds;
+        num_workers = 1;
+    }
+    for (uint32_t w = 0; w < num_workers; w++) {
+        bounds[w].min = AT_vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        bounds[w].max = AT_vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    }
+
+    AT_ModelBoundsJob job = {.model = model, .bounds = bounds};
+    AT_model_parallel_for(num_workers, model->vertex_count, AT_MODEL_CHUNK_SIZE, AT_model_bounds_worker, &job);
+
+    out_aabb->min = bounds[0].min;
+    out_aabb->max = bounds[0].max;
+    for (uint32_t w = 1; w < num_workers; w++) {
+        for (int axis = 0; axis < 3; axis++) {
+            out_aabb->min.arr[axis] = AT_min(out_aabb->min.arr[axis], bounds[w].min.arr[axis]);
+            out_aabb->max.arr[axis] = AT_max(out_aabb->max.arr[axis], bounds[w].max.arr[axis]);
+        }
+    }
     out_aabb->midpoint = AT_AABB_calc_midpoint(out_aabb);
+    if (bounds != stack_bounds) free(bounds);
 }
 
+typedef struct {
+    const AT_Model *model;
+    AT_Triangle *triangles;
+} AT_ModelTriangleJob;
 
-AT_Result AT_model_get_triangles(AT_Triangle **out_triangles, const AT_Model *model)
+static void AT_model_triangle_worker(void *ctx, uint32_t worker, size_t first, size_t last)
 {
-    uint32_t triangle_count = model->index_count / 3;
-    AT_Triangle *ts = (AT_Triangle*)malloc(sizeof(AT_Triangle) * triangle_count);
-    if (!ts) return AT_ERR_ALLOC_ERROR;
-    for (uint32_t i = 0; i < triangle_count; i++) {
+    (void)worker;
+    AT_ModelTriangleJob *job = ctx;
+    const AT_Model *model = job->model;
+    AT_Triangle *ts = job->triangles;
+    for (size_t i = first; i < last; i++) {
         ts[i] = (AT_Triangle){
             .v1 = model->vertices[model->indices[i*3 + 0]],
             .v2 = model->vertices[model->indices[i*3 + 1]],
@@ -244,6 +893,26 @@ AT_Result AT_model_get_triangles(AT_Triangle **out_triangles, const AT_Model *mo
         };
         ts[i].aabb = AT_AABB_from_triangle(&ts[i]);
     }
+}
+
+
+AT_Result AT_model_get_triangles(AT_Triangle **out_triangles, const AT_Model *model)
+{
+    if (model->triangles) {
+        AT_Triangle *copy = malloc(sizeof(AT_Triangle) * model->triangle_count);
+        if (!copy) return AT_ERR_ALLOC_ERROR;
+        memcpy(copy, model->triangles, sizeof(AT_Triangle) * model->triangle_count);
+        *out_triangles = copy;
+        return AT_OK;
+    }
+
+    uint32_t triangle_count = model->index_count / 3;
+    AT_Triangle *ts = (AT_Triangle*)malloc(sizeof(AT_Triangle) * triangle_count);
+    if (!ts) return AT_ERR_ALLOC_ERROR;
+
+    AT_ModelTriangleJob job = {.model = model, .triangles = ts};
+    AT_model_parallel_for(AT_model_worker_count(triangle_count, AT_MODEL_CHUNK_SIZE), triangle_count,
+                          AT_MODEL_CHUNK_SIZE, AT_model_triangle_worker, &job);
     *out_triangles = ts;
     return AT_OK;
 }
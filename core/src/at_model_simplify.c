@@ -0,0 +1,486 @@
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+#include "../src/at_utils.h"
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Half-edge collapse driven by quadric error: a vertex u moves onto a
+// neighbour v, so every remaining vertex is an original one and normals
+// stay valid. Quadrics hold the planes of the triangles a vertex has
+// absorbed, plus planes perpendicular to open and material boundary edges,
+// so the cost is a sum of squared distances in metres.
+
+#define AT_SIMPLIFY_NONE UINT32_MAX
+#define AT_SIMPLIFY_MIN_NORMAL_DOT 0.2f
+
+// Symmetric 4x4 plane quadric, upper triangle
+typedef struct {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+} AT_Quadric;
+
+typedef struct {
+    float cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t from_stamp;
+    uint32_t to_stamp;
+} AT_Collapse;
+
+typedef struct {
+    AT_Collapse *items;
+    size_t count;
+    size_t capacity;
+} AT_CollapseHeap;
+
+// Triangles around a vertex, slices of one slab until a merge reallocates them
+typedef struct {
+    uint32_t *items;
+    uint32_t count;
+    bool is_owned;
+} AT_VertexTriangles;
+
+typedef struct {
+    const AT_Model *model;
+    uint32_t *indices; // working copy, dead triangles keep stale indices
+    bool *is_dead_triangle;
+    bool *is_removed;
+    uint32_t *stamps;
+    uint32_t *marks;
+    uint32_t mark;
+    AT_Quadric *quadrics;
+    AT_VertexTriangles *around;
+    uint32_t *neighbours; // scratch, deduplicated through marks
+    uint32_t num_neighbours;
+    float max_cost;
+} AT_Simplifier;
+
+static void AT_quadric_add_plane(AT_Quadric *q, AT_Vec3 n, float d, double weight)
+{
+    q->a2 += weight * n.x * n.x; q->ab += weight * n.x * n.y; q->ac += weight * n.x * n.z; q->ad += weight * n.x * d;
+    q->b2 += weight * n.y * n.y; q->bc += weight * n.y * n.z; q->bd += weight * n.y * d;
+    q->c2 += weight * n.z * n.z; q->cd += weight * n.z * d;
+    q->d2 += weight * (double)d * d;
+}
+
+static void AT_quadric_add(AT_Quadric *q, const AT_Quadric *o)
+{
+    q->a2 += o->a2; q->ab += o->ab; q->ac += o->ac; q->ad += o->ad;
+    q->b2 += o->b2; q->bc += o->bc; q->bd += o->bd;
+    q->c2 += o->c2; q->cd += o->cd;
+    q->d2 += o->d2;
+}
+
+static double AT_quadric_eval(const AT_Quadric *q, AT_Vec3 p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    return q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x +
+           q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y +
+           q->c2 * z * z + 2.0 * q->cd * z +
+           q->d2;
+}
+
+static void AT_collapse_heap_push(AT_CollapseHeap *heap, AT_Collapse collapse)
+{
+    AT_da_append(heap, collapse);
+    size_t i = heap->count - 1;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].cost <= heap->items[i].cost) break;
+        AT_Collapse tmp = heap->items[parent];
+        heap->items[parent] = heap->items[i];
+        heap->items[i] = tmp;
+        i = parent;
+    }
+}
+
+static AT_Collapse AT_collapse_heap_pop(AT_CollapseHeap *heap)
+{
+    AT_Collapse top = heap->items[0];
+    heap->items[0] = heap->items[--heap->count];
+    size_t i = 0;
+    for (;;) {
+        size_t smallest = i;
+        size_t l = 2 * i + 1, r = 2 * i + 2;
+        if (l < heap->count && heap->items[l].cost < heap->items[smallest].cost) smallest = l;
+        if (r < heap->count && heap->items[r].cost < heap->items[smallest].cost) smallest = r;
+        if (smallest == i) break;
+        AT_Collapse tmp = heap->items[smallest];
+        heap->items[smallest] = heap->items[i];
+        heap->items[i] = tmp;
+        i = smallest;
+    }
+    return top;
+}
+
+static inline bool AT_triangle_has(const uint32_t *tri, uint32_t v)
+{
+    return tri[0] == v || tri[1] == v || tri[2] == v;
+}
+
+static inline AT_Vec3 AT_simplifier_normal(const AT_Simplifier *s, const uint32_t *tri, uint32_t from, uint32_t to)
+{
+    AT_Vec3 p[3];
+    for (int c = 0; c < 3; c++) p[c] = s->model->vertices[tri[c] == from ? to : tri[c]];
+    return AT_vec3_cross(AT_vec3_sub(p[1], p[0]), AT_vec3_sub(p[2], p[0]));
+}
+
+// Live triangles around v holding both v and w
+static uint32_t AT_simplifier_edge_triangles(const AT_Simplifier *s, uint32_t v, uint32_t w, uint32_t *out_first)
+{
+    uint32_t count = 0;
+    const AT_VertexTriangles *around = &s->around[v];
+    for (uint32_t i = 0; i < around->count; i++) {
+        uint32_t t = around->items[i];
+        if (s->is_dead_triangle[t] || !AT_triangle_has(&s->indices[t * 3], w)) continue;
+        if (count == 0 && out_first) *out_first = t;
+        count++;
+    }
+    return count;
+}
+
+// Open edges, non-manifold edges and edges between two materials
+static bool AT_simplifier_is_border_edge(const AT_Simplifier *s, uint32_t v, uint32_t w)
+{
+    uint32_t first = 0;
+    if (AT_simplifier_edge_triangles(s, v, w, &first) != 2) return true;
+    const AT_VertexTriangles *around = &s->around[v];
+    for (uint32_t i = 0; i < around->count; i++) {
+        uint32_t t = around->items[i];
+        if (s->is_dead_triangle[t] || t == first || !AT_triangle_has(&s->indices[t * 3], w)) continue;
+        return s->model->triangle_materials[t] != s->model->triangle_materials[first];
+    }
+    return true;
+}
+
+// Fills neighbours with the distinct live neighbours of v, marked with the current mark
+static void AT_simplifier_gather_neighbours(AT_Simplifier *s, uint32_t v)
+{
+    s->mark++;
+    s->num_neighbours = 0;
+    const AT_VertexTriangles *around = &s->around[v];
+    for (uint32_t i = 0; i < around->count; i++) {
+        uint32_t t = around->items[i];
+        if (s->is_dead_triangle[t]) continue;
+        for (int c = 0; c < 3; c++) {
+            uint32_t w = s->indices[t * 3 + c];
+            if (w == v || s->marks[w] == s->mark) continue;
+            s->marks[w] = s->mark;
+            s->neighbours[s->num_neighbours++] = w;
+        }
+    }
+}
+
+// Cost of moving from onto to, or a negative value when the collapse would
+// move a border off itself, pinch the surface or fold a triangle over
+static float AT_simplifier_evaluate(AT_Simplifier *s, uint32_t from, uint32_t to)
+{
+    //an interior vertex may go anywhere, a border vertex only along the one
+    //border line through it, corners stay
+    AT_simplifier_gather_neighbours(s, from);
+    uint32_t border_count = 0;
+    bool is_along_border = false;
+    for (uint32_t i = 0; i < s->num_neighbours; i++) {
+        uint32_t w = s->neighbours[i];
+        if (!AT_simplifier_is_border_edge(s, from, w)) continue;
+        border_count++;
+        if (w == to) is_along_border = true;
+    }
+    if (border_count != 0 && (border_count != 2 || !is_along_border)) return -1.0f;
+
+    //link condition: the only shared neighbours are the tips of the edge triangles
+    uint32_t edge_triangles = AT_simplifier_edge_triangles(s, from, to, NULL);
+    uint32_t from_mark = s->mark;
+    uint32_t shared = 0;
+    const AT_VertexTriangles *to_around = &s->around[to];
+    s->mark++;
+    for (uint32_t i = 0; i < to_around->count; i++) {
+        uint32_t t = to_around->items[i];
+        if (s->is_dead_triangle[t]) continue;
+        for (int c = 0; c < 3; c++) {
+            uint32_t w = s->indices[t * 3 + c];
+            if (w == to || w == from || s->marks[w] != from_mark) continue;
+            s->marks[w] = s->mark; //counted once
+            shared++;
+        }
+    }
+    if (shared != edge_triangles) return -1.0f;
+
+    const AT_VertexTriangles *from_around = &s->around[from];
+    for (uint32_t i = 0; i < from_around->count; i++) {
+        uint32_t t = from_around->items[i];
+        const uint32_t *tri = &s->indices[t * 3];
+        if (s->is_dead_triangle[t] || AT_triangle_has(tri, to)) continue;
+        AT_Vec3 before = AT_simplifier_normal(s, tri, from, from);
+        AT_Vec3 after = AT_simplifier_normal(s, tri, from, to);
+        float after_length = AT_vec3_length(after);
+        if (!(after_length > 0.0f) ||
+            AT_vec3_dot(before, after) < AT_SIMPLIFY_MIN_NORMAL_DOT * AT_vec3_length(before) * after_length) {
+            return -1.0f;
+        }
+    }
+
+    AT_Quadric q = s->quadrics[from];
+    AT_quadric_add(&q, &s->quadrics[to]);
+    return (float)fmax(AT_quadric_eval(&q, s->model->vertices[to]), 0.0);
+}
+
+static void AT_simplifier_push(AT_Simplifier *s, AT_CollapseHeap *heap, uint32_t from, uint32_t to)
+{
+    //quadrics only grow, so a collapse too costly now stays too costly
+    float cost = AT_simplifier_evaluate(s, from, to);
+    if (cost < 0.0f || cost > s->max_cost) return;
+    AT_collapse_heap_push(heap, (AT_Collapse){
+        .cost = cost,
+        .from = from,
+        .to = to,
+        .from_stamp = s->stamps[from],
+        .to_stamp = s->stamps[to],
+    });
+}
+
+// Moves from onto to, killing the triangles over the edge
+static bool AT_simplifier_collapse(AT_Simplifier *s, uint32_t from, uint32_t to)
+{
+    AT_VertexTriangles *from_around = &s->around[from];
+    AT_VertexTriangles *to_around = &s->around[to];
+
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < to_around->count; i++) live += !s->is_dead_triangle[to_around->items[i]];
+    for (uint32_t i = 0; i < from_around->count; i++) live += !s->is_dead_triangle[from_around->items[i]];
+    uint32_t *merged = malloc(sizeof(uint32_t) * AT_max(live, 1u));
+    if (!merged) return false;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < from_around->count; i++) {
+        uint32_t t = from_around->items[i];
+        uint32_t *tri = &s->indices[t * 3];
+        if (s->is_dead_triangle[t]) continue;
+        if (AT_triangle_has(tri, to)) {
+            s->is_dead_triangle[t] = true;
+            continue;
+        }
+        for (int c = 0; c < 3; c++) if (tri[c] == from) tri[c] = to;
+        merged[count++] = t;
+    }
+    for (uint32_t i = 0; i < to_around->count; i++) {
+        uint32_t t = to_around->items[i];
+        if (!s->is_dead_triangle[t]) merged[count++] = t;
+    }
+
+    if (from_around->is_owned) free(from_around->items);
+    if (to_around->is_owned) free(to_around->items);
+    *from_around = (AT_VertexTriangles){0};
+    *to_around = (AT_VertexTriangles){.items = merged, .count = count, .is_owned = true};
+
+    AT_quadric_add(&s->quadrics[to], &s->quadrics[from]);
+    s->is_removed[from] = true;
+    s->stamps[to]++;
+    return true;
+}
+
+static AT_Result AT_simplifier_init(AT_Simplifier *s, uint32_t **out_slab, const AT_Model *model, float max_error)
+{
+    size_t vertex_count = model->vertex_count;
+    size_t triangle_count = model->index_count / 3;
+    s->model = model;
+    s->max_cost = max_error * max_error;
+    s->indices = malloc(sizeof(uint32_t) * AT_max(model->index_count, (size_t)1));
+    s->is_dead_triangle = calloc(AT_max(triangle_count, (size_t)1), sizeof(bool));
+    s->is_removed = calloc(vertex_count, sizeof(bool));
+    s->stamps = calloc(vertex_count, sizeof(uint32_t));
+    s->marks = calloc(vertex_count, sizeof(uint32_t));
+    s->quadrics = calloc(vertex_count, sizeof(AT_Quadric));
+    s->around = calloc(vertex_count, sizeof(AT_VertexTriangles));
+    s->neighbours = malloc(sizeof(uint32_t) * vertex_count);
+    uint32_t *offsets = calloc(vertex_count + 1, sizeof(uint32_t));
+    *out_slab = malloc(sizeof(uint32_t) * AT_max(model->index_count, (size_t)1));
+    if (!s->indices || !s->is_dead_triangle || !s->is_removed || !s->stamps || !s->marks ||
+        !s->quadrics || !s->around || !s->neighbours || !offsets || !*out_slab) {
+        free(offsets);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    memcpy(s->indices, model->indices, sizeof(uint32_t) * model->index_count);
+
+    //triangles around each vertex, as slices of the slab
+    for (size_t i = 0; i < model->index_count; i++) offsets[s->indices[i] + 1]++;
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+    for (size_t v = 0; v < vertex_count; v++) s->around[v].items = *out_slab + offsets[v];
+    for (size_t i = 0; i < model->index_count; i++) {
+        AT_VertexTriangles *around = &s->around[s->indices[i]];
+        around->items[around->count++] = (uint32_t)(i / 3);
+    }
+    free(offsets);
+
+    for (size_t t = 0; t < triangle_count; t++) {
+        const uint32_t *tri = &s->indices[t * 3];
+        AT_Vec3 a = model->vertices[tri[0]], b = model->vertices[tri[1]], c = model->vertices[tri[2]];
+        AT_Vec3 n = AT_vec3_cross(AT_vec3_sub(b, a), AT_vec3_sub(c, a));
+        if (!(AT_vec3_length(n) > 0.0f)) continue;
+        n = AT_vec3_normalize(n);
+        for (int k = 0; k < 3; k++) AT_quadric_add_plane(&s->quadrics[tri[k]], n, -AT_vec3_dot(n, a), 1.0);
+
+        //planes through border edges at right angles to the triangle keep
+        //the border where it is
+        for (int e = 0; e < 3; e++) {
+            uint32_t v = tri[e], w = tri[(e + 1) % 3];
+            if (!AT_simplifier_is_border_edge(s, v, w)) continue;
+            AT_Vec3 edge = AT_vec3_sub(model->vertices[w], model->vertices[v]);
+            if (!(AT_vec3_length(edge) > 0.0f)) continue;
+            AT_Vec3 side = AT_vec3_normalize(AT_vec3_cross(edge, n));
+            float d = -AT_vec3_dot(side, model->vertices[v]);
+            AT_quadric_add_plane(&s->quadrics[v], side, d, 1.0);
+            AT_quadric_add_plane(&s->quadrics[w], side, d, 1.0);
+        }
+    }
+    return AT_OK;
+}
+
+static void AT_simplifier_destroy(AT_Simplifier *s, uint32_t *slab)
+{
+    if (s->around) {
+        for (size_t v = 0; v < s->model->vertex_count; v++) {
+            if (s->around[v].is_owned) free(s->around[v].items);
+        }
+    }
+    free(s->indices);
+    free(s->is_dead_triangle);
+    free(s->is_removed);
+    free(s->stamps);
+    free(s->marks);
+    free(s->quadrics);
+    free(s->around);
+    free(s->neighbours);
+    free(slab);
+}
+
+AT_Result AT_model_simplify(AT_Model **out_model, const AT_Model *model, float max_error, AT_ModelSimplifyStats *out_stats)
+{
+    if (!out_model || *out_model || !model || model->triangles || !(max_error >= 0.0f)) return AT_ERR_INVALID_ARGUMENT;
+
+    size_t vertex_count = model->vertex_count;
+    size_t triangle_count = model->index_count / 3;
+    if (vertex_count >= UINT32_MAX || triangle_count == 0) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_Simplifier s = {0};
+    uint32_t *slab = NULL;
+    AT_CollapseHeap heap = {0};
+    AT_Result res = AT_simplifier_init(&s, &slab, model, max_error);
+    if (res != AT_OK) {
+        AT_simplifier_destroy(&s, slab);
+        return res;
+    }
+
+    //every edge both ways, from each triangle holding it
+    for (size_t t = 0; t < triangle_count; t++) {
+        for (int e = 0; e < 3; e++) {
+            uint32_t v = s.indices[t * 3 + e], w = s.indices[t * 3 + (e + 1) % 3];
+            if (v == w) continue;
+            AT_simplifier_push(&s, &heap, v, w);
+            AT_simplifier_push(&s, &heap, w, v);
+        }
+    }
+
+    size_t collapsed = 0;
+    float max_cost = 0.0f;
+    while (heap.count > 0) {
+        AT_Collapse collapse = AT_collapse_heap_pop(&heap);
+        if (s.is_removed[collapse.from] || s.is_removed[collapse.to] ||
+            s.stamps[collapse.from] != collapse.from_stamp || s.stamps[collapse.to] != collapse.to_stamp) {
+            continue;
+        }
+        //neighbours of either end may have changed the border or the link
+        float cost = AT_simplifier_evaluate(&s, collapse.from, collapse.to);
+        if (cost < 0.0f || cost > s.max_cost) continue;
+
+        if (!AT_simplifier_collapse(&s, collapse.from, collapse.to)) {
+            res = AT_ERR_ALLOC_ERROR;
+            break;
+        }
+        collapsed++;
+        max_cost = fmaxf(max_cost, cost);
+
+        AT_simplifier_gather_neighbours(&s, collapse.to);
+        uint32_t num_neighbours = s.num_neighbours;
+        uint32_t *neighbours = malloc(sizeof(uint32_t) * AT_max(num_neighbours, 1u));
+        if (!neighbours) {
+            res = AT_ERR_ALLOC_ERROR;
+            break;
+        }
+        memcpy(neighbours, s.neighbours, sizeof(uint32_t) * num_neighbours);
+        for (uint32_t i = 0; i < num_neighbours; i++) {
+            AT_simplifier_push(&s, &heap, collapse.to, neighbours[i]);
+            AT_simplifier_push(&s, &heap, neighbours[i], collapse.to);
+        }
+        free(neighbours);
+    }
+    AT_da_free(&heap);
+
+    AT_Model *simplified = (res == AT_OK) ? calloc(1, sizeof(AT_Model)) : NULL;
+    if (res == AT_OK && !simplified) res = AT_ERR_ALLOC_ERROR;
+
+    //survivors, with vertices numbered in first use order
+    size_t kept = 0;
+    for (size_t t = 0; t < triangle_count; t++) kept += !s.is_dead_triangle[t];
+    if (res == AT_OK) {
+        simplified->indices = malloc(sizeof(uint32_t) * AT_max(kept * 3, (size_t)1));
+        simplified->triangle_materials = malloc(sizeof(AT_MaterialId) * AT_max(kept, (size_t)1));
+        simplified->vertices = malloc(sizeof(AT_Vec3) * AT_max(AT_min(vertex_count, kept * 3), (size_t)1));
+        simplified->normals = malloc(sizeof(AT_Vec3) * AT_max(AT_min(vertex_count, kept * 3), (size_t)1));
+        if (model->materials) {
+            simplified->materials = malloc(sizeof(AT_Material) * model->material_count);
+            if (simplified->materials) {
+                memcpy(simplified->materials, model->materials, sizeof(AT_Material) * model->material_count);
+                simplified->material_count = model->material_count;
+            }
+        }
+        if (!simplified->indices || !simplified->triangle_materials || !simplified->vertices || !simplified->normals ||
+            (model->materials && !simplified->materials)) {
+            res = AT_ERR_ALLOC_ERROR;
+        }
+    }
+    if (res != AT_OK) {
+        AT_model_destroy(simplified);
+        AT_simplifier_destroy(&s, slab);
+        return res;
+    }
+
+    uint32_t *renumber = s.marks; //no longer needed for marking
+    memset(renumber, 0xff, sizeof(uint32_t) * vertex_count);
+    size_t out_vertices = 0;
+    size_t out_triangles = 0;
+    for (size_t t = 0; t < triangle_count; t++) {
+        if (s.is_dead_triangle[t]) continue;
+        for (int c = 0; c < 3; c++) {
+            uint32_t v = s.indices[t * 3 + c];
+            if (renumber[v] == AT_SIMPLIFY_NONE) {
+                renumber[v] = (uint32_t)out_vertices;
+                simplified->vertices[out_vertices] = model->vertices[v];
+                simplified->normals[out_vertices] = model->normals[v];
+                out_vertices++;
+            }
+            simplified->indices[out_triangles * 3 + c] = renumber[v];
+        }
+        simplified->triangle_materials[out_triangles] = model->triangle_materials[t];
+        out_triangles++;
+    }
+    simplified->vertex_count = out_vertices;
+    simplified->index_count = out_triangles * 3;
+    AT_simplifier_destroy(&s, slab);
+
+    if (out_stats) {
+        *out_stats = (AT_ModelSimplifyStats){
+            .collapsed_vertices = collapsed,
+            .vertex_count = out_vertices,
+            .triangle_count = out_triangles,
+            .max_error = sqrtf(max_cost),
+        };
+    }
+    *out_model = simplified;
+    return AT_OK;
+}
@@ -0,0 +1,486 @@
+#include "../src/at_polygon.h"
+#include "../src/at_aabb.h"
+#include "../src/at_utils.h"
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AT_POLYGON_NONE UINT32_MAX
+
+// Relative tolerance for collinear outline vertices
+#define AT_POLYGON_COLLINEAR_EPSILON 1e-6f
+
+// Undirected edge between two corner ids and the triangles along it, a
+// third triangle marks it non-manifold
+typedef struct {
+    uint32_t lo, hi;
+    uint32_t triangles[2];
+    uint32_t count;
+} AT_PolygonEdgeEntry;
+
+// Polygon being merged, numbered after its seed triangle, whose plane it
+// keeps. Collinear corners stay until the end so outlines of neighbours
+// still share their corners.
+typedef struct {
+    uint32_t *loop; // counter-clockwise about the seed normal
+    uint32_t n;
+    uint32_t first_triangle; // chained through next_triangle
+    uint32_t last_triangle;
+} AT_PolygonDraft;
+
+typedef struct {
+    const AT_Triangle *triangles;
+    const AT_MaterialId *materials;
+    AT_Vec3 *positions; // distinct corners
+    uint32_t *ids; // corner id of every triangle corner
+    AT_Vec3 *normals; // unit, zero for degenerate triangles
+    uint32_t *owner; // draft each triangle belongs to, NONE if degenerate
+    uint32_t *next_triangle;
+    AT_PolygonDraft *drafts;
+    uint32_t *scratch; // merged outline
+    uint32_t *region; // union-find parent over mergeable triangles
+    uint32_t *boundary_next; // per corner, outline walk of one region
+    AT_PolygonEdgeEntry *edges;
+    uint32_t edges_size; // power of two
+} AT_PolygonBuilder;
+
+static inline uint32_t AT_polygon_hash(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t h = a * 0x8da6b343u ^ b * 0xd8163841u ^ c * 0xcb1ab31fu;
+    return h ^ (h >> 15);
+}
+
+static inline uint32_t AT_polygon_table_size(size_t entries)
+{
+    uint32_t size = 16;
+    while (size < entries * 2) size <<= 1;
+    return size;
+}
+
+static inline AT_Vec3 AT_polygon_corner(const AT_Triangle *tri, int c)
+{
+    return (c == 0) ? tri->v1 : (c == 1) ? tri->v2 : tri->v3;
+}
+
+// Numbers corners by their exact bits, -0 and 0 alike
+static AT_Result AT_polygon_number_corners(AT_PolygonBuilder *b, uint32_t count)
+{
+    uint32_t table_size = AT_polygon_table_size((size_t)count * 3);
+    uint32_t *table = malloc(sizeof(uint32_t) * table_size);
+    if (!table) return AT_ERR_ALLOC_ERROR;
+    memset(table, 0xff, sizeof(uint32_t) * table_size);
+
+    uint32_t num_positions = 0;
+    for (uint32_t i = 0; i < count * 3; i++) {
+        AT_Vec3 p = AT_polygon_corner(&b->triangles[i / 3], i % 3);
+        p = AT_vec3(p.x + 0.0f, p.y + 0.0f, p.z + 0.0f);
+        uint32_t bits[3];
+        memcpy(bits, p.arr, sizeof(bits));
+
+        uint32_t slot = AT_polygon_hash(bits[0], bits[1], bits[2]) & (table_size - 1);
+        while (table[slot] != AT_POLYGON_NONE && memcmp(b->positions[table[slot]].arr, bits, sizeof(bits)) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == AT_POLYGON_NONE) {
+            table[slot] = num_positions;
+            b->positions[num_positions++] = p;
+        }
+        b->ids[i] = table[slot];
+    }
+
+    free(table);
+    return AT_OK;
+}
+
+static AT_PolygonEdgeEntry *AT_polygon_find_edge(const AT_PolygonBuilder *b, uint32_t u, uint32_t v)
+{
+    uint32_t lo = AT_min(u, v), hi = AT_max(u, v);
+    uint32_t slot = AT_polygon_hash(lo, hi, 0) & (b->edges_size - 1);
+    while (b->edges[slot].count != 0 && (b->edges[slot].lo != lo || b->edges[slot].hi != hi)) {
+        slot = (slot + 1) & (b->edges_size - 1);
+    }
+    return &b->edges[slot];
+}
+
+static void AT_polygon_add_edge(AT_PolygonBuilder *b, uint32_t u, uint32_t v, uint32_t t)
+{
+    AT_PolygonEdgeEntry *entry = AT_polygon_find_edge(b, u, v);
+    if (entry->count == 0) {
+        entry->lo = AT_min(u, v);
+        entry->hi = AT_max(u, v);
+    }
+    if (entry->count < 2) entry->triangles[entry->count] = t;
+    entry->count++;
+}
+
+// Turn at q between p and r, positive for a left turn about the normal,
+// as the sine of the angle
+static inline float AT_polygon_turn(AT_Vec3 p, AT_Vec3 q, AT_Vec3 r, AT_Vec3 normal, float *out_cos)
+{
+    AT_Vec3 a = AT_vec3_sub(q, p), b = AT_vec3_sub(r, q);
+    float lengths = fmaxf(AT_vec3_length(a) * AT_vec3_length(b), FLT_MIN);
+    if (out_cos) *out_cos = AT_vec3_dot(a, b) / lengths;
+    return AT_vec3_dot(AT_vec3_cross(a, b), normal) / lengths;
+}
+
+// Corners left once collinear ones are dropped, or 0 if the outline is not
+// convex or doubles back on itself
+static uint32_t AT_polygon_convex_corners(const AT_PolygonBuilder *b, const uint32_t *loop, uint32_t n, AT_Vec3 normal)
+{
+    uint32_t corners = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        float cos_turn = 0.0f;
+        float turn = AT_polygon_turn(b->positions[loop[(i + n - 1) % n]], b->positions[loop[i]],
+                                     b->positions[loop[(i + 1) % n]], normal, &cos_turn);
+        if (turn < -AT_POLYGON_COLLINEAR_EPSILON) return 0;
+        if (turn > AT_POLYGON_COLLINEAR_EPSILON) {
+            corners++;
+        } else if (cos_turn < 0.0f) {
+            return 0;
+        }
+    }
+    return corners;
+}
+
+// Merges draft from into draft into across the edge u-v when the union is
+// a convex polygon in the plane of into
+static bool AT_polygon_try_merge(AT_PolygonBuilder *b, uint32_t into, uint32_t from, uint32_t u, uint32_t v)
+{
+    AT_PolygonDraft *a = &b->drafts[into];
+    AT_PolygonDraft *o = &b->drafts[from];
+    const AT_Vec3 normal = b->normals[into];
+    const float d = -AT_vec3_dot(normal, b->positions[a->loop[0]]);
+
+    //a holds the edge one way, o the other
+    uint32_t s = AT_POLYGON_NONE;
+    for (uint32_t i = 0; i < a->n && s == AT_POLYGON_NONE; i++) {
+        uint32_t p = a->loop[i], q = a->loop[(i + 1) % a->n];
+        if ((p == u && q == v) || (p == v && q == u)) s = i;
+    }
+    uint32_t js = AT_POLYGON_NONE;
+    for (uint32_t j = 0; j < o->n && js == AT_POLYGON_NONE; j++) {
+        if (o->loop[j] == a->loop[s] && o->loop[(j + o->n - 1) % o->n] == a->loop[(s + 1) % a->n]) js = j;
+    }
+    if (s == AT_POLYGON_NONE || js == AT_POLYGON_NONE) return false;
+
+    //widen to the whole shared chain, a[s..s+len] runs backwards through o from js
+    uint32_t len = 1;
+    while (len < AT_min(a->n, o->n) - 1 &&
+           a->loop[(s + len + 1) % a->n] == o->loop[(js + o->n - len - 1) % o->n]) {
+        len++;
+    }
+    while (len < AT_min(a->n, o->n) - 1 &&
+           a->loop[(s + a->n - 1) % a->n] == o->loop[(js + 1) % o->n]) {
+        s = (s + a->n - 1) % a->n;
+        js = (js + 1) % o->n;
+        len++;
+    }
+
+    //a from the chain end round to its start, then the rest of o
+    uint32_t n = 0;
+    for (uint32_t k = 0; k <= a->n - len; k++) b->scratch[n++] = a->loop[(s + len + k) % a->n];
+    for (uint32_t k = 1; k < o->n - len; k++) {
+        uint32_t w = o->loop[(js + k) % o->n];
+        if (fabsf(AT_vec3_dot(normal, b->positions[w]) + d) > AT_POLYGON_COPLANAR_DISTANCE) return false;
+        b->scratch[n++] = w;
+    }
+
+    uint32_t corners = (n >= 3) ? AT_polygon_convex_corners(b, b->scratch, n, normal) : 0;
+    if (corners < 3 || corners > AT_POLYGON_MAX_VERTICES) return false;
+
+    uint32_t *loop = malloc(sizeof(uint32_t) * n);
+    if (!loop) return false;
+    memcpy(loop, b->scratch, sizeof(uint32_t) * n);
+    free(a->loop);
+    free(o->loop);
+    a->loop = loop;
+    a->n = n;
+    o->loop = NULL;
+    o->n = 0;
+
+    for (uint32_t t = o->first_triangle; t != AT_POLYGON_NONE; t = b->next_triangle[t]) b->owner[t] = into;
+    b->next_triangle[a->last_triangle] = o->first_triangle;
+    a->last_triangle = o->last_triangle;
+    return true;
+}
+
+static uint32_t AT_polygon_find_region(uint32_t *region, uint32_t t)
+{
+    while (region[t] != t) {
+        region[t] = region[region[t]];
+        t = region[t];
+    }
+    return t;
+}
+
+static inline bool AT_polygon_is_mergeable(const AT_PolygonBuilder *b, const AT_PolygonEdgeEntry *entry)
+{
+    if (entry->count != 2) return false;
+    uint32_t t0 = entry->triangles[0], t1 = entry->triangles[1];
+    return b->owner[t0] != AT_POLYGON_NONE && b->owner[t1] != AT_POLYGON_NONE &&
+           b->materials[t0] == b->materials[t1] &&
+           AT_vec3_dot(b->normals[t0], b->normals[t1]) >= AT_POLYGON_COPLANAR_COS;
+}
+
+// Turns a whole region into the draft of its first triangle when it is
+// flat and bounded by one convex outline, as most walls are
+static void AT_polygon_merge_region(AT_PolygonBuilder *b, uint32_t seed)
+{
+    const AT_Vec3 normal = b->normals[seed];
+    const float d = -AT_vec3_dot(normal, b->positions[b->ids[seed * 3]]);
+
+    //edges not shared within the region form the outline, each corner
+    //must start exactly one of them
+    uint32_t num_boundary = 0;
+    uint32_t start = AT_POLYGON_NONE;
+    bool is_simple = true;
+    for (uint32_t t = seed; t != AT_POLYGON_NONE; t = b->next_triangle[t]) {
+        for (int e = 0; e < 3; e++) {
+            uint32_t u = b->ids[t * 3 + e], v = b->ids[t * 3 + (e + 1) % 3];
+            if (fabsf(AT_vec3_dot(normal, b->positions[u]) + d) > AT_POLYGON_COPLANAR_DISTANCE) is_simple = false;
+            const AT_PolygonEdgeEntry *entry = AT_polygon_find_edge(b, u, v);
+            if (AT_polygon_is_mergeable(b, entry)) continue;
+            if (b->boundary_next[u] != AT_POLYGON_NONE) is_simple = false;
+            b->boundary_next[u] = v;
+            start = u;
+            num_boundary++;
+        }
+    }
+
+    uint32_t n = 0;
+    if (is_simple && start != AT_POLYGON_NONE) {
+        uint32_t u = start;
+        do {
+            b->scratch[n++] = u;
+            u = b->boundary_next[u];
+        } while (u != start && u != AT_POLYGON_NONE && n <= num_boundary);
+        if (u != start || n != num_boundary) is_simple = false;
+    }
+    uint32_t corners = is_simple ? AT_polygon_convex_corners(b, b->scratch, n, normal) : 0;
+
+    for (uint32_t t = seed; t != AT_POLYGON_NONE; t = b->next_triangle[t]) {
+        for (int c = 0; c < 3; c++) b->boundary_next[b->ids[t * 3 + c]] = AT_POLYGON_NONE;
+    }
+    uint32_t *loop = (corners >= 3 && corners <= AT_POLYGON_MAX_VERTICES) ? malloc(sizeof(uint32_t) * n) : NULL;
+    if (!loop) {
+        //the triangles go on as drafts of their own
+        for (uint32_t t = seed, next; t != AT_POLYGON_NONE; t = next) {
+            next = b->next_triangle[t];
+            b->next_triangle[t] = AT_POLYGON_NONE;
+        }
+        return;
+    }
+
+    memcpy(loop, b->scratch, sizeof(uint32_t) * n);
+    uint32_t last = seed;
+    for (uint32_t t = seed; t != AT_POLYGON_NONE; t = b->next_triangle[t]) {
+        free(b->drafts[t].loop);
+        b->drafts[t] = (AT_PolygonDraft){0};
+        b->owner[t] = seed;
+        last = t;
+    }
+    b->drafts[seed] = (AT_PolygonDraft){.loop = loop, .n = n, .first_triangle = seed, .last_triangle = last};
+}
+
+// Groups triangles joined by mergeable edges and merges every region
+// with a convex outline in one go
+static void AT_polygon_merge_regions(AT_PolygonBuilder *b, uint32_t count)
+{
+    for (uint32_t t = 0; t < count; t++) b->region[t] = t;
+    for (uint32_t slot = 0; slot < b->edges_size; slot++) {
+        const AT_PolygonEdgeEntry *entry = &b->edges[slot];
+        if (!AT_polygon_is_mergeable(b, entry)) continue;
+        uint32_t r0 = AT_polygon_find_region(b->region, entry->triangles[0]);
+        uint32_t r1 = AT_polygon_find_region(b->region, entry->triangles[1]);
+        if (r0 != r1) b->region[AT_min(r0, r1)] = AT_max(r0, r1);
+    }
+
+    //chain each region from its first triangle
+    uint32_t *heads = b->boundary_next; //borrowed, reset below
+    uint32_t *tails = b->boundary_next + count;
+    for (uint32_t t = 0; t < count; t++) heads[t] = tails[t] = AT_POLYGON_NONE;
+    for (uint32_t t = 0; t < count; t++) {
+        if (b->owner[t] == AT_POLYGON_NONE) continue;
+        uint32_t root = AT_polygon_find_region(b->region, t);
+        if (heads[root] == AT_POLYGON_NONE) {
+            heads[root] = t;
+        } else {
+            b->next_triangle[tails[root]] = t;
+        }
+        tails[root] = t;
+    }
+
+    //the union-find is done with, it now lists the region seeds
+    uint32_t num_seeds = 0;
+    for (uint32_t root = 0; root < count; root++) {
+        if (heads[root] != AT_POLYGON_NONE) b->region[num_seeds++] = heads[root];
+    }
+    memset(b->boundary_next, 0xff, sizeof(uint32_t) * (size_t)count * 3);
+    for (uint32_t i = 0; i < num_seeds; i++) AT_polygon_merge_region(b, b->region[i]);
+}
+
+// Hertel-Mehlhorn: drop shared edges while both sides stay convex
+static void AT_polygon_merge_all(AT_PolygonBuilder *b)
+{
+    bool is_merged = true;
+    while (is_merged) {
+        is_merged = false;
+        for (uint32_t slot = 0; slot < b->edges_size; slot++) {
+            const AT_PolygonEdgeEntry *entry = &b->edges[slot];
+            if (entry->count != 2) continue;
+            uint32_t t0 = entry->triangles[0], t1 = entry->triangles[1];
+            uint32_t into = b->owner[t0], from = b->owner[t1];
+            if (into == from || b->materials[t0] != b->materials[t1] ||
+                AT_vec3_dot(b->normals[into], b->normals[from]) < AT_POLYGON_COPLANAR_COS) {
+                continue;
+            }
+            if (AT_polygon_try_merge(b, into, from, entry->lo, entry->hi)) is_merged = true;
+        }
+    }
+}
+
+AT_Result AT_polygon_set_create(AT_PolygonSet *out_set, const AT_Triangle *triangles, const AT_MaterialId *materials, uint32_t count)
+{
+    if (!out_set || (!triangles && count > 0) || (!materials && count > 0)) return AT_ERR_INVALID_ARGUMENT;
+    *out_set = (AT_PolygonSet){0};
+
+    size_t corner_count = AT_max((size_t)count * 3, (size_t)1);
+    AT_PolygonBuilder b = {
+        .triangles = triangles,
+        .materials = materials,
+        .positions = malloc(sizeof(AT_Vec3) * corner_count),
+        .ids = malloc(sizeof(uint32_t) * corner_count),
+        .normals = malloc(sizeof(AT_Vec3) * AT_max(count, 1u)),
+        .owner = malloc(sizeof(uint32_t) * AT_max(count, 1u)),
+        .next_triangle = malloc(sizeof(uint32_t) * AT_max(count, 1u)),
+        .drafts = calloc(AT_max(count, 1u), sizeof(AT_PolygonDraft)),
+        .scratch = malloc(sizeof(uint32_t) * corner_count),
+        .region = malloc(sizeof(uint32_t) * AT_max(count, 1u)),
+        .boundary_next = malloc(sizeof(uint32_t) * corner_count),
+        .edges_size = AT_polygon_table_size(corner_count),
+    };
+    b.edges = calloc(b.edges_size, sizeof(AT_PolygonEdgeEntry));
+
+    AT_Result res = AT_OK;
+    if (!b.positions || !b.ids || !b.normals || !b.owner || !b.next_triangle || !b.drafts || !b.scratch ||
+        !b.region || !b.boundary_next || !b.edges) {
+        res = AT_ERR_ALLOC_ERROR;
+    } else {
+        res = AT_polygon_number_corners(&b, count);
+    }
+
+    //every triangle starts as a draft of its own
+    uint32_t num_drafts = 0;
+    uint32_t num_edges = 0;
+    for (uint32_t t = 0; t < count && res == AT_OK; t++) {
+        const uint32_t *id = &b.ids[t * 3];
+        AT_Vec3 a = b.positions[id[0]];
+        AT_Vec3 n = AT_vec3_cross(AT_vec3_sub(b.positions[id[1]], a), AT_vec3_sub(b.positions[id[2]], a));
+        b.next_triangle[t] = AT_POLYGON_NONE;
+        b.owner[t] = AT_POLYGON_NONE;
+        if (id[0] == id[1] || id[1] == id[2] || id[2] == id[0] || !(AT_vec3_length(n) > 0.0f)) continue;
+
+        b.normals[t] = AT_vec3_normalize(n);
+        b.owner[t] = t;
+        b.drafts[t] = (AT_PolygonDraft){.loop = malloc(sizeof(uint32_t) * 3), .n = 3, .first_triangle = t, .last_triangle = t};
+        if (!b.drafts[t].loop) {
+            res = AT_ERR_ALLOC_ERROR;
+            break;
+        }
+        memcpy(b.drafts[t].loop, id, sizeof(uint32_t) * 3);
+        for (int e = 0; e < 3; e++) AT_polygon_add_edge(&b, id[e], id[(e + 1) % 3], t);
+    }
+    //degenerate triangles leave their neighbours' edges open
+    bool is_closed = count > 0;
+    for (uint32_t slot = 0; slot < b.edges_size && res == AT_OK; slot++) {
+        if (b.edges && b.edges[slot].count != 0 && b.edges[slot].count != 2) is_closed = false;
+    }
+    if (res == AT_OK) {
+        AT_polygon_merge_regions(&b, count);
+        AT_polygon_merge_all(&b);
+    }
+
+    for (uint32_t t = 0; t < count && res == AT_OK; t++) {
+        if (b.drafts[t].n == 0) continue;
+        num_drafts++;
+        num_edges += AT_polygon_convex_corners(&b, b.drafts[t].loop, b.drafts[t].n, b.normals[t]);
+    }
+
+    AT_Polygon *polygons = (res == AT_OK) ? malloc(sizeof(AT_Polygon) * AT_max(num_drafts, 1u)) : NULL;
+    AT_PolygonEdge *edges = (res == AT_OK) ? malloc(sizeof(AT_PolygonEdge) * AT_max(num_edges, 1u)) : NULL;
+    if (res == AT_OK && (!polygons || !edges)) res = AT_ERR_ALLOC_ERROR;
+
+    uint32_t num_polygons = 0;
+    num_edges = 0;
+    for (uint32_t t = 0; t < count && res == AT_OK; t++) {
+        const AT_PolygonDraft *draft = &b.drafts[t];
+        if (draft->n == 0) continue;
+
+        //straight runs along merged edges need no edge plane
+        uint32_t n = 0;
+        AT_Vec3 normal = b.normals[t];
+        for (uint32_t i = 0; i < draft->n; i++) {
+            float turn = AT_polygon_turn(b.positions[draft->loop[(i + draft->n - 1) % draft->n]], b.positions[draft->loop[i]],
+                                         b.positions[draft->loop[(i + 1) % draft->n]], normal, NULL);
+            if (turn > AT_POLYGON_COLLINEAR_EPSILON) b.scratch[n++] = draft->loop[i];
+        }
+
+        AT_Polygon *polygon = &polygons[num_polygons++];
+        polygon->normal = normal;
+        polygon->d = -AT_vec3_dot(normal, b.positions[b.ids[t * 3]]);
+        polygon->first_edge = num_edges;
+        polygon->num_edges = (uint16_t)n;
+        polygon->material = materials[t];
+        polygon->aabb.min = polygon->aabb.max = b.positions[b.scratch[0]];
+        for (uint32_t i = 0; i < n; i++) {
+            AT_Vec3 p = b.positions[b.scratch[i]];
+            AT_Vec3 q = b.positions[b.scratch[(i + 1) % n]];
+            AT_Vec3 inward = AT_vec3_normalize(AT_vec3_cross(normal, AT_vec3_sub(q, p)));
+            edges[num_edges++] = (AT_PolygonEdge){.normal = inward, .d = -AT_vec3_dot(inward, p)};
+            for (int axis = 0; axis < 3; axis++) {
+                polygon->aabb.min.arr[axis] = fminf(polygon->aabb.min.arr[axis], p.arr[axis]);
+                polygon->aabb.max.arr[axis] = fmaxf(polygon->aabb.max.arr[axis], p.arr[axis]);
+            }
+        }
+        polygon->aabb.midpoint = AT_AABB_calc_midpoint(&polygon->aabb);
+    }
+
+    if (b.drafts) {
+        for (uint32_t t = 0; t < count; t++) free(b.drafts[t].loop);
+    }
+    free(b.positions);
+    free(b.ids);
+    free(b.normals);
+    free(b.owner);
+    free(b.next_triangle);
+    free(b.drafts);
+    free(b.scratch);
+    free(b.region);
+    free(b.boundary_next);
+    free(b.edges);
+    if (res != AT_OK) {
+        free(polygons);
+        free(edges);
+        return res;
+    }
+
+    out_set->polygons = polygons;
+    out_set->edges = edges;
+    out_set->num_polygons = num_polygons;
+    out_set->num_edges = num_edges;
+    out_set->is_closed = is_closed;
+    return AT_OK;
+}
+
+void AT_polygon_set_destroy(AT_PolygonSet *set)
+{
+    if (!set) return;
+    free(set->polygons);
+    free(set->edges);
+    *set = (AT_PolygonSet){0};
+}
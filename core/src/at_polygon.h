@@ -0,0 +1,70 @@
+#ifndef AT_POLYGON_H
+#define AT_POLYGON_H
+
+#include "acoustic/at.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** \brief Most vertices a merged polygon may gather. */
+#define AT_POLYGON_MAX_VERTICES 32
+
+/** \brief Largest angle cosine and plane distance, in metres, at which two
+    triangles still count as coplanar. */
+#define AT_POLYGON_COPLANAR_COS 0.99999f
+#define AT_POLYGON_COPLANAR_DISTANCE 1e-4f
+
+/** \brief How far outside its edges a hit may land, so shared edges leak no rays. */
+#define AT_POLYGON_EDGE_EPSILON 1e-6f
+
+/** \brief Plane holding one edge of a polygon, the normal points inwards. */
+typedef struct {
+    AT_Vec3 normal;
+    float d;
+} AT_PolygonEdge;
+
+/** \brief Convex planar polygon traced as a single primitive.
+
+    Edges first_edge up to first_edge + num_edges of the owning set bound
+    it. A point of the plane is inside when every edge plane has it on the
+    positive side.
+ */
+typedef struct {
+    AT_Vec3 normal;
+    float d;
+    uint32_t first_edge;
+    uint16_t num_edges; //at most AT_POLYGON_MAX_VERTICES
+    AT_MaterialId material; //shares the word with num_edges, read on every hit
+    AT_AABB aabb;
+} AT_Polygon;
+
+typedef struct {
+    AT_Polygon *polygons;
+    AT_PolygonEdge *edges;
+    uint32_t num_polygons;
+    uint32_t num_edges;
+    bool is_closed; /**< Every triangle edge is shared by exactly two triangles. */
+} AT_PolygonSet;
+
+/** \brief Merges triangles into convex polygons.
+
+    A flat region of one material bounded by a single convex outline
+    becomes one polygon, other regions are split by dropping shared edges
+    while both sides stay convex. Collinear outline vertices are dropped.
+    Triangles share edges when their corners are bit-identical, which holds
+    for welded models and compiled scenes alike. Degenerate triangles are
+    left out.
+
+    \param out_set Pointer to an empty AT_PolygonSet.
+    \param triangles Triangles to merge.
+    \param materials Material of every triangle.
+    \param count Number of triangles.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the set could not be built.
+ */
+AT_Result AT_polygon_set_create(AT_PolygonSet *out_set, const AT_Triangle *triangles, const AT_MaterialId *materials, uint32_t count);
+
+/** \brief Frees the arrays of a polygon set. */
+void AT_polygon_set_destroy(AT_PolygonSet *set);
+
+#endif // AT_POLYGON_H
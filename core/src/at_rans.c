@@ -0,0 +1,173 @@
+#include "../src/at_rans.h"
+#include "acoustic/at.h"
+#include "../src/at_bytes.h"
+#include "../src/at_utils.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define AT_RANS_TABLE_BYTES 32
+
+// Scales the byte counts to frequencies summing to AT_RANS_SCALE, every
+// value that occurs keeping at least 1. The rounding error goes to the
+// most frequent values, where it costs the least.
+static void AT_rans_normalise(uint32_t *freqs, const size_t *counts, size_t total)
+{
+    uint32_t sum = 0;
+    uint32_t largest = 0;
+    for (uint32_t s = 0; s < 256; s++) {
+        freqs[s] = 0;
+        if (counts[s] == 0) continue;
+        freqs[s] = AT_max((uint32_t)((uint64_t)counts[s] * AT_RANS_SCALE / total), 1u);
+        sum += freqs[s];
+        if (counts[s] > counts[largest]) largest = s;
+    }
+
+    if (sum < AT_RANS_SCALE) freqs[largest] += AT_RANS_SCALE - sum;
+    while (sum > AT_RANS_SCALE) {
+        uint32_t s_max = 0;
+        for (uint32_t s = 1; s < 256; s++) {
+            if (freqs[s] > freqs[s_max]) s_max = s;
+        }
+        uint32_t take = AT_min(sum - AT_RANS_SCALE, freqs[s_max] - 1);
+        freqs[s_max] -= take;
+        sum -= take;
+    }
+}
+
+AT_Result AT_rans_compress(uint8_t *dst, size_t *dst_size, const uint8_t *src, size_t src_size)
+{
+    if (!dst || !dst_size || (!src && src_size > 0)) return AT_ERR_INVALID_ARGUMENT;
+    if (*dst_size < AT_rans_bound(src_size)) return AT_ERR_INVALID_ARGUMENT;
+
+    size_t counts[256] = {0};
+    for (size_t i = 0; i < src_size; i++) counts[src[i]]++;
+
+    uint32_t freqs[256];
+    uint32_t starts[256];
+    size_t table_size = AT_RANS_TABLE_BYTES;
+    if (src_size > 0) {
+        AT_rans_normalise(freqs, counts, src_size);
+        uint32_t start = 0;
+        for (uint32_t s = 0; s < 256; s++) {
+            starts[s] = start;
+            start += freqs[s];
+            if (freqs[s]) table_size += AT_bytes_varint_size(freqs[s]);
+        }
+    }
+
+    //the renorm bytes are written backwards from where a stored block would
+    //end, so coding is only kept when they and the states stop short of the table
+    uint8_t *table = dst + 1;
+    uint8_t *end = dst + 1 + src_size;
+    if (src_size == 0 || table_size + 8 >= src_size) goto stored;
+
+    memset(table, 0, AT_RANS_TABLE_BYTES);
+    uint8_t *p = table + AT_RANS_TABLE_BYTES;
+    for (uint32_t s = 0; s < 256; s++) {
+        if (!freqs[s]) continue;
+        table[s >> 3] |= (uint8_t)(1u << (s & 7));
+        p = AT_bytes_put_varint(p, freqs[s]);
+    }
+
+    uint8_t *out = end;
+    uint32_t states[2] = {AT_RANS_LOWER_BOUND, AT_RANS_LOWER_BOUND};
+    for (size_t i = src_size; i-- > 0;) {
+        uint32_t *x = &states[i & 1];
+        uint32_t freq = freqs[src[i]];
+        uint32_t x_max = ((AT_RANS_LOWER_BOUND >> AT_RANS_SCALE_BITS) << 8) * freq;
+        while (*x >= x_max) {
+            if (out == p) goto stored;
+            *--out = (uint8_t)*x;
+            *x >>= 8;
+        }
+        *x = ((*x / freq) << AT_RANS_SCALE_BITS) + (*x % freq) + starts[src[i]];
+    }
+    if (out - p < 8) goto stored;
+
+    out -= 8;
+    AT_bytes_put_u32(out, states[0]);
+    AT_bytes_put_u32(out + 4, states[1]);
+    size_t stream_size = (size_t)(end - out);
+    memmove(p, out, stream_size);
+
+    dst[0] = AT_RANS_CODED;
+    *dst_size = (size_t)(p - dst) + stream_size;
+    return AT_OK;
+
+stored:
+    dst[0] = AT_RANS_STORED;
+    if (src_size > 0) memcpy(dst + 1, src, src_size);
+    *dst_size = 1 + src_size;
+    return AT_OK;
+}
+
+// A decode slot packs the byte value (bits 0-7), its frequency - 1 (bits
+// 8-19) and the slot's distance from the value's first slot (bits 20-31)
+static inline bool AT_rans_decode_step(uint32_t *state, uint8_t *out, const uint32_t *slots,
+                                       const uint8_t **src, const uint8_t *end)
+{
+    uint32_t x = *state;
+    uint32_t slot = slots[x & (AT_RANS_SCALE - 1)];
+    *out = (uint8_t)slot;
+    x = ((slot >> 8 & (AT_RANS_SCALE - 1)) + 1) * (x >> AT_RANS_SCALE_BITS) + (slot >> 20);
+    while (x < AT_RANS_LOWER_BOUND) {
+        if (*src == end) return false;
+        x = x << 8 | *(*src)++;
+    }
+    *state = x;
+    return true;
+}
+
+AT_Result AT_rans_decompress(uint8_t *dst, size_t dst_size, const uint8_t *src, size_t src_size)
+{
+    if ((!dst && dst_size > 0) || !src || src_size < 1) return AT_ERR_INVALID_ARGUMENT;
+
+    if (src[0] == AT_RANS_STORED) {
+        if (src_size - 1 != dst_size) return AT_ERR_INVALID_ARGUMENT;
+        if (dst_size > 0) memcpy(dst, src + 1, dst_size);
+        return AT_OK;
+    }
+    if (src[0] != AT_RANS_CODED || src_size < 1 + AT_RANS_TABLE_BYTES) return AT_ERR_INVALID_ARGUMENT;
+
+    const uint8_t *end = src + src_size;
+    const uint8_t *table = src + 1;
+    const uint8_t *p = table + AT_RANS_TABLE_BYTES;
+
+    uint32_t slots[AT_RANS_SCALE];
+    uint32_t start = 0;
+    for (uint32_t s = 0; s < 256; s++) {
+        if (!(table[s >> 3] & (1u << (s & 7)))) continue;
+
+        uint32_t freq = 0;
+        p = AT_bytes_get_varint(p, end, &freq);
+        if (!p || freq == 0 || freq > AT_RANS_SCALE - start) return AT_ERR_INVALID_ARGUMENT;
+
+        for (uint32_t k = 0; k < freq; k++) slots[start + k] = s | (freq - 1) << 8 | k << 20;
+        start += freq;
+    }
+    if (start != AT_RANS_SCALE || end - p < 8) return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t states[2] = {AT_bytes_get_u32(p), AT_bytes_get_u32(p + 4)};
+    p += 8;
+    for (int i = 0; i < 2; i++) {
+        if (states[i] < AT_RANS_LOWER_BOUND || states[i] >= AT_RANS_LOWER_BOUND << 8) return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    //both states in one iteration, so their updates overlap
+    size_t i = 0;
+    for (; i + 1 < dst_size; i += 2) {
+        if (!AT_rans_decode_step(&states[0], &dst[i], slots, &p, end) ||
+            !AT_rans_decode_step(&states[1], &dst[i + 1], slots, &p, end)) {
+            return AT_ERR_INVALID_ARGUMENT;
+        }
+    }
+    if (i < dst_size && !AT_rans_decode_step(&states[0], &dst[i], slots, &p, end)) return AT_ERR_INVALID_ARGUMENT;
+
+    //the encoder started both states at the lower bound and used every byte
+    if (states[0] != AT_RANS_LOWER_BOUND || states[1] != AT_RANS_LOWER_BOUND || p != end) {
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+    return AT_OK;
+}
@@ -0,0 +1,64 @@
+#ifndef AT_RANS_H
+#define AT_RANS_H
+
+#include "acoustic/at.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*  Small order-0 rANS block coder, no dependencies. Two interleaved states
+    share one byte stream, byte i of the input goes through state i & 1.
+    A block is
+
+        uint8_t  mode          AT_RANS_STORED or AT_RANS_CODED
+
+        AT_RANS_STORED
+        uint8_t  bytes[]       the input as it is
+
+        AT_RANS_CODED
+        uint8_t  present[32]   bitmap of the byte values that occur
+        varint   freq[]        LEB128, one per present value in ascending
+                               order, summing to AT_RANS_SCALE
+        uint32_t state[2]      little endian, the decoder's initial states
+        uint8_t  renorm[]      bytes the decoder shifts in, in read order
+
+    The coder keeps whichever mode is smaller.
+*/
+
+#define AT_RANS_SCALE_BITS 12
+#define AT_RANS_SCALE (1u << AT_RANS_SCALE_BITS)
+#define AT_RANS_LOWER_BOUND (1u << 23) //states stay in [AT_RANS_LOWER_BOUND, AT_RANS_LOWER_BOUND << 8)
+
+#define AT_RANS_STORED 0
+#define AT_RANS_CODED 1
+
+/** \brief Largest coded size of \a size input bytes.
+ */
+static inline size_t AT_rans_bound(size_t size)
+{
+    return size + 1;
+}
+
+/** \brief Codes a block.
+
+    \param dst Output buffer of at least AT_rans_bound() bytes.
+    \param dst_size In: capacity of \a dst. Out: coded size.
+    \param src Input bytes.
+    \param src_size Input size.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if \a dst is too small.
+*/
+AT_Result AT_rans_compress(uint8_t *dst, size_t *dst_size, const uint8_t *src, size_t src_size);
+
+/** \brief Decodes a block of known size, validating the stream.
+
+    \param dst Output buffer of exactly \a dst_size bytes.
+    \param dst_size Decoded size.
+    \param src Coded block.
+    \param src_size Coded size.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if the block is malformed or does not decode to \a dst_size bytes.
+*/
+AT_Result AT_rans_decompress(uint8_t *dst, size_t dst_size, const uint8_t *src, size_t src_size);
+
+#endif // AT_RANS_H
@@ -42,6 +42,30 @@ bool AT_ray_triangle_intersect(AT_Ray *ray, const AT_Triangle *triangle, AT_Ray
     return true;
 }
 
+AT_RayHit AT_ray_polygon_intersect(AT_Ray *ray, const AT_PolygonSet *set, uint32_t polygon, AT_Ray *out_ray)
+{
+    const AT_Polygon *p = &set->polygons[polygon];
+
+    float denom = AT_vec3_dot(p->normal, ray->direction);
+    if (fabs(denom) < EPSILON) return AT_RAY_MISS;
+
+    float t = -(AT_vec3_dot(p->normal, ray->origin) + p->d) / denom;
+    if (t < EPSILON) return AT_RAY_MISS;
+
+    AT_Vec3 hit_point = AT_ray_at(ray, t);
+    const AT_PolygonEdge *edges = &set->edges[p->first_edge];
+    for (uint32_t e = 0; e < p->num_edges; e++) {
+        if (AT_vec3_dot(edges[e].normal, hit_point) + edges[e].d < -AT_POLYGON_EDGE_EPSILON) return AT_RAY_MISS;
+    }
+
+    if (AT_vec3_distance_sq(ray->origin, hit_point) >= AT_vec3_distance_sq(ray->origin, out_ray->origin)) return AT_RAY_HIT;
+
+    out_ray->origin = hit_point;
+    AT_Vec3 normal = (denom > 0) ? AT_vec3_scale(p->normal, -1) : p->normal;
+    out_ray->direction = AT_ray_reflect(ray->direction, normal);
+    return AT_RAY_HIT_NEARER;
+}
+
 void AT_ray_destroy_children(AT_Ray *ray) {
     if (!ray) return;
     if (ray->child) {
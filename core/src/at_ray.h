@@ -2,6 +2,7 @@
 #define AT_RAY_H
 
 #include "../src/at_internal.h"
+#include "../src/at_polygon.h"
 #include "acoustic/at_math.h"
 
 #include <stdbool.h>
@@ -59,6 +60,21 @@ bool AT_ray_triangle_intersect(AT_Ray *ray,
                                AT_Ray *out_ray);
 
 
+// What a polygon test found, non-zero for any hit
+typedef enum {
+    AT_RAY_MISS = 0,
+    AT_RAY_HIT, //not nearer than out_ray, which is left alone
+    AT_RAY_HIT_NEARER, //nearer than out_ray, which moved to it
+} AT_RayHit;
+
+// One plane test, then the point against every edge plane. Like the
+// triangle test it reports any hit and only moves out_ray for a nearer one.
+AT_RayHit AT_ray_polygon_intersect(AT_Ray *ray,
+                              const AT_PolygonSet *set,
+                              uint32_t polygon,
+                              AT_Ray *out_ray);
+
+
 void AT_ray_destroy_children(AT_Ray *ray);
 
 #endif // AT_RAY_H
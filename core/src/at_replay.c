@@ -0,0 +1,1246 @@
+#include "acoustic/at_replay.h"
+#include "acoustic/at.h"
+#include "../src/at_bytes.h"
+#include "../src/at_internal.h"
+#include "../src/at_rans.h"
+#include "../src/at_simd.h"
+#include "../src/at_thread.h"
+#include "../src/at_utils.h"
+#include "../src/at_voxel.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define AT_REPLAY_PATH_LENGTH 1024
+
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+    float max;
+    float sum;
+} AT_ReplayFrame;
+
+typedef struct {
+    const AT_Simulation *simulation;
+    const AT_ReplaySettings *settings;
+    uint32_t start_frame;
+    uint32_t frame_count;
+    uint32_t num_workers;
+    uint32_t *counts; //[worker * frame_count + frame], per worker counts then write cursors
+    const uint32_t *frame_starts; //first gathered pair of each frame, frame_count + 1 entries
+    uint32_t *indices; //gathered pairs, frame after frame
+    float *values;
+    AT_ReplayFrame *frames;
+    uint32_t keyframe_interval;
+    uint32_t next_group; //shared work counter for the encode pass
+    AT_Result result;
+} AT_ReplayChunkJob;
+
+static AT_ReplaySettings AT_replay_resolve_settings(const AT_Simulation *simulation, const AT_ReplaySettings *settings)
+{
+    AT_ReplaySettings resolved = settings ? *settings : (AT_ReplaySettings){0};
+    if (resolved.frames_per_chunk == 0) resolved.frames_per_chunk = AT_REPLAY_DEFAULT_FRAMES_PER_CHUNK;
+    if (resolved.num_threads == 0) resolved.num_threads = simulation->num_threads;
+    if (resolved.num_threads == 0) resolved.num_threads = 1;
+    return resolved;
+}
+
+uint32_t AT_replay_frame_count(const AT_Simulation *simulation)
+{
+    if (!simulation) return 0;
+
+    return AT_voxel_get_num_bins(simulation);
+}
+
+uint32_t AT_replay_chunk_count(const AT_Simulation *simulation, const AT_ReplaySettings *settings)
+{
+    if (!simulation) return 0;
+
+    AT_ReplaySettings resolved = AT_replay_resolve_settings(simulation, settings);
+    uint32_t num_frames = AT_replay_frame_count(simulation);
+    return (num_frames + resolved.frames_per_chunk - 1) / resolved.frames_per_chunk;
+}
+
+// Each worker owns a contiguous range of row-major voxels, so concatenating
+// the workers in order keeps every frame's indices ascending
+static void AT_replay_worker_range(const AT_ReplayChunkJob *job, uint32_t worker, uint32_t *out_first, uint32_t *out_last)
+{
+    uint64_t num_voxels = job->simulation->num_voxels;
+    *out_first = (uint32_t)(num_voxels * worker / job->num_workers);
+    *out_last = (uint32_t)(num_voxels * (worker + 1) / job->num_workers);
+}
+
+static void AT_replay_count_worker(void *ctx, uint32_t worker)
+{
+    AT_ReplayChunkJob *job = ctx;
+    const AT_Simulation *simulation = job->simulation;
+    const float threshold = job->settings->threshold;
+    uint32_t *counts = &job->counts[(size_t)worker * job->frame_count];
+
+    uint32_t first, last;
+    AT_replay_worker_range(job, worker, &first, &last);
+
+    for (uint32_t v = first; v < last; v++) {
+        AT_VoxelSpan span = AT_voxel_span(simulation, v);
+        uint32_t start = AT_max(span.first_bin, job->start_frame);
+        uint32_t end = AT_min(span.first_bin + span.count, job->start_frame + job->frame_count);
+        for (uint32_t f = start; f < end; f++) {
+            if (span.values[f - span.first_bin] > threshold) counts[f - job->start_frame]++;
+        }
+    }
+}
+
+static void AT_replay_gather_worker(void *ctx, uint32_t worker)
+{
+    AT_ReplayChunkJob *job = ctx;
+    const AT_Simulation *simulation = job->simulation;
+    const float threshold = job->settings->threshold;
+    uint32_t *cursors = &job->counts[(size_t)worker * job->frame_count];
+
+    uint32_t first, last;
+    AT_replay_worker_range(job, worker, &first, &last);
+
+    for (uint32_t v = first; v < last; v++) {
+        AT_VoxelSpan span = AT_voxel_span(simulation, v);
+        uint32_t start = AT_max(span.first_bin, job->start_frame);
+        uint32_t end = AT_min(span.first_bin + span.count, job->start_frame + job->frame_count);
+        for (uint32_t f = start; f < end; f++) {
+            float value = span.values[f - span.first_bin];
+            if (value <= threshold) continue;
+
+            uint32_t local = f - job->start_frame;
+            uint32_t k = job->frame_starts[local] + cursors[local]++;
+            job->indices[k] = v;
+            job->values[k] = value;
+        }
+    }
+}
+
+// k-th largest value (k counted from 0), partially reorders \a values
+static float AT_replay_select(float *values, uint32_t count, uint32_t k)
+{
+    uint32_t lo = 0;
+    uint32_t hi = count - 1;
+    while (lo < hi) {
+        float pivot = values[lo + (hi - lo) / 2];
+        uint32_t i = lo;
+        uint32_t j = hi;
+        while (i <= j) {
+            while (values[i] > pivot) i++;
+            while (values[j] < pivot) j--;
+            if (i <= j) {
+                float tmp = values[i];
+                values[i] = values[j];
+                values[j] = tmp;
+                i++;
+                if (j == 0) break;
+                j--;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return values[k];
+}
+
+// Keeps the top_k largest values in place, in index order. Ties on the
+// smallest kept value go to the lower voxel indices.
+static AT_Result AT_replay_keep_top_k(uint32_t *indices, float *values, uint32_t *count, uint32_t top_k)
+{
+    float *scratch = malloc(sizeof(float) * *count);
+    if (!scratch) return AT_ERR_ALLOC_ERROR;
+    memcpy(scratch, values, sizeof(float) * *count);
+    float cutoff = AT_replay_select(scratch, *count, top_k - 1);
+    free(scratch);
+
+    uint32_t num_above = 0;
+    for (uint32_t i = 0; i < *count; i++) num_above += values[i] > cutoff;
+    uint32_t num_ties = top_k - num_above;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < *count; i++) {
+        bool is_kept = values[i] > cutoff || (values[i] == cutoff && num_ties > 0 && num_ties--);
+        if (!is_kept) continue;
+        indices[kept] = indices[i];
+        values[kept] = values[i];
+        kept++;
+    }
+    *count = kept;
+    return AT_OK;
+}
+
+static size_t AT_replay_varint_bytes(const uint32_t *indices, uint32_t count)
+{
+    size_t size = 0;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t delta = indices[i] - prev;
+        prev = indices[i];
+        size += AT_bytes_varint_size(delta);
+    }
+    return size;
+}
+
+// Exact size of a pair list as written by AT_replay_put_pairs()
+static size_t AT_replay_pairs_size(const uint32_t *indices, uint32_t count, AT_ReplayEncoding encoding)
+{
+    if (encoding == AT_REPLAY_ENCODING_RAW) return 4 + (size_t)count * 8;
+
+    size_t size = 12 + AT_replay_varint_bytes(indices, count);
+    size += size & 1;
+    size += (size_t)count * 2;
+    return (size + 3) & ~(size_t)3;
+}
+
+static size_t AT_replay_removed_size(const uint32_t *indices, uint32_t count)
+{
+    return (8 + AT_replay_varint_bytes(indices, count) + 3) & ~(size_t)3;
+}
+
+// Writes a sorted pair list, returns its size. The values are replaced with
+// what a decoder reads back, so delta frames compare against the same state.
+static size_t AT_replay_put_pairs(uint8_t *dst, const uint32_t *indices, float *values, uint32_t count,
+                                  AT_ReplayEncoding encoding)
+{
+    AT_bytes_put_u32(dst, count);
+
+    if (encoding == AT_REPLAY_ENCODING_RAW) {
+        for (uint32_t i = 0; i < count; i++) {
+            AT_bytes_put_u32(dst + 4 + (size_t)i * 4, indices[i]);
+            AT_bytes_put_f32(dst + 4 + (size_t)count * 4 + (size_t)i * 4, values[i]);
+        }
+        return 4 + (size_t)count * 8;
+    }
+
+    float max = 0.0f;
+    for (uint32_t i = 0; i < count; i++) max = fmaxf(max, values[i]);
+    float scale = max / 65535.0f;
+    AT_bytes_put_f32(dst + 4, scale);
+
+    uint8_t *p = dst + 12;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        p = AT_bytes_put_varint(p, indices[i] - prev);
+        prev = indices[i];
+    }
+    AT_bytes_put_u32(dst + 8, (uint32_t)(p - (dst + 12)));
+
+    size_t size = (size_t)(p - dst);
+    if (size & 1) dst[size++] = 0;
+    uint16_t *quantised = (uint16_t*)(dst + size);
+    AT_simd_quantise_u16(quantised, values, count, (scale > 0.0f) ? 1.0f / scale : 0.0f);
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = (float)quantised[i] * scale;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        AT_bytes_put_u16((uint8_t*)&quantised[i], quantised[i]);
+#endif
+    }
+    size += (size_t)count * 2;
+    while (size & 3) dst[size++] = 0;
+    return size;
+}
+
+static size_t AT_replay_put_removed(uint8_t *dst, const uint32_t *indices, uint32_t count)
+{
+    AT_bytes_put_u32(dst, count);
+
+    uint8_t *p = dst + 8;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        p = AT_bytes_put_varint(p, indices[i] - prev);
+        prev = indices[i];
+    }
+    AT_bytes_put_u32(dst + 4, (uint32_t)(p - (dst + 8)));
+
+    size_t size = (size_t)(p - dst);
+    while (size & 3) dst[size++] = 0;
+    return size;
+}
+
+// What the decoder holds after each frame of a keyframe group, plus
+// scratch for the delta against it. Every array holds capacity entries.
+typedef struct {
+    uint32_t capacity;
+    uint32_t ref_count;
+    uint32_t *ref_indices;
+    float *ref_values;
+    uint32_t *next_indices;
+    float *next_values;
+    uint32_t *update_indices;
+    float *update_values;
+    uint32_t *update_slots; //where each update lands in next_values
+    uint32_t *removed;
+} AT_ReplayDeltaState;
+
+static void AT_replay_delta_state_destroy(AT_ReplayDeltaState *state)
+{
+    free(state->ref_indices);
+    free(state->ref_values);
+    free(state->next_indices);
+    free(state->next_values);
+    free(state->update_indices);
+    free(state->update_values);
+    free(state->update_slots);
+    free(state->removed);
+}
+
+static AT_Result AT_replay_delta_state_create(AT_ReplayDeltaState *state, uint32_t capacity)
+{
+    size_t n = AT_max(capacity, 1u);
+    *state = (AT_ReplayDeltaState){
+        .capacity = capacity,
+        .ref_indices = malloc(sizeof(uint32_t) * n),
+        .ref_values = malloc(sizeof(float) * n),
+        .next_indices = malloc(sizeof(uint32_t) * n),
+        .next_values = malloc(sizeof(float) * n),
+        .update_indices = malloc(sizeof(uint32_t) * n),
+        .update_values = malloc(sizeof(float) * n),
+        .update_slots = malloc(sizeof(uint32_t) * n),
+        .removed = malloc(sizeof(uint32_t) * n),
+    };
+    if (!state->ref_indices || !state->ref_values || !state->next_indices || !state->next_values ||
+        !state->update_indices || !state->update_values || !state->update_slots || !state->removed) {
+        AT_replay_delta_state_destroy(state);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    return AT_OK;
+}
+
+// Delta chunks lead every frame with its kind, plain chunks hold keyframes only
+static AT_Result AT_replay_encode_keyframe(AT_ReplayFrame *out_frame,
+                                           AT_ReplayDeltaState *state,
+                                           const uint32_t *indices,
+                                           const float *values,
+                                           uint32_t count,
+                                           const AT_ReplaySettings *settings,
+                                           bool is_delta_chunk)
+{
+    size_t kind_size = is_delta_chunk ? 4 : 0;
+    uint8_t *data = malloc(kind_size + AT_replay_pairs_size(indices, count, settings->encoding));
+    if (!data) return AT_ERR_ALLOC_ERROR;
+
+    memcpy(state->ref_indices, indices, sizeof(uint32_t) * count);
+    memcpy(state->ref_values, values, sizeof(float) * count);
+    state->ref_count = count;
+
+    if (is_delta_chunk) AT_bytes_put_u32(data, AT_REPLAY_FRAME_KEY);
+    out_frame->data = data;
+    out_frame->size = (uint32_t)(kind_size + AT_replay_put_pairs(data + kind_size, state->ref_indices,
+                                                                 state->ref_values, count, settings->encoding));
+    return AT_OK;
+}
+
+// Encodes the frame against the decoder state: voxels that entered or moved
+// by more than the tolerance are sent, voxels that left are listed as
+// removed. Falls back to a keyframe when that is no larger.
+static AT_Result AT_replay_encode_delta(AT_ReplayFrame *out_frame,
+                                        AT_ReplayDeltaState *state,
+                                        const uint32_t *indices,
+                                        const float *values,
+                                        uint32_t count,
+                                        const AT_ReplaySettings *settings)
+{
+    const float tolerance = settings->delta_tolerance;
+    uint32_t num_updates = 0;
+    uint32_t num_removed = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    while (i < count || j < state->ref_count) {
+        if (j == state->ref_count || (i < count && indices[i] < state->ref_indices[j])) {
+            state->update_slots[num_updates] = i;
+            state->update_indices[num_updates] = indices[i];
+            state->update_values[num_updates++] = values[i];
+            state->next_indices[i] = indices[i];
+            i++;
+        } else if (i == count || state->ref_indices[j] < indices[i]) {
+            state->removed[num_removed++] = state->ref_indices[j++];
+        } else {
+            state->next_indices[i] = indices[i];
+            state->next_values[i] = state->ref_values[j];
+            if (fabsf(values[i] - state->ref_values[j]) > tolerance) {
+                state->update_slots[num_updates] = i;
+                state->update_indices[num_updates] = indices[i];
+                state->update_values[num_updates++] = values[i];
+            }
+            i++;
+            j++;
+        }
+    }
+
+    size_t delta_size = 4 + AT_replay_pairs_size(state->update_indices, num_updates, settings->encoding) +
+                        AT_replay_removed_size(state->removed, num_removed);
+    if (delta_size >= 4 + AT_replay_pairs_size(indices, count, settings->encoding)) {
+        return AT_replay_encode_keyframe(out_frame, state, indices, values, count, settings, true);
+    }
+
+    uint8_t *data = malloc(delta_size);
+    if (!data) return AT_ERR_ALLOC_ERROR;
+
+    AT_bytes_put_u32(data, AT_REPLAY_FRAME_DELTA);
+    size_t size = 4 + AT_replay_put_pairs(data + 4, state->update_indices, state->update_values, num_updates,
+                                          settings->encoding);
+    size += AT_replay_put_removed(data + size, state->removed, num_removed);
+
+    for (uint32_t k = 0; k < num_updates; k++) {
+        state->next_values[state->update_slots[k]] = state->update_values[k];
+    }
+
+    uint32_t *swap_indices = state->ref_indices;
+    float *swap_values = state->ref_values;
+    state->ref_indices = state->next_indices;
+    state->ref_values = state->next_values;
+    state->next_indices = swap_indices;
+    state->next_values = swap_values;
+    state->ref_count = count;
+
+    out_frame->data = data;
+    out_frame->size = (uint32_t)size;
+    return AT_OK;
+}
+
+// Encodes the frames [first, last) of the chunk, the first one as a keyframe
+static AT_Result AT_replay_encode_group(AT_ReplayChunkJob *job, uint32_t first, uint32_t last)
+{
+    const AT_ReplaySettings *settings = job->settings;
+    const bool is_delta_chunk = job->keyframe_interval > 1;
+
+    uint32_t capacity = 0;
+    for (uint32_t f = first; f < last; f++) {
+        uint32_t count = job->frame_starts[f + 1] - job->frame_starts[f];
+        capacity = AT_max(capacity, (settings->top_k > 0) ? AT_min(count, settings->top_k) : count);
+    }
+
+    AT_ReplayDeltaState state;
+    if (AT_replay_delta_state_create(&state, capacity) != AT_OK) return AT_ERR_ALLOC_ERROR;
+
+    AT_Result res = AT_OK;
+    for (uint32_t f = first; f < last && res == AT_OK; f++) {
+        uint32_t *indices = job->indices + job->frame_starts[f];
+        float *values = job->values + job->frame_starts[f];
+        uint32_t count = job->frame_starts[f + 1] - job->frame_starts[f];
+
+        if (settings->top_k > 0 && count > settings->top_k) {
+            res = AT_replay_keep_top_k(indices, values, &count, settings->top_k);
+            if (res != AT_OK) break;
+        }
+
+        float max = 0.0f;
+        double sum = 0.0;
+        for (uint32_t i = 0; i < count; i++) {
+            max = fmaxf(max, values[i]);
+            sum += values[i];
+        }
+        job->frames[f].max = max;
+        job->frames[f].sum = (float)sum;
+
+        res = (f == first) ?
+            AT_replay_encode_keyframe(&job->frames[f], &state, indices, values, count, settings, is_delta_chunk) :
+            AT_replay_encode_delta(&job->frames[f], &state, indices, values, count, settings);
+    }
+
+    AT_replay_delta_state_destroy(&state);
+    return res;
+}
+
+static void AT_replay_encode_worker(void *ctx, uint32_t worker)
+{
+    (void)worker;
+    AT_ReplayChunkJob *job = ctx;
+    const uint32_t interval = job->keyframe_interval;
+
+    for (;;) {
+        uint32_t group = __atomic_fetch_add(&job->next_group, 1, __ATOMIC_RELAXED);
+        uint64_t first = (uint64_t)group * interval;
+        if (first >= job->frame_count) break;
+
+        uint32_t last = (uint32_t)AT_min(first + interval, (uint64_t)job->frame_count);
+        AT_Result res = AT_replay_encode_group(job, (uint32_t)first, last);
+        if (res != AT_OK) __atomic_store_n(&job->result, res, __ATOMIC_RELAXED);
+    }
+}
+
+// Streams the body of a compressed chunk is split into, so each holds bytes
+// of one kind and codes well on its own
+enum {
+    AT_REPLAY_STREAM_FIELDS = 0, //directory, frame fields and padding
+    AT_REPLAY_STREAM_INDEX_DELTAS,
+    AT_REPLAY_STREAM_QUANTISED_LOW,
+    AT_REPLAY_STREAM_QUANTISED_HIGH,
+    AT_REPLAY_STREAM_RAW_INDEX, //4 streams, byte 0 to 3 of each raw index delta
+    AT_REPLAY_STREAM_RAW_VALUE = AT_REPLAY_STREAM_RAW_INDEX + 4, //4 streams, byte 0 to 3 of each raw value
+};
+
+typedef enum {
+    AT_REPLAY_SHUFFLE_COUNT = 0,
+    AT_REPLAY_SHUFFLE_SPLIT,
+    AT_REPLAY_SHUFFLE_JOIN,
+} AT_ReplayShuffleMode;
+
+typedef struct {
+    AT_ReplayShuffleMode mode;
+    uint8_t *body; //plain directory and frames
+    size_t body_size;
+    size_t sizes[AT_REPLAY_NUM_STREAMS]; //filled by AT_REPLAY_SHUFFLE_COUNT
+    uint8_t *cursors[AT_REPLAY_NUM_STREAMS];
+    const uint8_t *ends[AT_REPLAY_NUM_STREAMS];
+} AT_ReplayShuffle;
+
+// Checks that count elements of width bytes at offset lie in the body and,
+// unless counting, that the streams from first_stream on have room for them
+static bool AT_replay_shuffle_fits(AT_ReplayShuffle *shuffle, size_t offset, size_t count, uint32_t width, uint32_t first_stream)
+{
+    if (offset > shuffle->body_size || count > (shuffle->body_size - offset) / width) return false;
+
+    for (uint32_t b = 0; b < width; b++) {
+        uint32_t stream = first_stream + b;
+        if (shuffle->mode == AT_REPLAY_SHUFFLE_COUNT) {
+            shuffle->sizes[stream] += count;
+        } else if ((size_t)(shuffle->ends[stream] - shuffle->cursors[stream]) < count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Moves count elements of width bytes at offset of the body, byte b of each
+// element to or from stream first_stream + b
+static bool AT_replay_shuffle_move(AT_ReplayShuffle *shuffle, size_t offset, size_t count, uint32_t width, uint32_t first_stream)
+{
+    if (!AT_replay_shuffle_fits(shuffle, offset, count, width, first_stream)) return false;
+    if (shuffle->mode == AT_REPLAY_SHUFFLE_COUNT) return true;
+
+    uint8_t *plain = shuffle->body + offset;
+    for (uint32_t b = 0; b < width; b++) {
+        uint8_t *cursor = shuffle->cursors[first_stream + b];
+        if (width == 1 && shuffle->mode == AT_REPLAY_SHUFFLE_SPLIT) {
+            memcpy(cursor, plain, count);
+        } else if (width == 1) {
+            memcpy(plain, cursor, count);
+        } else if (shuffle->mode == AT_REPLAY_SHUFFLE_SPLIT) {
+            for (size_t i = 0; i < count; i++) cursor[i] = plain[i * width + b];
+        } else {
+            for (size_t i = 0; i < count; i++) plain[i * width + b] = cursor[i];
+        }
+        shuffle->cursors[first_stream + b] = cursor + count;
+    }
+    return true;
+}
+
+// Raw indices ascend, so they are split as differences to the previous one,
+// which leave the upper byte planes almost all zero
+static bool AT_replay_shuffle_indices(AT_ReplayShuffle *shuffle, size_t offset, size_t count)
+{
+    if (!AT_replay_shuffle_fits(shuffle, offset, count, 4, AT_REPLAY_STREAM_RAW_INDEX)) return false;
+    if (shuffle->mode == AT_REPLAY_SHUFFLE_COUNT) return true;
+
+    uint8_t *plain = shuffle->body + offset;
+    uint8_t **planes = &shuffle->cursors[AT_REPLAY_STREAM_RAW_INDEX];
+    uint32_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (shuffle->mode == AT_REPLAY_SHUFFLE_SPLIT) {
+            uint32_t index = AT_bytes_get_u32(plain + i * 4);
+            uint32_t delta = index - prev;
+            prev = index;
+            for (uint32_t b = 0; b < 4; b++) planes[b][i] = (uint8_t)(delta >> (8 * b));
+        } else {
+            uint32_t delta = 0;
+            for (uint32_t b = 0; b < 4; b++) delta |= (uint32_t)planes[b][i] << (8 * b);
+            prev += delta;
+            AT_bytes_put_u32(plain + i * 4, prev);
+        }
+    }
+    for (uint32_t b = 0; b < 4; b++) planes[b] += count;
+    return true;
+}
+
+// Fields are read back from the body right after they were moved, so a
+// join restores each count before it is used
+static bool AT_replay_shuffle_pairs(AT_ReplayShuffle *shuffle, AT_ReplayEncoding encoding, size_t *offset)
+{
+    size_t start = *offset;
+    if (encoding == AT_REPLAY_ENCODING_RAW) {
+        if (!AT_replay_shuffle_move(shuffle, start, 4, 1, AT_REPLAY_STREAM_FIELDS)) return false;
+        uint32_t count = AT_bytes_get_u32(shuffle->body + start);
+        if (!AT_replay_shuffle_indices(shuffle, start + 4, count) ||
+            !AT_replay_shuffle_move(shuffle, start + 4 + (size_t)count * 4, count, 4, AT_REPLAY_STREAM_RAW_VALUE)) {
+            return false;
+        }
+        *offset = start + 4 + (size_t)count * 8;
+        return true;
+    }
+
+    if (!AT_replay_shuffle_move(shuffle, start, 12, 1, AT_REPLAY_STREAM_FIELDS)) return false;
+    uint32_t count = AT_bytes_get_u32(shuffle->body + start);
+    uint32_t index_bytes = AT_bytes_get_u32(shuffle->body + start + 8);
+
+    size_t size = 12;
+    if (!AT_replay_shuffle_move(shuffle, start + size, index_bytes, 1, AT_REPLAY_STREAM_INDEX_DELTAS)) return false;
+    size += index_bytes;
+    if (!AT_replay_shuffle_move(shuffle, start + size, size & 1, 1, AT_REPLAY_STREAM_FIELDS)) return false;
+    size += size & 1;
+    if (!AT_replay_shuffle_move(shuffle, start + size, count, 2, AT_REPLAY_STREAM_QUANTISED_LOW)) return false;
+    size += (size_t)count * 2;
+    size_t padding = (4 - (size & 3)) & 3;
+    if (!AT_replay_shuffle_move(shuffle, start + size, padding, 1, AT_REPLAY_STREAM_FIELDS)) return false;
+    *offset = start + size + padding;
+    return true;
+}
+
+// Walks the directory and frames of a chunk body in layout order
+static bool AT_replay_shuffle_body(AT_ReplayShuffle *shuffle, const AT_ReplayChunkInfo *info)
+{
+    size_t offset = (size_t)info->frame_count * AT_REPLAY_DIRECTORY_ENTRY_SIZE;
+    if (!AT_replay_shuffle_move(shuffle, 0, offset, 1, AT_REPLAY_STREAM_FIELDS)) return false;
+
+    for (uint32_t f = 0; f < info->frame_count; f++) {
+        const uint8_t *entry = shuffle->body + (size_t)f * AT_REPLAY_DIRECTORY_ENTRY_SIZE;
+        uint32_t frame_offset = AT_bytes_get_u32(entry);
+        uint32_t frame_size = AT_bytes_get_u32(entry + 4);
+        if (frame_offset != AT_REPLAY_HEADER_SIZE + offset || frame_size > shuffle->body_size - offset) return false;
+        size_t frame_end = offset + frame_size;
+
+        uint32_t kind = AT_REPLAY_FRAME_KEY;
+        if (info->flags & AT_REPLAY_FLAG_DELTA) {
+            if (!AT_replay_shuffle_move(shuffle, offset, 4, 1, AT_REPLAY_STREAM_FIELDS)) return false;
+            kind = AT_bytes_get_u32(shuffle->body + offset);
+            offset += 4;
+        }
+        if (!AT_replay_shuffle_pairs(shuffle, info->encoding, &offset)) return false;
+
+        if (kind == AT_REPLAY_FRAME_DELTA) {
+            if (!AT_replay_shuffle_move(shuffle, offset, 8, 1, AT_REPLAY_STREAM_FIELDS)) return false;
+            uint32_t index_bytes = AT_bytes_get_u32(shuffle->body + offset + 4);
+            if (!AT_replay_shuffle_move(shuffle, offset + 8, index_bytes, 1, AT_REPLAY_STREAM_INDEX_DELTAS)) return false;
+            offset += 8 + (size_t)index_bytes;
+        }
+
+        //the padding that closes the frame
+        if (offset > frame_end ||
+            !AT_replay_shuffle_move(shuffle, offset, frame_end - offset, 1, AT_REPLAY_STREAM_FIELDS)) {
+            return false;
+        }
+        offset = frame_end;
+    }
+    return offset == shuffle->body_size;
+}
+
+// Points each stream at its place in the streams laid out back to back
+static void AT_replay_shuffle_place(AT_ReplayShuffle *shuffle, uint8_t *streams)
+{
+    for (uint32_t s = 0; s < AT_REPLAY_NUM_STREAMS; s++) {
+        shuffle->cursors[s] = streams;
+        streams += shuffle->sizes[s];
+        shuffle->ends[s] = streams;
+    }
+}
+
+// Splits everything after the header into streams and entropy codes each,
+// keeping the chunk as it is when that does not make it smaller
+static AT_Result AT_replay_compress_chunk(uint8_t **data, size_t *size)
+{
+    AT_ReplayChunkInfo info;
+    if (AT_replay_read_chunk_info(&info, *data, *size) != AT_OK) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ReplayShuffle shuffle = {
+        .mode = AT_REPLAY_SHUFFLE_COUNT,
+        .body = *data + AT_REPLAY_HEADER_SIZE,
+        .body_size = *size - AT_REPLAY_HEADER_SIZE,
+    };
+    if (!AT_replay_shuffle_body(&shuffle, &info)) return AT_ERR_INVALID_ARGUMENT;
+
+    //each coded stream takes at most one byte more than the stream
+    size_t capacity = AT_REPLAY_COMPRESSED_PREFIX_SIZE + shuffle.body_size + AT_REPLAY_NUM_STREAMS;
+    uint8_t *streams = malloc(AT_max(shuffle.body_size, (size_t)1));
+    uint8_t *compressed = malloc(capacity);
+    if (!streams || !compressed) {
+        free(streams);
+        free(compressed);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    shuffle.mode = AT_REPLAY_SHUFFLE_SPLIT;
+    AT_replay_shuffle_place(&shuffle, streams);
+    AT_replay_shuffle_body(&shuffle, &info);
+
+    uint8_t *prefix = compressed + AT_REPLAY_HEADER_SIZE;
+    size_t compressed_size = AT_REPLAY_COMPRESSED_PREFIX_SIZE;
+    const uint8_t *stream = streams;
+    AT_Result res = AT_OK;
+    for (uint32_t s = 0; s < AT_REPLAY_NUM_STREAMS && res == AT_OK; s++) {
+        size_t block_size = capacity - compressed_size;
+        res = AT_rans_compress(compressed + compressed_size, &block_size, stream, shuffle.sizes[s]);
+        AT_bytes_put_u32(prefix + 4 + s * 4, (uint32_t)shuffle.sizes[s]);
+        AT_bytes_put_u32(prefix + 4 + (AT_REPLAY_NUM_STREAMS + s) * 4, (uint32_t)block_size);
+        stream += shuffle.sizes[s];
+        compressed_size += block_size;
+    }
+    free(streams);
+
+    if (res != AT_OK || compressed_size >= *size) {
+        free(compressed);
+        return res;
+    }
+
+    memcpy(compressed, *data, AT_REPLAY_HEADER_SIZE);
+    AT_bytes_put_u16(compressed + 6, info.flags | AT_REPLAY_FLAG_COMPRESSED);
+    AT_bytes_put_u32(prefix, (uint32_t)shuffle.body_size);
+
+    free(*data);
+    *data = compressed;
+    *size = compressed_size;
+    return AT_OK;
+}
+
+AT_Result AT_replay_encode_chunk(uint8_t **out_data,
+                                 size_t *out_size,
+                                 const AT_Simulation *simulation,
+                                 const AT_ReplaySettings *settings,
+                                 uint32_t chunk_index)
+{
+    if (!out_data || !out_size || !simulation) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ReplaySettings resolved = AT_replay_resolve_settings(simulation, settings);
+    if (resolved.encoding != AT_REPLAY_ENCODING_RAW &&
+        resolved.encoding != AT_REPLAY_ENCODING_QUANTISED) return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t num_frames = AT_replay_frame_count(simulation);
+    uint32_t start_frame = chunk_index * resolved.frames_per_chunk;
+    if (start_frame >= num_frames) return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t frame_count = AT_min(resolved.frames_per_chunk, num_frames - start_frame);
+    uint32_t keyframe_interval = AT_max(resolved.keyframe_interval, 1u);
+    uint32_t num_groups = (uint32_t)(((uint64_t)frame_count + keyframe_interval - 1) / keyframe_interval);
+    uint32_t num_workers = AT_max(AT_min(resolved.num_threads, simulation->num_voxels), 1u);
+
+    uint32_t *counts = calloc((size_t)num_workers * frame_count, sizeof(uint32_t));
+    uint32_t *frame_starts = malloc(sizeof(uint32_t) * (frame_count + 1));
+    AT_ReplayFrame *frames = calloc(frame_count, sizeof(AT_ReplayFrame));
+    if (!counts || !frame_starts || !frames) {
+        free(counts);
+        free(frame_starts);
+        free(frames);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    AT_ReplayChunkJob job = {
+        .simulation = simulation,
+        .settings = &resolved,
+        .start_frame = start_frame,
+        .frame_count = frame_count,
+        .num_workers = num_workers,
+        .counts = counts,
+        .frame_starts = frame_starts,
+        .frames = frames,
+        .keyframe_interval = keyframe_interval,
+        .next_group = 0,
+        .result = AT_OK,
+    };
+
+    AT_thread_run(num_workers, AT_replay_count_worker, &job);
+
+    //frames are gathered back to back, each worker's count becomes its
+    //first slot within the frame
+    uint32_t num_pairs = 0;
+    for (uint32_t f = 0; f < frame_count; f++) {
+        frame_starts[f] = num_pairs;
+        uint32_t total = 0;
+        for (uint32_t w = 0; w < num_workers; w++) {
+            uint32_t count = counts[(size_t)w * frame_count + f];
+            counts[(size_t)w * frame_count + f] = total;
+            total += count;
+        }
+        num_pairs += total;
+    }
+    frame_starts[frame_count] = num_pairs;
+
+    job.indices = malloc(sizeof(uint32_t) * AT_max(num_pairs, 1u));
+    job.values = malloc(sizeof(float) * AT_max(num_pairs, 1u));
+    AT_Result res = (job.indices && job.values) ? AT_OK : AT_ERR_ALLOC_ERROR;
+
+    if (res == AT_OK) {
+        AT_thread_run(num_workers, AT_replay_gather_worker, &job);
+        AT_thread_run(AT_min(num_workers, num_groups), AT_replay_encode_worker, &job);
+        res = job.result;
+    }
+
+    size_t size = AT_REPLAY_HEADER_SIZE + (size_t)frame_count * AT_REPLAY_DIRECTORY_ENTRY_SIZE;
+    for (uint32_t f = 0; f < frame_count; f++) size += frames[f].size;
+
+    //offsets are stored as uint32, use fewer frames per chunk beyond that
+    if (res == AT_OK && size > UINT32_MAX) res = AT_ERR_INVALID_ARGUMENT;
+
+    uint8_t *data = NULL;
+    if (res == AT_OK) {
+        data = malloc(size);
+        if (!data) res = AT_ERR_ALLOC_ERROR;
+    }
+
+    if (res == AT_OK) {
+        memcpy(data, AT_REPLAY_MAGIC, 4);
+        AT_bytes_put_u16(data + 4, AT_REPLAY_VERSION);
+        AT_bytes_put_u16(data + 6, (keyframe_interval > 1) ? AT_REPLAY_FLAG_DELTA : 0);
+        AT_bytes_put_u32(data + 8, chunk_index);
+        AT_bytes_put_u32(data + 12, frame_count);
+        AT_bytes_put_u32(data + 16, start_frame);
+        AT_bytes_put_u32(data + 20, resolved.encoding);
+        AT_bytes_put_u32(data + 24, simulation->num_voxels);
+        AT_bytes_put_u32(data + 28, keyframe_interval);
+
+        size_t offset = AT_REPLAY_HEADER_SIZE + (size_t)frame_count * AT_REPLAY_DIRECTORY_ENTRY_SIZE;
+        for (uint32_t f = 0; f < frame_count; f++) {
+            uint8_t *entry = data + AT_REPLAY_HEADER_SIZE + (size_t)f * AT_REPLAY_DIRECTORY_ENTRY_SIZE;
+            AT_bytes_put_u32(entry, (uint32_t)offset);
+            AT_bytes_put_u32(entry + 4, frames[f].size);
+            AT_bytes_put_f32(entry + 8, frames[f].max);
+            AT_bytes_put_f32(entry + 12, frames[f].sum);
+
+            memcpy(data + offset, frames[f].data, frames[f].size);
+            offset += frames[f].size;
+        }
+    }
+
+    for (uint32_t f = 0; f < frame_count; f++) free(frames[f].data);
+    free(frames);
+    free(counts);
+    free(frame_starts);
+    free(job.indices);
+    free(job.values);
+
+    if (res == AT_OK && resolved.is_compressed) res = AT_replay_compress_chunk(&data, &size);
+    if (res != AT_OK) {
+        free(data);
+        return res;
+    }
+
+    *out_data = data;
+    *out_size = size;
+    return AT_OK;
+}
+
+AT_Result AT_replay_read_chunk_info(AT_ReplayChunkInfo *out_info, const uint8_t *data, size_t size)
+{
+    if (!out_info || !data || size < AT_REPLAY_HEADER_SIZE) return AT_ERR_INVALID_ARGUMENT;
+    if (memcmp(data, AT_REPLAY_MAGIC, 4) != 0) return AT_ERR_INVALID_ARGUMENT;
+    if (AT_bytes_get_u16(data + 4) != AT_REPLAY_VERSION) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ReplayChunkInfo info = {
+        .flags = AT_bytes_get_u16(data + 6),
+        .chunk_index = AT_bytes_get_u32(data + 8),
+        .frame_count = AT_bytes_get_u32(data + 12),
+        .start_frame = AT_bytes_get_u32(data + 16),
+        .encoding = (AT_ReplayEncoding)AT_bytes_get_u32(data + 20),
+        .num_voxels = AT_bytes_get_u32(data + 24),
+        .keyframe_interval = AT_bytes_get_u32(data + 28),
+    };
+
+    if (info.encoding != AT_REPLAY_ENCODING_RAW && info.encoding != AT_REPLAY_ENCODING_QUANTISED) {
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+    if (info.keyframe_interval == 0) return AT_ERR_INVALID_ARGUMENT;
+
+    if (info.flags & AT_REPLAY_FLAG_COMPRESSED) {
+        if (size < AT_REPLAY_COMPRESSED_PREFIX_SIZE) return AT_ERR_INVALID_ARGUMENT;
+    } else if ((size - AT_REPLAY_HEADER_SIZE) / AT_REPLAY_DIRECTORY_ENTRY_SIZE < info.frame_count) {
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    *out_info = info;
+    return AT_OK;
+}
+
+AT_Result AT_replay_decompress_chunk(uint8_t **out_data, size_t *out_size, const uint8_t *data, size_t size)
+{
+    AT_ReplayChunkInfo info;
+    if (!out_data || !out_size || AT_replay_read_chunk_info(&info, data, size) != AT_OK) return AT_ERR_INVALID_ARGUMENT;
+
+    size_t body_size = size - AT_REPLAY_HEADER_SIZE;
+    if (info.flags & AT_REPLAY_FLAG_COMPRESSED) body_size = AT_bytes_get_u32(data + AT_REPLAY_HEADER_SIZE);
+
+    uint8_t *chunk = malloc(AT_REPLAY_HEADER_SIZE + body_size);
+    if (!chunk) return AT_ERR_ALLOC_ERROR;
+
+    memcpy(chunk, data, AT_REPLAY_HEADER_SIZE);
+    if (!(info.flags & AT_REPLAY_FLAG_COMPRESSED)) {
+        memcpy(chunk + AT_REPLAY_HEADER_SIZE, data + AT_REPLAY_HEADER_SIZE, body_size);
+        *out_data = chunk;
+        *out_size = AT_REPLAY_HEADER_SIZE + body_size;
+        return AT_OK;
+    }
+    AT_bytes_put_u16(chunk + 6, info.flags & ~AT_REPLAY_FLAG_COMPRESSED);
+
+    AT_ReplayShuffle shuffle = {
+        .mode = AT_REPLAY_SHUFFLE_JOIN,
+        .body = chunk + AT_REPLAY_HEADER_SIZE,
+        .body_size = body_size,
+    };
+    const uint8_t *prefix = data + AT_REPLAY_HEADER_SIZE;
+    size_t streams_size = 0;
+    size_t blocks_size = 0;
+    for (uint32_t s = 0; s < AT_REPLAY_NUM_STREAMS; s++) {
+        shuffle.sizes[s] = AT_bytes_get_u32(prefix + 4 + s * 4);
+        streams_size += shuffle.sizes[s];
+        blocks_size += AT_bytes_get_u32(prefix + 4 + (AT_REPLAY_NUM_STREAMS + s) * 4);
+    }
+
+    uint8_t *streams = NULL;
+    bool is_ok = streams_size == body_size && blocks_size == size - AT_REPLAY_COMPRESSED_PREFIX_SIZE;
+    if (is_ok) {
+        streams = malloc(AT_max(body_size, (size_t)1));
+        if (!streams) {
+            free(chunk);
+            return AT_ERR_ALLOC_ERROR;
+        }
+    }
+
+    const uint8_t *block = data + AT_REPLAY_COMPRESSED_PREFIX_SIZE;
+    uint8_t *stream = streams;
+    for (uint32_t s = 0; s < AT_REPLAY_NUM_STREAMS && is_ok; s++) {
+        size_t block_size = AT_bytes_get_u32(prefix + 4 + (AT_REPLAY_NUM_STREAMS + s) * 4);
+        is_ok = AT_rans_decompress(stream, shuffle.sizes[s], block, block_size) == AT_OK;
+        stream += shuffle.sizes[s];
+        block += block_size;
+    }
+    if (is_ok) {
+        AT_replay_shuffle_place(&shuffle, streams);
+        is_ok = AT_replay_shuffle_body(&shuffle, &info);
+    }
+    for (uint32_t s = 0; s < AT_REPLAY_NUM_STREAMS && is_ok; s++) is_ok = shuffle.cursors[s] == shuffle.ends[s];
+    free(streams);
+    if (!is_ok) {
+        free(chunk);
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    *out_data = chunk;
+    *out_size = AT_REPLAY_HEADER_SIZE + body_size;
+    return AT_OK;
+}
+
+// Where the parts of a keyframe pair list sit
+typedef struct {
+    uint32_t count;
+    float scale; //QUANTISED only
+    const uint8_t *indices; //uint32_t each for RAW, varint deltas for QUANTISED
+    const uint8_t *indices_end;
+    const uint8_t *values; //float each for RAW, uint16_t each for QUANTISED
+    const uint8_t *end; //past the list and its padding
+} AT_ReplayPairs;
+
+// Returns false if the list does not fit in [src, end)
+static bool AT_replay_read_pairs(AT_ReplayPairs *out_pairs, AT_ReplayEncoding encoding, const uint8_t *src, const uint8_t *end)
+{
+    if (end - src < 4) return false;
+    uint32_t count = AT_bytes_get_u32(src);
+
+    if (encoding == AT_REPLAY_ENCODING_RAW) {
+        if ((size_t)(end - src - 4) / 8 < count) return false;
+        *out_pairs = (AT_ReplayPairs){
+            .count = count,
+            .indices = src + 4,
+            .indices_end = src + 4 + (size_t)count * 4,
+            .values = src + 4 + (size_t)count * 4,
+            .end = src + 4 + (size_t)count * 8,
+        };
+        return true;
+    }
+    if (encoding != AT_REPLAY_ENCODING_QUANTISED || end - src < 12) return false;
+
+    uint32_t index_bytes = AT_bytes_get_u32(src + 8);
+    if ((size_t)(end - src - 12) < index_bytes) return false;
+    size_t offset = 12 + (size_t)index_bytes;
+    offset += offset & 1;
+    if ((size_t)(end - src) < offset || (size_t)(end - src - offset) / 2 < count) return false;
+
+    *out_pairs = (AT_ReplayPairs){
+        .count = count,
+        .scale = AT_bytes_get_f32(src + 4),
+        .indices = src + 12,
+        .indices_end = src + 12 + index_bytes,
+        .values = src + offset,
+    };
+    offset += (size_t)count * 2;
+    offset = (offset + 3) & ~(size_t)3;
+    out_pairs->end = src + AT_min(offset, (size_t)(end - src));
+    return true;
+}
+
+// Applies a pair list to the dense field, returns the end of the list or
+// NULL if it is malformed
+static const uint8_t *AT_replay_apply_pairs(float *values,
+                                            const AT_ReplayChunkInfo *info,
+                                            const uint8_t *src,
+                                            const uint8_t *end)
+{
+    AT_ReplayPairs pairs;
+    if (!AT_replay_read_pairs(&pairs, info->encoding, src, end)) return NULL;
+
+    if (info->encoding == AT_REPLAY_ENCODING_RAW) {
+        for (uint32_t i = 0; i < pairs.count; i++) {
+            uint32_t voxel_idx = AT_bytes_get_u32(pairs.indices + (size_t)i * 4);
+            if (voxel_idx >= info->num_voxels) return NULL;
+            values[voxel_idx] = AT_bytes_get_f32(pairs.values + (size_t)i * 4);
+        }
+        return pairs.end;
+    }
+
+    const uint8_t *deltas = pairs.indices;
+    uint32_t voxel_idx = 0;
+    for (uint32_t i = 0; i < pairs.count; i++) {
+        uint32_t delta;
+        deltas = AT_bytes_get_varint(deltas, pairs.indices_end, &delta);
+        if (!deltas || delta > info->num_voxels - voxel_idx) return NULL;
+        voxel_idx += delta;
+        if (voxel_idx >= info->num_voxels) return NULL;
+        values[voxel_idx] = (float)AT_bytes_get_u16(pairs.values + (size_t)i * 2) * pairs.scale;
+    }
+    return pairs.end;
+}
+
+static bool AT_replay_apply_removed(float *values, const AT_ReplayChunkInfo *info, const uint8_t *src, const uint8_t *end)
+{
+    if (end - src < 8) return false;
+    uint32_t count = AT_bytes_get_u32(src);
+    uint32_t index_bytes = AT_bytes_get_u32(src + 4);
+    if ((size_t)(end - src - 8) < index_bytes) return false;
+
+    const uint8_t *deltas = src + 8;
+    const uint8_t *deltas_end = deltas + index_bytes;
+    uint32_t voxel_idx = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t delta;
+        deltas = AT_bytes_get_varint(deltas, deltas_end, &delta);
+        if (!deltas || delta > info->num_voxels - voxel_idx) return false;
+        voxel_idx += delta;
+        if (voxel_idx >= info->num_voxels) return false;
+        values[voxel_idx] = 0.0f;
+    }
+    return true;
+}
+
+// Locates a frame payload, past the kind of delta chunks
+static bool AT_replay_frame_payload(const AT_ReplayChunkInfo *info,
+                                    const uint8_t *data,
+                                    size_t size,
+                                    uint32_t frame,
+                                    uint32_t *out_kind,
+                                    const uint8_t **out_start,
+                                    const uint8_t **out_end)
+{
+    const uint8_t *entry = data + AT_REPLAY_HEADER_SIZE + (size_t)frame * AT_REPLAY_DIRECTORY_ENTRY_SIZE;
+    uint32_t offset = AT_bytes_get_u32(entry);
+    uint32_t frame_size = AT_bytes_get_u32(entry + 4);
+    if (offset > size || frame_size > size - offset) return false;
+
+    *out_kind = AT_REPLAY_FRAME_KEY;
+    *out_start = data + offset;
+    *out_end = data + offset + frame_size;
+
+    if (info->flags & AT_REPLAY_FLAG_DELTA) {
+        if (frame_size < 4) return false;
+        *out_kind = AT_bytes_get_u32(*out_start);
+        *out_start += 4;
+        if (*out_kind != AT_REPLAY_FRAME_KEY && *out_kind != AT_REPLAY_FRAME_DELTA) return false;
+    }
+    return true;
+}
+
+AT_Result AT_replay_decode_frame(float *values, const uint8_t *data, size_t size, uint32_t frame)
+{
+    AT_ReplayChunkInfo info;
+    if (!values || AT_replay_read_chunk_info(&info, data, size) != AT_OK) return AT_ERR_INVALID_ARGUMENT;
+    if (frame >= info.frame_count || (info.flags & AT_REPLAY_FLAG_COMPRESSED)) return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t kind;
+    const uint8_t *start;
+    const uint8_t *end;
+
+    //walk back to the keyframe the frame builds on
+    uint32_t keyframe = frame;
+    for (;;) {
+        if (!AT_replay_frame_payload(&info, data, size, keyframe, &kind, &start, &end)) return AT_ERR_INVALID_ARGUMENT;
+        if (kind == AT_REPLAY_FRAME_KEY) break;
+        if (keyframe == 0) return AT_ERR_INVALID_ARGUMENT;
+        keyframe--;
+    }
+
+    memset(values, 0, sizeof(float) * info.num_voxels);
+
+    for (uint32_t f = keyframe; f <= frame; f++) {
+        if (!AT_replay_frame_payload(&info, data, size, f, &kind, &start, &end)) return AT_ERR_INVALID_ARGUMENT;
+
+        const uint8_t *removed = AT_replay_apply_pairs(values, &info, start, end);
+        if (!removed) return AT_ERR_INVALID_ARGUMENT;
+        if (kind == AT_REPLAY_FRAME_DELTA && !AT_replay_apply_removed(values, &info, removed, end)) {
+            return AT_ERR_INVALID_ARGUMENT;
+        }
+    }
+    return AT_OK;
+}
+
+AT_Result AT_replay_lookup_keyframe(float *out_values,
+                                    const uint32_t *voxels,
+                                    uint32_t count,
+                                    AT_ReplayEncoding encoding,
+                                    const uint8_t *data,
+                                    size_t size)
+{
+    if (!data || (count > 0 && (!out_values || !voxels))) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ReplayPairs pairs;
+    if (!AT_replay_read_pairs(&pairs, encoding, data, data + size)) return AT_ERR_INVALID_ARGUMENT;
+
+    //RAW indices are searched, each search starting where the last ended
+    if (encoding == AT_REPLAY_ENCODING_RAW) {
+        uint32_t lo = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t hi = pairs.count;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (AT_bytes_get_u32(pairs.indices + (size_t)mid * 4) < voxels[i]) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo == pairs.count) break;
+            if (AT_bytes_get_u32(pairs.indices + (size_t)lo * 4) == voxels[i]) {
+                out_values[i] = AT_bytes_get_f32(pairs.values + (size_t)lo * 4);
+            }
+        }
+        return AT_OK;
+    }
+
+    //QUANTISED deltas are walked up to the last voxel asked for
+    const uint8_t *deltas = pairs.indices;
+    uint32_t voxel_idx = 0;
+    uint32_t i = 0;
+    for (uint32_t k = 0; k < pairs.count && i < count; k++) {
+        uint32_t delta;
+        deltas = AT_bytes_get_varint(deltas, pairs.indices_end, &delta);
+        if (!deltas || delta > UINT32_MAX - voxel_idx) return AT_ERR_INVALID_ARGUMENT;
+        voxel_idx += delta;
+
+        while (i < count && voxels[i] < voxel_idx) i++;
+        for (; i < count && voxels[i] == voxel_idx; i++) {
+            out_values[i] = (float)AT_bytes_get_u16(pairs.values + (size_t)k * 2) * pairs.scale;
+        }
+    }
+    return AT_OK;
+}
+
+AT_Result AT_replay_apply_keyframe(float *values,
+                                   uint32_t num_voxels,
+                                   AT_ReplayEncoding encoding,
+                                   const uint8_t *data,
+                                   size_t size)
+{
+    if (!values || !data) return AT_ERR_INVALID_ARGUMENT;
+    if (encoding != AT_REPLAY_ENCODING_RAW && encoding != AT_REPLAY_ENCODING_QUANTISED) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ReplayChunkInfo info = {
+        .encoding = encoding,
+        .num_voxels = num_voxels,
+        .keyframe_interval = 1,
+    };
+    return AT_replay_apply_pairs(values, &info, data, data + size) ? AT_OK : AT_ERR_INVALID_ARGUMENT;
+}
+
+AT_Result AT_replay_write_meta(const AT_Simulation *simulation,
+                               const AT_ReplaySettings *settings,
+                               const char *path)
+{
+    if (!simulation || !path) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ReplaySettings resolved = AT_replay_resolve_settings(simulation, settings);
+    bool is_quantised = resolved.encoding == AT_REPLAY_ENCODING_QUANTISED;
+
+    FILE *file = fopen(path, "w");
+    if (!file) return AT_ERR_IO_FAILURE;
+
+    fprintf(file,
+        "{\n"
+        "  \"version\": %d,\n"
+        "  \"grid\": {\"x\": %u, \"y\": %u, \"z\": %u},\n"
+        "  \"origin\": [%.9g, %.9g, %.9g],\n"
+        "  \"voxelSize\": %.9g,\n"
+        "  \"voxelCount\": %u,\n"
+        "  \"fps\": %u,\n"
+        "  \"frameCount\": %u,\n"
+        "  \"framesPerChunk\": %u,\n"
+        "  \"numChunks\": %u,\n"
+        "  \"threshold\": %.9g,\n"
+        "  \"topK\": %u,\n"
+        "  \"keyframeInterval\": %u,\n"
+        "  \"deltaTolerance\": %.9g,\n"
+        "  \"encoding\": \"%s\",\n"
+        "  \"compression\": \"%s\",\n"
+        "  \"values\": %s\n"
+        "}\n",
+        AT_REPLAY_VERSION,
+        (uint32_t)simulation->grid_dimensions.x,
+        (uint32_t)simulation->grid_dimensions.y,
+        (uint32_t)simulation->grid_dimensions.z,
+        simulation->origin.x, simulation->origin.y, simulation->origin.z,
+        simulation->voxel_size,
+        simulation->num_voxels,
+        (uint32_t)simulation->fps,
+        AT_replay_frame_count(simulation),
+        resolved.frames_per_chunk,
+        AT_replay_chunk_count(simulation, &resolved),
+        resolved.threshold,
+        resolved.top_k,
+        AT_max(resolved.keyframe_interval, 1u),
+        resolved.delta_tolerance,
+        is_quantised ? "quantised" : "raw",
+        resolved.is_compressed ? "rans" : "none",
+        is_quantised ?
+            "{\"type\": \"uint16\", \"scale\": \"frame\"}" :
+            "{\"type\": \"float32\", \"scale\": 1}");
+
+    bool is_failed = ferror(file) != 0;
+    if (fclose(file) != 0) is_failed = true;
+    return is_failed ? AT_ERR_IO_FAILURE : AT_OK;
+}
+
+AT_Result AT_replay_write(const AT_Simulation *simulation,
+                          const AT_ReplaySettings *settings,
+                          const char *dir_path)
+{
+    if (!simulation || !dir_path) return AT_ERR_INVALID_ARGUMENT;
+
+    if (mkdir(dir_path, 0755) != 0 && errno != EEXIST) return AT_ERR_IO_FAILURE;
+
+    char path[AT_REPLAY_PATH_LENGTH];
+    int len = snprintf(path, sizeof(path), "%s/meta.json", dir_path);
+    if (len < 0 || (size_t)len >= sizeof(path)) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_Result res = AT_replay_write_meta(simulation, settings, path);
+    if (res != AT_OK) return res;
+
+    uint32_t num_chunks = AT_replay_chunk_count(simulation, settings);
+    for (uint32_t c = 0; c < num_chunks; c++) {
+        len = snprintf(path, sizeof(path), "%s/chunk_%03u.bin", dir_path, c);
+        if (len < 0 || (size_t)len >= sizeof(path)) return AT_ERR_INVALID_ARGUMENT;
+
+        uint8_t *data = NULL;
+        size_t size = 0;
+        res = AT_replay_encode_chunk(&data, &size, simulation, settings, c);
+        if (res != AT_OK) return res;
+
+        FILE *file = fopen(path, "wb");
+        if (!file) {
+            free(data);
+            return AT_ERR_IO_FAILURE;
+        }
+        bool is_failed = fwrite(data, 1, size, file) != size;
+        if (fclose(file) != 0) is_failed = true;
+        free(data);
+        if (is_failed) return AT_ERR_IO_FAILURE;
+    }
+
+    return AT_OK;
+}
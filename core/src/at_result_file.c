@@ -0,0 +1,486 @@
+#include "acoustic/at_result_file.h"
+#include "acoustic/at.h"
+#include "acoustic/at_replay.h"
+#include "../src/at_bytes.h"
+#include "../src/at_internal.h"
+#include "../src/at_thread.h"
+#include "../src/at_utils.h"
+#include "../src/at_voxel.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct AT_ResultFile {
+    const uint8_t *data;
+    size_t size;
+    const uint8_t *table;
+    const uint8_t *spans; //NULL if the file has no span index
+    AT_ResultInfo info;
+};
+
+typedef struct {
+    const AT_Simulation *simulation;
+    float threshold;
+    uint32_t num_workers;
+    uint8_t *spans;
+} AT_ResultSpanJob;
+
+typedef struct {
+    uint32_t voxel;
+    uint32_t series;
+} AT_ResultQueryItem;
+
+static void AT_result_put_header(uint8_t *dst, const AT_Simulation *simulation, AT_ReplayEncoding encoding,
+                                 uint32_t frame_count)
+{
+    memset(dst, 0, AT_RESULT_FILE_HEADER_SIZE);
+    memcpy(dst, AT_RESULT_FILE_MAGIC, 4);
+    AT_bytes_put_u16(dst + 4, AT_RESULT_FILE_VERSION);
+    AT_bytes_put_u16(dst + 6, AT_RESULT_FILE_FLAG_VOXEL_SPANS);
+    AT_bytes_put_u32(dst + 8, frame_count);
+    AT_bytes_put_u32(dst + 12, (uint32_t)encoding);
+    AT_bytes_put_u32(dst + 16, (uint32_t)simulation->grid_dimensions.x);
+    AT_bytes_put_u32(dst + 20, (uint32_t)simulation->grid_dimensions.y);
+    AT_bytes_put_u32(dst + 24, (uint32_t)simulation->grid_dimensions.z);
+    AT_bytes_put_u32(dst + 28, simulation->num_voxels);
+    AT_bytes_put_f32(dst + 32, simulation->origin.x);
+    AT_bytes_put_f32(dst + 36, simulation->origin.y);
+    AT_bytes_put_f32(dst + 40, simulation->origin.z);
+    AT_bytes_put_f32(dst + 44, simulation->voxel_size);
+    AT_bytes_put_u32(dst + 48, (uint32_t)simulation->fps);
+    AT_bytes_put_u64(dst + 56, AT_RESULT_FILE_HEADER_SIZE);
+}
+
+// Frames each voxel of the worker's row-major range is above the threshold
+// in. Top-k can only drop voxels from a frame, so the spans stay a superset.
+static void AT_result_span_worker(void *ctx, uint32_t worker)
+{
+    AT_ResultSpanJob *job = ctx;
+    const AT_Simulation *simulation = job->simulation;
+    uint64_t num_voxels = simulation->num_voxels;
+    uint32_t first = (uint32_t)(num_voxels * worker / job->num_workers);
+    uint32_t last = (uint32_t)(num_voxels * (worker + 1) / job->num_workers);
+
+    for (uint32_t v = first; v < last; v++) {
+        AT_VoxelSpan span = AT_voxel_span(simulation, v);
+        uint32_t start = 0;
+        while (start < span.count && !(span.values[start] > job->threshold)) start++;
+        uint32_t end = span.count;
+        while (end > start && !(span.values[end - 1] > job->threshold)) end--;
+
+        uint8_t *out = job->spans + (size_t)v * AT_RESULT_FILE_SPAN_SIZE;
+        AT_bytes_put_u32(out, start == end ? 0 : span.first_bin + start);
+        AT_bytes_put_u32(out + 4, start == end ? 0 : span.first_bin + end);
+    }
+}
+
+// Copies the frames of one encoded chunk to the file and fills their table entries
+static AT_Result AT_result_write_chunk(FILE *file, uint64_t *offset, uint8_t *table,
+                                       const uint8_t *chunk, size_t chunk_size)
+{
+    AT_ReplayChunkInfo info;
+    AT_Result res = AT_replay_read_chunk_info(&info, chunk, chunk_size);
+    if (res != AT_OK) return res;
+
+    for (uint32_t f = 0; f < info.frame_count; f++) {
+        const uint8_t *entry = chunk + AT_REPLAY_HEADER_SIZE + (size_t)f * AT_REPLAY_DIRECTORY_ENTRY_SIZE;
+        uint32_t frame_offset = AT_bytes_get_u32(entry);
+        uint32_t frame_size = AT_bytes_get_u32(entry + 4);
+        if (frame_size < 4 || frame_offset > chunk_size || frame_size > chunk_size - frame_offset) {
+            return AT_ERR_INVALID_ARGUMENT;
+        }
+
+        const uint8_t *payload = chunk + frame_offset;
+        if (fwrite(payload, 1, frame_size, file) != frame_size) return AT_ERR_IO_FAILURE;
+
+        uint8_t *out = table + (size_t)(info.start_frame + f) * AT_RESULT_FILE_ENTRY_SIZE;
+        AT_bytes_put_u64(out, *offset);
+        AT_bytes_put_u32(out + 8, frame_size);
+        AT_bytes_put_u32(out + 12, AT_bytes_get_u32(payload));
+        memcpy(out + 16, entry + 8, 8); //max and sum, already little endian
+        *offset += frame_size;
+    }
+
+    return AT_OK;
+}
+
+AT_Result AT_result_write(const AT_Simulation *simulation, const AT_ReplaySettings *settings, const char *path)
+{
+    if (!simulation || !path) return AT_ERR_INVALID_ARGUMENT;
+
+    //every frame is a keyframe so any one of them decodes on its own
+    AT_ReplaySettings resolved = settings ? *settings : (AT_ReplaySettings){0};
+    resolved.keyframe_interval = 0;
+    resolved.delta_tolerance = 0.0f;
+    resolved.is_compressed = false;
+
+    uint32_t frame_count = AT_replay_frame_count(simulation);
+    uint32_t num_chunks = AT_replay_chunk_count(simulation, &resolved);
+
+    size_t table_size = (size_t)frame_count * AT_RESULT_FILE_ENTRY_SIZE;
+    size_t spans_size = (size_t)simulation->num_voxels * AT_RESULT_FILE_SPAN_SIZE;
+    uint8_t *table = calloc(table_size ? table_size : 1, 1);
+    uint8_t *spans = malloc(spans_size ? spans_size : 1);
+    if (!table || !spans) {
+        free(table);
+        free(spans);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    uint32_t num_threads = resolved.num_threads ? resolved.num_threads : simulation->num_threads;
+    AT_ResultSpanJob span_job = {
+        .simulation = simulation,
+        .threshold = resolved.threshold,
+        .num_workers = AT_max(num_threads, 1u),
+        .spans = spans,
+    };
+    AT_thread_run(span_job.num_workers, AT_result_span_worker, &span_job);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        free(table);
+        free(spans);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    uint8_t header[AT_RESULT_FILE_HEADER_SIZE];
+    AT_result_put_header(header, simulation, resolved.encoding, frame_count);
+
+    //the table is written once the payload offsets are known
+    AT_Result res = AT_OK;
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(table, 1, table_size, file) != table_size ||
+        fwrite(spans, 1, spans_size, file) != spans_size) {
+        res = AT_ERR_IO_FAILURE;
+    }
+    free(spans);
+
+    uint64_t offset = AT_RESULT_FILE_HEADER_SIZE + table_size + spans_size;
+    for (uint32_t c = 0; c < num_chunks && res == AT_OK; c++) {
+        uint8_t *chunk = NULL;
+        size_t chunk_size = 0;
+        res = AT_replay_encode_chunk(&chunk, &chunk_size, simulation, &resolved, c);
+        if (res != AT_OK) break;
+        res = AT_result_write_chunk(file, &offset, table, chunk, chunk_size);
+        free(chunk);
+    }
+
+    if (res == AT_OK) {
+        if (fseeko(file, AT_RESULT_FILE_HEADER_SIZE, SEEK_SET) != 0 ||
+            fwrite(table, 1, table_size, file) != table_size) {
+            res = AT_ERR_IO_FAILURE;
+        }
+    }
+
+    if (fclose(file) != 0 && res == AT_OK) res = AT_ERR_IO_FAILURE;
+    free(table);
+    return res;
+}
+
+// Checks the header and that the table and every frame lie inside the mapping
+static bool AT_result_parse(AT_ResultFile *file)
+{
+    const uint8_t *src = file->data;
+    if (file->size < AT_RESULT_FILE_HEADER_SIZE) return false;
+    if (memcmp(src, AT_RESULT_FILE_MAGIC, 4) != 0) return false;
+    if (AT_bytes_get_u16(src + 4) != AT_RESULT_FILE_VERSION) return false;
+
+    AT_ResultInfo *info = &file->info;
+    info->frame_count = AT_bytes_get_u32(src + 8);
+    uint32_t encoding = AT_bytes_get_u32(src + 12);
+    if (encoding != AT_REPLAY_ENCODING_RAW && encoding != AT_REPLAY_ENCODING_QUANTISED) return false;
+    info->encoding = (AT_ReplayEncoding)encoding;
+    info->grid[0] = AT_bytes_get_u32(src + 16);
+    info->grid[1] = AT_bytes_get_u32(src + 20);
+    info->grid[2] = AT_bytes_get_u32(src + 24);
+    info->num_voxels = AT_bytes_get_u32(src + 28);
+    info->origin = AT_vec3(AT_bytes_get_f32(src + 32), AT_bytes_get_f32(src + 36), AT_bytes_get_f32(src + 40));
+    info->voxel_size = AT_bytes_get_f32(src + 44);
+    info->fps = AT_bytes_get_u32(src + 48);
+
+    if ((uint64_t)info->grid[0] * info->grid[1] * info->grid[2] != info->num_voxels) return false;
+
+    uint64_t table_offset = AT_bytes_get_u64(src + 56);
+    uint64_t table_size = (uint64_t)info->frame_count * AT_RESULT_FILE_ENTRY_SIZE;
+    if (table_offset > file->size || table_size > file->size - table_offset) return false;
+    file->table = src + table_offset;
+
+    if (AT_bytes_get_u16(src + 6) & AT_RESULT_FILE_FLAG_VOXEL_SPANS) {
+        uint64_t spans_offset = table_offset + table_size;
+        uint64_t spans_size = (uint64_t)info->num_voxels * AT_RESULT_FILE_SPAN_SIZE;
+        if (spans_size > file->size - spans_offset) return false;
+        file->spans = src + spans_offset;
+    }
+
+    for (uint32_t f = 0; f < info->frame_count; f++) {
+        const uint8_t *entry = file->table + (size_t)f * AT_RESULT_FILE_ENTRY_SIZE;
+        uint64_t offset = AT_bytes_get_u64(entry);
+        uint32_t size = AT_bytes_get_u32(entry + 8);
+        if (size < 4 || offset > file->size || size > file->size - offset) return false;
+    }
+
+    return true;
+}
+
+AT_Result AT_result_open(AT_ResultFile **out_file, const char *path)
+{
+    if (!out_file || !path) return AT_ERR_INVALID_ARGUMENT;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return AT_ERR_IO_FAILURE;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); //the mapping keeps the file alive
+    if (data == MAP_FAILED) return AT_ERR_IO_FAILURE;
+
+    AT_ResultFile *file = calloc(1, sizeof(AT_ResultFile));
+    if (!file) {
+        munmap(data, (size_t)st.st_size);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    file->data = data;
+    file->size = (size_t)st.st_size;
+
+    if (!AT_result_parse(file)) {
+        AT_result_close(file);
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    *out_file = file;
+    return AT_OK;
+}
+
+const AT_ResultInfo *AT_result_info(const AT_ResultFile *file)
+{
+    return file ? &file->info : NULL;
+}
+
+AT_Result AT_result_get_frame(AT_ResultFrame *out_frame, const AT_ResultFile *file, uint32_t frame)
+{
+    if (!out_frame || !file || frame >= file->info.frame_count) return AT_ERR_INVALID_ARGUMENT;
+
+    //bounds were checked for every entry in AT_result_open()
+    const uint8_t *entry = file->table + (size_t)frame * AT_RESULT_FILE_ENTRY_SIZE;
+    uint64_t offset = AT_bytes_get_u64(entry);
+
+    out_frame->data = file->data + offset;
+    out_frame->size = AT_bytes_get_u32(entry + 8);
+    out_frame->active_count = AT_bytes_get_u32(entry + 12);
+    out_frame->max = AT_bytes_get_f32(entry + 16);
+    out_frame->sum = AT_bytes_get_f32(entry + 20);
+    return AT_OK;
+}
+
+AT_Result AT_result_decode_frame(float *values, const AT_ResultFile *file, uint32_t frame)
+{
+    if (!values) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ResultFrame result_frame;
+    AT_Result res = AT_result_get_frame(&result_frame, file, frame);
+    if (res != AT_OK) return res;
+
+    memset(values, 0, (size_t)file->info.num_voxels * sizeof(float));
+    return AT_replay_apply_keyframe(values, file->info.num_voxels, file->info.encoding,
+                                    result_frame.data, result_frame.size);
+}
+
+static int AT_result_compare_items(const void *a, const void *b)
+{
+    const AT_ResultQueryItem *x = a;
+    const AT_ResultQueryItem *y = b;
+    if (x->voxel != y->voxel) return (x->voxel > y->voxel) - (x->voxel < y->voxel);
+    return (x->series > y->series) - (x->series < y->series);
+}
+
+// Fills series->values for the voxels in series->voxels, reading only the
+// frames the span index allows and only the queried voxels in them
+static AT_Result AT_result_read_series(AT_ResultSeries *series, const AT_ResultFile *file)
+{
+    uint32_t num_items = series->num_series;
+    uint32_t frame_count = file->info.frame_count;
+
+    AT_ResultQueryItem *items = malloc(sizeof(AT_ResultQueryItem) * AT_max(num_items, 1u));
+    AT_ResultQueryItem *active = malloc(sizeof(AT_ResultQueryItem) * AT_max(num_items, 1u));
+    uint32_t *active_voxels = malloc(sizeof(uint32_t) * AT_max(num_items, 1u));
+    float *active_values = malloc(sizeof(float) * AT_max(num_items, 1u));
+    uint32_t *span_starts = malloc(sizeof(uint32_t) * AT_max(num_items, 1u));
+    uint32_t *span_ends = malloc(sizeof(uint32_t) * AT_max(num_items, 1u));
+    if (!items || !active || !active_voxels || !active_values || !span_starts || !span_ends) {
+        free(items);
+        free(active);
+        free(active_voxels);
+        free(active_values);
+        free(span_starts);
+        free(span_ends);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    for (uint32_t i = 0; i < num_items; i++) {
+        items[i] = (AT_ResultQueryItem){.voxel = series->voxels[i], .series = i};
+    }
+    qsort(items, num_items, sizeof(AT_ResultQueryItem), AT_result_compare_items);
+
+    uint32_t first_frame = frame_count;
+    uint32_t end_frame = 0;
+    for (uint32_t i = 0; i < num_items; i++) {
+        span_starts[i] = 0;
+        span_ends[i] = frame_count;
+        if (file->spans) {
+            const uint8_t *span = file->spans + (size_t)items[i].voxel * AT_RESULT_FILE_SPAN_SIZE;
+            span_starts[i] = AT_bytes_get_u32(span);
+            span_ends[i] = AT_min(AT_bytes_get_u32(span + 4), frame_count);
+        }
+        if (span_starts[i] >= span_ends[i]) continue;
+        first_frame = AT_min(first_frame, span_starts[i]);
+        end_frame = AT_max(end_frame, span_ends[i]);
+    }
+
+    AT_Result res = AT_OK;
+    for (uint32_t f = first_frame; f < end_frame && res == AT_OK; f++) {
+        uint32_t num_active = 0;
+        for (uint32_t i = 0; i < num_items; i++) {
+            if (f < span_starts[i] || f >= span_ends[i]) continue;
+            active[num_active] = items[i];
+            active_voxels[num_active] = items[i].voxel;
+            active_values[num_active++] = 0.0f;
+        }
+        if (num_active == 0) continue;
+
+        AT_ResultFrame frame;
+        res = AT_result_get_frame(&frame, file, f);
+        if (res == AT_OK) {
+            res = AT_replay_lookup_keyframe(active_values, active_voxels, num_active, file->info.encoding,
+                                            frame.data, frame.size);
+        }
+        for (uint32_t i = 0; res == AT_OK && i < num_active; i++) {
+            series->values[(size_t)active[i].series * frame_count + f] = active_values[i];
+        }
+    }
+
+    free(items);
+    free(active);
+    free(active_voxels);
+    free(active_values);
+    free(span_starts);
+    free(span_ends);
+    return res;
+}
+
+static AT_Result AT_result_series_alloc(AT_ResultSeries *series, const AT_ResultFile *file, uint32_t num_series)
+{
+    *series = (AT_ResultSeries){
+        .num_series = num_series,
+        .frame_count = file->info.frame_count,
+        .voxels = malloc(sizeof(uint32_t) * AT_max(num_series, 1u)),
+        .values = calloc(AT_max((size_t)num_series * file->info.frame_count, (size_t)1), sizeof(float)),
+    };
+    if (!series->voxels || !series->values) {
+        AT_result_series_destroy(series);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    return AT_OK;
+}
+
+// Grid coordinate of a world position along one axis, may be out of range
+static inline int64_t AT_result_grid_coord(float position, float origin, float voxel_size)
+{
+    return (int64_t)floorf((position - origin) / voxel_size);
+}
+
+AT_Result AT_result_query_points(AT_ResultSeries *out_series,
+                                 const AT_ResultFile *file,
+                                 const AT_Vec3 *points,
+                                 uint32_t num_points)
+{
+    if (!out_series || !file || (!points && num_points > 0)) return AT_ERR_INVALID_ARGUMENT;
+
+    const AT_ResultInfo *info = &file->info;
+    AT_Result res = AT_result_series_alloc(out_series, file, num_points);
+    if (res != AT_OK) return res;
+
+    for (uint32_t i = 0; i < num_points; i++) {
+        const float *p = points[i].arr;
+        const float *o = info->origin.arr;
+        uint32_t coords[3];
+        for (int axis = 0; axis < 3; axis++) {
+            int64_t c = AT_result_grid_coord(p[axis], o[axis], info->voxel_size);
+            //points on the far face belong to the last voxel
+            if (c == (int64_t)info->grid[axis] && p[axis] <= o[axis] + info->grid[axis] * info->voxel_size) c--;
+            if (c < 0 || c >= (int64_t)info->grid[axis]) {
+                AT_result_series_destroy(out_series);
+                return AT_ERR_INVALID_ARGUMENT;
+            }
+            coords[axis] = (uint32_t)c;
+        }
+        out_series->voxels[i] = (coords[2] * info->grid[1] + coords[1]) * info->grid[0] + coords[0];
+    }
+
+    res = AT_result_read_series(out_series, file);
+    if (res != AT_OK) AT_result_series_destroy(out_series);
+    return res;
+}
+
+AT_Result AT_result_query_aabb(AT_ResultSeries *out_series, const AT_ResultFile *file, AT_AABB box)
+{
+    if (!out_series || !file) return AT_ERR_INVALID_ARGUMENT;
+
+    const AT_ResultInfo *info = &file->info;
+    uint32_t lo[3];
+    uint32_t hi[3]; //exclusive
+    uint64_t num_series = 1;
+    for (int axis = 0; axis < 3; axis++) {
+        int64_t first = AT_result_grid_coord(box.min.arr[axis], info->origin.arr[axis], info->voxel_size);
+        int64_t last = AT_result_grid_coord(box.max.arr[axis], info->origin.arr[axis], info->voxel_size);
+        first = AT_max(first, (int64_t)0);
+        last = AT_min(last, (int64_t)info->grid[axis] - 1);
+        lo[axis] = (uint32_t)AT_min(first, (int64_t)info->grid[axis]);
+        hi[axis] = (last >= first) ? (uint32_t)last + 1 : lo[axis];
+        num_series *= hi[axis] - lo[axis];
+    }
+    if (num_series > UINT32_MAX) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_Result res = AT_result_series_alloc(out_series, file, (uint32_t)num_series);
+    if (res != AT_OK) return res;
+
+    uint32_t i = 0;
+    for (uint32_t z = lo[2]; z < hi[2]; z++) {
+        for (uint32_t y = lo[1]; y < hi[1]; y++) {
+            for (uint32_t x = lo[0]; x < hi[0]; x++) {
+                out_series->voxels[i++] = (z * info->grid[1] + y) * info->grid[0] + x;
+            }
+        }
+    }
+
+    res = AT_result_read_series(out_series, file);
+    if (res != AT_OK) AT_result_series_destroy(out_series);
+    return res;
+}
+
+void AT_result_series_destroy(AT_ResultSeries *series)
+{
+    if (!series) return;
+    free(series->voxels);
+    free(series->values);
+    *series = (AT_ResultSeries){0};
+}
+
+void AT_result_close(AT_ResultFile *file)
+{
+    if (!file) return;
+    if (file->data) munmap((void *)file->data, file->size);
+    free(file);
+}
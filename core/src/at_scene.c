@@ -2,13 +2,42 @@
 #include "acoustic/at.h"
 #include "../src/at_internal.h"
 #include "acoustic/at_math.h"
+#include "../src/at_aabb.h"
+#include "../src/at_convex.h"
+#include "../src/at_polygon.h"
+#include "../src/at_scene_cache.h"
+#include "acoustic/at_model.h"
 
+#include <math.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
 
+// Merges the environment into the polygons every run traces and checks
+// whether they close a single convex room, traced against its wall planes
+static AT_Result AT_scene_build_geometry(AT_Scene *scene, const AT_Model *model)
+{
+    uint32_t triangle_count = model->triangles ? (uint32_t)model->triangle_count : (uint32_t)(model->index_count / 3);
+    const AT_Triangle *triangles = model->triangles;
+    AT_Triangle *built = NULL;
+    if (!triangles) {
+        AT_Result res = AT_model_get_triangles(&built, model);
+        if (res != AT_OK) return res;
+        triangles = built;
+    }
+
+    AT_Result res = AT_polygon_set_create(&scene->polygons, triangles, model->triangle_materials, triangle_count);
+    if (res == AT_OK) res = AT_convex_room_create(&scene->convex_room, &scene->polygons, triangles, triangle_count);
+    if (res == AT_OK) res = AT_scene_cache_create(&scene->cache);
+    if (res == AT_OK) printf("Merged %u triangles into %u polygons\n", triangle_count, scene->polygons.num_polygons);
+
+    free(built);
+    return res;
+}
+
 AT_Result AT_scene_create(AT_Scene **out_scene, const AT_SceneConfig* config)
 {
     if (!out_scene || !config) return AT_ERR_INVALID_ARGUMENT;
@@ -24,6 +53,21 @@ AT_Result AT_scene_create(AT_Scene **out_scene, const AT_SceneConfig* config)
 
     AT_model_to_AABB(&scene->world_AABB, config->environment);
 
+    scene->observer_AABB = scene->world_AABB;
+    if (config->observer_area) {
+        //nothing outside the model is ever hit, so clip the area to it
+        AT_AABB *observer = &scene->observer_AABB;
+        for (int axis = 0; axis < 3; axis++) {
+            observer->min.arr[axis] = fmaxf(config->observer_area->min.arr[axis], scene->world_AABB.min.arr[axis]);
+            observer->max.arr[axis] = fminf(config->observer_area->max.arr[axis], scene->world_AABB.max.arr[axis]);
+            if (observer->min.arr[axis] >= observer->max.arr[axis]) {
+                free(scene);
+                return AT_ERR_INVALID_ARGUMENT;
+            }
+        }
+        observer->midpoint = AT_AABB_calc_midpoint(observer);
+    }
+
     scene->sources = malloc(sizeof(AT_Source) * config->num_sources);
     if (!scene->sources) {
         free(scene);
@@ -31,6 +75,26 @@ AT_Result AT_scene_create(AT_Scene **out_scene, const AT_SceneConfig* config)
     }
 
     memcpy(scene->sources, config->sources, sizeof(AT_Source) * config->num_sources);
+
+    //a bounce scales the ray energy by the reflectance of the material hit
+    const AT_Model *model = config->environment;
+    scene->num_materials = model->materials ? model->material_count : AT_MATERIAL_COUNT;
+    scene->reflectance = malloc(sizeof(float) * scene->num_materials);
+    if (!scene->reflectance) {
+        free(scene->sources);
+        free(scene);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    for (uint32_t m = 0; m < scene->num_materials; m++) {
+        const AT_Material *material = model->materials ? &model->materials[m] : &AT_MATERIAL_TABLE[m];
+        scene->reflectance[m] = 1.0f - material->absorption;
+    }
+
+    AT_Result res = AT_scene_build_geometry(scene, config->environment);
+    if (res != AT_OK) {
+        AT_scene_destroy(scene);
+        return res;
+    }
     //for (uint32_t i = 0; i < scene->num_sources; i++) {
       //  scene->sources[i].direction = AT_vec3_normalize(scene->sources[i].direction);
       //}
@@ -42,6 +106,10 @@ AT_Result AT_scene_create(AT_Scene **out_scene, const AT_SceneConfig* config)
 void AT_scene_destroy(AT_Scene *scene)
 {
     if (!scene) return;
+    AT_scene_cache_destroy(scene->cache);
+    AT_convex_room_destroy(&scene->convex_room);
+    AT_polygon_set_destroy(&scene->polygons);
+    free(scene->reflectance);
     free(scene->sources);
     free(scene);
 }
@@ -0,0 +1,98 @@
+#include "../src/at_scene_cache.h"
+#include "../src/at_internal.h"
+#include "../src/at_polygon.h"
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct AT_SceneCacheEntry {
+    float max_error;
+    AT_PolygonSet polygons;
+    AT_SceneCacheEntry *next;
+};
+
+AT_Result AT_scene_cache_create(AT_SceneCache **out_cache)
+{
+    if (!out_cache) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_SceneCache *cache = calloc(1, sizeof(AT_SceneCache));
+    if (!cache) return AT_ERR_ALLOC_ERROR;
+    if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+        free(cache);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    *out_cache = cache;
+    return AT_OK;
+}
+
+static AT_Result AT_scene_cache_build(AT_PolygonSet *out_polygons, const AT_Model *model, float max_error)
+{
+    AT_Model *simplified = NULL;
+    AT_ModelSimplifyStats stats = {0};
+    AT_Result res = AT_model_simplify(&simplified, model, max_error, &stats);
+    if (res != AT_OK) return res;
+
+    AT_Triangle *triangles = NULL;
+    res = AT_model_get_triangles(&triangles, simplified);
+    if (res == AT_OK) {
+        res = AT_polygon_set_create(out_polygons, triangles, simplified->triangle_materials, (uint32_t)stats.triangle_count);
+    }
+    if (res == AT_OK) {
+        printf("Merged %zu simplified triangles into %u polygons\n", stats.triangle_count, out_polygons->num_polygons);
+    }
+
+    free(triangles);
+    AT_model_destroy(simplified);
+    return res;
+}
+
+AT_Result AT_scene_cache_get(const AT_PolygonSet **out_polygons, AT_SceneCache *cache, const AT_Model *model, float max_error)
+{
+    if (!out_polygons || !cache || !model) return AT_ERR_INVALID_ARGUMENT;
+
+    //held while building, so runs asking for the same error wait for one
+    //build instead of each doing their own
+    pthread_mutex_lock(&cache->lock);
+
+    AT_SceneCacheEntry *entry = cache->entries;
+    while (entry && entry->max_error != max_error) entry = entry->next;
+
+    AT_Result res = AT_OK;
+    if (!entry) {
+        entry = calloc(1, sizeof(AT_SceneCacheEntry));
+        res = entry ? AT_scene_cache_build(&entry->polygons, model, max_error) : AT_ERR_ALLOC_ERROR;
+        if (res == AT_OK) {
+            entry->max_error = max_error;
+            entry->next = cache->entries;
+            cache->entries = entry;
+        } else {
+            free(entry);
+            entry = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    if (entry) *out_polygons = &entry->polygons;
+    return res;
+}
+
+void AT_scene_cache_destroy(AT_SceneCache *cache)
+{
+    if (!cache) return;
+
+    AT_SceneCacheEntry *entry = cache->entries;
+    while (entry) {
+        AT_SceneCacheEntry *next = entry->next;
+        AT_polygon_set_destroy(&entry->polygons);
+        free(entry);
+        entry = next;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
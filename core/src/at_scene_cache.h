@@ -0,0 +1,46 @@
+#ifndef AT_SCENE_CACHE_H
+#define AT_SCENE_CACHE_H
+
+#include "acoustic/at.h"
+#include "../src/at_polygon.h"
+
+#include <pthread.h>
+
+typedef struct AT_SceneCacheEntry AT_SceneCacheEntry;
+
+/** \brief Polygons of the simplified environment, per allowed error.
+
+    Sets are built on first use and never changed or freed before the
+    cache, so a simulation keeps the one it got for as long as the scene
+    lives. The lock guards lookups and building, reading a set needs none.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    AT_SceneCacheEntry *entries;
+} AT_SceneCache;
+
+/** \brief Creates an empty cache.
+
+    \param out_cache Pointer to an empty AT_SceneCache pointer.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR if the cache could not be created.
+ */
+AT_Result AT_scene_cache_create(AT_SceneCache **out_cache);
+
+/** \brief Polygons of the model simplified to max_error, built if missing.
+
+    Safe to call from several threads at once, a set is built only once.
+
+    \param out_polygons Receives the shared, read-only set.
+    \param cache Cache of the scene the model belongs to.
+    \param model The scene's environment, with vertices and indices.
+    \param max_error Surface error the simplification allows, in metres.
+
+    \retval AT_Result Errors from AT_model_simplify() and building the set.
+ */
+AT_Result AT_scene_cache_get(const AT_PolygonSet **out_polygons, AT_SceneCache *cache, const AT_Model *model, float max_error);
+
+/** \brief Frees every set of the cache and the cache itself. */
+void AT_scene_cache_destroy(AT_SceneCache *cache);
+
+#endif // AT_SCENE_CACHE_H
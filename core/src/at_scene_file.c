@@ -0,0 +1,188 @@
+#include "acoustic/at_scene_file.h"
+#include "acoustic/at.h"
+#include "acoustic/at_model.h"
+#include "../src/at_internal.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Header fields are native, the byte order field tells a foreign file apart
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t byte_order;
+    uint32_t triangle_size;
+    uint64_t triangle_count;
+    uint64_t triangles_offset;
+    uint64_t materials_offset;
+    uint64_t file_size;
+    float aabb_min[3];
+    float aabb_max[3];
+    uint32_t material_size;
+    uint32_t material_count;
+    uint64_t table_offset;
+} AT_SceneFileHeader;
+
+_Static_assert(sizeof(AT_SceneFileHeader) <= AT_SCENE_FILE_HEADER_SIZE, "scene file header does not fit");
+
+static inline uint64_t AT_scene_file_align(uint64_t offset)
+{
+    return (offset + AT_SCENE_FILE_ALIGNMENT - 1) & ~(uint64_t)(AT_SCENE_FILE_ALIGNMENT - 1);
+}
+
+// Zero padding up to offset
+static bool AT_scene_file_pad(FILE *file, uint64_t *position, uint64_t offset)
+{
+    static const uint8_t zeros[256] = {0};
+    while (*position < offset) {
+        size_t n = (size_t)((offset - *position < sizeof(zeros)) ? offset - *position : sizeof(zeros));
+        if (fwrite(zeros, 1, n, file) != n) return false;
+        *position += n;
+    }
+    return true;
+}
+
+AT_Result AT_scene_file_write(const AT_Model *model, const char *path)
+{
+    if (!model || !path) return AT_ERR_INVALID_ARGUMENT;
+
+    //compiled models already hold their triangles
+    const AT_Triangle *triangles = model->triangles;
+    AT_Triangle *built = NULL;
+    uint64_t triangle_count = model->triangles ? model->triangle_count : model->index_count / 3;
+    if (!triangles) {
+        AT_Result res = AT_model_get_triangles(&built, model);
+        if (res != AT_OK) return res;
+        triangles = built;
+    }
+
+    AT_AABB aabb;
+    AT_model_to_AABB(&aabb, model);
+
+    //hand-built models use the built-in table
+    const AT_Material *table = model->materials ? model->materials : AT_MATERIAL_TABLE;
+    uint32_t material_count = model->materials ? model->material_count : AT_MATERIAL_COUNT;
+
+    AT_SceneFileHeader header = {
+        .magic = AT_SCENE_FILE_MAGIC,
+        .version = AT_SCENE_FILE_VERSION,
+        .byte_order = AT_SCENE_FILE_BYTE_ORDER,
+        .triangle_size = sizeof(AT_Triangle),
+        .triangle_count = triangle_count,
+        .aabb_min = {aabb.min.x, aabb.min.y, aabb.min.z},
+        .aabb_max = {aabb.max.x, aabb.max.y, aabb.max.z},
+        .material_size = sizeof(AT_Material),
+        .material_count = material_count,
+    };
+    header.triangles_offset = AT_scene_file_align(AT_SCENE_FILE_HEADER_SIZE);
+    header.materials_offset = AT_scene_file_align(header.triangles_offset + triangle_count * sizeof(AT_Triangle));
+    header.table_offset = AT_scene_file_align(header.materials_offset + triangle_count * sizeof(AT_MaterialId));
+    header.file_size = header.table_offset + material_count * sizeof(AT_Material);
+
+    uint8_t header_bytes[AT_SCENE_FILE_HEADER_SIZE] = {0};
+    memcpy(header_bytes, &header, sizeof(header));
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        free(built);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    uint64_t position = 0;
+    bool is_failed = fwrite(header_bytes, 1, sizeof(header_bytes), file) != sizeof(header_bytes);
+    position += sizeof(header_bytes);
+
+    is_failed = is_failed || !AT_scene_file_pad(file, &position, header.triangles_offset);
+    is_failed = is_failed || fwrite(triangles, sizeof(AT_Triangle), triangle_count, file) != triangle_count;
+    position += triangle_count * sizeof(AT_Triangle);
+
+    is_failed = is_failed || !AT_scene_file_pad(file, &position, header.materials_offset);
+    is_failed = is_failed || fwrite(model->triangle_materials, sizeof(AT_MaterialId), triangle_count, file) != triangle_count;
+    position += triangle_count * sizeof(AT_MaterialId);
+
+    is_failed = is_failed || !AT_scene_file_pad(file, &position, header.table_offset);
+    is_failed = is_failed || fwrite(table, sizeof(AT_Material), material_count, file) != material_count;
+
+    if (fclose(file) != 0) is_failed = true;
+    free(built);
+    return is_failed ? AT_ERR_IO_FAILURE : AT_OK;
+}
+
+AT_Result AT_scene_file_open(AT_Model **out_model, const char *path)
+{
+    if (!out_model || *out_model || !path) return AT_ERR_INVALID_ARGUMENT;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return AT_ERR_IO_FAILURE;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return AT_ERR_IO_FAILURE;
+    }
+    if (st.st_size < AT_SCENE_FILE_HEADER_SIZE) {
+        close(fd);
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return AT_ERR_IO_FAILURE;
+
+    AT_SceneFileHeader header;
+    memcpy(&header, mapping, sizeof(header));
+
+    //every section must be whole, aligned and inside the file
+    uint64_t max_count = size / sizeof(AT_Triangle);
+    bool is_valid = memcmp(header.magic, AT_SCENE_FILE_MAGIC, 4) == 0 &&
+                    header.version == AT_SCENE_FILE_VERSION &&
+                    header.byte_order == AT_SCENE_FILE_BYTE_ORDER &&
+                    header.triangle_size == sizeof(AT_Triangle) &&
+                    header.triangle_count > 0 && header.triangle_count <= max_count &&
+                    header.file_size == size &&
+                    header.triangles_offset % AT_SCENE_FILE_ALIGNMENT == 0 &&
+                    header.materials_offset % AT_SCENE_FILE_ALIGNMENT == 0 &&
+                    header.table_offset % AT_SCENE_FILE_ALIGNMENT == 0 &&
+                    header.material_size == sizeof(AT_Material) &&
+                    header.material_count >= AT_MATERIAL_COUNT && header.material_count <= AT_MATERIAL_MAX_COUNT &&
+                    header.triangles_offset >= AT_SCENE_FILE_HEADER_SIZE &&
+                    header.triangles_offset <= size && header.materials_offset <= size && header.table_offset <= size &&
+                    header.triangles_offset + header.triangle_count * sizeof(AT_Triangle) <= header.materials_offset &&
+                    header.materials_offset + header.triangle_count * sizeof(AT_MaterialId) <= header.table_offset &&
+                    header.table_offset + (uint64_t)header.material_count * sizeof(AT_Material) <= size;
+
+    const uint8_t *data = mapping;
+    const AT_MaterialId *materials = is_valid ? (const AT_MaterialId*)(data + header.materials_offset) : NULL;
+    for (uint64_t i = 0; is_valid && i < header.triangle_count; i++) {
+        is_valid = materials[i] < header.material_count;
+    }
+
+    AT_Model *model = is_valid ? calloc(1, sizeof(AT_Model)) : NULL;
+    if (!model) {
+        munmap(mapping, size);
+        return is_valid ? AT_ERR_ALLOC_ERROR : AT_ERR_INVALID_ARGUMENT;
+    }
+
+    model->triangles = (const AT_Triangle*)(data + header.triangles_offset);
+    model->triangle_count = (size_t)header.triangle_count;
+    //read-only mapping, nothing writes materials after loading
+    model->triangle_materials = (AT_MaterialId*)materials;
+    model->materials = (AT_Material*)(data + header.table_offset);
+    model->material_count = header.material_count;
+    model->aabb.min = AT_vec3(header.aabb_min[0], header.aabb_min[1], header.aabb_min[2]);
+    model->aabb.max = AT_vec3(header.aabb_max[0], header.aabb_max[1], header.aabb_max[2]);
+    model->mapping = mapping;
+    model->mapping_size = size;
+
+    *out_model = model;
+    return AT_OK;
+}
@@ -0,0 +1,124 @@
+#ifndef AT_SIMD_H
+#define AT_SIMD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Portable SIMD through GCC/Clang vector extensions. The compiler lowers
+// these to whatever the target has (SSE, AVX, NEON), or to scalar code.
+// Lanes of 32 bits; 8 when the target has 256 bit registers, 4 otherwise.
+#ifndef AT_SIMD_WIDTH
+#if defined(__AVX__)
+#define AT_SIMD_WIDTH 8
+#else
+#define AT_SIMD_WIDTH 4
+#endif
+#endif
+
+typedef float AT_SimdFloat __attribute__((vector_size(AT_SIMD_WIDTH * sizeof(float))));
+typedef int32_t AT_SimdInt __attribute__((vector_size(AT_SIMD_WIDTH * sizeof(int32_t))));
+typedef uint16_t AT_SimdU16 __attribute__((vector_size(AT_SIMD_WIDTH * sizeof(uint16_t))));
+
+// Comparisons produce AT_SimdInt masks, each lane all ones (true) or zero.
+
+static inline AT_SimdFloat AT_simd_splat_f(float value)
+{
+    return (AT_SimdFloat){0} + value;
+}
+
+static inline AT_SimdInt AT_simd_splat_i(int32_t value)
+{
+    return (AT_SimdInt){0} + value;
+}
+
+static inline AT_SimdFloat AT_simd_select_f(AT_SimdInt mask, AT_SimdFloat a, AT_SimdFloat b)
+{
+    return (AT_SimdFloat)(((AT_SimdInt)a & mask) | ((AT_SimdInt)b & ~mask));
+}
+
+static inline AT_SimdInt AT_simd_select_i(AT_SimdInt mask, AT_SimdInt a, AT_SimdInt b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+static inline AT_SimdFloat AT_simd_min_f(AT_SimdFloat a, AT_SimdFloat b)
+{
+    return AT_simd_select_f(a < b, a, b);
+}
+
+static inline AT_SimdFloat AT_simd_max_f(AT_SimdFloat a, AT_SimdFloat b)
+{
+    return AT_simd_select_f(a > b, a, b);
+}
+
+// Truncates towards zero, like a (int) cast
+static inline AT_SimdInt AT_simd_to_int(AT_SimdFloat v)
+{
+    return __builtin_convertvector(v, AT_SimdInt);
+}
+
+static inline bool AT_simd_any(AT_SimdInt mask)
+{
+    int32_t bits = 0;
+    for (int i = 0; i < AT_SIMD_WIDTH; i++) bits |= mask[i];
+    return bits != 0;
+}
+
+// Writes round(src[i] * inv_scale), clamped to [0, 65535], in host byte order
+static inline void AT_simd_quantise_u16(uint16_t *dst, const float *src, uint32_t n, float inv_scale)
+{
+    const AT_SimdFloat scale = AT_simd_splat_f(inv_scale);
+    const AT_SimdFloat lo = AT_simd_splat_f(0.0f);
+    const AT_SimdFloat hi = AT_simd_splat_f(65535.0f);
+
+    uint32_t i = 0;
+    for (; i + AT_SIMD_WIDTH <= n; i += AT_SIMD_WIDTH) {
+        AT_SimdFloat v;
+        memcpy(&v, src + i, sizeof(v));
+        v = AT_simd_min_f(AT_simd_max_f(v * scale + 0.5f, lo), hi);
+
+        AT_SimdU16 q = __builtin_convertvector(AT_simd_to_int(v), AT_SimdU16);
+        memcpy(dst + i, &q, sizeof(q));
+    }
+    for (; i < n; i++) {
+        float v = src[i] * inv_scale + 0.5f;
+        v = (v < 0.0f) ? 0.0f : (v > 65535.0f) ? 65535.0f : v;
+        dst[i] = (uint16_t)(int32_t)v;
+    }
+}
+
+// log2 of positive normal floats, within 2e-5 of the exact value. The
+// mantissa m in [1, 2) goes through the atanh series of y = (m-1)/(m+1).
+static inline AT_SimdFloat AT_simd_log2_f(AT_SimdFloat x)
+{
+    AT_SimdInt bits = (AT_SimdInt)x;
+    AT_SimdInt exponent = ((bits >> 23) & 0xff) - 127;
+    AT_SimdFloat m = (AT_SimdFloat)((bits & 0x007fffff) | 0x3f800000);
+
+    AT_SimdFloat y = (m - 1.0f) / (m + 1.0f);
+    AT_SimdFloat y2 = y * y;
+    AT_SimdFloat series = y * (1.0f + y2 * (1.0f / 3.0f + y2 * (1.0f / 5.0f + y2 * (1.0f / 7.0f))));
+    return __builtin_convertvector(exponent, AT_SimdFloat) + series * 2.8853900817779268f; //2 / ln 2
+}
+
+// Writes 10 log10(src[i] * inv_ref), the level of each value in dB
+static inline void AT_simd_decibels(float *dst, const float *src, uint32_t n, float inv_ref)
+{
+    const float db_per_octave = 3.0102999566398120f; //10 log10(2)
+    const AT_SimdFloat scale = AT_simd_splat_f(inv_ref);
+
+    uint32_t i = 0;
+    for (; i + AT_SIMD_WIDTH <= n; i += AT_SIMD_WIDTH) {
+        AT_SimdFloat v;
+        memcpy(&v, src + i, sizeof(v));
+        v = AT_simd_log2_f(v * scale) * db_per_octave;
+        memcpy(dst + i, &v, sizeof(v));
+    }
+    for (; i < n; i++) {
+        AT_SimdFloat v = AT_simd_splat_f(src[i] * inv_ref);
+        dst[i] = AT_simd_log2_f(v)[0] * db_per_octave;
+    }
+}
+
+#endif // AT_SIMD_H
@@ -4,11 +4,17 @@
 #include "acoustic/at_model.h"
 #include "acoustic/at_scene.h"
 #include "../src/at_voxel.h"
+#include "../src/at_convex.h"
+#include "../src/at_deposit.h"
+#include "../src/at_polygon.h"
+#include "../src/at_thread.h"
 #include "at_internal.h"
 #include "at_ray.h"
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
 
@@ -29,8 +35,8 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation, const AT_Scene *s
 
     simulation->scene = scene;
 
-    // World dimensions
-    AT_Vec3 dimensions = AT_vec3_sub(scene->world_AABB.max, scene->world_AABB.min);
+    // Grid dimensions, only the observer area is voxelised
+    AT_Vec3 dimensions = AT_vec3_sub(scene->observer_AABB.max, scene->observer_AABB.min);
 
     // Grid dimensions (num voxels in each dimension)
     float grid_x = ceilf(dimensions.x / settings->voxel_size);
@@ -38,7 +44,15 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation, const AT_Scene *s
     float grid_z = ceilf(dimensions.z / settings->voxel_size);
     uint32_t num_voxels = (uint32_t)(grid_x * grid_y * grid_z);
 
-    simulation->voxel_grid = calloc(num_voxels, sizeof(AT_Voxel));
+    // Bricked layouts pad every axis up to a whole brick
+    uint32_t bricks_x = ((uint32_t)grid_x + AT_VOXEL_BRICK_SIZE - 1) >> AT_VOXEL_BRICK_SHIFT;
+    uint32_t bricks_y = ((uint32_t)grid_y + AT_VOXEL_BRICK_SIZE - 1) >> AT_VOXEL_BRICK_SHIFT;
+    uint32_t bricks_z = ((uint32_t)grid_z + AT_VOXEL_BRICK_SIZE - 1) >> AT_VOXEL_BRICK_SHIFT;
+    uint32_t num_voxel_slots = (settings->voxel_layout == AT_VOXEL_LAYOUT_TILED) ?
+        bricks_x * bricks_y * bricks_z * AT_VOXEL_BRICK_VOXELS :
+        num_voxels;
+
+    simulation->voxel_grid = calloc(num_voxel_slots, sizeof(AT_Voxel));
     if (!simulation->voxel_grid) {
         free(simulation->rays);
         free(simulation);
@@ -46,18 +60,41 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation, const AT_Scene *s
     }
 
     // Initialize each voxels bin dynamic array (we dont know the num bins yet)
-    for (uint32_t i = 0; i < num_voxels; i++) {
+    for (uint32_t i = 0; i < num_voxel_slots; i++) {
         AT_voxel_init(&simulation->voxel_grid[i]);
     }
 
-    simulation->origin = scene->world_AABB.min;
+    simulation->origin = scene->observer_AABB.min;
     simulation->dimensions = dimensions;
     simulation->fps = settings->fps;
     simulation->num_rays = settings->num_rays;
     simulation->num_voxels = num_voxels;
+    simulation->num_voxel_slots = num_voxel_slots;
+    simulation->bricks_x = bricks_x;
+    simulation->bricks_y = bricks_y;
+    simulation->voxel_layout = settings->voxel_layout;
     simulation->grid_dimensions = (AT_Vec3){{grid_x, grid_y, grid_z}}; //dimensions in terms of voxels
     simulation->voxel_size = settings->voxel_size;
+
+    // Segments are clipped to the grid before stepping. Faces the grid
+    // shares with the model get some slack, since hit points on a wall
+    // can round to just outside it.
+    for (int axis = 0; axis < 3; axis++) {
+        float grid_max = scene->observer_AABB.min.arr[axis] + simulation->grid_dimensions.arr[axis] * settings->voxel_size;
+        bool is_min_wall = scene->observer_AABB.min.arr[axis] <= scene->world_AABB.min.arr[axis];
+        bool is_max_wall = grid_max >= scene->world_AABB.max.arr[axis];
+
+        simulation->clip_min.arr[axis] = is_min_wall ? -AT_VOXEL_CLIP_EPSILON : 0.0f;
+        simulation->clip_max.arr[axis] = simulation->grid_dimensions.arr[axis] +
+            (is_max_wall ? AT_VOXEL_CLIP_EPSILON : 0.0f);
+    }
     simulation->bin_width = 1.0f / settings->fps;
+    simulation->num_threads = settings->num_threads ?
+        settings->num_threads :
+        AT_thread_default_count();
+    simulation->deposit_strategy = settings->deposit_strategy;
+    simulation->is_compensated = settings->is_compensated;
+    simulation->is_simplified = settings->is_simplified;
 
     *out_simulation = simulation;
 
@@ -68,19 +105,230 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation, const AT_Scene *s
 #define MIN_RAY_ENERGY_THRESHOLD 0.001f
 #define SOURCE_ENERGY 1.0f //this can be the power of the sound source defined by the user
 
-AT_Result AT_simulation_run(AT_Simulation *simulation)
+// What a ray is bounced off, shared by every ray of the run
+typedef struct {
+    const AT_ConvexRoom *room; //NULL unless the room is left through its wall planes
+    const AT_PolygonSet *polygons;
+    const float *reflectance;
+    uint32_t num_rays;
+} AT_Tracer;
+
+typedef struct {
+    const AT_Simulation *simulation;
+    AT_Deposit *deposit;
+    float max_segment_length;
+    float horizon; //only segments starting before this distance are deposited
+    const AT_Tracer *tracer; //when streaming, bounces each ray as it is walked
+    AT_Ray **cursors; //next segment of each ray when streaming, NULL once it is done
+    uint32_t *last_hits; //per ray when streaming, what its last segment was reflected off
+    float *fronts; //per worker when streaming, distance of the nearest segment it left
+    float *reaches; //per worker when streaming, furthest end of the rays it finished
+    uint32_t num_children; //bounces traced while streaming
+    uint32_t total_rays;
+    uint32_t next_ray; //shared work counter, claimed in deposit blocks
+    uint32_t voxel_first_bin; //bin each voxel's first item holds
+    uint32_t end_bin; //one past the last bin deposited into the voxel grid
+    AT_Result result;
+} AT_DDAJob;
+
+typedef struct {
+    AT_Simulation *simulation;
+    float *values; //[(frame - first_frame) * num_voxels + voxel], row-major voxels
+    uint32_t first_frame;
+    uint32_t num_frames;
+    uint32_t voxel_first_bin; //bin each voxel's first item holds
+    uint32_t release_frame; //frames before this one are dropped from the voxels
+    uint32_t num_workers;
+} AT_FrameGatherJob;
+
+typedef struct {
+    AT_Simulation *simulation;
+    AT_VoxelBins *bins;
+    uint32_t num_workers;
+} AT_CompactJob;
+
+// Appends the next bounce to a ray without a child, leaving it childless
+// once it is too weak or leaves the model. last_hit_idx holds the polygon
+// or plane the ray was reflected off, UINT32_MAX for none.
+static AT_Result AT_simulation_bounce(const AT_Tracer *tracer, AT_Ray *ray, uint32_t *last_hit_idx)
 {
-    if (!simulation) return AT_ERR_INVALID_ARGUMENT;
+    if (ray->energy <= MIN_RAY_ENERGY_THRESHOLD) return AT_OK;
+
+    AT_Ray closest = AT_ray_init((AT_Vec3){{FLT_MAX, FLT_MAX, FLT_MAX}},
+        (AT_Vec3){0},
+        ray->total_distance,
+        ray->energy,
+        ray->ray_id);
+    bool intersects = false;
+    uint32_t hit_idx = 0;
+    AT_MaterialId material = 0;
+    //a reflected ray starts on the plane or polygon it left, rounding
+    //can hit that again just past the epsilon, more so on large ones
+    if (tracer->room) {
+        float t = 0.0f;
+        hit_idx = AT_convex_room_exit(tracer->room, ray->origin, ray->direction, *last_hit_idx, &t);
+        intersects = hit_idx != AT_CONVEX_NO_PLANE;
+        if (intersects) {
+            closest.origin = AT_ray_at(ray, t);
+            closest.direction = AT_ray_reflect(ray->direction, tracer->room->planes[hit_idx].normal);
+            material = tracer->room->planes[hit_idx].material;
+        }
+    } else {
+        const AT_PolygonSet *polygons = tracer->polygons;
+        for (uint32_t p = 0; p < polygons->num_polygons; p++) {
+            if (p == *last_hit_idx) continue;
+            //any hit counts, only a nearer one moves closest
+            AT_RayHit hit = AT_ray_polygon_intersect(ray, polygons, p, &closest);
+            intersects = intersects || hit != AT_RAY_MISS;
+            if (hit == AT_RAY_HIT_NEARER) hit_idx = p;
+        }
+        if (intersects) material = polygons->polygons[hit_idx].material;
+    }
+    *last_hit_idx = hit_idx;
+    if (!intersects) return AT_OK;
+
+    AT_Ray *child = (AT_Ray*)malloc(sizeof(AT_Ray));
+    if (!child) return AT_ERR_ALLOC_ERROR;
+    *child = closest;
+    child->child = NULL;
+    child->ray_id = ray->ray_id + tracer->num_rays;
+    AT_Vec3 hit_point = closest.origin;
+    child->total_distance = ray->total_distance +
+        AT_vec3_distance(ray->origin, hit_point);
+    child->energy = ray->energy * tracer->reflectance[material];
+    ray->child = child;
+    return AT_OK;
+}
 
-    uint32_t triangle_count = simulation->scene->environment->index_count / 3;
-    AT_Triangle *triangles = NULL;
-    if (AT_model_get_triangles(&triangles, simulation->scene->environment) != AT_OK) {
-        return AT_ERR_ALLOC_ERROR;
+static AT_Result AT_simulation_dda_ray(AT_DDAJob *job, AT_VoxelBatch *batch, AT_DepositLane *lane, uint32_t ray_idx, float *reach)
+{
+    AT_Ray *ray = job->cursors ? job->cursors[ray_idx] : &job->simulation->rays[ray_idx];
+    while (ray && ray->total_distance < job->horizon) {
+        //a streamed ray is traced only as far as the segment it deposits
+        if (job->tracer) {
+            AT_Result res = AT_simulation_bounce(job->tracer, ray, &job->last_hits[ray_idx]);
+            if (res != AT_OK) return res;
+            if (ray->child) __atomic_fetch_add(&job->num_children, 1, __ATOMIC_RELAXED);
+        }
+
+        //if the ray has a child, use its origin as the end
+        //otherwise set the end as the direction scaled by the maximum distance in the scene
+        AT_Vec3 ray_end = ray->child ?
+            ray->child->origin :
+            AT_vec3_add(ray->origin, AT_vec3_scale(ray->direction, job->max_segment_length));
+        if (!ray->child) *reach = fmaxf(*reach, ray->total_distance + job->max_segment_length);
+
+        AT_Result res = AT_voxel_batch_add(batch, lane, ray, ray_end);
+        if (res != AT_OK) return res;
+        ray = ray->child;
+    }
+    if (job->cursors) job->cursors[ray_idx] = ray;
+    return AT_OK;
+}
+
+static void AT_simulation_dda_worker(void *ctx, uint32_t thread_idx)
+{
+    AT_DDAJob *job = ctx;
+    AT_DepositLane *lane = &job->deposit->lanes[thread_idx];
+    float front = INFINITY;
+    float reach = 0.0f;
+
+    //segments are traversed AT_SIMD_WIDTH at a time
+    AT_VoxelBatch batch;
+    AT_voxel_batch_init(&batch, job->simulation);
+
+    //chunks line up with the deterministic deposit blocks, so a block is
+    //always deposited by one lane in ray order
+    for (;;) {
+        uint32_t first = __atomic_fetch_add(&job->next_ray, AT_DEPOSIT_BLOCK_RAYS, __ATOMIC_RELAXED);
+        if (first >= job->total_rays) break;
+        uint32_t last = AT_min(first + AT_DEPOSIT_BLOCK_RAYS, job->total_rays);
+
+        AT_Result res = AT_OK;
+        for (uint32_t i = first; i < last && res == AT_OK; i++) {
+            res = AT_simulation_dda_ray(job, &batch, lane, i, &reach);
+            if (job->cursors && job->cursors[i]) front = fminf(front, job->cursors[i]->total_distance);
+        }
+        //the block has to be complete before it is closed
+        if (res == AT_OK) res = AT_voxel_batch_flush(&batch, lane);
+        batch.count = 0;
+
+        if (res == AT_OK) res = AT_deposit_block_end(job->deposit, lane, first / AT_DEPOSIT_BLOCK_RAYS);
+        if (res != AT_OK) {
+            //lanes waiting for this block to be folded give up too
+            AT_deposit_abort(job->deposit, res);
+            __atomic_store_n(&job->result, res, __ATOMIC_RELAXED);
+            break;
+        }
     }
+    if (job->fronts) job->fronts[thread_idx] = front;
+    if (job->reaches) job->reaches[thread_idx] = reach;
+}
 
-    uint32_t num_children = 0;
+// Time bins needed to hold deposits up to max_distance from their source
+static uint32_t AT_simulation_bins_to(const AT_Simulation *simulation, float max_distance)
+{
+    return (uint32_t)(max_distance / SPEED_OF_SOUND / simulation->bin_width) + 2;
+}
+
+// The furthest any deposit can be from its source is the end of the last
+// segment of some ray, which bounds the number of time bins
+static uint32_t AT_simulation_count_bins(const AT_Simulation *simulation, uint32_t total_rays, float max_segment_length)
+{
+    float max_distance = 0.0f;
+    for (uint32_t i = 0; i < total_rays; i++) {
+        const AT_Ray *ray = &simulation->rays[i];
+        while (ray->child) ray = ray->child;
+        max_distance = fmaxf(max_distance, ray->total_distance + max_segment_length);
+    }
+    return AT_simulation_bins_to(simulation, max_distance);
+}
+
+// The scene's polygons, or those of its simplified environment when the
+// run asks for it, shared with every other run of the scene
+static AT_Result AT_simulation_polygons(const AT_PolygonSet **out_polygons, const AT_Simulation *simulation)
+{
+    //compiled scenes are traced straight from their mapping, and have no
+    //connectivity left to simplify
+    const AT_Scene *scene = simulation->scene;
+    if (simulation->is_simplified && !scene->environment->triangles) {
+        float max_error = simulation->voxel_size * AT_SIMULATION_SIMPLIFY_VOXEL_FRACTION;
+        return AT_scene_cache_get(out_polygons, scene->cache, scene->environment, max_error);
+    }
+    *out_polygons = &scene->polygons;
+    return AT_OK;
+}
+
+// Picks what the rays are bounced off
+static AT_Result AT_simulation_tracer(AT_Tracer *out_tracer, const AT_Simulation *simulation)
+{
+    //a convex room with every source inside is left through the nearest
+    //wall plane ahead, no polygon search needed
+    const AT_ConvexRoom *room = &simulation->scene->convex_room;
+    bool is_convex = room->num_planes > 0;
+    for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
+        is_convex = is_convex && AT_convex_room_contains(room, simulation->scene->sources[s].position);
+    }
 
-    //initialize and trace rays at every source
+    *out_tracer = (AT_Tracer){
+        .room = is_convex ? room : NULL,
+        .polygons = &simulation->scene->polygons,
+        .reflectance = simulation->scene->reflectance,
+        .num_rays = simulation->num_rays,
+    };
+    if (is_convex) {
+        printf("Tracing convex room with %u planes\n", room->num_planes);
+    } else {
+        AT_Result res = AT_simulation_polygons(&out_tracer->polygons, simulation);
+        if (res != AT_OK) return res;
+        printf("Tracing %u polygons\n", out_tracer->polygons->num_polygons);
+    }
+    return AT_OK;
+}
+
+// Starts every ray at its source
+static void AT_simulation_init_rays(AT_Simulation *simulation)
+{
     for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
         //init rays for this source
         for (uint32_t r = 0; r < simulation->num_rays; r++) {
@@ -102,84 +350,366 @@ AT_Result AT_simulation_run(AT_Simulation *simulation)
             );
         }
     }
+}
 
-    //trace rays for this source
-    uint32_t total_rays = simulation->scene->num_sources * simulation->num_rays;
+// Builds the child chain of every ray, one bounce per child
+static AT_Result AT_simulation_trace(AT_Simulation *simulation, uint32_t total_rays)
+{
+    AT_Tracer tracer;
+    AT_Result res = AT_simulation_tracer(&tracer, simulation);
+    if (res != AT_OK) return res;
+
+    AT_simulation_init_rays(simulation);
+
+    uint32_t num_children = 0;
     for (uint32_t i = 0; i < total_rays; i++) {
-        AT_Ray *ray = &simulation->rays[i];
-        while (ray->energy > MIN_RAY_ENERGY_THRESHOLD) {
-            AT_Ray closest = AT_ray_init((AT_Vec3){{FLT_MAX, FLT_MAX, FLT_MAX}},
-                (AT_Vec3){0},
-                ray->total_distance,
-                ray->energy,
-                i);
-            bool intersects = false;
-            uint32_t tri_idx = 0;
-            for (uint32_t t = 0; t < triangle_count; t++) {
-                if (AT_ray_triangle_intersect(ray, &triangles[t], &closest)) {
-                    intersects = true;
-                    tri_idx = t;
-                }
-            }
-            if (!intersects) break;
-
-            AT_Ray *child = (AT_Ray*)malloc(sizeof(AT_Ray));
-            if (!child) return AT_ERR_ALLOC_ERROR;
-            *child = closest;
-            child->child = NULL;
-            child->ray_id = ray->ray_id + simulation->num_rays;
-            AT_Vec3 hit_point = closest.origin;
-            child->total_distance = ray->total_distance +
-                AT_vec3_distance(ray->origin, hit_point);
-            child->energy = ray->energy * (1.0f - AT_MATERIAL_TABLE[simulation->scene->environment->triangle_materials[tri_idx]].absorption);
-            ray->child = child;
-            ray = ray->child;
-            num_children++;
+        uint32_t last_hit_idx = UINT32_MAX;
+        for (AT_Ray *ray = &simulation->rays[i]; ray; ray = ray->child) {
+            res = AT_simulation_bounce(&tracer, ray, &last_hit_idx);
+            if (res != AT_OK) return res;
+            if (ray->child) num_children++;
         }
     }
 
     printf("Number of child rays: %i\n", num_children);
 
+    return AT_OK;
+}
+
+// Runs the DDA over the segments the job lets through, depositing into
+// bins [first_bin, first_bin + num_bins) and adding them to the voxel grid
+static AT_Result AT_simulation_deposit(AT_Simulation *simulation, AT_DDAJob *job, uint32_t first_bin, uint32_t num_bins)
+{
+    AT_Deposit deposit = {0};
+    AT_Result res = AT_deposit_create(&deposit,
+                                      simulation->deposit_strategy,
+                                      simulation->num_voxel_slots,
+                                      first_bin,
+                                      num_bins,
+                                      simulation->num_threads,
+                                      job->total_rays,
+                                      simulation->is_compensated);
+    if (res != AT_OK) return res;
+
+    job->deposit = &deposit;
+    job->next_ray = 0;
+    job->result = AT_OK;
+
+    res = AT_thread_run(simulation->num_threads, AT_simulation_dda_worker, job);
+    if (res == AT_OK) res = job->result;
+    if (res == AT_OK) {
+        res = AT_deposit_finish(&deposit, simulation->voxel_grid, job->voxel_first_bin);
+        job->end_bin = AT_max(job->end_bin, deposit.end_bin);
+    }
+
+    AT_deposit_destroy(&deposit);
+    job->deposit = NULL;
+    return res;
+}
+
+static AT_DDAJob AT_simulation_dda_job(const AT_Simulation *simulation)
+{
+    return (AT_DDAJob){
+        .simulation = simulation,
+        .max_segment_length = AT_vec3_distance(
+            simulation->scene->world_AABB.min,
+            simulation->scene->world_AABB.max
+        ),
+        .horizon = INFINITY,
+        .total_rays = simulation->scene->num_sources * simulation->num_rays,
+        .next_ray = 0,
+        .result = AT_OK,
+    };
+}
+
+AT_Result AT_simulation_run(AT_Simulation *simulation)
+{
+    if (!simulation || !simulation->voxel_grid) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_DDAJob job = AT_simulation_dda_job(simulation);
+    AT_Result res = AT_simulation_trace(simulation, job.total_rays);
+    if (res != AT_OK) return res;
+
     //DDA
+    simulation->num_bins = AT_simulation_count_bins(simulation, job.total_rays, job.max_segment_length);
+    return AT_simulation_deposit(simulation, &job, 0, simulation->num_bins);
+}
 
-    for (uint32_t i = 0; i < total_rays; i++) {
-        AT_Ray *ray = &simulation->rays[i];
-
-        while (ray) {
-            //if the ray has a child, use its origin as the end
-            //otherwise set the end as the direction scaled by the maximum distance in the scene
-            AT_Vec3 ray_end = ray->child ?
-                ray->child->origin :
-                    AT_vec3_add(
-                      ray->origin,
-                      AT_vec3_scale(
-                          ray->direction,
-                          AT_vec3_distance(
-                              simulation->scene->world_AABB.min,
-                              simulation->scene->world_AABB.max
-                          )
-                      )
-                  );
-
-            AT_voxel_ray_step(simulation, ray, ray_end);
-            ray = ray->child;
+static void AT_simulation_gather_worker(void *ctx, uint32_t worker)
+{
+    AT_FrameGatherJob *job = ctx;
+    const AT_Simulation *simulation = job->simulation;
+    uint64_t num_voxels = simulation->num_voxels;
+    uint32_t first = (uint32_t)(num_voxels * worker / job->num_workers);
+    uint32_t last = (uint32_t)(num_voxels * (worker + 1) / job->num_workers);
+
+    for (uint32_t v = first; v < last; v++) {
+        const AT_Voxel *voxel = &simulation->voxel_grid[AT_voxel_index_from_linear(simulation, v)];
+        for (uint32_t f = 0; f < job->num_frames; f++) {
+            uint32_t item = job->first_frame + f - job->voxel_first_bin;
+            job->values[(size_t)f * num_voxels + v] = (item < voxel->count) ? voxel->items[item] : 0.0f;
+        }
+    }
+}
+
+// Drops the bins before job->release_frame from the front of every voxel,
+// freeing the voxels left empty
+static void AT_simulation_release_worker(void *ctx, uint32_t worker)
+{
+    AT_FrameGatherJob *job = ctx;
+    AT_Simulation *simulation = job->simulation;
+    uint64_t num_slots = simulation->num_voxel_slots;
+    uint32_t first = (uint32_t)(num_slots * worker / job->num_workers);
+    uint32_t last = (uint32_t)(num_slots * (worker + 1) / job->num_workers);
+    size_t num_dropped = job->release_frame - job->voxel_first_bin;
+
+    for (uint32_t v = first; v < last; v++) {
+        AT_Voxel *voxel = &simulation->voxel_grid[v];
+        if (voxel->count <= num_dropped) {
+            AT_da_free(voxel);
+            continue;
+        }
+        voxel->count -= num_dropped;
+        memmove(voxel->items, voxel->items + num_dropped, voxel->count * sizeof(float));
+    }
+}
+
+// Hands frames [first_frame, last_frame) to the sink, gathering up to
+// job->num_frames of them at a time
+static AT_Result AT_simulation_emit_frames(const AT_FrameStream *stream, AT_FrameGatherJob *job,
+                                           uint32_t capacity, uint32_t first_frame, uint32_t last_frame)
+{
+    const uint32_t num_voxels = job->simulation->num_voxels;
+    for (uint32_t frame = first_frame; frame < last_frame; frame += capacity) {
+        job->first_frame = frame;
+        job->num_frames = AT_min(capacity, last_frame - frame);
+        AT_Result res = AT_thread_run(job->num_workers, AT_simulation_gather_worker, job);
+        if (res != AT_OK) return res;
+
+        for (uint32_t f = 0; f < job->num_frames; f++) {
+            res = stream->sink(stream->ctx, frame + f, job->values + (size_t)f * num_voxels, num_voxels);
+            if (res != AT_OK) return res;
         }
     }
-    free(triangles);
     return AT_OK;
 }
 
+AT_Result AT_simulation_run_streamed(AT_Simulation *simulation, const AT_FrameStream *stream)
+{
+    if (!simulation || !simulation->voxel_grid || !stream || !stream->sink) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_DDAJob job = AT_simulation_dda_job(simulation);
+    AT_Tracer tracer;
+    AT_Result res = AT_simulation_tracer(&tracer, simulation);
+    if (res != AT_OK) return res;
+
+    AT_simulation_init_rays(simulation);
+    job.tracer = &tracer;
+
+    uint32_t epoch_frames = stream->frames_per_epoch ? stream->frames_per_epoch : AT_SIMULATION_DEFAULT_EPOCH_FRAMES;
+    job.cursors = malloc(sizeof(AT_Ray*) * AT_max(job.total_rays, 1u));
+    job.last_hits = malloc(sizeof(uint32_t) * AT_max(job.total_rays, 1u));
+    job.fronts = malloc(sizeof(float) * simulation->num_threads);
+    job.reaches = malloc(sizeof(float) * simulation->num_threads);
+    AT_FrameGatherJob gather = {
+        .simulation = simulation,
+        .values = malloc(sizeof(float) * AT_max((size_t)simulation->num_voxels * epoch_frames, (size_t)1)),
+        .num_workers = simulation->num_threads,
+    };
+    if (!job.cursors || !job.last_hits || !job.fronts || !job.reaches || !gather.values) {
+        free(job.cursors);
+        free(job.last_hits);
+        free(job.fronts);
+        free(job.reaches);
+        free(gather.values);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    //distance only grows along a ray, so nothing can land before the bin
+    //of the closest segment still to be deposited, which is where a ray
+    //still being traced stands. The DDA workers find it for every epoch
+    //after the first.
+    float front = INFINITY;
+    for (uint32_t i = 0; i < job.total_rays; i++) {
+        job.cursors[i] = &simulation->rays[i];
+        job.last_hits[i] = UINT32_MAX;
+        front = fminf(front, simulation->rays[i].total_distance);
+    }
+    //the chains are only complete once every ray is finished, the bins
+    //follow from the furthest end of a finished ray
+    float reach = 0.0f;
+
+    //same bin mapping as the DDA, which is monotonic in the distance
+    const float inv_bin_distance = 1.0f / (SPEED_OF_SOUND * simulation->bin_width);
+    uint32_t next_frame = 0;
+
+    while (res == AT_OK) {
+        bool is_done = isinf(front);
+        if (is_done) simulation->num_bins = AT_simulation_bins_to(simulation, reach);
+        uint32_t front_bin = is_done ? simulation->num_bins : (uint32_t)(int32_t)(front * inv_bin_distance);
+
+        //frames past the last non-empty one so far may still turn out to be trailing zeros
+        uint32_t last_frame = AT_min(front_bin, job.end_bin);
+        if (last_frame > next_frame) {
+            gather.voxel_first_bin = job.voxel_first_bin;
+            res = AT_simulation_emit_frames(stream, &gather, epoch_frames, next_frame, last_frame);
+            next_frame = last_frame;
+        }
+        if (res == AT_OK && stream->is_releasing && next_frame > job.voxel_first_bin) {
+            gather.release_frame = next_frame;
+            res = AT_thread_run(gather.num_workers, AT_simulation_release_worker, &gather);
+            job.voxel_first_bin = next_frame;
+        }
+        if (is_done || res != AT_OK) break;
+
+        //advance the front by one epoch, tracing the rays as far as the new
+        //horizon. Segments starting before it end at most the room's
+        //diagonal past it, which bounds the bins the deposit has to cover
+        job.horizon = fmaxf((float)(front_bin + epoch_frames) / inv_bin_distance, nextafterf(front, INFINITY));
+        uint32_t end_bin = (uint32_t)((job.horizon + job.max_segment_length) * inv_bin_distance) + 2;
+        end_bin = AT_max(end_bin, front_bin + 1);
+
+        res = AT_simulation_deposit(simulation, &job, front_bin, end_bin - front_bin);
+        front = INFINITY;
+        for (uint32_t w = 0; res == AT_OK && w < simulation->num_threads; w++) {
+            front = fminf(front, job.fronts[w]);
+            reach = fmaxf(reach, job.reaches[w]);
+        }
+    }
+    if (res == AT_OK) printf("Number of child rays: %i\n", job.num_children);
+
+    //a released run leaves every voxel empty, also when it stopped early
+    if (stream->is_releasing) {
+        for (uint32_t i = 0; i < simulation->num_voxel_slots; i++) AT_da_free(&simulation->voxel_grid[i]);
+    }
+
+    free(job.cursors);
+    free(job.last_hits);
+    free(job.fronts);
+    free(job.reaches);
+    free(gather.values);
+    return res;
+}
+
+
+// Row-major range of voxels a compaction worker owns
+static void AT_simulation_compact_range(const AT_CompactJob *job, uint32_t worker, uint32_t *out_first, uint32_t *out_last)
+{
+    uint64_t num_voxels = job->simulation->num_voxels;
+    *out_first = (uint32_t)(num_voxels * worker / job->num_workers);
+    *out_last = (uint32_t)(num_voxels * (worker + 1) / job->num_workers);
+}
+
+// Trims the zero bins off both ends of every voxel, leaving its run length
+// in offsets[v + 1] for the prefix sum
+static void AT_simulation_compact_count_worker(void *ctx, uint32_t worker)
+{
+    AT_CompactJob *job = ctx;
+    const AT_Simulation *simulation = job->simulation;
+    AT_VoxelBins *bins = job->bins;
+
+    uint32_t first, last;
+    AT_simulation_compact_range(job, worker, &first, &last);
+    for (uint32_t v = first; v < last; v++) {
+        const AT_Voxel *voxel = &simulation->voxel_grid[AT_voxel_index_from_linear(simulation, v)];
+        uint32_t end = (uint32_t)voxel->count;
+        while (end > 0 && voxel->items[end - 1] == 0.0f) end--;
+        uint32_t start = 0;
+        while (start < end && voxel->items[start] == 0.0f) start++;
+
+        bins->first_bin[v] = start;
+        bins->offsets[v + 1] = end - start;
+    }
+}
+
+// Copies every run into place and frees the voxel it came from
+static void AT_simulation_compact_copy_worker(void *ctx, uint32_t worker)
+{
+    AT_CompactJob *job = ctx;
+    AT_Simulation *simulation = job->simulation;
+    AT_VoxelBins *bins = job->bins;
+
+    uint32_t first, last;
+    AT_simulation_compact_range(job, worker, &first, &last);
+    for (uint32_t v = first; v < last; v++) {
+        AT_Voxel *voxel = &simulation->voxel_grid[AT_voxel_index_from_linear(simulation, v)];
+        uint32_t count = bins->offsets[v + 1] - bins->offsets[v];
+        if (count > 0) {
+            memcpy(bins->values + bins->offsets[v], voxel->items + bins->first_bin[v], sizeof(float) * count);
+        }
+        AT_voxel_cleanup(voxel);
+    }
+}
+
+static void AT_simulation_free_bins(AT_VoxelBins *bins)
+{
+    free(bins->offsets);
+    free(bins->first_bin);
+    free(bins->values);
+    *bins = (AT_VoxelBins){0};
+}
+
+AT_Result AT_simulation_compact(AT_Simulation *simulation)
+{
+    if (!simulation) return AT_ERR_INVALID_ARGUMENT;
+    if (!simulation->voxel_grid) return AT_OK;
+
+    uint32_t num_voxels = simulation->num_voxels;
+    AT_VoxelBins bins = {
+        .offsets = malloc(sizeof(uint32_t) * ((size_t)num_voxels + 1)),
+        .first_bin = malloc(sizeof(uint32_t) * AT_max(num_voxels, 1u)),
+        .num_bins = AT_voxel_get_num_bins(simulation),
+    };
+    if (!bins.offsets || !bins.first_bin) {
+        AT_simulation_free_bins(&bins);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    AT_CompactJob job = {
+        .simulation = simulation,
+        .bins = &bins,
+        .num_workers = AT_max(simulation->num_threads, 1u),
+    };
+    AT_Result res = AT_thread_run(job.num_workers, AT_simulation_compact_count_worker, &job);
+    if (res != AT_OK) {
+        AT_simulation_free_bins(&bins);
+        return res;
+    }
+
+    uint64_t total = 0;
+    bins.offsets[0] = 0;
+    for (uint32_t v = 0; v < num_voxels; v++) {
+        total += bins.offsets[v + 1];
+        if (total > UINT32_MAX) break;
+        bins.offsets[v + 1] = (uint32_t)total;
+    }
+    bins.values = (total <= UINT32_MAX) ? malloc(sizeof(float) * AT_max(total, (uint64_t)1)) : NULL;
+    if (!bins.values) {
+        AT_simulation_free_bins(&bins);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    //every worker runs even when threads cannot be started, so past this
+    //point the runs are all copied
+    AT_thread_run(job.num_workers, AT_simulation_compact_copy_worker, &job);
+
+    //brick padding slots are outside the row-major range
+    for (uint32_t i = 0; i < simulation->num_voxel_slots; i++) {
+        AT_voxel_cleanup(&simulation->voxel_grid[i]);
+    }
+    free(simulation->voxel_grid);
+    simulation->voxel_grid = NULL;
+    simulation->bins = bins;
+    return AT_OK;
+}
 
 void AT_simulation_destroy(AT_Simulation *simulation) {
     if (!simulation) return;
 
-    uint32_t num_voxels = (uint32_t)(simulation->grid_dimensions.x *
-                                     simulation->grid_dimensions.y *
-                                     simulation->grid_dimensions.z);
-
-    for (uint32_t i = 0; i < num_voxels; i++) {
+    for (uint32_t i = 0; simulation->voxel_grid && i < simulation->num_voxel_slots; i++) {
         AT_voxel_cleanup(&simulation->voxel_grid[i]);
     }
+    AT_simulation_free_bins(&simulation->bins);
 
     uint32_t total_rays = simulation->scene->num_sources * simulation->num_rays;
     for (uint32_t i = 0; i < total_rays; i++) {
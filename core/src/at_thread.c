@@ -0,0 +1,70 @@
+#include "../src/at_thread.h"
+#include "acoustic/at.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    AT_ThreadFn fn;
+    void *ctx;
+    uint32_t thread_idx;
+} AT_ThreadArgs;
+
+static void *AT_thread_entry(void *arg)
+{
+    AT_ThreadArgs *args = arg;
+    args->fn(args->ctx, args->thread_idx);
+    return NULL;
+}
+
+uint32_t AT_thread_default_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (uint32_t)n : 1;
+}
+
+AT_Result AT_thread_run(uint32_t num_threads, AT_ThreadFn fn, void *ctx)
+{
+    if (!fn) return AT_ERR_INVALID_ARGUMENT;
+    if (num_threads == 0) num_threads = AT_thread_default_count();
+
+    if (num_threads == 1) {
+        fn(ctx, 0);
+        return AT_OK;
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    AT_ThreadArgs *args = malloc(sizeof(AT_ThreadArgs) * num_threads);
+    bool *is_started = calloc(num_threads, sizeof(bool));
+    if (!threads || !args || !is_started) {
+        free(threads);
+        free(args);
+        free(is_started);
+        //still do the work, just without the extra threads
+        for (uint32_t i = 0; i < num_threads; i++) fn(ctx, i);
+        return AT_OK;
+    }
+
+    for (uint32_t i = 1; i < num_threads; i++) {
+        args[i] = (AT_ThreadArgs){ .fn = fn, .ctx = ctx, .thread_idx = i };
+        is_started[i] = pthread_create(&threads[i], NULL, AT_thread_entry, &args[i]) == 0;
+    }
+
+    fn(ctx, 0);
+
+    for (uint32_t i = 1; i < num_threads; i++) {
+        if (is_started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            fn(ctx, i);
+        }
+    }
+
+    free(threads);
+    free(args);
+    free(is_started);
+    return AT_OK;
+}
@@ -0,0 +1,35 @@
+#ifndef AT_THREAD_H
+#define AT_THREAD_H
+
+#include "acoustic/at.h"
+
+#include <stdint.h>
+
+/** \brief Work function run once per worker thread.
+
+    \param ctx User data shared by every worker.
+    \param thread_idx Index of the worker in [0, num_threads).
+*/
+typedef void (*AT_ThreadFn)(void *ctx, uint32_t thread_idx);
+
+/** \brief Number of online CPUs, used when a thread count of 0 is requested.
+
+    \retval uint32_t At least 1.
+*/
+uint32_t AT_thread_default_count(void);
+
+/** \brief Runs \a fn on \a num_threads workers and waits for all of them.
+
+    The calling thread acts as worker 0. If a worker thread cannot be
+    started its index is run on the calling thread instead, so every index
+    is always executed exactly once.
+
+    \param num_threads Number of workers, 0 picks AT_thread_default_count().
+    \param fn Work function.
+    \param ctx User data passed to every worker.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT if \a fn is NULL.
+*/
+AT_Result AT_thread_run(uint32_t num_threads, AT_ThreadFn fn, void *ctx);
+
+#endif // AT_THREAD_H
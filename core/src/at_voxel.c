@@ -4,17 +4,15 @@
 #include "../src/at_utils.h"
 #include <stdint.h>
 
-#define VOXEL_MAX_STEPS 100
-#define SPEED_OF_SOUND 343.0f
 #define SLOWER_SPEED 10.0f
 
-void AT_voxel_ray_step(AT_Simulation *simulation, AT_Ray *ray, AT_Vec3 ray_end)
+bool AT_voxel_segment_init(const AT_Simulation *simulation, const AT_Ray *ray, AT_Vec3 ray_end, AT_VoxelSegment *out_segment)
 {
     //the ray segment spans from p0 (origin) to p1 (end)
     // out current position within the segement is "t"
 
     float world_ray_length = AT_vec3_distance(ray->origin, ray_end);
-    if (world_ray_length <= 0.0f) return;
+    if (world_ray_length <= 0.0f) return false;
 
     //origin in voxel space
     AT_Vec3 p0 = AT_vec3_scale(
@@ -34,109 +32,242 @@ void AT_voxel_ray_step(AT_Simulation *simulation, AT_Ray *ray, AT_Vec3 ray_end)
     //distance along "t" to move one voxel
     const AT_Vec3 delta = AT_vec3_delta(ray->direction);
 
-    const int grid_x = simulation->grid_dimensions.x;
-    const int grid_y = simulation->grid_dimensions.y;
-    const int grid_z = simulation->grid_dimensions.z;
-
-    AT_Vec3i pos = (AT_Vec3i){
-        AT_clamp((int)floorf(p0.x), 0, grid_x - 1),
-        AT_clamp((int)floorf(p0.y), 0, grid_y - 1),
-        AT_clamp((int)floorf(p0.z), 0, grid_z - 1)
+    const int grid[3] = {
+        simulation->grid_dimensions.x,
+        simulation->grid_dimensions.y,
+        simulation->grid_dimensions.z
     };
 
-    //distance along ray until we cross next voxel boundary each axis
-    // aka the max "t" :|
-    // since the ray can only leave through one face of the voxel first,
-    // the smallest of the three t_max values tells us which face
-    //this gif kinda helps visualize it: https://m4xc.dev/anim/articles/amanatides-and-woo/walk-anim.mp4
-    AT_Vec3 t_max;
-
-    t_max.x = (step.x > 0) ?
-        ((pos.x + 1.0f) - p0.x) * delta.x :
-        (p0.x - pos.x) * delta.x;
-
-    t_max.y = (step.y > 0) ?
-        ((pos.y + 1.0f) - p0.y) * delta.y :
-        (p0.y - pos.y) * delta.y;
-
-    t_max.z = (step.z > 0) ?
-        ((pos.z + 1.0f) - p0.z) * delta.z :
-        (p0.z - pos.z) * delta.z;
-
-    /*
-    printf("Ray: %i: CHILD:%p ", ray->ray_id, ray->child);
-    printf("p0: {%f, %f, %f}, ", p0.x, p0.y, p0.z);
-    printf("p1: {%f, %f, %f}, ", p1.x, p1.y, p1.z);
-    printf("Step: {%.1f, %.1f, %.1f}, ", step.x, step.y, step.z);
-    printf("Delta: {%f, %f, %f}", delta.x, delta.y, delta.z);
-    printf("t_max: {%f, %f, %f}\n", t_max.x, t_max.y, t_max.z);
-    */
+    //clip the segment to the grid (the observer area), slab by slab
+    const float t_length = AT_vec3_length(AT_vec3_sub(p1, p0));
+    float t_enter = 0.0f;
+    float t_exit = t_length;
+    if (t_length <= 0.0f) return false;
+    for (int axis = 0; axis < 3; axis++) {
+        float d = (p1.arr[axis] - p0.arr[axis]) / t_length;
+        if (d == 0.0f) {
+            if (p0.arr[axis] < simulation->clip_min.arr[axis] || p0.arr[axis] > simulation->clip_max.arr[axis]) return false;
+            continue;
+        }
+        float t_near = (simulation->clip_min.arr[axis] - p0.arr[axis]) / d;
+        float t_far = (simulation->clip_max.arr[axis] - p0.arr[axis]) / d;
+        if (t_near > t_far) {
+            float tmp = t_near;
+            t_near = t_far;
+            t_far = tmp;
+        }
+        t_enter = fmaxf(t_enter, t_near);
+        t_exit = fminf(t_exit, t_far);
+    }
+    if (t_enter >= t_exit) return false;
+
+    //start stepping where the segment enters the grid
+    if (t_enter > 0.0f) {
+        p0 = AT_vec3_add(p0, AT_vec3_scale(AT_vec3_sub(p1, p0), t_enter / t_length));
+    }
+
+    AT_VoxelSegment segment;
+    for (int axis = 0; axis < 3; axis++) {
+        //the clip slack lets p0 sit just outside the grid, heading out of
+        //it, which would put the first boundary behind it
+        float start = AT_clamp(0.0f, p0.arr[axis], (float)grid[axis]);
+        int pos = AT_clamp(0, (int)floorf(start), grid[axis] - 1);
+
+        //distance along ray until we cross next voxel boundary each axis
+        // aka the max "t" :|
+        // since the ray can only leave through one face of the voxel first,
+        // the smallest of the three t_max values tells us which face
+        //this gif kinda helps visualize it: https://m4xc.dev/anim/articles/amanatides-and-woo/walk-anim.mp4
+        segment.t_max[axis] = (step.arr[axis] > 0) ?
+            ((pos + 1.0f) - start) * delta.arr[axis] :
+            (start - pos) * delta.arr[axis];
+
+        //the walk only leaves the grid by stepping past the last voxel,
+        //so counting the voxels left replaces the per-step bounds check
+        segment.steps_left[axis] =
+            (step.arr[axis] > 0) ? grid[axis] - 1 - pos :
+            (step.arr[axis] < 0) ? pos :
+            INT32_MAX;
+
+        segment.pos[axis] = pos;
+        segment.step[axis] = (int32_t)step.arr[axis];
+        segment.delta[axis] = delta.arr[axis];
+    }
+
+    segment.t_end = t_exit - t_enter;
+    segment.energy_scale = ray->energy * simulation->voxel_size / world_ray_length;
+    segment.base_distance = ray->total_distance + t_enter * simulation->voxel_size;
+
+    *out_segment = segment;
+    return true;
+}
+
+void AT_voxel_ray_step(const AT_Simulation *simulation, AT_DepositLane *lane, const AT_Ray *ray, AT_Vec3 ray_end)
+{
+    AT_VoxelSegment segment;
+    if (!AT_voxel_segment_init(simulation, ray, ray_end, &segment)) return;
+
+    const float voxel_size = simulation->voxel_size;
+    const float inv_bin_distance = 1.0f / (SPEED_OF_SOUND * simulation->bin_width);
+    //const float inv_bin_distance = 1.0f / (SLOWER_SPEED * simulation->bin_width);
 
     //curr pos within ray segment
-    float t = 0.0f;
-    const float t_end = AT_vec3_length(AT_vec3_sub(p1, p0));
     float t_prev = 0.0f;
 
     //while we havent yet reached the end of the ray segment
-    while (t < t_end) {
-        if (pos.x < 0 || pos.x >= grid_x ||
-            pos.y < 0 || pos.y >= grid_y ||
-            pos.z < 0 || pos.z >= grid_z) break;
-
+    while (t_prev < segment.t_end) {
         //index into the voxel_grid array
-        const uint32_t voxel_idx =
-            (uint32_t)pos.z * grid_y * grid_x +
-            (uint32_t)pos.y * grid_x +
-            (uint32_t)pos.x;
+        const uint32_t voxel_idx = AT_voxel_index(simulation, segment.pos[0], segment.pos[1], segment.pos[2]);
 
-
-        float t_current = fminf(t_max.x, fminf(t_max.y, t_max.z));
-        if (t_current > t_end) t_current = t_end; //if we reached the end of the ray segment
+        float t_current = fminf(segment.t_max[0], fminf(segment.t_max[1], segment.t_max[2]));
+        if (t_current > segment.t_end) t_current = segment.t_end; //if we reached the end of the ray segment
 
         float t_segment = t_current - t_prev; //how far we moved in voxel space
-        float world_segment = t_segment * simulation->voxel_size; //how far in world space
 
-        float t_midpoint = t_prev + t_segment * 0.5f; //center point of curr voxel
-        //total dist from source to this midpoint
-        float total_world_dist = ray->total_distance + (t_midpoint * simulation->voxel_size);
+        //total dist from source to the center point of curr voxel
+        float total_world_dist = segment.base_distance + (t_prev + t_segment * 0.5f) * voxel_size;
 
         //inverse square law - attenuation
-        float dist_from_source = fmaxf(total_world_dist, 0.1f);
-        float intensity_factor = 1.0f / (1.0f + dist_from_source * 0.01f);
-
-        float energy_deposit = (ray->energy * world_segment / world_ray_length) * intensity_factor;
-
-        float curr_time = total_world_dist / SPEED_OF_SOUND;
-        //float curr_time = total_world_dist / SLOWER_SPEED;
+        float intensity_factor = 1.0f / (1.0f + fmaxf(total_world_dist, 0.1f) * 0.01f);
 
-        size_t bin_index = (size_t)(curr_time / simulation->bin_width);
-        //printf("BIN INDEX: %zu\n", bin_index);
+        float energy_deposit = t_segment * segment.energy_scale * intensity_factor;
 
-        AT_Voxel *voxel = &simulation->voxel_grid[voxel_idx];
+        uint32_t bin_index = (uint32_t)(int32_t)(total_world_dist * inv_bin_distance);
 
-        //grow bin count
-        while (voxel->count <= bin_index) {
-            AT_voxel_bin_append(voxel, 0.0f);
-        }
-
-        if (AT_voxel_add_energy(voxel, energy_deposit, bin_index) != AT_OK) {
+        if (AT_deposit_add(lane, voxel_idx, bin_index, energy_deposit) != AT_OK) {
             break;
         }
 
         t_prev = t_current;
-        t = t_current;
 
         //now we look for smallest t_max and advance through it
-        //t_max.x smallest
-        if (t_max.x < t_max.y && t_max.x < t_max.z) {
-            pos.x += step.x;
-            t_max.x += delta.x;
-        } else if (t_max.y < t_max.z) { //smallest y
-            pos.y += step.y;
-            t_max.y += delta.y;
-        } else { //smallest z
-            pos.z += step.z;
-            t_max.z += delta.z;
+        const int axis =
+            (segment.t_max[0] < segment.t_max[1] && segment.t_max[0] < segment.t_max[2]) ? 0 :
+            (segment.t_max[1] < segment.t_max[2]) ? 1 : 2;
+
+        if (segment.steps_left[axis]-- == 0) break; //stepped out of the grid
+        segment.pos[axis] += segment.step[axis];
+        segment.t_max[axis] += segment.delta[axis];
+    }
+}
+
+static void AT_voxel_batch_clear(AT_VoxelBatch *batch)
+{
+    const AT_SimdInt zero_i = AT_simd_splat_i(0);
+    const AT_SimdFloat zero_f = AT_simd_splat_f(0.0f);
+
+    for (int axis = 0; axis < 3; axis++) {
+        batch->pos[axis] = zero_i;
+        batch->step[axis] = zero_i;
+        batch->steps_left[axis] = zero_i;
+        batch->t_max[axis] = zero_f;
+        batch->delta[axis] = zero_f;
+    }
+    batch->t_prev = zero_f;
+    batch->t_end = zero_f;
+    batch->energy_scale = zero_f;
+    batch->base_distance = zero_f;
+    batch->is_alive = zero_i;
+}
+
+// Records one DDA step for every live lane, then advances each lane through
+// the face it leaves by. Dead lanes are masked out rather than branched on.
+static inline void AT_voxel_batch_step(AT_VoxelBatch *batch, AT_SimdInt active, uint32_t run_idx,
+                                       AT_SimdFloat voxel_size, AT_SimdFloat inv_bin_distance)
+{
+    const AT_SimdFloat *t_max = batch->t_max;
+
+    AT_SimdFloat t_current = AT_simd_min_f(t_max[0], AT_simd_min_f(t_max[1], t_max[2]));
+    t_current = AT_simd_min_f(t_current, batch->t_end);
+
+    AT_SimdFloat t_segment = t_current - batch->t_prev;
+    AT_SimdFloat total_world_dist = batch->base_distance + (batch->t_prev + t_segment * 0.5f) * voxel_size;
+    AT_SimdFloat intensity_factor = 1.0f / (1.0f + AT_simd_max_f(total_world_dist, AT_simd_splat_f(0.1f)) * 0.01f);
+
+    batch->run_voxel[run_idx] = AT_voxel_index_simd(batch->simulation, batch->pos[0], batch->pos[1], batch->pos[2]);
+    batch->run_bin[run_idx] = AT_simd_to_int(total_world_dist * inv_bin_distance);
+    batch->run_energy[run_idx] = t_segment * batch->energy_scale * intensity_factor;
+
+    //one mask per axis, exactly one set in each active lane
+    AT_SimdInt take[3];
+    take[0] = (t_max[0] < t_max[1]) & (t_max[0] < t_max[2]);
+    take[1] = ~take[0] & (t_max[1] < t_max[2]);
+    take[2] = ~(take[0] | take[1]);
+
+    AT_SimdInt is_leaving = AT_simd_splat_i(0);
+    for (int axis = 0; axis < 3; axis++) {
+        take[axis] &= active;
+        is_leaving |= take[axis] & (batch->steps_left[axis] == 0);
+        batch->steps_left[axis] += take[axis]; //masks are -1, so this decrements
+        batch->pos[axis] += batch->step[axis] & take[axis];
+        batch->t_max[axis] += AT_simd_select_f(take[axis], batch->delta[axis], AT_simd_splat_f(0.0f));
+    }
+
+    batch->t_prev = AT_simd_select_f(active, t_current, batch->t_prev);
+    batch->is_alive = active & ~is_leaving;
+}
+
+AT_Result AT_voxel_batch_flush(AT_VoxelBatch *batch, AT_DepositLane *lane)
+{
+    if (batch->count == 0) return AT_OK;
+
+    const AT_SimdFloat voxel_size = AT_simd_splat_f(batch->simulation->voxel_size);
+    const AT_SimdFloat inv_bin_distance = AT_simd_splat_f(1.0f / (SPEED_OF_SOUND * batch->simulation->bin_width));
+
+    AT_Result result = AT_OK;
+    while (AT_simd_any(batch->is_alive)) {
+        //lanes stay active for a prefix of the steps, so one length per lane
+        //describes its run
+        AT_SimdInt run_length = AT_simd_splat_i(0);
+        for (uint32_t run_idx = 0; run_idx < AT_VOXEL_BATCH_STEPS; run_idx++) {
+            AT_SimdInt active = batch->is_alive & (batch->t_prev < batch->t_end);
+            batch->is_alive = active;
+            if (!AT_simd_any(active)) break;
+
+            run_length -= active;
+            AT_voxel_batch_step(batch, active, run_idx, voxel_size, inv_bin_distance);
         }
+
+        for (uint32_t l = 0; l < batch->count; l++) {
+            for (int32_t k = 0; k < run_length[l]; k++) {
+                AT_Result res = AT_deposit_add(lane,
+                                               (uint32_t)batch->run_voxel[k][l],
+                                               (uint32_t)batch->run_bin[k][l],
+                                               batch->run_energy[k][l]);
+                if (res != AT_OK) {
+                    //same as the scalar walk, a failed deposit ends the segment
+                    if (res == AT_ERR_ALLOC_ERROR) result = res;
+                    batch->is_alive[l] = 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    batch->count = 0;
+    return result;
+}
+
+AT_Result AT_voxel_batch_add(AT_VoxelBatch *batch, AT_DepositLane *lane, const AT_Ray *ray, AT_Vec3 ray_end)
+{
+    AT_VoxelSegment segment;
+    if (!AT_voxel_segment_init(batch->simulation, ray, ray_end, &segment)) return AT_OK;
+
+    if (batch->count == 0) AT_voxel_batch_clear(batch);
+
+    uint32_t l = batch->count++;
+    for (int axis = 0; axis < 3; axis++) {
+        batch->pos[axis][l] = segment.pos[axis];
+        batch->step[axis][l] = segment.step[axis];
+        batch->steps_left[axis][l] = segment.steps_left[axis];
+        batch->t_max[axis][l] = segment.t_max[axis];
+        batch->delta[axis][l] = segment.delta[axis];
     }
+    batch->t_end[l] = segment.t_end;
+    batch->energy_scale[l] = segment.energy_scale;
+    batch->base_distance[l] = segment.base_distance;
+    batch->is_alive[l] = -1;
+
+    if (batch->count == AT_SIMD_WIDTH) return AT_voxel_batch_flush(batch, lane);
+    return AT_OK;
 }
@@ -3,10 +3,74 @@
 
 #include "acoustic/at.h"
 #include "at_internal.h"
+#include "../src/at_deposit.h"
+#include "../src/at_simd.h"
 #include "../src/at_utils.h"
 #include <stddef.h>
 #include <stdint.h>
 
+#define SPEED_OF_SOUND 343.0f
+
+// AT_VOXEL_LAYOUT_TILED stores 4x4x4 bricks of voxels, one deposit tile each
+#define AT_VOXEL_BRICK_SHIFT 2
+#define AT_VOXEL_BRICK_SIZE (1u << AT_VOXEL_BRICK_SHIFT)
+#define AT_VOXEL_BRICK_VOXELS (AT_VOXEL_BRICK_SIZE * AT_VOXEL_BRICK_SIZE * AT_VOXEL_BRICK_SIZE)
+
+// Index into simulation->voxel_grid for voxel (x, y, z).
+// Every lookup by grid coordinates must go through here.
+static inline uint32_t AT_voxel_index(const AT_Simulation *simulation, uint32_t x, uint32_t y, uint32_t z)
+{
+    if (simulation->voxel_layout == AT_VOXEL_LAYOUT_TILED) {
+        uint32_t brick =
+            ((z >> AT_VOXEL_BRICK_SHIFT) * simulation->bricks_y +
+             (y >> AT_VOXEL_BRICK_SHIFT)) * simulation->bricks_x +
+            (x >> AT_VOXEL_BRICK_SHIFT);
+
+        //interleave the low two bits of each axis (Z-order within the brick)
+        uint32_t inner =
+            (x & 1) | ((y & 1) << 1) | ((z & 1) << 2) |
+            ((x & 2) << 2) | ((y & 2) << 3) | ((z & 2) << 4);
+
+        return brick * AT_VOXEL_BRICK_VOXELS + inner;
+    }
+
+    return z * (uint32_t)simulation->grid_dimensions.y * (uint32_t)simulation->grid_dimensions.x +
+           y * (uint32_t)simulation->grid_dimensions.x +
+           x;
+}
+
+// AT_voxel_index for AT_SIMD_WIDTH voxels at once
+static inline AT_SimdInt AT_voxel_index_simd(const AT_Simulation *simulation, AT_SimdInt x, AT_SimdInt y, AT_SimdInt z)
+{
+    if (simulation->voxel_layout == AT_VOXEL_LAYOUT_TILED) {
+        AT_SimdInt brick =
+            ((z >> AT_VOXEL_BRICK_SHIFT) * (int32_t)simulation->bricks_y +
+             (y >> AT_VOXEL_BRICK_SHIFT)) * (int32_t)simulation->bricks_x +
+            (x >> AT_VOXEL_BRICK_SHIFT);
+
+        AT_SimdInt inner =
+            (x & 1) | ((y & 1) << 1) | ((z & 1) << 2) |
+            ((x & 2) << 2) | ((y & 2) << 3) | ((z & 2) << 4);
+
+        return brick * (int32_t)AT_VOXEL_BRICK_VOXELS + inner;
+    }
+
+    return (z * (int32_t)simulation->grid_dimensions.y + y) * (int32_t)simulation->grid_dimensions.x + x;
+}
+
+// Maps a row-major voxel index (what exporters and clients use) to its slot
+static inline uint32_t AT_voxel_index_from_linear(const AT_Simulation *simulation, uint32_t linear_idx)
+{
+    if (simulation->voxel_layout == AT_VOXEL_LAYOUT_LINEAR) return linear_idx;
+
+    uint32_t grid_x = (uint32_t)simulation->grid_dimensions.x;
+    uint32_t grid_y = (uint32_t)simulation->grid_dimensions.y;
+    uint32_t x = linear_idx % grid_x;
+    uint32_t y = (linear_idx / grid_x) % grid_y;
+    uint32_t z = linear_idx / (grid_x * grid_y);
+    return AT_voxel_index(simulation, x, y, z);
+}
+
 //these are pretty much voxel specific wrappers of the dynamic array
 static inline AT_Result AT_voxel_init(AT_Voxel *voxel)
 {
@@ -40,12 +104,76 @@ static inline void AT_voxel_print(AT_Voxel *voxel)
     printf("]\n");
 }
 
-void AT_voxel_ray_step(AT_Simulation *simulation, AT_Ray *ray, AT_Vec3 ray_end);
+// Slack in voxels when clipping segments against a face the grid shares
+// with the model
+#define AT_VOXEL_CLIP_EPSILON 1e-3f
 
-static inline uint32_t AT_voxel_get_num_bins(AT_Simulation *simulation)
+// Lock-step iterations a batch records before depositing its runs
+#ifndef AT_VOXEL_BATCH_STEPS
+#define AT_VOXEL_BATCH_STEPS 64
+#endif
+
+// Per-segment DDA constants, computed once before stepping
+typedef struct {
+    int32_t pos[3];
+    int32_t step[3];
+    int32_t steps_left[3]; //voxels left before the walk leaves the grid, per axis
+    float t_max[3];
+    float delta[3];
+    float t_end;
+    float energy_scale; //ray energy per voxel unit of t
+    float base_distance; //distance travelled before the segment starts
+} AT_VoxelSegment;
+
+// Up to AT_SIMD_WIDTH segments traversed in lock-step, one per SIMD lane.
+// Each lane's voxel/bin/energy run is recorded and deposited afterwards.
+// Contains vector members, so keep it on the stack rather than malloc it.
+typedef struct {
+    const AT_Simulation *simulation;
+    uint32_t count;
+    AT_SimdInt pos[3];
+    AT_SimdInt step[3];
+    AT_SimdInt steps_left[3];
+    AT_SimdFloat t_max[3];
+    AT_SimdFloat delta[3];
+    AT_SimdFloat t_prev;
+    AT_SimdFloat t_end;
+    AT_SimdFloat energy_scale;
+    AT_SimdFloat base_distance;
+    AT_SimdInt is_alive;
+    AT_SimdInt run_voxel[AT_VOXEL_BATCH_STEPS];
+    AT_SimdInt run_bin[AT_VOXEL_BATCH_STEPS];
+    AT_SimdFloat run_energy[AT_VOXEL_BATCH_STEPS];
+} AT_VoxelBatch;
+
+// Fills in the constants for the segment from ray->origin to ray_end.
+// Returns false if the segment has no length.
+bool AT_voxel_segment_init(const AT_Simulation *simulation, const AT_Ray *ray, AT_Vec3 ray_end, AT_VoxelSegment *out_segment);
+
+// Steps the segment from ray->origin to ray_end through the grid,
+// depositing energy through the given lane (one lane per thread)
+void AT_voxel_ray_step(const AT_Simulation *simulation, AT_DepositLane *lane, const AT_Ray *ray, AT_Vec3 ray_end);
+
+static inline void AT_voxel_batch_init(AT_VoxelBatch *batch, const AT_Simulation *simulation)
+{
+    batch->simulation = simulation;
+    batch->count = 0;
+}
+
+// Traverses every queued segment and deposits them through the lane,
+// segment by segment in queue order
+AT_Result AT_voxel_batch_flush(AT_VoxelBatch *batch, AT_DepositLane *lane);
+
+// Queues a segment, traversing the batch once every SIMD lane is taken.
+// Same result as AT_voxel_ray_step, give or take the order deposits land in.
+AT_Result AT_voxel_batch_add(AT_VoxelBatch *batch, AT_DepositLane *lane, const AT_Ray *ray, AT_Vec3 ray_end);
+
+static inline uint32_t AT_voxel_get_num_bins(const AT_Simulation *simulation)
 {
+    if (!simulation->voxel_grid) return simulation->bins.num_bins;
+
     uint32_t max_count = 0;
-    for (uint32_t i = 0; i < simulation->num_voxels; i++) {
+    for (uint32_t i = 0; i < simulation->num_voxel_slots; i++) {
         if (simulation->voxel_grid[i].count > max_count) {
             max_count = simulation->voxel_grid[i].count;
         }
@@ -53,6 +181,37 @@ static inline uint32_t AT_voxel_get_num_bins(AT_Simulation *simulation)
     return max_count;
 }
 
+// Non-zero run of one voxel's bins, values[i] is bin first_bin + i
+typedef struct {
+    const float *values;
+    uint32_t first_bin;
+    uint32_t count;
+} AT_VoxelSpan;
+
+// Bins of row-major voxel linear_idx, from the grid or the compacted bins.
+// Exporters and analysis passes read voxels through here.
+static inline AT_VoxelSpan AT_voxel_span(const AT_Simulation *simulation, uint32_t linear_idx)
+{
+    if (!simulation->voxel_grid) {
+        const AT_VoxelBins *bins = &simulation->bins;
+        uint32_t offset = bins->offsets[linear_idx];
+        return (AT_VoxelSpan){
+            .values = bins->values + offset,
+            .first_bin = bins->first_bin[linear_idx],
+            .count = bins->offsets[linear_idx + 1] - offset,
+        };
+    }
+
+    const AT_Voxel *voxel = &simulation->voxel_grid[AT_voxel_index_from_linear(simulation, linear_idx)];
+    return (AT_VoxelSpan){.values = voxel->items, .first_bin = 0, .count = (uint32_t)voxel->count};
+}
+
+static inline float AT_voxel_span_get(AT_VoxelSpan span, uint32_t bin)
+{
+    uint32_t i = bin - span.first_bin; //bins before the span wrap around
+    return (i < span.count) ? span.values[i] : 0.0f;
+}
+
 static inline void AT_voxel_cleanup(AT_Voxel *voxel)
 {
     AT_da_free(voxel);